@@ -1,5 +1,6 @@
 #include <sys/cdefs.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -7,7 +8,19 @@
 #include "esp_check.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
+#include "esp_timer.h"
+#include "light_persist.h"
+#include "light_ep_attrs.h"
+#include "light_scenes.h"
+#include "light_automation.h"
+#include "light_pixels.h"
+#include "zcl_attr_dispatch.h"
+#include "color_convert.h"
+#include "ultrasonic.h"
 #include "temp_sensor_driver.h"
+#include "thermal_derate.h"
+#include "zboss_api.h"
+#include "esp_heap_caps.h"
 
 static const char *TAG = "ESP_ZB_LIGHT";
 
@@ -22,38 +35,338 @@ static inline bool endpoint_is_light(uint8_t ep) {
 }
 static inline size_t endpoint_to_channel(uint8_t ep) { return (size_t)(ep - BASE_LIGHT_ENDPOINT); }
 
+/* Commands carrying a ZCL transition time (1/10 s, little endian u16 at tt_offset of the payload) */
+typedef struct {
+    uint16_t cluster;
+    uint8_t cmd;
+    uint8_t tt_offset;
+} zcl_transition_cmd_t;
+
+static const zcl_transition_cmd_t s_transition_cmds[] = {
+    { ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, 0x00, 1 },   // Move to Level
+    { ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, 0x02, 2 },   // Step
+    { ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, 0x04, 1 },   // Move to Level (with On/Off)
+    { ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, 0x06, 2 },   // Step (with On/Off)
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0x00, 2 },   // Move to Hue
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0x03, 1 },   // Move to Saturation
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0x06, 2 },   // Move to Hue and Saturation
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0x07, 4 },   // Move to Color
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0x09, 4 },   // Step Color
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0x0A, 2 },   // Move to Color Temperature
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0x40, 3 },   // Enhanced Move to Hue
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0x43, 3 },   // Enhanced Move to Hue and Saturation
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0x4C, 3 },   // Step Color Temperature
+};
+
 static int16_t zb_temperature_encode(float celsius) { return (int16_t)(celsius * 100); }
 
+static thermal_derate_t s_derate;
+
 static void board_temp_update_cb(float temperature)
 {
     int16_t measured_value = zb_temperature_encode(temperature);
+    // derating goes through the output scaling path, the channels' ZCL levels stay what the user set
+    bool derate_changed = thermal_derate_update(&s_derate, measured_value);
+    if (derate_changed) light_driver_set_output_cap(thermal_derate_cap(&s_derate));
     esp_zb_lock_acquire(portMAX_DELAY);
     esp_zb_zcl_set_attribute_val(BOARD_TEMP_ENDPOINT,
                                  ESP_ZB_ZCL_CLUSTER_ID_TEMP_MEASUREMENT,
                                  ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
                                  ESP_ZB_ZCL_ATTR_TEMP_MEASUREMENT_VALUE_ID,
                                  &measured_value, false);
+    if (derate_changed) {
+        uint8_t state = (uint8_t) thermal_derate_state(&s_derate);
+        uint8_t pct = (uint8_t) ((thermal_derate_cap(&s_derate) * 100 + 128) / 256);
+        esp_zb_zcl_set_attribute_val(BOARD_TEMP_ENDPOINT, LIGHT_AUTOMATION_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+                                     BOARD_ATTR_DERATE_STATE, &state, false);
+        esp_zb_zcl_set_attribute_val(BOARD_TEMP_ENDPOINT, LIGHT_AUTOMATION_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+                                     BOARD_ATTR_DERATE_CAP_PCT, &pct, false);
+        ESP_LOGW(TAG, "Board at %d.%02d C, LED output capped to %u%%", measured_value / 100, abs(measured_value % 100), pct);
+    }
     esp_zb_lock_release();
 }
 
-static esp_err_t deferred_driver_init(void)
+// Drives a channel to a full stored state (boot restore, scene recall)
+static void apply_light_state(size_t ch, const light_persist_channel_t *c)
+{
+    switch (c->color_mode) {
+        case LIGHT_PERSIST_COLOR_HS: light_driver_set_color_hue_sat_ch(ch, (uint8_t) (c->hue >> 8), c->sat); break;
+        case LIGHT_PERSIST_COLOR_EHS: light_driver_set_color_enhanced_hue_sat_ch(ch, c->hue, c->sat); break;
+        case LIGHT_PERSIST_COLOR_CT: light_driver_set_color_temperature_mired_ch(ch, c->mired); break;
+        case LIGHT_PERSIST_COLOR_XY:
+        default: light_driver_set_color_xy_ch(ch, c->x, c->y); break;
+    }
+    light_driver_set_level_ch(ch, c->level);
+    light_driver_set_power_ch(ch, c->power);
+}
+
+// Drives every channel from the persisted / StartUp* state; runs in app_main before the Zigbee stack exists
+static void restore_lights(void)
 {
-    // Light endpoints off state
-    size_t chs = light_driver_channel_count();
+    for (size_t ch = 0; ch < TOTAL_LIGHT_CHANNELS; ++ch) {
+        const light_persist_channel_t *c = light_persist_get(ch);
+        if (c) apply_light_state(ch, c);
+    }
+}
+
+#define SET_LIGHT_ATTR(ep, cluster, attr, value) \
+    esp_zb_zcl_set_attribute_val(ep, cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, attr, value, false)
+
+// Writes a channel's state into its ZCL attributes; the caller holds the Zigbee lock
+static void sync_light_attributes(size_t ch, const light_persist_channel_t *c)
+{
+    uint8_t ep = (uint8_t) (BASE_LIGHT_ENDPOINT + ch);
+    bool on = c->power;
+    uint8_t level = c->level, sat = c->sat, hue = (uint8_t) (c->hue >> 8);
+    uint16_t x = c->x, y = c->y, ehue = c->hue, mired = c->mired;
+    uint8_t startup_on_off = c->startup_on_off, startup_level = c->startup_level;
+    uint16_t startup_mired = c->startup_mired;
+    uint8_t mode, enhanced_mode;
+    switch (c->color_mode) {
+        case LIGHT_PERSIST_COLOR_HS: mode = enhanced_mode = ESP_ZB_ZCL_COLOR_CONTROL_COLOR_MODE_HUE_SATURATION; break;
+        case LIGHT_PERSIST_COLOR_EHS: mode = ESP_ZB_ZCL_COLOR_CONTROL_COLOR_MODE_HUE_SATURATION; enhanced_mode = 3; break;
+        case LIGHT_PERSIST_COLOR_CT: mode = enhanced_mode = ESP_ZB_ZCL_COLOR_CONTROL_COLOR_MODE_TEMPERATURE; break;
+        default: mode = enhanced_mode = ESP_ZB_ZCL_COLOR_CONTROL_COLOR_MODE_CURRENT_X_Y; break;
+    }
+    SET_LIGHT_ATTR(ep, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, &on);
+    SET_LIGHT_ATTR(ep, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_START_UP_ON_OFF, &startup_on_off);
+    SET_LIGHT_ATTR(ep, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, &level);
+    SET_LIGHT_ATTR(ep, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_START_UP_CURRENT_LEVEL_ID, &startup_level);
+    SET_LIGHT_ATTR(ep, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID, &x);
+    SET_LIGHT_ATTR(ep, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID, &y);
+    SET_LIGHT_ATTR(ep, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_HUE_ID, &hue);
+    SET_LIGHT_ATTR(ep, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_CURRENT_HUE_ID, &ehue);
+    SET_LIGHT_ATTR(ep, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_SATURATION_ID, &sat);
+    SET_LIGHT_ATTR(ep, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID, &mired);
+    SET_LIGHT_ATTR(ep, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_START_UP_COLOR_TEMPERATURE_MIREDS_ID, &startup_mired);
+    SET_LIGHT_ATTR(ep, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_MODE_ID, &mode);
+    SET_LIGHT_ATTR(ep, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_COLOR_MODE_ID, &enhanced_mode);
+
+    light_ep_attrs_t *a = light_ep_attrs_get(ch);
+    a->x = x;
+    a->y = y;
+    a->hue = hue;
+    a->enhanced_hue = ehue;
+    a->sat = sat;
+    a->color_temp = mired;
+    a->startup_on_off = startup_on_off;
+    a->startup_level = startup_level;
+    a->startup_mired = startup_mired;
+}
+
+/* Group effect presets, started with Identify Trigger Effect ids GROUP_EFFECT_ID_BASE + preset on any light endpoint */
+#define GROUP_EFFECT_ID_BASE    0x80
+#define ZCL_IDENTIFY_CMD_TRIGGER_EFFECT 0x40
+#define ANIM_EFFECT_ID_BASE     0xA0    // Trigger Effect ids 0xA0+ play animation n of the anim partition
+#define ANIM_EFFECT_ID_COUNT    0x40
+
+enum {
+    GROUP_PRESET_STAIR_CHASE_UP = 0,
+    GROUP_PRESET_STAIR_CHASE_DOWN,
+    GROUP_PRESET_STAIR_CASCADE,
+    GROUP_PRESET_STAIRS_TO_BED_WIPE,
+    GROUP_PRESET_COUNT,
+};
+
+// Runs in the render task once a held cascade/wipe has landed: the channels now show the effect color,
+// so the attributes and the stored state follow, as for any other change of the channel state
+static void group_land_cb(uint64_t channels, const light_group_effect_config_t *cfg)
+{
+    color_rgb_t rgb = { cfg->r, cfg->g, cfg->b };
+    uint16_t enhanced_hue;
+    uint8_t sat;
+    bool has_hue = color_rgb_to_ehs(&rgb, &enhanced_hue, &sat);
     esp_zb_lock_acquire(portMAX_DELAY);
-    for (size_t i = 0; i < chs; ++i) {
-        uint8_t ep = BASE_LIGHT_ENDPOINT + i;
-        bool off = false;
-        uint8_t startup_off = 0;
-        esp_zb_zcl_set_attribute_val(ep, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
-                                     ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, &off, false);
-        esp_zb_zcl_set_attribute_val(ep, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
-                                     ESP_ZB_ZCL_ATTR_ON_OFF_START_UP_ON_OFF, &startup_off, false);
+    for (size_t ch = 0; ch < TOTAL_LIGHT_CHANNELS; ++ch) {
+        if (!(channels & (1ull << ch))) continue;
+        light_persist_set_power(ch, true);
+        light_persist_set_level(ch, cfg->level);
+        if (has_hue) light_persist_set_hue_sat(ch, enhanced_hue, sat, true);
+        sync_light_attributes(ch, light_persist_get(ch));
     }
     esp_zb_lock_release();
+}
+
+static void define_group_effects(void)
+{
+    static uint8_t stairs[STAIRS_LED_COUNT];
+    static uint8_t stairs_bed[TOTAL_LIGHT_CHANNELS];
+    for (size_t i = 0; i < TOTAL_LIGHT_CHANNELS; ++i) {
+        if (i < STAIRS_LED_COUNT) stairs[i] = (uint8_t) i;
+        stairs_bed[i] = (uint8_t) i;
+    }
+    const light_group_effect_config_t presets[GROUP_PRESET_COUNT] = {
+        [GROUP_PRESET_STAIR_CHASE_UP] = { .kind = LIGHT_GROUP_CHASE, .channels = stairs, .count = STAIRS_LED_COUNT,
+                                          .step_ms = 80, .tail = 3, .r = 255, .g = 160, .b = 60, .level = 200 },
+        [GROUP_PRESET_STAIR_CHASE_DOWN] = { .kind = LIGHT_GROUP_CHASE, .channels = stairs, .count = STAIRS_LED_COUNT,
+                                            .step_ms = 80, .tail = 3, .r = 255, .g = 160, .b = 60, .level = 200, .reverse = true },
+        [GROUP_PRESET_STAIR_CASCADE] = { .kind = LIGHT_GROUP_CASCADE, .channels = stairs, .count = STAIRS_LED_COUNT,
+                                         .step_ms = 120, .fade_ms = 400, .r = 255, .g = 180, .b = 90, .level = 160, .hold = true },
+        [GROUP_PRESET_STAIRS_TO_BED_WIPE] = { .kind = LIGHT_GROUP_WIPE, .channels = stairs_bed, .count = TOTAL_LIGHT_CHANNELS,
+                                              .step_ms = 20, .r = 255, .g = 140, .b = 40, .level = 120, .hold = true },
+    };
+    for (uint8_t i = 0; i < GROUP_PRESET_COUNT; ++i) {
+        ESP_ERROR_CHECK(light_driver_group_effect_define(i, &presets[i]));
+    }
+    light_driver_set_group_land_cb(group_land_cb);
+}
+
+/* Presence automation: ultrasonic rangers at the ends of the stairs (ASSUMED GPIOs – adjust to your wiring!) */
+static const ultrasonic_sensor_t s_presence_sensors[] = {
+    { .trigger_pin = 4, .echo_pin = 5 },    // bottom of the stairs
+    { .trigger_pin = 6, .echo_pin = 7 },    // top of the stairs
+};
+#define PRESENCE_MAX_DISTANCE_CM    300
+#define STAIR_CHANNELS_MASK         ((1ull << STAIRS_LED_COUNT) - 1)
+#define BED_CHANNELS_MASK           (((1ull << BED_STRIP_COUNT) - 1) << STAIRS_LED_COUNT)
+
+_Static_assert(TOTAL_LIGHT_CHANNELS <= LIGHT_CHANNELS_MAX, "more channels than the light driver supports");
+_Static_assert(TOTAL_LIGHT_CHANNELS <= 64, "automation channel masks are 64 bits");
+_Static_assert(BED_STRIP_COUNT <= LIGHT_PIXELS_CHANNELS_MAX, "every bed strip accepts pixel uploads");
+
+static const light_automation_rule_t s_default_rules[] = {
+    // walking up: chase up the stairs, then keep them dimly lit
+    { .enabled = true, .sensor = 0, .near_cm = 80, .hysteresis_cm = 20, .hold_s = 30, .channels = STAIR_CHANNELS_MASK,
+      .level = 80, .fade_ds = 3, .off_fade_ds = 20, .effect = GROUP_PRESET_STAIR_CHASE_UP },
+    // walking down: chase down
+    { .enabled = true, .sensor = 1, .near_cm = 80, .hysteresis_cm = 20, .hold_s = 30, .channels = STAIR_CHANNELS_MASK,
+      .level = 80, .fade_ds = 3, .off_fade_ds = 20, .effect = GROUP_PRESET_STAIR_CHASE_DOWN },
+    // top of the stairs also fades the bed strips in softly (disabled by default)
+    { .enabled = false, .sensor = 1, .near_cm = 80, .hysteresis_cm = 20, .hold_s = 60, .channels = BED_CHANNELS_MASK,
+      .level = 30, .fade_ds = 20, .off_fade_ds = 50, .effect = LIGHT_AUTOMATION_NO_EFFECT },
+};
+
+// Runs in the ranging task. The Zigbee lock makes it the only light command producer for the duration, and
+// the strips are driven before the ZCL attributes are touched so the coordinator update is off the light path.
+static void presence_action_cb(const light_automation_rule_t *rule, bool on, int64_t event_us)
+{
+    esp_zb_lock_acquire(portMAX_DELAY);
+    light_driver_batch_begin();
+    for (size_t ch = 0; ch < TOTAL_LIGHT_CHANNELS; ++ch) {
+        if (!(rule->channels & (1ull << ch))) continue;
+        light_driver_set_transition_ch(ch, on ? rule->fade_ds : rule->off_fade_ds);
+        if (on && rule->level) light_driver_set_level_ch(ch, rule->level);
+        light_driver_set_power_ch(ch, on);
+        // the fades are running, later setters on the channel cut again
+        light_driver_set_transition_ch(ch, 0);
+    }
+    if (on && rule->effect != LIGHT_AUTOMATION_NO_EFFECT) light_driver_group_effect_start(rule->effect);
+    light_driver_batch_end();
+    light_driver_mark_latency(event_us);
+
+    // keep the coordinator's view (and the stored state) consistent with what the strips now show
+    for (size_t ch = 0; ch < TOTAL_LIGHT_CHANNELS; ++ch) {
+        if (!(rule->channels & (1ull << ch))) continue;
+        uint8_t ep = (uint8_t) (BASE_LIGHT_ENDPOINT + ch);
+        if (on && rule->level) {
+            uint8_t level = rule->level;
+            light_persist_set_level(ch, level);
+            SET_LIGHT_ATTR(ep, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, &level);
+        }
+        light_persist_set_power(ch, on);
+        SET_LIGHT_ATTR(ep, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, &on);
+    }
+    esp_zb_lock_release();
+    ESP_LOGI(TAG, "Presence on sensor %u: lights %s", rule->sensor, on ? "on" : "off");
+}
+
+#define PRESENCE_SENSOR_COUNT (sizeof(s_presence_sensors) / sizeof(s_presence_sensors[0]))
+
+/* Distance attributes are filtered and only written when they move, the presence rules see every raw reading
+ * (their hysteresis and hold time debounce, and a median would cost a whole ranging round of latency) */
+static sensor_filter_t s_distance_filter[PRESENCE_SENSOR_COUNT];
+
+static const sensor_filter_config_t s_distance_filter_cfg = {
+    .median_len = 3, .ema_shift = 1,
+    .outlier_delta = 100, .outlier_max = 2,
+    .stable_delta = 3, .report_delta = 5,
+};
+
+static void presence_result_cb(const ultrasonic_result_t *result, void *arg)
+{
+    light_automation_process(result, arg);
+    if (result->err != ESP_OK || result->sensor >= PRESENCE_SENSOR_COUNT) return;
+    int32_t cm;
+    if (!sensor_filter_update(&s_distance_filter[result->sensor], (int32_t) result->distance_cm, &cm)) return;
+    uint16_t distance = (uint16_t) cm;
+    esp_zb_lock_acquire(portMAX_DELAY);
+    esp_zb_zcl_set_attribute_val(BOARD_TEMP_ENDPOINT, LIGHT_AUTOMATION_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+                                 LIGHT_AUTOMATION_ATTR_DISTANCE + result->sensor, &distance, false);
+    esp_zb_lock_release();
+}
+
+static void start_presence_ranging(void)
+{
+    for (size_t i = 0; i < PRESENCE_SENSOR_COUNT; ++i) sensor_filter_init(&s_distance_filter[i], &s_distance_filter_cfg);
+    ultrasonic_async_config_t cfg = {
+        .sensors = s_presence_sensors,
+        .count = PRESENCE_SENSOR_COUNT,
+        .max_distance = PRESENCE_MAX_DISTANCE_CM,
+        .cb = presence_result_cb,
+    };
+    esp_err_t err = ultrasonic_async_start(&cfg);
+    if (err != ESP_OK) ESP_LOGW(TAG, "Presence ranging not started: %s", esp_err_to_name(err));
+}
+
+/* Power estimate attributes, refreshed from the Zigbee task and only written when they move */
+static sensor_filter_t s_power_filter;
+
+static void power_report_cb(uint8_t param)
+{
+    light_power_stats_t ps;
+    light_driver_get_power_stats(&ps);
+    int32_t ma;
+    if (sensor_filter_update(&s_power_filter, (int32_t) ps.output_ma, &ma)) {
+        uint16_t estimate = (uint16_t) (ma > UINT16_MAX ? UINT16_MAX : ma);
+        uint16_t demand = (uint16_t) (ps.demand_ma > UINT16_MAX ? UINT16_MAX : ps.demand_ma);
+        esp_zb_zcl_set_attribute_val(BOARD_TEMP_ENDPOINT, LIGHT_AUTOMATION_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+                                     BOARD_ATTR_POWER_ESTIMATE_MA, &estimate, false);
+        esp_zb_zcl_set_attribute_val(BOARD_TEMP_ENDPOINT, LIGHT_AUTOMATION_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+                                     BOARD_ATTR_POWER_DEMAND_MA, &demand, false);
+    }
+    esp_zb_scheduler_alarm(power_report_cb, 0, LIGHT_POWER_REPORT_INTERVAL_MS);
+}
+
+static void start_power_reporting(void)
+{
+    static const sensor_filter_config_t cfg = { .report_delta = LIGHT_POWER_REPORT_DELTA_MA };
+    sensor_filter_init(&s_power_filter, &cfg);
+    power_report_cb(0);
+}
+
+// Brings the ZCL attributes in line with what restore_lights() put on the strips
+static void reconcile_light_attributes(void)
+{
+    esp_zb_lock_acquire(portMAX_DELAY);
+    for (size_t ch = 0; ch < TOTAL_LIGHT_CHANNELS; ++ch) {
+        const light_persist_channel_t *c = light_persist_get(ch);
+        if (c) sync_light_attributes(ch, c);
+    }
+    esp_zb_lock_release();
+}
+
+static esp_err_t deferred_driver_init(void)
+{
+    // The strips already show the restored state (app_main); only the ZCL side has to catch up
+    reconcile_light_attributes();
+    light_persist_start();
+    // actions take the Zigbee lock and write attributes, so readings only start with the stack
+    start_presence_ranging();
+    start_power_reporting();
     // Temperature sensor init
     temperature_sensor_config_t tcfg = TEMPERATURE_SENSOR_CONFIG_DEFAULT(BOARD_TEMP_MIN_C, BOARD_TEMP_MAX_C);
-    esp_err_t err = temp_sensor_driver_init(&tcfg, BOARD_TEMP_UPDATE_INTERVAL_S, board_temp_update_cb);
+    static const sensor_filter_config_t temp_filter = {
+        .median_len = 5, .ema_shift = 2,
+        .outlier_delta = 300, .outlier_max = 3,     // a 3 degree jump has to show up 4 times in a row
+        .stable_delta = 10, .report_delta = BOARD_TEMP_REPORT_DELTA,
+        .interval_min_ms = BOARD_TEMP_INTERVAL_MIN_S * 1000, .interval_max_ms = BOARD_TEMP_INTERVAL_MAX_S * 1000,
+    };
+    static const thermal_derate_config_t derate_cfg = {
+        .start_c100 = BOARD_DERATE_START_C * 100, .full_c100 = BOARD_DERATE_FULL_C * 100,
+        .hysteresis_c100 = BOARD_DERATE_HYSTERESIS_C * 100, .min_cap_q8 = BOARD_DERATE_MIN_PCT * 256 / 100,
+    };
+    thermal_derate_init(&s_derate, &derate_cfg);
+    esp_err_t err = temp_sensor_driver_init(&tcfg, &temp_filter, board_temp_update_cb);
     if (err != ESP_OK) {
         ESP_LOGW(TAG, "Temp sensor init failed: %s", esp_err_to_name(err));
     }
@@ -120,107 +433,325 @@ void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct)
     }
 }
 
-static void esp_zb_identify(void *pvParameters)
+/* ZCL attribute writes: one constant table keyed by (cluster, attribute, type) */
+
+static void attr_on_off(size_t ch, uint16_t attr_id, const void *value)
 {
-    bool light_state = false;
-    for (int i = 0; i < 10; ++i) // blink fewer times for identify
-    {
-        light_state = !light_state;
-        light_driver_set_power(light_state);
-        vTaskDelay(pdMS_TO_TICKS(500));
-    };
-    light_driver_set_power(false);
-    vTaskDelay(pdMS_TO_TICKS(100));
-    vTaskDelete(NULL);
+    bool on = *(const bool *) value;
+    ESP_LOGI(TAG, "Channel %d set power %s", (int) ch, on ? "On" : "Off");
+    light_driver_set_power_ch(ch, on);
+    light_persist_set_power(ch, on);
+}
+
+static void attr_start_up_on_off(size_t ch, uint16_t attr_id, const void *value)
+{
+    light_ep_attrs_t *a = light_ep_attrs_get(ch);
+    a->startup_on_off = *(const uint8_t *) value;
+    light_persist_set_startup_on_off(ch, a->startup_on_off);
 }
 
+static void attr_level(size_t ch, uint16_t attr_id, const void *value)
+{
+    uint8_t level = *(const uint8_t *) value;
+    ESP_LOGI(TAG, "Channel %d level -> %u", (int) ch, level);
+    light_driver_set_level_ch(ch, level);
+    light_persist_set_level(ch, level);
+}
+
+static void attr_on_off_transition(size_t ch, uint16_t attr_id, const void *value)
+{
+    light_ep_attrs_t *a = light_ep_attrs_get(ch);
+    a->on_off_transition_ds = *(const uint16_t *) value;
+    ESP_LOGI(TAG, "Channel %d on/off transition -> %u ds", (int) ch, a->on_off_transition_ds);
+}
+
+static void attr_start_up_level(size_t ch, uint16_t attr_id, const void *value)
+{
+    light_ep_attrs_t *a = light_ep_attrs_get(ch);
+    a->startup_level = *(const uint8_t *) value;
+    light_persist_set_startup_level(ch, a->startup_level);
+}
+
+static void attr_color_xy(size_t ch, uint16_t attr_id, const void *value)
+{
+    light_ep_attrs_t *a = light_ep_attrs_get(ch);
+    if (attr_id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID) a->x = *(const uint16_t *) value;
+    else a->y = *(const uint16_t *) value;
+    ESP_LOGI(TAG, "Channel %d color xy -> 0x%x, 0x%x", (int) ch, a->x, a->y);
+    light_driver_set_color_xy_ch(ch, a->x, a->y);
+    light_persist_set_xy(ch, a->x, a->y);
+}
+
+static void attr_color_temp(size_t ch, uint16_t attr_id, const void *value)
+{
+    uint16_t mired = *(const uint16_t *) value;
+    light_ep_attrs_get(ch)->color_temp = mired;
+    ESP_LOGI(TAG, "Channel %d color temp mired -> %u", (int) ch, mired);
+    light_driver_set_color_temperature_mired_ch(ch, mired);
+    light_persist_set_mired(ch, mired);
+}
+
+static void attr_hue_sat(size_t ch, uint16_t attr_id, const void *value)
+{
+    light_ep_attrs_t *a = light_ep_attrs_get(ch);
+    if (attr_id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_HUE_ID) a->hue = *(const uint8_t *) value;
+    else a->sat = *(const uint8_t *) value;
+    ESP_LOGI(TAG, "Channel %d hue / saturation -> %u / %u", (int) ch, a->hue, a->sat);
+    light_driver_set_color_hue_sat_ch(ch, a->hue, a->sat);
+    light_persist_set_hue_sat(ch, (uint16_t) (a->hue << 8), a->sat, false);
+}
+
+static void attr_enhanced_hue(size_t ch, uint16_t attr_id, const void *value)
+{
+    light_ep_attrs_t *a = light_ep_attrs_get(ch);
+    a->enhanced_hue = *(const uint16_t *) value;
+    ESP_LOGI(TAG, "Channel %d enhanced hue -> %u", (int) ch, a->enhanced_hue);
+    light_driver_set_color_enhanced_hue_sat_ch(ch, a->enhanced_hue, a->sat);
+    light_persist_set_hue_sat(ch, a->enhanced_hue, a->sat, true);
+}
+
+static void attr_start_up_mired(size_t ch, uint16_t attr_id, const void *value)
+{
+    light_ep_attrs_t *a = light_ep_attrs_get(ch);
+    a->startup_mired = *(const uint16_t *) value;
+    light_persist_set_startup_mired(ch, a->startup_mired);
+}
+
+// Identify writes map the attribute id onto an effect id
+static void attr_identify(size_t ch, uint16_t attr_id, const void *value)
+{
+    switch (attr_id) {
+        case ESP_ZB_ZCL_IDENTIFY_EFFECT_ID_BLINK: light_driver_effect_start_ch(ch, LIGHT_EFFECT_BLINK); break;
+        case ESP_ZB_ZCL_IDENTIFY_EFFECT_ID_BREATHE: light_driver_effect_start_ch(ch, LIGHT_EFFECT_BREATHE); break;
+        case ESP_ZB_ZCL_IDENTIFY_EFFECT_ID_OKAY: light_driver_effect_start_ch(ch, LIGHT_EFFECT_ICU); break;
+        case ESP_ZB_ZCL_IDENTIFY_EFFECT_ID_CHANNEL_CHANGE: light_driver_effect_start_ch(ch, LIGHT_EFFECT_RANDOM_COLOR); break;
+        case ESP_ZB_ZCL_IDENTIFY_EFFECT_ID_FINISH_EFFECT:
+        case ESP_ZB_ZCL_IDENTIFY_EFFECT_ID_STOP: light_driver_effect_stop_ch(ch); break;
+        default: ESP_LOGI(TAG, "Identify effect not supported attr:0x%x", attr_id); break;
+    }
+}
+
+// A message matches the first entry with its cluster, attribute and type; indexed once in esp_zb_task()
+static const zcl_attr_entry_t s_attr_table[] = {
+    { ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, ESP_ZB_ZCL_ATTR_TYPE_U8, 0, attr_level },
+    { ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, ESP_ZB_ZCL_ATTR_TYPE_BOOL, 0, attr_on_off },
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID, ESP_ZB_ZCL_ATTR_TYPE_U16, 0, attr_color_xy },
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID, ESP_ZB_ZCL_ATTR_TYPE_U16, 0, attr_color_xy },
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID, ESP_ZB_ZCL_ATTR_TYPE_U16, 0, attr_color_temp },
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_HUE_ID, ESP_ZB_ZCL_ATTR_TYPE_U8, 0, attr_hue_sat },
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_SATURATION_ID, ESP_ZB_ZCL_ATTR_TYPE_U8, 0, attr_hue_sat },
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_CURRENT_HUE_ID, ESP_ZB_ZCL_ATTR_TYPE_U16, 0, attr_enhanced_hue },
+    { ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_ON_OFF_TRANSITION_TIME_ID, ESP_ZB_ZCL_ATTR_TYPE_U16, 0, attr_on_off_transition },
+    { ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_START_UP_ON_OFF, ZCL_ATTR_TYPE_ANY, 0, attr_start_up_on_off },
+    { ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_START_UP_CURRENT_LEVEL_ID, ZCL_ATTR_TYPE_ANY, 0, attr_start_up_level },
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_START_UP_COLOR_TEMPERATURE_MIREDS_ID, ZCL_ATTR_TYPE_ANY, 0, attr_start_up_mired },
+    { ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY, ZCL_ATTR_ANY, ZCL_ATTR_TYPE_ANY, ZCL_ATTR_VALUE_OPTIONAL, attr_identify },
+};
+
+static zcl_attr_dispatch_t s_attr_dispatch;
+
 static esp_err_t zb_attribute_handler(const esp_zb_zcl_set_attr_value_message_t *message)
 {
-    esp_err_t ret = ESP_OK;
-    bool light_state = 0;
-    uint8_t light_level = 0;
-    uint16_t light_color_x = 0;
-    uint16_t light_color_y = 0;
-    uint16_t light_temp_mired = 0;
-    uint8_t hue = 0;
-    uint8_t sat = 0;
     ESP_RETURN_ON_FALSE(message, ESP_FAIL, TAG, "Empty message");
     ESP_RETURN_ON_FALSE(message->info.status == ESP_ZB_ZCL_STATUS_SUCCESS, ESP_ERR_INVALID_ARG, TAG,
                         "Received message: error status(%d)",
                         message->info.status);
+    uint8_t ep = message->info.dst_endpoint;
+    uint16_t cluster = message->info.cluster, attr_id = message->attribute.id;
+    const void *value = message->attribute.data.value;
     ESP_LOGI(TAG, "Received message: endpoint(%d), cluster(0x%x), attribute(0x%x), data size(%d)",
-             message->info.dst_endpoint, message->info.cluster,
-             message->attribute.id, message->attribute.data.size);
-    if (endpoint_is_light(message->info.dst_endpoint))
-    {
-        size_t ch = endpoint_to_channel(message->info.dst_endpoint);
-        switch (message->info.cluster)
-        {
+             ep, cluster, attr_id, message->attribute.data.size);
+    if (ep == BOARD_TEMP_ENDPOINT && cluster == LIGHT_AUTOMATION_CLUSTER_ID) {
+        ESP_RETURN_ON_FALSE(value, ESP_ERR_INVALID_ARG, TAG, "Automation attribute 0x%x without data", attr_id);
+        esp_err_t ret = light_automation_set_attr(attr_id, value);
+        if (ret != ESP_OK) ESP_LOGW(TAG, "Automation attribute 0x%x: %s", attr_id, esp_err_to_name(ret));
+        return ret;
+    }
+    if (!endpoint_is_light(ep)) return ESP_OK;
+
+    esp_err_t ret = zcl_attr_dispatch(&s_attr_dispatch, endpoint_to_channel(ep), cluster, attr_id, message->attribute.data.type,
+                                      value);
+    ESP_RETURN_ON_FALSE(ret != ESP_ERR_INVALID_ARG, ret, TAG, "EP %d cluster 0x%x attribute 0x%x without data", ep, cluster, attr_id);
+    if (ret == ESP_ERR_NOT_FOUND) {
+        ESP_LOGW(TAG, "EP %d cluster 0x%x attribute 0x%x type 0x%x not handled", ep, cluster, attr_id, message->attribute.data.type);
+    }
+    return ESP_OK;
+}
+
+/* Runs before the stack processes a command: arms the command's transition time on the driver so the
+ * attribute writes that follow fade instead of cutting, and disarms it for commands without one. Never
+ * consumes the command. */
+static bool s_zcl_batch_open;
+
+// Runs from the scheduler once the stack has finished the command (and any group/scene fan-out) that opened the batch
+static void zcl_batch_end_cb(uint8_t param)
+{
+    s_zcl_batch_open = false;
+    light_driver_batch_end();
+}
+
+#define ZCL_SCENES_CMD_ADD          0x00
+#define ZCL_SCENES_CMD_REMOVE       0x02
+#define ZCL_SCENES_CMD_REMOVE_ALL   0x03
+#define ZCL_SCENES_CMD_ENHANCED_ADD 0x40
+
+static inline uint16_t get_u16(const uint8_t *p) { return (uint16_t) (p[0] | (p[1] << 8)); }
+
+// Add Scene / Enhanced Add Scene: group, scene, transition time, name, then extension field sets of
+// (cluster, length, attribute values in scene table order). Clusters the command leaves out keep the
+// channel's current values, as the stack does for its own table.
+static void scene_add(size_t ch, const uint8_t *p, size_t len)
+{
+    if (len < 6) return;
+    uint16_t group = get_u16(p);
+    uint8_t scene = p[2];
+    size_t pos = 5, name_len = p[pos] == 0xFF ? 0 : p[pos];
+    pos += 1 + name_len;
+    const light_persist_channel_t *current = light_persist_get(ch);
+    if (!current || pos > len) return;
+    light_persist_channel_t s = *current;
+    while (pos + 3 <= len) {
+        uint16_t cluster = get_u16(&p[pos]);
+        size_t n = p[pos + 2];
+        const uint8_t *v = &p[pos + 3];
+        pos += 3 + n;
+        if (pos > len) break;
+        switch (cluster) {
             case ESP_ZB_ZCL_CLUSTER_ID_ON_OFF:
-                if (message->attribute.id == ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID &&
-                    message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_BOOL)
-                {
-                    light_state = message->attribute.data.value ? *(bool *) message->attribute.data.value : light_state;
-                    ESP_LOGI(TAG, "EP %d -> channel %d set power %s", message->info.dst_endpoint, (int)ch, light_state ? "On" : "Off");
-                    light_driver_set_power_ch(ch, light_state);
-                } else {
-                    ESP_LOGW(TAG, "On/Off cluster data: attribute(0x%x), type(0x%x)", message->attribute.id, message->attribute.data.type);
-                }
-                break;
-            case ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL:
-                // same logic but call channel-specific setters
-                if (message->attribute.id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID && message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16) {
-                    light_color_x = message->attribute.data.value ? *(uint16_t *) message->attribute.data.value : light_color_x;
-                    light_color_y = *(uint16_t *) esp_zb_zcl_get_attribute(message->info.dst_endpoint, message->info.cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID)->data_p;
-                    ESP_LOGI(TAG, "EP %d color x -> 0x%x", message->info.dst_endpoint, light_color_x);
-                    light_driver_set_color_xy_ch(ch, light_color_x, light_color_y);
-                } else if (message->attribute.id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID && message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16) {
-                    light_color_y = message->attribute.data.value ? *(uint16_t *) message->attribute.data.value : light_color_y;
-                    light_color_x = *(uint16_t *) esp_zb_zcl_get_attribute(message->info.dst_endpoint, message->info.cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID)->data_p;
-                    ESP_LOGI(TAG, "EP %d color y -> 0x%x", message->info.dst_endpoint, light_color_y);
-                    light_driver_set_color_xy_ch(ch, light_color_x, light_color_y);
-                } else if (message->attribute.id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID && message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16) {
-                    light_temp_mired = message->attribute.data.value ? *(uint16_t *) message->attribute.data.value : light_temp_mired;
-                    ESP_LOGI(TAG, "EP %d color temp mired -> %u", message->info.dst_endpoint, light_temp_mired);
-                    light_driver_set_color_temperature_mired_ch(ch, light_temp_mired);
-                } else if (message->attribute.id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_HUE_ID && message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8) {
-                    hue = message->attribute.data.value ? *(uint8_t *) message->attribute.data.value : hue;
-                    sat = *(uint8_t *) esp_zb_zcl_get_attribute(message->info.dst_endpoint, message->info.cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_SATURATION_ID)->data_p;
-                    ESP_LOGI(TAG, "EP %d hue -> %u", message->info.dst_endpoint, hue);
-                    light_driver_set_color_hue_sat_ch(ch, hue, sat);
-                } else if (message->attribute.id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_SATURATION_ID && message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8) {
-                    sat = message->attribute.data.value ? *(uint8_t *) message->attribute.data.value : sat;
-                    hue = *(uint8_t *) esp_zb_zcl_get_attribute(message->info.dst_endpoint, message->info.cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_HUE_ID)->data_p;
-                    ESP_LOGI(TAG, "EP %d saturation -> %u", message->info.dst_endpoint, sat);
-                    light_driver_set_color_hue_sat_ch(ch, hue, sat);
-                } else {
-                    ESP_LOGW(TAG, "Color control cluster data: attribute(0x%x), type(0x%x)", message->attribute.id, message->attribute.data.type);
-                }
+                if (n >= 1) s.power = v[0] != 0;
                 break;
             case ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL:
-                if (message->attribute.id == ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID && message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8) {
-                    light_level = message->attribute.data.value ? *(uint8_t *) message->attribute.data.value : light_level;
-                    ESP_LOGI(TAG, "EP %d level -> %u", message->info.dst_endpoint, light_level);
-                    light_driver_set_level_ch(ch, light_level);
-                } else {
-                    ESP_LOGW(TAG, "Level Control cluster data: attribute(0x%x), type(0x%x)", message->attribute.id, message->attribute.data.type);
-                }
+                if (n >= 1) s.level = v[0];
                 break;
-            case ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY:
-                switch (message->attribute.id) {
-                    case ESP_ZB_ZCL_IDENTIFY_EFFECT_ID_BLINK: light_driver_effect_start_ch(ch, LIGHT_EFFECT_BLINK); break;
-                    case ESP_ZB_ZCL_IDENTIFY_EFFECT_ID_BREATHE: light_driver_effect_start_ch(ch, LIGHT_EFFECT_BREATHE); break;
-                    case ESP_ZB_ZCL_IDENTIFY_EFFECT_ID_OKAY: light_driver_effect_start_ch(ch, LIGHT_EFFECT_ICU); break;
-                    case ESP_ZB_ZCL_IDENTIFY_EFFECT_ID_CHANNEL_CHANGE: light_driver_effect_start_ch(ch, LIGHT_EFFECT_RANDOM_COLOR); break;
-                    case ESP_ZB_ZCL_IDENTIFY_EFFECT_ID_FINISH_EFFECT:
-                    case ESP_ZB_ZCL_IDENTIFY_EFFECT_ID_STOP: light_driver_effect_stop_ch(ch); break;
-                    default: ESP_LOGI(TAG, "Identify effect not supported attr:0x%x", message->attribute.id); break;
+            case ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL:
+                // CurrentX, CurrentY, EnhancedCurrentHue, CurrentSaturation, loop active/direction/time,
+                // ColorTemperatureMireds, EnhancedColorMode; shorter sets from older clients carry only xy
+                if (n >= 4) { s.x = get_u16(&v[0]); s.y = get_u16(&v[2]); s.color_mode = LIGHT_PERSIST_COLOR_XY; }
+                if (n >= 7) { s.hue = get_u16(&v[4]); s.sat = v[6]; }
+                if (n >= 13) s.mired = get_u16(&v[11]);
+                if (n >= 14) {
+                    switch (v[13]) {
+                        case ESP_ZB_ZCL_COLOR_CONTROL_COLOR_MODE_HUE_SATURATION: s.color_mode = LIGHT_PERSIST_COLOR_HS; break;
+                        case ESP_ZB_ZCL_COLOR_CONTROL_COLOR_MODE_TEMPERATURE: s.color_mode = LIGHT_PERSIST_COLOR_CT; break;
+                        case 3: s.color_mode = LIGHT_PERSIST_COLOR_EHS; break;    // enhanced hue and saturation
+                        default: s.color_mode = LIGHT_PERSIST_COLOR_XY; break;
+                    }
                 }
                 break;
             default:
-                ESP_LOGI(TAG, "EP %d cluster 0x%x attr 0x%x", message->info.dst_endpoint, message->info.cluster, message->attribute.id);
+                break;
+        }
+    }
+    ESP_LOGI(TAG, "EP %d add scene %u group 0x%04x", (int) (BASE_LIGHT_ENDPOINT + ch), scene, group);
+    light_scenes_store(group, scene, (uint8_t) ch, &s);
+}
+
+// Transition time a command asks for in 1/10 s: its own field for the commands in s_transition_cmds, the
+// OnOffTransitionTime for On/Off and for 0xFFFF, 0 (cut) for everything else
+static uint16_t command_transition_ds(const zb_zcl_parsed_hdr_t *cmd_info, size_t ch, const uint8_t *payload, zb_uint_t len)
+{
+    if (cmd_info->is_common_command) return 0;
+    if (cmd_info->cluster_id == ESP_ZB_ZCL_CLUSTER_ID_ON_OFF) return light_ep_attrs_get(ch)->on_off_transition_ds;
+    for (size_t i = 0; i < sizeof(s_transition_cmds) / sizeof(s_transition_cmds[0]); ++i) {
+        const zcl_transition_cmd_t *tc = &s_transition_cmds[i];
+        if (tc->cluster != cmd_info->cluster_id || tc->cmd != cmd_info->cmd_id) continue;
+        if (len < (zb_uint_t) tc->tt_offset + 2) return 0;
+        uint16_t tt = (uint16_t) (payload[tc->tt_offset] | (payload[tc->tt_offset + 1] << 8));
+        return tt == 0xFFFF ? light_ep_attrs_get(ch)->on_off_transition_ds : tt;
+    }
+    return 0;
+}
+
+static bool zb_raw_command_handler(uint8_t bufid)
+{
+    zb_zcl_parsed_hdr_t *cmd_info = ZB_BUF_GET_PARAM(bufid, zb_zcl_parsed_hdr_t);
+    uint8_t ep = ZB_ZCL_PARSED_HDR_SHORT_DATA(cmd_info).dst_endpoint;
+    if (!endpoint_is_light(ep)) return false;
+    // All attribute writes resulting from this command reach the strips in one frame
+    if (!s_zcl_batch_open) {
+        s_zcl_batch_open = true;
+        light_driver_batch_begin();
+        esp_zb_scheduler_alarm(zcl_batch_end_cb, 0, 0);
+    }
+    size_t ch = endpoint_to_channel(ep);
+    const uint8_t *payload = zb_buf_begin(bufid);
+    zb_uint_t len = zb_buf_len(bufid);
+    // every command re-arms the channel, so a deadline never outlives the command that set it into a
+    // Move, a Toggle, an attribute write or an effect arriving before it ran out
+    light_driver_set_transition_ch(ch, command_transition_ds(cmd_info, ch, payload, len));
+    if (cmd_info->is_common_command) return false;
+
+    if (cmd_info->cluster_id == ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY) {
+        // Trigger Effect with a vendor effect id runs a group preset (0x80+) or plays an animation on the
+        // endpoint (0xA0+), Stop/Finish also end them
+        if (cmd_info->cmd_id == ZCL_IDENTIFY_CMD_TRIGGER_EFFECT && len >= 1) {
+            if (payload[0] >= GROUP_EFFECT_ID_BASE && payload[0] < GROUP_EFFECT_ID_BASE + GROUP_PRESET_COUNT) {
+                ESP_LOGI(TAG, "EP %d group effect %u", ep, payload[0] - GROUP_EFFECT_ID_BASE);
+                light_driver_group_effect_start((uint8_t) (payload[0] - GROUP_EFFECT_ID_BASE));
+            } else if (payload[0] >= ANIM_EFFECT_ID_BASE && payload[0] < ANIM_EFFECT_ID_BASE + ANIM_EFFECT_ID_COUNT) {
+                esp_err_t err = light_driver_anim_start_ch(ch, (uint16_t) (payload[0] - ANIM_EFFECT_ID_BASE));
+                ESP_LOGI(TAG, "EP %d animation %u: %s", ep, payload[0] - ANIM_EFFECT_ID_BASE, esp_err_to_name(err));
+            } else if (payload[0] == ESP_ZB_ZCL_IDENTIFY_EFFECT_ID_STOP || payload[0] == ESP_ZB_ZCL_IDENTIFY_EFFECT_ID_FINISH_EFFECT) {
+                light_driver_group_effect_stop();
+                light_driver_effect_stop_ch(ch);
+            }
         }
+        return false;
+    }
+    if (cmd_info->cluster_id == ESP_ZB_ZCL_CLUSTER_ID_SCENES) {
+        // the stack keeps its own scene table and answers; the app table follows Add, Remove and Remove All
+        if (len < 2) return false;
+        uint16_t group = (uint16_t) (payload[0] | (payload[1] << 8));
+        switch (cmd_info->cmd_id) {
+            case ZCL_SCENES_CMD_ADD:
+            case ZCL_SCENES_CMD_ENHANCED_ADD: scene_add(ch, payload, len); break;
+            case ZCL_SCENES_CMD_REMOVE: if (len >= 3) light_scenes_remove(group, payload[2], (uint8_t) ch); break;
+            case ZCL_SCENES_CMD_REMOVE_ALL: light_scenes_remove_all(group, (uint8_t) ch); break;
+            default: break;
+        }
+        return false;
+    }
+
+    return false;
+}
+
+static esp_err_t zb_store_scene_handler(const esp_zb_zcl_store_scene_message_t *message)
+{
+    ESP_RETURN_ON_FALSE(message && endpoint_is_light(message->info.dst_endpoint), ESP_ERR_INVALID_ARG, TAG, "Bad store scene");
+    size_t ch = endpoint_to_channel(message->info.dst_endpoint);
+    const light_persist_channel_t *state = light_persist_get(ch);
+    ESP_RETURN_ON_FALSE(state, ESP_ERR_INVALID_STATE, TAG, "No state for channel %u", (unsigned) ch);
+    ESP_LOGI(TAG, "EP %d store scene %u group 0x%04x", message->info.dst_endpoint, message->scene_id, message->group_id);
+    return light_scenes_store(message->group_id, message->scene_id, (uint8_t) ch, state);
+}
+
+// Recall is applied inside the batch the raw handler opened for the command, so a scene spanning every
+// endpoint (group recall) reaches the strips in one frame
+static esp_err_t zb_recall_scene_handler(const esp_zb_zcl_recall_scene_message_t *message)
+{
+    ESP_RETURN_ON_FALSE(message && endpoint_is_light(message->info.dst_endpoint), ESP_ERR_INVALID_ARG, TAG, "Bad recall scene");
+    size_t ch = endpoint_to_channel(message->info.dst_endpoint);
+    const light_persist_channel_t *state = light_scenes_find(message->group_id, message->scene_id, (uint8_t) ch);
+    if (!state) {
+        ESP_LOGW(TAG, "EP %d has no scene %u in group 0x%04x", message->info.dst_endpoint, message->scene_id, message->group_id);
+        return ESP_ERR_NOT_FOUND;
     }
+    light_persist_channel_t recalled = *state;
+    light_driver_set_transition_ch(ch, message->transition_time == 0xFFFF ? 0 : message->transition_time);
+    apply_light_state(ch, &recalled);
+    light_driver_set_transition_ch(ch, 0);
+    light_persist_set_channel(ch, &recalled);
+    sync_light_attributes(ch, light_persist_get(ch));
+    return ESP_OK;
+}
+
+static esp_err_t zb_pixels_handler(const esp_zb_zcl_custom_cluster_command_message_t *message)
+{
+    ESP_RETURN_ON_FALSE(message && endpoint_is_light(message->info.dst_endpoint), ESP_ERR_INVALID_ARG, TAG, "Bad pixel command");
+    if (message->info.cluster != LIGHT_PIXELS_CLUSTER_ID) return ESP_ERR_NOT_SUPPORTED;
+    size_t ch = endpoint_to_channel(message->info.dst_endpoint);
+    esp_err_t ret = light_pixels_command(ch, message->info.command.id, message->data.value, message->data.size);
+    if (ret != ESP_OK) ESP_LOGW(TAG, "EP %d pixel command 0x%x: %s", message->info.dst_endpoint, message->info.command.id, esp_err_to_name(ret));
     return ret;
 }
 
@@ -233,9 +764,18 @@ static esp_err_t zb_action_handler(esp_zb_core_action_callback_id_t callback_id,
             ESP_LOGI(TAG, "Set attribute value callback");
             ret = zb_attribute_handler((esp_zb_zcl_set_attr_value_message_t *) message);
             break;
+        case ESP_ZB_CORE_SCENES_STORE_SCENE_CB_ID:
+            ret = zb_store_scene_handler((const esp_zb_zcl_store_scene_message_t *) message);
+            break;
+        case ESP_ZB_CORE_SCENES_RECALL_SCENE_CB_ID:
+            ret = zb_recall_scene_handler((const esp_zb_zcl_recall_scene_message_t *) message);
+            break;
         case ESP_ZB_CORE_IDENTIFY_EFFECT_CB_ID:
             ESP_LOGI(TAG, "Identify effect callback");
             break;
+        case ESP_ZB_CORE_CMD_CUSTOM_CLUSTER_REQ_CB_ID:
+            ret = zb_pixels_handler((const esp_zb_zcl_custom_cluster_command_message_t *) message);
+            break;
         default:
             ESP_LOGI(TAG, "Zigbee action(0x%x) callback", callback_id);
             break;
@@ -244,41 +784,54 @@ static esp_err_t zb_action_handler(esp_zb_core_action_callback_id_t callback_id,
 }
 
 static esp_zb_cluster_list_t *
-custom_light_clusters_create(esp_zb_color_dimmable_light_cfg_t *light)
+custom_light_clusters_create(esp_zb_color_dimmable_light_cfg_t *light, light_ep_attrs_t *attrs, bool primary)
 {
     esp_zb_cluster_list_t *cluster_list = esp_zb_zcl_cluster_list_create();
 
-    esp_zb_attribute_list_t *basic_cluster = esp_zb_basic_cluster_create(&light->basic_cfg);
-    ESP_ERROR_CHECK(esp_zb_basic_cluster_add_attr(basic_cluster, ESP_ZB_ZCL_ATTR_BASIC_MANUFACTURER_NAME_ID,
-                                                  MANUFACTURER_NAME));
-    ESP_ERROR_CHECK(esp_zb_basic_cluster_add_attr(basic_cluster, ESP_ZB_ZCL_ATTR_BASIC_MODEL_IDENTIFIER_ID,
-                                                  MODEL_IDENTIFIER));
-    ESP_ERROR_CHECK(esp_zb_cluster_list_add_basic_cluster(cluster_list, basic_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
-
+    // Device-wide data lives on the primary endpoint only: Basic with its strings and the Identify client
+    if (primary) {
+        esp_zb_attribute_list_t *basic_cluster = esp_zb_basic_cluster_create(&light->basic_cfg);
+        ESP_ERROR_CHECK(esp_zb_basic_cluster_add_attr(basic_cluster, ESP_ZB_ZCL_ATTR_BASIC_MANUFACTURER_NAME_ID,
+                                                      MANUFACTURER_NAME));
+        ESP_ERROR_CHECK(esp_zb_basic_cluster_add_attr(basic_cluster, ESP_ZB_ZCL_ATTR_BASIC_MODEL_IDENTIFIER_ID,
+                                                      MODEL_IDENTIFIER));
+        ESP_ERROR_CHECK(esp_zb_cluster_list_add_basic_cluster(cluster_list, basic_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
+        ESP_ERROR_CHECK(esp_zb_cluster_list_add_identify_cluster(cluster_list, esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY), ESP_ZB_ZCL_CLUSTER_CLIENT_ROLE));
+    }
     ESP_ERROR_CHECK(esp_zb_cluster_list_add_identify_cluster(cluster_list, esp_zb_identify_cluster_create(&light->identify_cfg), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
-    ESP_ERROR_CHECK(esp_zb_cluster_list_add_identify_cluster(cluster_list, esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY), ESP_ZB_ZCL_CLUSTER_CLIENT_ROLE));
 
-    ESP_ERROR_CHECK(esp_zb_cluster_list_add_on_off_cluster(cluster_list, esp_zb_on_off_cluster_create(&light->on_off_cfg), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
+    esp_zb_attribute_list_t *on_off_cluster = esp_zb_on_off_cluster_create(&light->on_off_cfg);
+    esp_zb_on_off_cluster_add_attr(on_off_cluster, ESP_ZB_ZCL_ATTR_ON_OFF_START_UP_ON_OFF, &attrs->startup_on_off);
+    ESP_ERROR_CHECK(esp_zb_cluster_list_add_on_off_cluster(cluster_list, on_off_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
 
-    esp_zb_attribute_list_t *color_cluster = esp_zb_color_control_cluster_create(&light->color_cfg);
+    esp_zb_color_cluster_cfg_t color_cfg = light->color_cfg;
+    color_cfg.current_x = attrs->x;
+    color_cfg.current_y = attrs->y;
+    esp_zb_attribute_list_t *color_cluster = esp_zb_color_control_cluster_create(&color_cfg);
     // Add extended color attributes
-    static uint16_t color_temp = ESP_ZB_ZCL_COLOR_CONTROL_COLOR_TEMPERATURE_DEF_VALUE;
-    static uint16_t color_temp_min = ESP_ZB_ZCL_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MIN_MIREDS_DEFAULT_VALUE;
-    static uint16_t color_temp_max = ESP_ZB_ZCL_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MAX_MIREDS_DEFAULT_VALUE;
-    static uint8_t current_hue = 0x00;
-    static uint8_t current_sat = 0x00;
-    static uint16_t enhanced_hue = 0x0000;
-    esp_zb_color_control_cluster_add_attr(color_cluster, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID, &color_temp);
-    esp_zb_color_control_cluster_add_attr(color_cluster, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MIN_MIREDS_ID, &color_temp_min);
-    esp_zb_color_control_cluster_add_attr(color_cluster, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MAX_MIREDS_ID, &color_temp_max);
-    esp_zb_color_control_cluster_add_attr(color_cluster, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_HUE_ID, &current_hue);
-    esp_zb_color_control_cluster_add_attr(color_cluster, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_SATURATION_ID, &current_sat);
-    esp_zb_color_control_cluster_add_attr(color_cluster, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_CURRENT_HUE_ID, &enhanced_hue);
+    esp_zb_color_control_cluster_add_attr(color_cluster, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID, &attrs->color_temp);
+    esp_zb_color_control_cluster_add_attr(color_cluster, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MIN_MIREDS_ID, &attrs->color_temp_min);
+    esp_zb_color_control_cluster_add_attr(color_cluster, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MAX_MIREDS_ID, &attrs->color_temp_max);
+    esp_zb_color_control_cluster_add_attr(color_cluster, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_HUE_ID, &attrs->hue);
+    esp_zb_color_control_cluster_add_attr(color_cluster, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_SATURATION_ID, &attrs->sat);
+    esp_zb_color_control_cluster_add_attr(color_cluster, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_CURRENT_HUE_ID, &attrs->enhanced_hue);
+    esp_zb_color_control_cluster_add_attr(color_cluster, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_START_UP_COLOR_TEMPERATURE_MIREDS_ID, &attrs->startup_mired);
     ESP_ERROR_CHECK(esp_zb_cluster_list_add_color_control_cluster(cluster_list, color_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
 
     ESP_ERROR_CHECK(esp_zb_cluster_list_add_scenes_cluster(cluster_list, esp_zb_scenes_cluster_create(&light->scenes_cfg), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
-    ESP_ERROR_CHECK(esp_zb_cluster_list_add_level_cluster(cluster_list, esp_zb_level_cluster_create(&light->level_cfg), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
+    esp_zb_attribute_list_t *level_cluster = esp_zb_level_cluster_create(&light->level_cfg);
+    esp_zb_level_cluster_add_attr(level_cluster, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_ON_OFF_TRANSITION_TIME_ID, &attrs->on_off_transition_ds);
+    esp_zb_level_cluster_add_attr(level_cluster, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_START_UP_CURRENT_LEVEL_ID, &attrs->startup_level);
+    ESP_ERROR_CHECK(esp_zb_cluster_list_add_level_cluster(cluster_list, level_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
     ESP_ERROR_CHECK(esp_zb_cluster_list_add_groups_cluster(cluster_list, esp_zb_groups_cluster_create(&light->groups_cfg), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
+
+    // Bulk pixel upload on multi-pixel strips (see light_pixels.h)
+    if (attrs->led_count > 1) {
+        esp_zb_attribute_list_t *pixels = esp_zb_zcl_attr_list_create(LIGHT_PIXELS_CLUSTER_ID);
+        ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(pixels, LIGHT_PIXELS_ATTR_LED_COUNT, ESP_ZB_ZCL_ATTR_TYPE_U16,
+                                                              ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, &attrs->led_count));
+        ESP_ERROR_CHECK(esp_zb_cluster_list_add_custom_cluster(cluster_list, pixels, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
+    }
     return cluster_list;
 }
 
@@ -293,7 +846,7 @@ custom_light_ep_create(esp_zb_color_dimmable_light_cfg_t *light)
             .app_device_id = ESP_ZB_HA_COLOR_DIMMABLE_LIGHT_DEVICE_ID,
             .app_device_version = 0
     };
-    esp_zb_ep_list_add_ep(ep_list, custom_light_clusters_create(light), endpoint_config);
+    esp_zb_ep_list_add_ep(ep_list, custom_light_clusters_create(light, light_ep_attrs_get(0), true), endpoint_config);
     return ep_list;
 }
 
@@ -308,6 +861,33 @@ custom_temp_clusters_create(void)
     };
     ESP_ERROR_CHECK(esp_zb_cluster_list_add_temperature_meas_cluster(
             cluster_list, esp_zb_temperature_meas_cluster_create(&temp_cfg), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
+
+    // Presence automation rules, one block of attributes per rule (see light_automation.h)
+    esp_zb_attribute_list_t *automation = esp_zb_zcl_attr_list_create(LIGHT_AUTOMATION_CLUSTER_ID);
+    uint16_t attr_id;
+    uint8_t type;
+    void *value;
+    for (size_t i = 0; light_automation_attr_info(i, &attr_id, &type, &value); ++i) {
+        ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(automation, attr_id, type, ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE, value));
+    }
+    static uint16_t distance_unknown = 0xFFFF;
+    for (size_t i = 0; i < PRESENCE_SENSOR_COUNT; ++i) {
+        ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(automation, (uint16_t) (LIGHT_AUTOMATION_ATTR_DISTANCE + i), ESP_ZB_ZCL_ATTR_TYPE_U16,
+                                                              ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING, &distance_unknown));
+    }
+    static uint16_t power_zero = 0, power_budget = LIGHT_POWER_BUDGET_MA;
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(automation, BOARD_ATTR_POWER_ESTIMATE_MA, ESP_ZB_ZCL_ATTR_TYPE_U16,
+                                                          ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING, &power_zero));
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(automation, BOARD_ATTR_POWER_DEMAND_MA, ESP_ZB_ZCL_ATTR_TYPE_U16,
+                                                          ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING, &power_zero));
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(automation, BOARD_ATTR_POWER_BUDGET_MA, ESP_ZB_ZCL_ATTR_TYPE_U16,
+                                                          ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, &power_budget));
+    static uint8_t derate_state = THERMAL_DERATE_NORMAL, derate_pct = 100;
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(automation, BOARD_ATTR_DERATE_STATE, ESP_ZB_ZCL_ATTR_TYPE_8BIT_ENUM,
+                                                          ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING, &derate_state));
+    ESP_ERROR_CHECK(esp_zb_custom_cluster_add_custom_attr(automation, BOARD_ATTR_DERATE_CAP_PCT, ESP_ZB_ZCL_ATTR_TYPE_U8,
+                                                          ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING, &derate_pct));
+    ESP_ERROR_CHECK(esp_zb_cluster_list_add_custom_cluster(cluster_list, automation, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE));
     return cluster_list;
 }
 
@@ -324,6 +904,9 @@ static void esp_zb_task(void *pvParameters)
             .groups_cfg = { .groups_name_support_id = ESP_ZB_ZCL_GROUPS_NAME_SUPPORT_DEFAULT_VALUE, },
             .identify_cfg = { .identify_time = ESP_ZB_ZCL_IDENTIFY_IDENTIFY_TIME_DEFAULT_VALUE, }, };
 
+    // heap cost of the light endpoints, so the price of more channels shows in the log
+    size_t heap_start = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    size_t ep_max = 0;
     esp_zb_ep_list_t *ep_list = esp_zb_ep_list_create();
     for (size_t ch = 0; ch < TOTAL_LIGHT_CHANNELS; ++ch) {
         esp_zb_endpoint_config_t endpoint_config = {
@@ -332,9 +915,15 @@ static void esp_zb_task(void *pvParameters)
                 .app_device_id = ESP_ZB_HA_COLOR_DIMMABLE_LIGHT_DEVICE_ID,
                 .app_device_version = 0
         };
-        esp_zb_cluster_list_t *clusters = custom_light_clusters_create(&light_cfg);
+        size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+        light_ep_attrs_seed(ch, ch < STAIRS_LED_COUNT ? 1 : BED_STRIP_LED_LENGTH);
+        esp_zb_cluster_list_t *clusters = custom_light_clusters_create(&light_cfg, light_ep_attrs_get(ch), ch == 0);
         esp_zb_ep_list_add_ep(ep_list, clusters, endpoint_config);
+        size_t used = heap_before - heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+        if (used > ep_max) ep_max = used;
+        ESP_LOGD(TAG, "EP %d clusters: %u bytes", endpoint_config.endpoint, (unsigned) used);
     }
+    size_t heap_lights = heap_start - heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
     // Add board temperature endpoint
     esp_zb_endpoint_config_t temp_endpoint_cfg = {
             .endpoint = BOARD_TEMP_ENDPOINT,
@@ -343,7 +932,12 @@ static void esp_zb_task(void *pvParameters)
             .app_device_version = 0
     };
     esp_zb_ep_list_add_ep(ep_list, custom_temp_clusters_create(), temp_endpoint_cfg);
+    size_t heap_before_register = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
     esp_zb_device_register(ep_list);
+    size_t heap_register = heap_before_register - heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    ESP_LOGI(TAG, "%d light endpoints: %u bytes of cluster lists (%u per endpoint, largest %u), registration %u bytes, %u bytes free",
+             TOTAL_LIGHT_CHANNELS, (unsigned) heap_lights, (unsigned) (heap_lights / TOTAL_LIGHT_CHANNELS), (unsigned) ep_max,
+             (unsigned) heap_register, (unsigned) heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
 
     // Configure reporting for each endpoint
     for (size_t ch = 0; ch < TOTAL_LIGHT_CHANNELS; ++ch) {
@@ -396,7 +990,9 @@ static void esp_zb_task(void *pvParameters)
     };
     esp_zb_zcl_update_reporting_info(&temp_reporting);
 
+    ESP_ERROR_CHECK(zcl_attr_dispatch_init(&s_attr_dispatch, s_attr_table, sizeof(s_attr_table) / sizeof(s_attr_table[0])));
     esp_zb_core_action_handler_register(zb_action_handler);
+    esp_zb_raw_command_handler_register(zb_raw_command_handler);
     esp_zb_set_primary_network_channel_set(ESP_ZB_PRIMARY_CHANNEL_MASK);
     ESP_ERROR_CHECK(esp_zb_start(false));
     esp_zb_stack_main_loop();
@@ -404,19 +1000,45 @@ static void esp_zb_task(void *pvParameters)
 
 void app_main(void)
 {
-    // Multi-channel hardware configuration (ASSUMED GPIOs – adjust to your wiring!)
-    static const light_channel_config_t channel_cfg[TOTAL_LIGHT_CHANNELS] = {
-        // 12 stair LEDs (single pixel each) – example GPIO sequence (replace with real pins)
-        { .gpio = 2, .led_count = 1 }, { .gpio = 3, .led_count = 1 }, { .gpio = 4, .led_count = 1 }, { .gpio = 5, .led_count = 1 },
-        { .gpio = 6, .led_count = 1 }, { .gpio = 7, .led_count = 1 }, { .gpio = 8, .led_count = 1 }, { .gpio = 9, .led_count = 1 },
-        { .gpio = 10, .led_count = 1 }, { .gpio = 11, .led_count = 1 }, { .gpio = 12, .led_count = 1 }, { .gpio = 13, .led_count = 1 },
-        // 2 bed side strips
-        { .gpio = 14, .led_count = BED_STRIP_LED_LENGTH }, { .gpio = 15, .led_count = BED_STRIP_LED_LENGTH },
+    // Fast boot: NVS and the stored light state come first so the strips light up before the Zigbee stack starts
+    ESP_ERROR_CHECK(nvs_flash_init());
+    esp_err_t restored = light_persist_init(TOTAL_LIGHT_CHANNELS, LIGHT_PERSIST_QUIET_MS_DEFAULT);
+    light_persist_apply_startup();
+    ESP_ERROR_CHECK(light_ep_attrs_init(TOTAL_LIGHT_CHANNELS));
+    light_scenes_init();
+    light_automation_init(s_default_rules, sizeof(s_default_rules) / sizeof(s_default_rules[0]), presence_action_cb);
+
+    // Hardware layout (ASSUMED GPIOs – adjust to your wiring!)
+    // Stairs: one daisy-chained strip, one pixel per stair, each pixel is its own channel/endpoint.
+    // Bed sides: one strip each. The C6 has only two RMT TX channels, so the second bed strip goes out over SPI.
+    static const light_strip_config_t strip_cfg[] = {
+        { .gpio = 2, .led_count = STAIRS_LED_COUNT },
+        { .gpio = 14, .led_count = BED_STRIP_LED_LENGTH },
+        { .gpio = 15, .led_count = BED_STRIP_LED_LENGTH, .backend = LED_OUTPUT_SPI },
     };
-    light_driver_init_channels(channel_cfg, TOTAL_LIGHT_CHANNELS, LIGHT_DEFAULT_OFF);
+    light_segment_config_t segment_cfg[TOTAL_LIGHT_CHANNELS];
+    for (size_t i = 0; i < STAIRS_LED_COUNT; ++i) {
+        segment_cfg[i] = (light_segment_config_t) { .strip = 0, .offset = (uint16_t) i, .led_count = 1 };
+    }
+    for (size_t i = 0; i < BED_STRIP_COUNT; ++i) {
+        segment_cfg[STAIRS_LED_COUNT + i] = (light_segment_config_t) { .strip = (uint8_t) (1 + i), .offset = 0, .led_count = BED_STRIP_LED_LENGTH };
+    }
+    ESP_ERROR_CHECK(light_driver_init_segments(strip_cfg, sizeof(strip_cfg) / sizeof(strip_cfg[0]), segment_cfg,
+                                               TOTAL_LIGHT_CHANNELS, LIGHT_DEFAULT_OFF));
+    light_driver_set_power_budget(LIGHT_POWER_BUDGET_MA);
+    for (size_t i = 0; i < BED_STRIP_COUNT; ++i) {
+        light_driver_set_power_priority_ch(STAIRS_LED_COUNT + i, 1);
+        light_pixels_add_channel(STAIRS_LED_COUNT + i, BED_STRIP_LED_LENGTH);
+    }
+    define_group_effects();
+    esp_err_t anim_err = light_driver_anim_load();
+    if (anim_err != ESP_OK && anim_err != ESP_ERR_NOT_FOUND) ESP_LOGW(TAG, "Animations unavailable: %s", esp_err_to_name(anim_err));
+    // app_main is the only light command producer until the Zigbee task is created below
+    restore_lights();
+    ESP_LOGI(TAG, "%s light state queued %lld us after boot", restored == ESP_OK ? "Stored" : "Default",
+             (long long) esp_timer_get_time());
 
     esp_zb_platform_config_t config = { .radio_config = ESP_ZB_DEFAULT_RADIO_CONFIG(), .host_config = ESP_ZB_DEFAULT_HOST_CONFIG(), };
-    ESP_ERROR_CHECK(nvs_flash_init());
     ESP_ERROR_CHECK(esp_zb_platform_config(&config));
     xTaskCreate(esp_zb_task, "Zigbee_main", 6144, NULL, 5, NULL);
 }
@@ -21,17 +21,37 @@
 #define MODEL_IDENTIFIER                "\x0C""Bed.Lights"
 
 #define BASE_LIGHT_ENDPOINT              1
-#define STAIRS_LED_COUNT                12   // number of individual stair lights (channels)
+#define STAIRS_LED_COUNT                12   // number of individual stair lights (channels, one pixel each on the stair strip)
 #define BED_STRIP_COUNT                 2    // number of bed side strips (channels)
 #define BED_STRIP_LED_LENGTH            60    // assumed length per bed side strip (adjust)
-// NOTE: ESP32-C6 RMT channel count may limit how many strips can be driven simultaneously.
+// NOTE: ESP32-C6 has few RMT TX channels; stairs share one daisy-chained strip (see strip_cfg in app_main()).
 #define TOTAL_LIGHT_CHANNELS            (STAIRS_LED_COUNT + BED_STRIP_COUNT)
 
 #define BOARD_TEMP_ENDPOINT             (BASE_LIGHT_ENDPOINT + TOTAL_LIGHT_CHANNELS)
-#define BOARD_TEMP_UPDATE_INTERVAL_S    5    // seconds between measurements
+#define BOARD_TEMP_INTERVAL_MIN_S       5    // seconds between measurements while the temperature changes
+#define BOARD_TEMP_INTERVAL_MAX_S       60   // backed off to while it is stable
+#define BOARD_TEMP_REPORT_DELTA         20   // centi-degrees the filtered value has to move before the attribute is written
 #define BOARD_TEMP_MIN_C               -10
 #define BOARD_TEMP_MAX_C                85
 
+/* LED supply, see light_power_config_t; stairs are served first so they stay bright when the bed strips go full white */
+#define LIGHT_POWER_BUDGET_MA           4000  // ASSUMED 5 V / 4 A supply, adjust to yours
+#define LIGHT_POWER_REPORT_INTERVAL_MS  1000
+#define LIGHT_POWER_REPORT_DELTA_MA     50
+
+/* Thermal derating of the LED output, driven by the board temperature (see thermal_derate.h) */
+#define BOARD_DERATE_START_C            55   // output is capped above this
+#define BOARD_DERATE_FULL_C             70   // capped to BOARD_DERATE_MIN_PCT from here on
+#define BOARD_DERATE_HYSTERESIS_C       3    // recovery only once the board cooled this much
+#define BOARD_DERATE_MIN_PCT            30
+
+/* Board attributes in the manufacturer cluster on BOARD_TEMP_ENDPOINT (next to the automation rules, light_automation.h) */
+#define BOARD_ATTR_POWER_ESTIMATE_MA    0x0200  // uint16 read-only, estimated LED current after limiting
+#define BOARD_ATTR_POWER_DEMAND_MA      0x0201  // uint16 read-only, estimate before limiting
+#define BOARD_ATTR_POWER_BUDGET_MA      0x0202  // uint16 read-only
+#define BOARD_ATTR_DERATE_STATE         0x0300  // enum8 read-only, thermal_derate_state_t
+#define BOARD_ATTR_DERATE_CAP_PCT       0x0301  // uint8 read-only, output cap in percent
+
 #define ESP_ZB_ZR_CONFIG()                                                              \
     {                                                                                   \
         .esp_zb_role = ESP_ZB_DEVICE_TYPE_ROUTER,                                       \
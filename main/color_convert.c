@@ -0,0 +1,118 @@
+/*
+ * Fixed-point color space conversion for the light driver.
+ */
+
+#include <math.h>
+#include "color_convert.h"
+#include "mired_lut.h"
+
+/* sRGB (D65) XYZ -> linear RGB matrix in Q12 */
+#define Q12(v) ((int32_t) ((v) * 4096.0 + ((v) < 0 ? -0.5 : 0.5)))
+static const int32_t s_xyz_to_rgb[3][3] = {
+    { Q12( 3.240479), Q12(-1.537150), Q12(-0.498535) },
+    { Q12(-0.969256), Q12( 1.875992), Q12( 0.041556) },
+    { Q12( 0.055648), Q12(-0.204043), Q12( 1.057311) },
+};
+
+static inline uint8_t q12_to_u8(int32_t v)
+{
+    if (v <= 0) return 0;
+    if (v >= 4096) return 255;
+    return (uint8_t) ((v * 255 + 2048) >> 12);
+}
+
+bool color_xy_to_rgb(uint16_t x, uint16_t y, color_rgb_t *out)
+{
+    if (y == 0) return false;
+    // With Y = 1: X = x/y and Z = (1-x-y)/y, so each channel is (a*x + b*y + c*z) / y.
+    // All terms stay in the 0..65535 scale, the worst-case sum fits in int32.
+    int32_t z = 65535 - (int32_t) x - (int32_t) y;
+    int32_t c[3];
+    for (int i = 0; i < 3; ++i) {
+        int32_t num = s_xyz_to_rgb[i][0] * (int32_t) x + s_xyz_to_rgb[i][1] * (int32_t) y + s_xyz_to_rgb[i][2] * z;
+        c[i] = num / (int32_t) y;
+    }
+    out->r = q12_to_u8(c[0]);
+    out->g = q12_to_u8(c[1]);
+    out->b = q12_to_u8(c[2]);
+    return true;
+}
+
+static inline void hsv_sector(uint8_t sector, uint8_t p, uint8_t q, uint8_t t, color_rgb_t *out)
+{
+    switch (sector) {
+        case 0: out->r = 255; out->g = t; out->b = p; break;
+        case 1: out->r = q; out->g = 255; out->b = p; break;
+        case 2: out->r = p; out->g = 255; out->b = t; break;
+        case 3: out->r = p; out->g = q; out->b = 255; break;
+        case 4: out->r = t; out->g = p; out->b = 255; break;
+        case 5:
+        default: out->r = 255; out->g = p; out->b = q; break;
+    }
+}
+
+void color_hs_to_rgb(uint8_t hue, uint8_t sat, color_rgb_t *out)
+{
+    // Same 42-step sectors as the original float HSV_to_RGB macro
+    const uint32_t sector = UINT8_MAX / 6;
+    if (sat == 0) { out->r = out->g = out->b = 255; return; }
+    uint32_t f = hue % sector;
+    uint8_t p = (uint8_t) (255 - sat);
+    uint8_t q = (uint8_t) (255 - (sat * f + sector / 2) / sector);
+    uint8_t t = (uint8_t) (255 - (sat * (sector - f) + sector / 2) / sector);
+    hsv_sector((uint8_t) (hue / sector), p, q, t, out);
+}
+
+void color_ehs_to_rgb(uint16_t enhanced_hue, uint8_t sat, color_rgb_t *out)
+{
+    if (sat == 0) { out->r = out->g = out->b = 255; return; }
+    uint32_t h6 = (uint32_t) enhanced_hue * 6;     // sector in the top bits, Q16 fraction below
+    uint32_t f = h6 & 0xFFFF;
+    uint8_t p = (uint8_t) (255 - sat);
+    uint8_t q = (uint8_t) (255 - ((sat * f + 0x8000) >> 16));
+    uint8_t t = (uint8_t) (255 - ((sat * (0x10000 - f) + 0x8000) >> 16));
+    hsv_sector((uint8_t) (h6 >> 16), p, q, t, out);
+}
+
+bool color_rgb_to_ehs(const color_rgb_t *rgb, uint16_t *enhanced_hue, uint8_t *sat)
+{
+    uint8_t r = rgb->r, g = rgb->g, b = rgb->b;
+    uint8_t max = r > g ? (r > b ? r : b) : (g > b ? g : b);
+    uint8_t min = r < g ? (r < b ? r : b) : (g < b ? g : b);
+    if (!max) return false;
+    uint32_t d = max - min;
+    *sat = (uint8_t) ((d * 255 + max / 2) / max);
+    if (!d) { *enhanced_hue = 0; return true; }
+    // sector and the Q16 position of the middle channel inside it, as hsv_sector() lays them out
+    uint32_t sector, mid;
+    bool rising;
+    if (max == r && min == b) { sector = 0; mid = g; rising = true; }
+    else if (max == g && min == b) { sector = 1; mid = r; rising = false; }
+    else if (max == g) { sector = 2; mid = b; rising = true; }
+    else if (max == b && min == r) { sector = 3; mid = g; rising = false; }
+    else if (max == b) { sector = 4; mid = r; rising = true; }
+    else { sector = 5; mid = b; rising = false; }
+    uint32_t f = ((mid - min) * 0x10000 + d / 2) / d;
+    if (!rising) f = 0x10000 - f;
+    *enhanced_hue = (uint16_t) (((sector << 16) + f + 3) / 6);
+    return true;
+}
+
+void color_mired_to_rgb(uint16_t mired, color_rgb_t *out)
+{
+    if (mired < MIRED_LUT_MIN) mired = MIRED_LUT_MIN;
+    if (mired > MIRED_LUT_MAX) mired = MIRED_LUT_MAX;
+    const uint8_t *e = s_mired_lut[mired - MIRED_LUT_MIN];
+    out->r = e[0]; out->g = e[1]; out->b = e[2];
+}
+
+void color_level_lut_build(uint16_t gamma_x100, uint16_t lut[256])
+{
+    float gamma = (float) gamma_x100 / 100.0f;
+    lut[0] = 0;
+    for (int i = 1; i < 256; ++i) {
+        uint32_t v = (uint32_t) (powf((float) i / 255.0f, gamma) * 65535.0f + 0.5f);
+        if (v < 257) v = 257;
+        lut[i] = (uint16_t) (v > 65535 ? 65535 : v);
+    }
+}
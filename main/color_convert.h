@@ -0,0 +1,81 @@
+/*
+ * Fixed-point color space conversion for the light driver.
+ *
+ * The ESP32-C6 has no FPU, so every conversion here runs in integer math:
+ * xy via Q12 sRGB matrix coefficients, hue/saturation via integer sector
+ * interpolation and color temperature via a build-time generated table
+ * (tools/gen_mired_lut.py). Results stay within 1 LSB of the former float
+ * code, except for xy with y below ~0.01 where the matrix rounding grows.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint8_t r, g, b;
+} color_rgb_t;
+
+/**
+* @brief Convert ZCL CurrentX/CurrentY to RGB
+*
+* @param  x    CIE x scaled to 0..65535
+* @param  y    CIE y scaled to 0..65535
+* @param  out  Resulting RGB (full brightness)
+*
+* @return false if y is zero and the color is undefined (out is left untouched)
+*/
+bool color_xy_to_rgb(uint16_t x, uint16_t y, color_rgb_t *out);
+
+/**
+* @brief Convert ZCL CurrentHue/CurrentSaturation to RGB (value fixed at full scale)
+*
+* @param  hue  Hue 0..255
+* @param  sat  Saturation 0..255
+* @param  out  Resulting RGB
+*/
+void color_hs_to_rgb(uint8_t hue, uint8_t sat, color_rgb_t *out);
+
+/**
+* @brief Convert ZCL EnhancedCurrentHue/CurrentSaturation to RGB
+*
+* @param  enhanced_hue  Hue 0..65535 covering the full circle
+* @param  sat           Saturation 0..255
+* @param  out           Resulting RGB
+*/
+void color_ehs_to_rgb(uint16_t enhanced_hue, uint8_t sat, color_rgb_t *out);
+
+/**
+* @brief Convert RGB to EnhancedCurrentHue/CurrentSaturation, the inverse of color_ehs_to_rgb() at full value
+*
+* @return false for black, which has no hue (outputs are left untouched)
+*/
+bool color_rgb_to_ehs(const color_rgb_t *rgb, uint16_t *enhanced_hue, uint8_t *sat);
+
+/**
+* @brief Convert color temperature to RGB, clamped to 153 (6500K) - 500 (2000K) mired
+*
+* @param  mired  Color temperature in mireds
+* @param  out    Resulting RGB
+*/
+void color_mired_to_rgb(uint16_t mired, color_rgb_t *out);
+
+/**
+* @brief Build the level -> Q16 output factor table with a gamma curve folded in
+*
+* Runs at init and on gamma changes only, so it is the one place here that uses float. Entry 0 is 0,
+* every other level is at least 257 so it stays visible on a full-scale component.
+*
+* @param  gamma_x100  Gamma multiplied by 100, 100 = linear
+* @param  lut         Table to fill
+*/
+void color_level_lut_build(uint16_t gamma_x100, uint16_t lut[256]);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
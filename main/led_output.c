@@ -0,0 +1,69 @@
+/*
+ * WS2812 strip output for the light driver.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_check.h"
+#include "led_output_priv.h"
+
+static const char *TAG = "led_output";
+
+esp_err_t led_output_new(const led_output_config_t *cfg, led_output_t **ret)
+{
+    ESP_RETURN_ON_FALSE(cfg && ret && cfg->led_count, ESP_ERR_INVALID_ARG, TAG, "invalid args");
+    switch (cfg->backend) {
+        case LED_OUTPUT_RMT: return led_output_rmt_new(cfg, ret);
+        case LED_OUTPUT_SPI: return led_output_spi_new(cfg, ret);
+        default: return ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+esp_err_t led_output_init_buffers(led_output_t *out, uint16_t led_count)
+{
+    size_t len = (size_t) led_count * LED_OUTPUT_BYTES_PER_PIXEL;
+    out->buf[0] = calloc(2, len);
+    if (!out->buf[0]) return ESP_ERR_NO_MEM;
+    out->buf[1] = out->buf[0] + len;
+    out->led_count = led_count;
+    return ESP_OK;
+}
+
+void led_output_free_buffers(led_output_t *out)
+{
+    free(out->buf[0]);
+    out->buf[0] = out->buf[1] = NULL;
+}
+
+uint8_t *led_output_back_buffer(led_output_t *out) { return out->buf[out->front ^ 1]; }
+
+uint16_t led_output_led_count(const led_output_t *out) { return out->led_count; }
+
+bool led_output_busy(const led_output_t *out) { return out->busy; }
+
+esp_err_t led_output_wait_done(led_output_t *out, int timeout_ms)
+{
+    if (!out->busy) return ESP_OK;
+    return out->ops->wait_done(out, timeout_ms);
+}
+
+esp_err_t led_output_present(led_output_t *out, uint16_t lo, uint16_t hi)
+{
+    // the front buffer is still being read by the peripheral
+    if (out->busy) return ESP_ERR_INVALID_STATE;
+    size_t len = (size_t) out->led_count * LED_OUTPUT_BYTES_PER_PIXEL;
+    out->front ^= 1;
+    out->busy = true;
+    esp_err_t err = out->ops->transmit(out, out->buf[out->front], len);
+    if (err != ESP_OK) {
+        out->busy = false;
+        out->front ^= 1;
+        return err;
+    }
+    if (hi > out->led_count) hi = out->led_count;
+    if (lo < hi) {
+        size_t off = (size_t) lo * LED_OUTPUT_BYTES_PER_PIXEL;
+        memcpy(out->buf[out->front ^ 1] + off, out->buf[out->front] + off, (size_t) (hi - lo) * LED_OUTPUT_BYTES_PER_PIXEL);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,79 @@
+/*
+ * WS2812 strip output for the light driver.
+ *
+ * Each output owns two pixel buffers in wire (GRB) order. The renderer writes
+ * the back buffer directly and led_output_present() hands it to the backend
+ * as-is, so there is no intermediate copy or per-pixel call between the
+ * renderer and the peripheral. Backends: RMT (any GPIO, limited channel
+ * count) and SPI with DMA (one strip on SPI2, no CPU work once the frame is
+ * queued).
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LED_OUTPUT_BYTES_PER_PIXEL 3
+
+typedef enum {
+    LED_OUTPUT_RMT = 0,
+    LED_OUTPUT_SPI,
+} led_output_backend_t;
+
+typedef struct {
+    led_output_backend_t backend;
+    int gpio;
+    uint16_t led_count;
+} led_output_config_t;
+
+typedef struct led_output_t led_output_t;
+
+/**
+* @brief Create a WS2812 output on the configured backend
+*
+* @param  cfg  Backend, data GPIO and pixel count
+* @param  ret  Created output
+*
+* @return ESP_OK on success
+*/
+esp_err_t led_output_new(const led_output_config_t *cfg, led_output_t **ret);
+
+/**
+* @brief Buffer for the next frame, led_count * 3 bytes in GRB order
+*/
+uint8_t *led_output_back_buffer(led_output_t *out);
+
+uint16_t led_output_led_count(const led_output_t *out);
+
+/**
+* @brief Swap buffers and start transmitting the frame just rendered
+*
+* Returns as soon as the transmission is started; the previous one must have completed. Pixels
+* [lo, hi) are the ones that changed; they are carried over into the new back buffer so it again
+* mirrors what is on the strip and can be written right away.
+*
+* @return ESP_ERR_INVALID_STATE while the previous frame is still being sent
+*/
+esp_err_t led_output_present(led_output_t *out, uint16_t lo, uint16_t hi);
+
+/**
+* @brief Whether a frame is still being transmitted
+*/
+bool led_output_busy(const led_output_t *out);
+
+/**
+* @brief Block until the frame in flight is out
+*
+* @param  timeout_ms  Maximum wait, negative waits forever
+*/
+esp_err_t led_output_wait_done(led_output_t *out, int timeout_ms);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
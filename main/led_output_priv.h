@@ -0,0 +1,40 @@
+/*
+ * Backend interface of led_output, shared by the backend implementations only.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include "led_output.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    /* start sending len bytes of GRB data without blocking; the buffer stays untouched until busy clears */
+    esp_err_t (*transmit)(led_output_t *out, const uint8_t *grb, size_t len);
+    /* block until the last transmission is on the wire, timeout_ms < 0 waits forever */
+    esp_err_t (*wait_done)(led_output_t *out, int timeout_ms);
+    void (*del)(led_output_t *out);
+} led_output_ops_t;
+
+/* Common part, embedded first in every backend's own struct */
+struct led_output_t {
+    const led_output_ops_t *ops;
+    uint16_t led_count;
+    uint8_t front;
+    uint8_t *buf[2];
+    volatile bool busy;         // set on transmit, cleared by the backend's completion interrupt
+};
+
+esp_err_t led_output_rmt_new(const led_output_config_t *cfg, led_output_t **ret);
+esp_err_t led_output_spi_new(const led_output_config_t *cfg, led_output_t **ret);
+
+/* Allocates the two frame buffers of a freshly created backend object */
+esp_err_t led_output_init_buffers(led_output_t *out, uint16_t led_count);
+void led_output_free_buffers(led_output_t *out);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
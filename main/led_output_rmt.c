@@ -0,0 +1,160 @@
+/*
+ * RMT backend of led_output: WS2812 bit timing generated by the RMT peripheral.
+ */
+
+#include <stdlib.h>
+#include <sys/cdefs.h>
+#include "esp_attr.h"
+#include "esp_check.h"
+#include "driver/rmt_tx.h"
+#include "led_output_priv.h"
+
+static const char *TAG = "led_output_rmt";
+
+#define WS2812_RESOLUTION_HZ    (10 * 1000 * 1000)  // 0.1 us per tick
+#define WS2812_T0H_TICKS        3                   // 0.3 us
+#define WS2812_T0L_TICKS        9                   // 0.9 us
+#define WS2812_T1H_TICKS        9                   // 0.9 us
+#define WS2812_T1L_TICKS        3                   // 0.3 us
+#define WS2812_RESET_TICKS      250                 // 2 x 25 us low = 50 us latch
+#define RMT_MEM_BLOCK_SYMBOLS   48
+
+/* Bytes encoder for the pixel data followed by a copy encoder for the latch (reset) pulse */
+typedef struct {
+    rmt_encoder_t base;
+    rmt_encoder_t *bytes_encoder;
+    rmt_encoder_t *copy_encoder;
+    int state;
+    rmt_symbol_word_t reset_code;
+} ws2812_encoder_t;
+
+typedef struct {
+    led_output_t base;
+    rmt_channel_handle_t chan;
+    rmt_encoder_handle_t encoder;
+} led_output_rmt_t;
+
+static size_t ws2812_encode(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *data, size_t size,
+                            rmt_encode_state_t *ret_state)
+{
+    ws2812_encoder_t *enc = __containerof(encoder, ws2812_encoder_t, base);
+    rmt_encode_state_t session_state = RMT_ENCODING_RESET;
+    int state = RMT_ENCODING_RESET;
+    size_t encoded = 0;
+    switch (enc->state) {
+        case 0:
+            encoded += enc->bytes_encoder->encode(enc->bytes_encoder, channel, data, size, &session_state);
+            if (session_state & RMT_ENCODING_COMPLETE) enc->state = 1;
+            if (session_state & RMT_ENCODING_MEM_FULL) { state |= RMT_ENCODING_MEM_FULL; break; }
+            // fall through
+        case 1:
+            encoded += enc->copy_encoder->encode(enc->copy_encoder, channel, &enc->reset_code, sizeof(enc->reset_code),
+                                                 &session_state);
+            if (session_state & RMT_ENCODING_COMPLETE) { enc->state = RMT_ENCODING_RESET; state |= RMT_ENCODING_COMPLETE; }
+            if (session_state & RMT_ENCODING_MEM_FULL) state |= RMT_ENCODING_MEM_FULL;
+            break;
+    }
+    *ret_state = (rmt_encode_state_t) state;
+    return encoded;
+}
+
+static esp_err_t ws2812_encoder_reset(rmt_encoder_t *encoder)
+{
+    ws2812_encoder_t *enc = __containerof(encoder, ws2812_encoder_t, base);
+    rmt_encoder_reset(enc->bytes_encoder);
+    rmt_encoder_reset(enc->copy_encoder);
+    enc->state = RMT_ENCODING_RESET;
+    return ESP_OK;
+}
+
+static esp_err_t ws2812_encoder_del(rmt_encoder_t *encoder)
+{
+    ws2812_encoder_t *enc = __containerof(encoder, ws2812_encoder_t, base);
+    if (enc->bytes_encoder) rmt_del_encoder(enc->bytes_encoder);
+    if (enc->copy_encoder) rmt_del_encoder(enc->copy_encoder);
+    free(enc);
+    return ESP_OK;
+}
+
+static esp_err_t ws2812_encoder_new(rmt_encoder_handle_t *ret)
+{
+    ws2812_encoder_t *enc = calloc(1, sizeof(*enc));
+    ESP_RETURN_ON_FALSE(enc, ESP_ERR_NO_MEM, TAG, "no mem for encoder");
+    enc->base.encode = ws2812_encode;
+    enc->base.reset = ws2812_encoder_reset;
+    enc->base.del = ws2812_encoder_del;
+    rmt_bytes_encoder_config_t bytes_cfg = {
+        .bit0 = { .level0 = 1, .duration0 = WS2812_T0H_TICKS, .level1 = 0, .duration1 = WS2812_T0L_TICKS },
+        .bit1 = { .level0 = 1, .duration0 = WS2812_T1H_TICKS, .level1 = 0, .duration1 = WS2812_T1L_TICKS },
+        .flags.msb_first = 1,
+    };
+    rmt_copy_encoder_config_t copy_cfg = { 0 };
+    esp_err_t err = rmt_new_bytes_encoder(&bytes_cfg, &enc->bytes_encoder);
+    if (err == ESP_OK) err = rmt_new_copy_encoder(&copy_cfg, &enc->copy_encoder);
+    if (err != ESP_OK) { ws2812_encoder_del(&enc->base); return err; }
+    enc->reset_code = (rmt_symbol_word_t) { .level0 = 0, .duration0 = WS2812_RESET_TICKS, .level1 = 0, .duration1 = WS2812_RESET_TICKS };
+    *ret = &enc->base;
+    return ESP_OK;
+}
+
+static esp_err_t rmt_output_transmit(led_output_t *out, const uint8_t *grb, size_t len)
+{
+    led_output_rmt_t *rmt = __containerof(out, led_output_rmt_t, base);
+    const rmt_transmit_config_t tx_cfg = { .loop_count = 0 };
+    return rmt_transmit(rmt->chan, rmt->encoder, grb, len, &tx_cfg);
+}
+
+static esp_err_t rmt_output_wait_done(led_output_t *out, int timeout_ms)
+{
+    led_output_rmt_t *rmt = __containerof(out, led_output_rmt_t, base);
+    return rmt_tx_wait_all_done(rmt->chan, timeout_ms);
+}
+
+static bool IRAM_ATTR rmt_output_done_isr(rmt_channel_handle_t chan, const rmt_tx_done_event_data_t *edata, void *ctx)
+{
+    ((led_output_t *) ctx)->busy = false;
+    return false;
+}
+
+static void rmt_output_del(led_output_t *out)
+{
+    led_output_rmt_t *rmt = __containerof(out, led_output_rmt_t, base);
+    if (rmt->chan) rmt_tx_wait_all_done(rmt->chan, -1);
+    if (rmt->encoder) rmt_del_encoder(rmt->encoder);
+    if (rmt->chan) rmt_del_channel(rmt->chan);
+    led_output_free_buffers(out);
+    free(rmt);
+}
+
+static const led_output_ops_t s_rmt_ops = {
+    .transmit = rmt_output_transmit,
+    .wait_done = rmt_output_wait_done,
+    .del = rmt_output_del,
+};
+
+esp_err_t led_output_rmt_new(const led_output_config_t *cfg, led_output_t **ret)
+{
+    esp_err_t err = ESP_ERR_NO_MEM;
+    led_output_rmt_t *rmt = calloc(1, sizeof(*rmt));
+    ESP_RETURN_ON_FALSE(rmt, ESP_ERR_NO_MEM, TAG, "no mem for output");
+    rmt->base.ops = &s_rmt_ops;
+    if ((err = led_output_init_buffers(&rmt->base, cfg->led_count)) != ESP_OK) goto fail;
+
+    rmt_tx_channel_config_t chan_cfg = {
+        .gpio_num = cfg->gpio,
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .resolution_hz = WS2812_RESOLUTION_HZ,
+        .mem_block_symbols = RMT_MEM_BLOCK_SYMBOLS,
+        .trans_queue_depth = 4,
+    };
+    if ((err = rmt_new_tx_channel(&chan_cfg, &rmt->chan)) != ESP_OK) goto fail;
+    if ((err = ws2812_encoder_new(&rmt->encoder)) != ESP_OK) goto fail;
+    const rmt_tx_event_callbacks_t cbs = { .on_trans_done = rmt_output_done_isr };
+    if ((err = rmt_tx_register_event_callbacks(rmt->chan, &cbs, &rmt->base)) != ESP_OK) goto fail;
+    if ((err = rmt_enable(rmt->chan)) != ESP_OK) goto fail;
+    *ret = &rmt->base;
+    return ESP_OK;
+fail:
+    rmt_output_del(&rmt->base);
+    return err;
+}
@@ -0,0 +1,141 @@
+/*
+ * SPI backend of led_output: each WS2812 bit is sent as three SPI bits (1 -> 110, 0 -> 100) at
+ * 2.5 MHz, so every bit is 1.2 us with a 0.4 / 0.8 us high time. The frame is expanded once into a
+ * DMA-capable buffer and queued; the transfer runs without CPU involvement and post_cb flags completion. MOSI is the data line,
+ * clock and CS are not routed. Only one SPI output exists since it takes the whole SPI2 bus.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/cdefs.h>
+#include "esp_attr.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "driver/spi_master.h"
+#include "led_output_priv.h"
+
+static const char *TAG = "led_output_spi";
+
+#define WS2812_SPI_HOST         SPI2_HOST
+#define WS2812_SPI_CLOCK_HZ     (2500 * 1000)   // 0.4 us per SPI bit
+#define WS2812_SPI_BYTES_PER_BYTE 3
+#define WS2812_SPI_RESET_BYTES  24              // 77 us low for the latch
+
+typedef struct {
+    led_output_t base;
+    spi_device_handle_t dev;
+    spi_transaction_t trans;
+    uint8_t *dma_buf;
+    size_t dma_len;
+    bool bus_ready;
+    bool queued;
+} led_output_spi_t;
+
+/* Three SPI bytes per pixel byte, MSB first */
+static uint8_t s_expand[256][WS2812_SPI_BYTES_PER_BYTE];
+
+static void build_expand_lut(void)
+{
+    for (int v = 0; v < 256; v++) {
+        uint32_t bits = 0;
+        for (int i = 7; i >= 0; i--) bits = (bits << 3) | ((v >> i) & 1 ? 0x6 : 0x4);
+        s_expand[v][0] = bits >> 16;
+        s_expand[v][1] = bits >> 8;
+        s_expand[v][2] = bits;
+    }
+}
+
+static esp_err_t spi_output_transmit(led_output_t *out, const uint8_t *grb, size_t len)
+{
+    led_output_spi_t *spi = __containerof(out, led_output_spi_t, base);
+    // reclaim the finished transaction; busy is clear so this does not wait
+    if (spi->queued) {
+        spi_transaction_t *done;
+        spi_device_get_trans_result(spi->dev, &done, portMAX_DELAY);
+        spi->queued = false;
+    }
+    uint8_t *dst = spi->dma_buf;
+    for (size_t i = 0; i < len; i++, dst += WS2812_SPI_BYTES_PER_BYTE) {
+        const uint8_t *e = s_expand[grb[i]];
+        dst[0] = e[0];
+        dst[1] = e[1];
+        dst[2] = e[2];
+    }
+    spi->trans = (spi_transaction_t) { .length = spi->dma_len * 8, .tx_buffer = spi->dma_buf, .user = out };
+    esp_err_t err = spi_device_queue_trans(spi->dev, &spi->trans, portMAX_DELAY);
+    spi->queued = (err == ESP_OK);
+    return err;
+}
+
+static esp_err_t spi_output_wait_done(led_output_t *out, int timeout_ms)
+{
+    led_output_spi_t *spi = __containerof(out, led_output_spi_t, base);
+    if (!spi->queued) return ESP_OK;
+    spi_transaction_t *done;
+    esp_err_t err = spi_device_get_trans_result(spi->dev, &done, timeout_ms < 0 ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms));
+    if (err == ESP_OK) spi->queued = false;
+    return err;
+}
+
+static void IRAM_ATTR spi_output_done_isr(spi_transaction_t *t)
+{
+    ((led_output_t *) t->user)->busy = false;
+}
+
+static void spi_output_del(led_output_t *out)
+{
+    led_output_spi_t *spi = __containerof(out, led_output_spi_t, base);
+    spi_output_wait_done(out, -1);
+    if (spi->dev) spi_bus_remove_device(spi->dev);
+    if (spi->bus_ready) spi_bus_free(WS2812_SPI_HOST);
+    heap_caps_free(spi->dma_buf);
+    led_output_free_buffers(out);
+    free(spi);
+}
+
+static const led_output_ops_t s_spi_ops = {
+    .transmit = spi_output_transmit,
+    .wait_done = spi_output_wait_done,
+    .del = spi_output_del,
+};
+
+esp_err_t led_output_spi_new(const led_output_config_t *cfg, led_output_t **ret)
+{
+    esp_err_t err = ESP_ERR_NO_MEM;
+    led_output_spi_t *spi = calloc(1, sizeof(*spi));
+    ESP_RETURN_ON_FALSE(spi, ESP_ERR_NO_MEM, TAG, "no mem for output");
+    spi->base.ops = &s_spi_ops;
+    if ((err = led_output_init_buffers(&spi->base, cfg->led_count)) != ESP_OK) goto fail;
+
+    // Trailing zero bytes hold the line low for the latch; they are never overwritten
+    spi->dma_len = (size_t) cfg->led_count * LED_OUTPUT_BYTES_PER_PIXEL * WS2812_SPI_BYTES_PER_BYTE + WS2812_SPI_RESET_BYTES;
+    spi->dma_buf = heap_caps_calloc(1, spi->dma_len, MALLOC_CAP_DMA);
+    if (!spi->dma_buf) { err = ESP_ERR_NO_MEM; goto fail; }
+    build_expand_lut();
+
+    spi_bus_config_t bus_cfg = {
+        .mosi_io_num = cfg->gpio,
+        .miso_io_num = -1,
+        .sclk_io_num = -1,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = spi->dma_len,
+    };
+    if ((err = spi_bus_initialize(WS2812_SPI_HOST, &bus_cfg, SPI_DMA_CH_AUTO)) != ESP_OK) goto fail;
+    spi->bus_ready = true;
+
+    spi_device_interface_config_t dev_cfg = {
+        .mode = 0,
+        .clock_speed_hz = WS2812_SPI_CLOCK_HZ,
+        .spics_io_num = -1,
+        .queue_size = 1,
+        .post_cb = spi_output_done_isr,
+    };
+    if ((err = spi_bus_add_device(WS2812_SPI_HOST, &dev_cfg, &spi->dev)) != ESP_OK) goto fail;
+    *ret = &spi->base;
+    return ESP_OK;
+fail:
+    ESP_LOGE(TAG, "SPI output on GPIO %d failed: %s", cfg->gpio, esp_err_to_name(err));
+    spi_output_del(&spi->base);
+    return err;
+}
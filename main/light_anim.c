@@ -0,0 +1,132 @@
+/*
+ * Keyframe animation library: image validation and integer evaluation.
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "light_anim.h"
+
+static const char *TAG = "light_anim";
+
+static inline const light_anim_index_t *anim_index(const light_anim_lib_t *lib)
+{
+    return (const light_anim_index_t *) (lib->image + sizeof(light_anim_file_t));
+}
+
+// Checks one animation lies inside the image and its keys are in time order; returns false on a bad record
+static bool anim_valid(const uint8_t *image, size_t size, uint32_t offset)
+{
+    if (offset > size || size - offset < sizeof(light_anim_header_t)) return false;
+    const light_anim_header_t *a = (const light_anim_header_t *) (image + offset);
+    if (!a->duration_10ms || !a->track_count || a->track_count > LIGHT_ANIM_TRACKS_MAX) return false;
+    size_t pos = offset + sizeof(*a);
+    for (uint8_t t = 0; t < a->track_count; ++t) {
+        if (size - pos < sizeof(light_anim_track_t)) return false;
+        const light_anim_track_t *tr = (const light_anim_track_t *) (image + pos);
+        pos += sizeof(*tr);
+        if (!tr->key_count || tr->seg_lo > tr->seg_hi) return false;
+        if ((size - pos) / sizeof(light_anim_key_t) < tr->key_count) return false;
+        const light_anim_key_t *k = (const light_anim_key_t *) (image + pos);
+        for (uint8_t i = 0; i < tr->key_count; ++i) {
+            if (k[i].easing > LIGHT_ANIM_EASE_STEP) return false;
+            if (i && k[i].t_10ms < k[i - 1].t_10ms) return false;
+        }
+        pos += (size_t) tr->key_count * sizeof(light_anim_key_t);
+    }
+    return true;
+}
+
+esp_err_t light_anim_open(const void *image, size_t size, light_anim_lib_t *lib)
+{
+    if (!image || !lib) return ESP_ERR_INVALID_ARG;
+    memset(lib, 0, sizeof(*lib));
+    const light_anim_file_t *f = (const light_anim_file_t *) image;
+    if (size < sizeof(*f) || memcmp(f->magic, LIGHT_ANIM_MAGIC, 4) != 0) return ESP_ERR_NOT_FOUND;
+    if (f->version != LIGHT_ANIM_VERSION || f->size > size ||
+        (f->size - sizeof(*f)) / sizeof(light_anim_index_t) < f->count) {
+        ESP_LOGE(TAG, "Unsupported animation image (version %u, %u bytes)", f->version, (unsigned) f->size);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    const light_anim_index_t *idx = (const light_anim_index_t *) ((const uint8_t *) image + sizeof(*f));
+    for (uint16_t i = 0; i < f->count; ++i) {
+        if (!anim_valid(image, f->size, idx[i].offset)) {
+            ESP_LOGE(TAG, "Animation %u (%.*s) is corrupt", i, LIGHT_ANIM_NAME_LEN, idx[i].name);
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+    lib->image = image;
+    lib->size = f->size;
+    lib->count = f->count;
+    return ESP_OK;
+}
+
+int light_anim_find(const light_anim_lib_t *lib, const char *name)
+{
+    if (!lib || !lib->image || !name) return -1;
+    const light_anim_index_t *idx = anim_index(lib);
+    for (uint16_t i = 0; i < lib->count; ++i) {
+        if (strncmp(idx[i].name, name, LIGHT_ANIM_NAME_LEN) == 0) return i;
+    }
+    return -1;
+}
+
+// Q16 progress through an easing curve
+static uint32_t ease(uint8_t easing, uint32_t p)
+{
+    switch (easing) {
+        case LIGHT_ANIM_EASE_IN: return (p * p) >> 16;
+        case LIGHT_ANIM_EASE_OUT: { uint32_t q = 0x10000 - p; return 0x10000 - ((q * q) >> 16); }
+        case LIGHT_ANIM_EASE_IN_OUT: {
+            // smoothstep p^2 (3 - 2p)
+            uint32_t p2 = (p * p) >> 16;
+            return (uint32_t) (((uint64_t) p2 * (0x30000 - 2 * p)) >> 16);
+        }
+        case LIGHT_ANIM_EASE_STEP: return 0;
+        case LIGHT_ANIM_EASE_LINEAR:
+        default: return p;
+    }
+}
+
+static inline uint8_t lerp8(uint8_t a, uint8_t b, uint32_t p)
+{
+    return (uint8_t) (a + (((int32_t) b - a) * (int32_t) (p >> 1) >> 15));
+}
+
+bool light_anim_eval(const light_anim_lib_t *lib, uint16_t idx, uint32_t t_ms, uint16_t led_count,
+                     light_anim_span_t *spans, size_t *count)
+{
+    *count = 0;
+    if (!lib || !lib->image || idx >= lib->count) return false;
+    const light_anim_header_t *a = (const light_anim_header_t *) (lib->image + anim_index(lib)[idx].offset);
+    uint32_t duration = (uint32_t) a->duration_10ms * 10;
+    if (a->flags & LIGHT_ANIM_FLAG_LOOP) t_ms %= duration;
+    else if (t_ms >= duration) return false;
+    uint32_t t = t_ms / 10;
+
+    const uint8_t *pos = (const uint8_t *) (a + 1);
+    for (uint8_t n = 0; n < a->track_count; ++n) {
+        const light_anim_track_t *tr = (const light_anim_track_t *) pos;
+        const light_anim_key_t *k = (const light_anim_key_t *) (tr + 1);
+        pos = (const uint8_t *) (k + tr->key_count);
+
+        // last key at or before t; before the first key the first one holds
+        uint8_t i = 0;
+        while (i + 1 < tr->key_count && k[i + 1].t_10ms <= t) ++i;
+        const light_anim_key_t *k0 = &k[i];
+        const light_anim_key_t *k1 = i + 1 < tr->key_count ? &k[i + 1] : k0;
+        uint32_t p = 0;
+        if (k1 != k0 && t > k0->t_10ms) {
+            p = ease(k0->easing, ((t - k0->t_10ms) << 16) / (k1->t_10ms - k0->t_10ms));
+        }
+        light_anim_span_t *s = &spans[(*count)++];
+        s->px_lo = (uint16_t) ((uint32_t) tr->seg_lo * led_count / 255);
+        s->px_hi = (uint16_t) (((uint32_t) tr->seg_hi * led_count + 254) / 255);
+        if (s->px_hi > led_count) s->px_hi = led_count;
+        for (int c = 0; c < 3; ++c) {
+            s->c0[c] = lerp8(k0->c0[c], k1->c0[c], p);
+            s->c1[c] = lerp8(k0->c1[c], k1->c1[c], p);
+        }
+        s->level = lerp8(k0->level, k1->level, p);
+    }
+    return true;
+}
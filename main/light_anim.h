@@ -0,0 +1,120 @@
+/*
+ * Keyframe animation library, read in place from a memory-mapped data partition.
+ *
+ * Image layout (little endian, packed), produced by tools/anim_compile.py:
+ *
+ *   light_anim_file_t                   magic, version, animation count, image size
+ *   light_anim_index_t[count]           name and offset of every animation
+ *   per animation:
+ *     light_anim_header_t               duration, flags, track count
+ *     per track:
+ *       light_anim_track_t              pixel range of the channel (fractions of its length), key count
+ *       light_anim_key_t[key_count]     time, easing towards the next key, level and a color ramp
+ *
+ * A track colors its segment with a ramp from c0 (first pixel) to c1 (last pixel); between two keys
+ * the ramp ends and the level are interpolated with the first key's easing, after the last key the
+ * values hold. Pixels covered by no track are dark. The image is validated once when it is opened,
+ * so evaluation does no bounds checks.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LIGHT_ANIM_PARTITION_LABEL      "anim"
+#define LIGHT_ANIM_PARTITION_SUBTYPE    0x40
+#define LIGHT_ANIM_MAGIC                "LANM"
+#define LIGHT_ANIM_VERSION              1
+#define LIGHT_ANIM_NAME_LEN             12
+#define LIGHT_ANIM_TRACKS_MAX           8
+#define LIGHT_ANIM_FLAG_LOOP            0x01
+
+typedef enum {
+    LIGHT_ANIM_EASE_LINEAR = 0,
+    LIGHT_ANIM_EASE_IN,
+    LIGHT_ANIM_EASE_OUT,
+    LIGHT_ANIM_EASE_IN_OUT,
+    LIGHT_ANIM_EASE_STEP,           // hold until the next key
+} light_anim_easing_t;
+
+typedef struct __attribute__((packed)) {
+    char magic[4];
+    uint16_t version;
+    uint16_t count;
+    uint32_t size;                  // bytes of the whole image
+    uint32_t reserved;
+} light_anim_file_t;
+
+typedef struct __attribute__((packed)) {
+    char name[LIGHT_ANIM_NAME_LEN]; // NUL padded
+    uint32_t offset;                // of the light_anim_header_t from the start of the image
+} light_anim_index_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t duration_10ms;
+    uint8_t flags;                  // LIGHT_ANIM_FLAG_*
+    uint8_t track_count;
+} light_anim_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t seg_lo, seg_hi;         // segment [lo, hi] in 1/255 of the channel length
+    uint8_t key_count;
+    uint8_t reserved;
+} light_anim_track_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t t_10ms;
+    uint8_t easing;                 // light_anim_easing_t towards the next key
+    uint8_t level;
+    uint8_t c0[3];                  // RGB at the first pixel of the segment
+    uint8_t c1[3];                  // RGB at the last pixel
+    uint16_t reserved;
+} light_anim_key_t;
+
+_Static_assert(sizeof(light_anim_file_t) == 16 && sizeof(light_anim_index_t) == 16, "image layout");
+_Static_assert(sizeof(light_anim_header_t) == 4 && sizeof(light_anim_track_t) == 4 && sizeof(light_anim_key_t) == 12, "image layout");
+
+typedef struct {
+    const uint8_t *image;
+    size_t size;
+    uint16_t count;
+} light_anim_lib_t;
+
+/* One evaluated track: ramp c0..c1 over channel pixels [px_lo, px_hi) at level */
+typedef struct {
+    uint16_t px_lo, px_hi;
+    uint8_t c0[3], c1[3];
+    uint8_t level;
+} light_anim_span_t;
+
+/**
+* @brief Validate an image and make it the library; the image is used in place and must stay mapped
+*/
+esp_err_t light_anim_open(const void *image, size_t size, light_anim_lib_t *lib);
+
+/**
+* @brief Index of the animation called name, -1 if there is none
+*/
+int light_anim_find(const light_anim_lib_t *lib, const char *name);
+
+/**
+* @brief Evaluate animation idx at t_ms since it started for a channel of led_count pixels
+*
+* @param  spans  Receives up to LIGHT_ANIM_TRACKS_MAX spans
+* @param  count  Receives the number of spans
+*
+* @return false once a non-looping animation is over
+*/
+bool light_anim_eval(const light_anim_lib_t *lib, uint16_t idx, uint32_t t_ms, uint16_t led_count,
+                     light_anim_span_t *spans, size_t *count);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,242 @@
+/*
+ * Presence automation: threshold / hysteresis / hold rules over ultrasonic readings.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_zigbee_core.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+#include "light_automation.h"
+
+static const char *TAG = "light_automation";
+
+#define AUTOMATION_NAMESPACE    "automation"
+#define AUTOMATION_KEY          "rules"
+#define AUTOMATION_VERSION      2   // 2: 64-bit channel masks
+#define AUTOMATION_SAVE_QUIET_MS        2000    // a configuration tool writes a rule field by field
+#define AUTOMATION_SAVE_MAX_LATENCY_MS  10000   // upper bound from the first unsaved change to the write
+
+typedef enum {
+    RULE_IDLE = 0,
+    RULE_PRESENT,               // presence seen, lights on
+    RULE_HOLDING,               // presence gone, waiting out the hold time
+} rule_state_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t rule_size;
+    uint8_t rules;
+    light_automation_rule_t rule[LIGHT_AUTOMATION_RULES_MAX];
+} automation_blob_t;
+
+typedef struct {
+    uint8_t offset;
+    uint8_t size;
+    uint8_t type;               // esp_zb_zcl_attr_type_t
+} rule_field_t;
+
+static const rule_field_t s_fields[LIGHT_AUTOMATION_ATTR_FIELDS] = {
+    [LIGHT_AUTOMATION_ATTR_ENABLED] = { offsetof(light_automation_rule_t, enabled), 1, ESP_ZB_ZCL_ATTR_TYPE_BOOL },
+    [LIGHT_AUTOMATION_ATTR_SENSOR] = { offsetof(light_automation_rule_t, sensor), 1, ESP_ZB_ZCL_ATTR_TYPE_U8 },
+    [LIGHT_AUTOMATION_ATTR_NEAR_CM] = { offsetof(light_automation_rule_t, near_cm), 2, ESP_ZB_ZCL_ATTR_TYPE_U16 },
+    [LIGHT_AUTOMATION_ATTR_HYSTERESIS_CM] = { offsetof(light_automation_rule_t, hysteresis_cm), 2, ESP_ZB_ZCL_ATTR_TYPE_U16 },
+    [LIGHT_AUTOMATION_ATTR_HOLD_S] = { offsetof(light_automation_rule_t, hold_s), 2, ESP_ZB_ZCL_ATTR_TYPE_U16 },
+    [LIGHT_AUTOMATION_ATTR_CHANNELS] = { offsetof(light_automation_rule_t, channels), 8, ESP_ZB_ZCL_ATTR_TYPE_64BITMAP },
+    [LIGHT_AUTOMATION_ATTR_LEVEL] = { offsetof(light_automation_rule_t, level), 1, ESP_ZB_ZCL_ATTR_TYPE_U8 },
+    [LIGHT_AUTOMATION_ATTR_FADE_DS] = { offsetof(light_automation_rule_t, fade_ds), 2, ESP_ZB_ZCL_ATTR_TYPE_U16 },
+    [LIGHT_AUTOMATION_ATTR_OFF_FADE_DS] = { offsetof(light_automation_rule_t, off_fade_ds), 2, ESP_ZB_ZCL_ATTR_TYPE_U16 },
+    [LIGHT_AUTOMATION_ATTR_EFFECT] = { offsetof(light_automation_rule_t, effect), 1, ESP_ZB_ZCL_ATTR_TYPE_U8 },
+};
+
+static automation_blob_t s_blob;
+static rule_state_t s_state[LIGHT_AUTOMATION_RULES_MAX];
+static int64_t s_hold_until_us[LIGHT_AUTOMATION_RULES_MAX];
+static light_automation_action_cb_t s_action;
+static light_automation_stats_t s_stats;
+static SemaphoreHandle_t s_lock;    // rules are written by the Zigbee task and read by the ranging task
+static automation_blob_t s_written; // what NVS holds, only touched by the Zigbee task
+static bool s_save_armed;
+static uint32_t s_first_change_ms;
+
+static inline uint32_t now_ms(void) { return (uint32_t) (esp_timer_get_time() / 1000); }
+
+static esp_err_t rules_save(void)
+{
+    automation_blob_t blob;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    blob = s_blob;
+    xSemaphoreGive(s_lock);
+    // changed and changed back before the alarm ran
+    if (!memcmp(&blob, &s_written, sizeof(blob))) return ESP_OK;
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(AUTOMATION_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, AUTOMATION_KEY, &blob, sizeof(blob));
+        if (err == ESP_OK) err = nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+    if (err == ESP_OK) s_written = blob;
+    else ESP_LOGE(TAG, "Saving rules failed: %s", esp_err_to_name(err));
+    return err;
+}
+
+static void rules_save_cb(uint8_t param)
+{
+    s_save_armed = false;
+    rules_save();
+}
+
+// Same debounce as light_persist: re-armed on every change, never past the max latency from the first one
+static void rules_touch(void)
+{
+    uint32_t now = now_ms();
+    if (!s_save_armed) {
+        s_save_armed = true;
+        s_first_change_ms = now;
+    } else {
+        esp_zb_scheduler_alarm_cancel(rules_save_cb, 0);
+    }
+    uint32_t waited = now - s_first_change_ms;
+    uint32_t delay = AUTOMATION_SAVE_QUIET_MS;
+    if (waited + delay > AUTOMATION_SAVE_MAX_LATENCY_MS) {
+        delay = waited < AUTOMATION_SAVE_MAX_LATENCY_MS ? AUTOMATION_SAVE_MAX_LATENCY_MS - waited : 0;
+    }
+    esp_zb_scheduler_alarm(rules_save_cb, 0, delay);
+}
+
+esp_err_t light_automation_init(const light_automation_rule_t *defaults, size_t count, light_automation_action_cb_t action)
+{
+    if (count > LIGHT_AUTOMATION_RULES_MAX || (count && !defaults)) return ESP_ERR_INVALID_ARG;
+    if (!s_lock) s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) return ESP_ERR_NO_MEM;
+    s_action = action;
+
+    nvs_handle_t nvs;
+    size_t len = sizeof(s_blob);
+    esp_err_t err = nvs_open(AUTOMATION_NAMESPACE, NVS_READONLY, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(nvs, AUTOMATION_KEY, &s_blob, &len);
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK || len != sizeof(s_blob) || s_blob.version != AUTOMATION_VERSION ||
+        s_blob.rule_size != sizeof(light_automation_rule_t) || s_blob.rules != LIGHT_AUTOMATION_RULES_MAX) {
+        memset(&s_blob, 0, sizeof(s_blob));
+        for (size_t i = 0; i < LIGHT_AUTOMATION_RULES_MAX; ++i) s_blob.rule[i].effect = LIGHT_AUTOMATION_NO_EFFECT;
+        if (count) memcpy(s_blob.rule, defaults, count * sizeof(defaults[0]));
+        s_blob.version = AUTOMATION_VERSION;
+        s_blob.rule_size = sizeof(light_automation_rule_t);
+        s_blob.rules = LIGHT_AUTOMATION_RULES_MAX;
+        err = ESP_ERR_NOT_FOUND;
+    }
+    // defaults stay unwritten until a rule is changed
+    s_written = s_blob;
+    memset(s_state, 0, sizeof(s_state));
+    ESP_LOGI(TAG, "%s rules loaded", err == ESP_OK ? "Stored" : "Default");
+    return ESP_OK;
+}
+
+bool light_automation_get_rule(uint8_t idx, light_automation_rule_t *out)
+{
+    if (idx >= LIGHT_AUTOMATION_RULES_MAX || !out) return false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_blob.rule[idx];
+    xSemaphoreGive(s_lock);
+    return true;
+}
+
+bool light_automation_attr_info(size_t i, uint16_t *attr_id, uint8_t *type, void **value)
+{
+    if (i >= (size_t) LIGHT_AUTOMATION_RULES_MAX * LIGHT_AUTOMATION_ATTR_FIELDS) return false;
+    size_t rule = i / LIGHT_AUTOMATION_ATTR_FIELDS, field = i % LIGHT_AUTOMATION_ATTR_FIELDS;
+    *attr_id = (uint16_t) (rule * LIGHT_AUTOMATION_ATTR_STRIDE + field);
+    *type = s_fields[field].type;
+    *value = (uint8_t *) &s_blob.rule[rule] + s_fields[field].offset;
+    return true;
+}
+
+esp_err_t light_automation_set_attr(uint16_t attr_id, const void *value)
+{
+    size_t rule = attr_id / LIGHT_AUTOMATION_ATTR_STRIDE, field = attr_id % LIGHT_AUTOMATION_ATTR_STRIDE;
+    if (rule >= LIGHT_AUTOMATION_RULES_MAX || field >= LIGHT_AUTOMATION_ATTR_FIELDS) return ESP_ERR_NOT_FOUND;
+    if (!value) return ESP_ERR_INVALID_ARG;
+    uint8_t *dst = (uint8_t *) &s_blob.rule[rule] + s_fields[field].offset;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool changed = memcmp(dst, value, s_fields[field].size) != 0;
+    if (changed) {
+        memcpy(dst, value, s_fields[field].size);
+        // a reconfigured rule starts over; lights it switched on stay on until the next trigger/hold cycle
+        s_state[rule] = RULE_IDLE;
+    }
+    xSemaphoreGive(s_lock);
+    if (changed) rules_touch();
+    return ESP_OK;
+}
+
+void light_automation_process(const ultrasonic_result_t *result, void *arg)
+{
+    if (!result || !s_lock) return;
+    // a stuck echo line says nothing about presence, but still advances the clock hold times run on;
+    // no echo at all means nothing in range
+    bool unknown = result->err == ESP_ERR_ULTRASONIC_PING;
+    bool valid = result->err == ESP_OK;
+
+    light_automation_rule_t fired[LIGHT_AUTOMATION_RULES_MAX];
+    bool fired_on[LIGHT_AUTOMATION_RULES_MAX];
+    size_t nfired = 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.readings++;
+    for (size_t i = 0; i < LIGHT_AUTOMATION_RULES_MAX; ++i) {
+        const light_automation_rule_t *r = &s_blob.rule[i];
+        if (!r->enabled || r->sensor != result->sensor) continue;
+        bool near = valid && result->distance_cm < r->near_cm;
+        bool far = !valid || result->distance_cm >= (uint32_t) r->near_cm + r->hysteresis_cm;
+        if (unknown) {
+            // only an expired hold acts on a reading without a distance
+            near = far = false;
+            if (s_state[i] != RULE_HOLDING) continue;
+        }
+        switch (s_state[i]) {
+            case RULE_IDLE:
+                if (!near) break;
+                s_state[i] = RULE_PRESENT;
+                fired_on[nfired] = true;
+                fired[nfired++] = *r;
+                s_stats.triggers++;
+                break;
+            case RULE_PRESENT:
+                if (!far) break;
+                s_state[i] = RULE_HOLDING;
+                s_hold_until_us[i] = result->timestamp_us + (int64_t) r->hold_s * 1000000;
+                break;
+            case RULE_HOLDING:
+                if (near) {
+                    s_state[i] = RULE_PRESENT;
+                } else if (result->timestamp_us >= s_hold_until_us[i]) {
+                    s_state[i] = RULE_IDLE;
+                    fired_on[nfired] = false;
+                    fired[nfired++] = *r;
+                    s_stats.releases++;
+                }
+                break;
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    // actions take the Zigbee lock, never while holding ours (the Zigbee task takes ours in set_attr)
+    for (size_t i = 0; i < nfired; ++i) {
+        if (s_action) s_action(&fired[i], fired_on[i], result->timestamp_us);
+    }
+}
+
+void light_automation_get_stats(light_automation_stats_t *out)
+{
+    if (!out || !s_lock) return;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *out = s_stats;
+    xSemaphoreGive(s_lock);
+}
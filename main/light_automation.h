@@ -0,0 +1,110 @@
+/*
+ * On-device presence automation.
+ *
+ * Rules turn ultrasonic readings into light actions without a round trip through the coordinator:
+ * a rule fires when its sensor reads closer than near_cm, is released once the reading stays beyond
+ * near_cm + hysteresis_cm, and switches its channels off after hold_s without presence. Readings
+ * are evaluated in the ranging task as they arrive; the actions themselves are carried out by the
+ * application callback. Rules are exposed as attributes of a manufacturer-specific cluster (one
+ * block of LIGHT_AUTOMATION_ATTR_STRIDE ids per rule) and kept in NVS.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "ultrasonic.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LIGHT_AUTOMATION_CLUSTER_ID     0xFC00
+#define LIGHT_AUTOMATION_RULES_MAX      4
+#define LIGHT_AUTOMATION_ATTR_STRIDE    0x10    // attribute id = rule * stride + field
+#define LIGHT_AUTOMATION_NO_EFFECT      0xFF
+#define LIGHT_AUTOMATION_ATTR_DISTANCE  0x0100  // + sensor index: filtered distance in cm, uint16 read-only
+
+/* Rule fields, attribute id offsets within a rule block */
+typedef enum {
+    LIGHT_AUTOMATION_ATTR_ENABLED = 0,  // bool
+    LIGHT_AUTOMATION_ATTR_SENSOR,       // uint8, ultrasonic sensor index
+    LIGHT_AUTOMATION_ATTR_NEAR_CM,      // uint16
+    LIGHT_AUTOMATION_ATTR_HYSTERESIS_CM,// uint16
+    LIGHT_AUTOMATION_ATTR_HOLD_S,       // uint16
+    LIGHT_AUTOMATION_ATTR_CHANNELS,     // bitmap64, bit n = channel n
+    LIGHT_AUTOMATION_ATTR_LEVEL,        // uint8
+    LIGHT_AUTOMATION_ATTR_FADE_DS,      // uint16, fade-in time in 1/10 s
+    LIGHT_AUTOMATION_ATTR_OFF_FADE_DS,  // uint16, fade-out time in 1/10 s
+    LIGHT_AUTOMATION_ATTR_EFFECT,       // uint8, group effect run on trigger, LIGHT_AUTOMATION_NO_EFFECT = none
+    LIGHT_AUTOMATION_ATTR_FIELDS,
+} light_automation_field_t;
+
+typedef struct __attribute__((packed)) {
+    bool enabled;
+    uint8_t sensor;
+    uint16_t near_cm;
+    uint16_t hysteresis_cm;
+    uint16_t hold_s;
+    uint64_t channels;
+    uint8_t level;
+    uint16_t fade_ds;
+    uint16_t off_fade_ds;
+    uint8_t effect;
+} light_automation_rule_t;
+
+/**
+* @brief Carries out a rule's action; on = presence detected, off = hold time expired
+*
+* Called from the ranging task with no automation lock held. event_us is the esp_timer time of the
+* reading that caused the action.
+*/
+typedef void (*light_automation_action_cb_t)(const light_automation_rule_t *rule, bool on, int64_t event_us);
+
+typedef struct {
+    uint32_t readings;          // sensor results evaluated
+    uint32_t triggers;          // on actions fired
+    uint32_t releases;          // off actions fired after the hold time
+} light_automation_stats_t;
+
+/**
+* @brief Load the rules from NVS (or the defaults); NVS must be initialized
+*
+* @param  defaults  Rules used when nothing is stored, up to LIGHT_AUTOMATION_RULES_MAX
+* @param  count     Number of default rules, the remaining rules start disabled
+* @param  action    Action callback
+*/
+esp_err_t light_automation_init(const light_automation_rule_t *defaults, size_t count, light_automation_action_cb_t action);
+
+/**
+* @brief Copy of rule idx, false if out of range
+*/
+bool light_automation_get_rule(uint8_t idx, light_automation_rule_t *out);
+
+/**
+* @brief Id, ZCL type and value location of attribute i (0 .. RULES_MAX * ATTR_FIELDS - 1) for cluster creation
+*/
+bool light_automation_attr_info(size_t i, uint16_t *attr_id, uint8_t *type, void **value);
+
+/**
+* @brief Apply a written attribute to its rule; call from the Zigbee task
+*
+* A changed value arms a debounced save of the rules from a Zigbee scheduler alarm, an unchanged one
+* does nothing.
+*
+* @return ESP_ERR_NOT_FOUND for an attribute id outside the rule blocks
+*/
+esp_err_t light_automation_set_attr(uint16_t attr_id, const void *value);
+
+/**
+* @brief Evaluate a ranging result against the rules; meant as the ultrasonic result callback
+*/
+void light_automation_process(const ultrasonic_result_t *result, void *arg);
+
+void light_automation_get_stats(light_automation_stats_t *out);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,138 @@
+/*
+ * Single-producer / single-consumer light command ring with per channel overflow coalescing.
+ */
+
+#include <stdlib.h>
+#include "light_cmd_queue.h"
+
+#define QUEUE_MASK (LIGHT_CMD_QUEUE_LEN - 1)
+
+_Static_assert((LIGHT_CMD_QUEUE_LEN & QUEUE_MASK) == 0, "LIGHT_CMD_QUEUE_LEN must be a power of two");
+_Static_assert(LIGHT_CMD_OP_COUNT <= 32, "op bitmask is 32 bits");
+
+// Per-channel ops get a slot per channel, the channel-less ops one slot each after them
+static inline size_t mailbox_slot(const light_cmd_queue_t *q, uint8_t ch, uint8_t op)
+{
+    if (op < LIGHT_CMD_CHANNEL_OPS) return (size_t) ch * LIGHT_CMD_CHANNEL_OPS + op;
+    return (size_t) q->channels * LIGHT_CMD_CHANNEL_OPS + (op - LIGHT_CMD_CHANNEL_OPS);
+}
+
+esp_err_t light_cmd_queue_init(light_cmd_queue_t *q, uint16_t channels)
+{
+    if (!q || !channels) return ESP_ERR_INVALID_ARG;
+    size_t slots = (size_t) channels * LIGHT_CMD_CHANNEL_OPS + (LIGHT_CMD_OP_COUNT - LIGHT_CMD_CHANNEL_OPS);
+    q->box = calloc(slots, sizeof(*q->box));
+    q->box_lock = calloc(slots, sizeof(*q->box_lock));
+    q->box_pending = calloc(channels, sizeof(*q->box_pending));
+    if (!q->box || !q->box_lock || !q->box_pending) {
+        free(q->box); free(q->box_lock); free(q->box_pending);
+        q->box = NULL; q->box_lock = NULL; q->box_pending = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    q->channels = channels;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->spilled, false);
+    return ESP_OK;
+}
+
+static void mailbox_put(light_cmd_queue_t *q, const light_cmd_t *cmd)
+{
+    size_t slot = mailbox_slot(q, cmd->ch, cmd->op);
+    uint32_t bit = 1u << cmd->op;
+    if (atomic_load_explicit(&q->box_pending[cmd->ch], memory_order_relaxed) & bit) q->stats.coalesced++;
+    atomic_fetch_add_explicit(&q->box_lock[slot], 1, memory_order_acq_rel);
+    q->box[slot] = *cmd;
+    atomic_fetch_add_explicit(&q->box_lock[slot], 1, memory_order_release);
+    atomic_fetch_or_explicit(&q->box_pending[cmd->ch], bit, memory_order_release);
+    atomic_store_explicit(&q->spilled, true, memory_order_release);
+}
+
+// Copies a mailbox slot, retrying while the producer is in the middle of rewriting it
+static void mailbox_get(light_cmd_queue_t *q, size_t slot, light_cmd_t *out)
+{
+    uint32_t before, after;
+    do {
+        before = atomic_load_explicit(&q->box_lock[slot], memory_order_acquire);
+        *out = q->box[slot];
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&q->box_lock[slot], memory_order_relaxed);
+    } while ((before & 1) || before != after);
+}
+
+bool light_cmd_queue_push(light_cmd_queue_t *q, light_cmd_t *cmd)
+{
+    if (cmd->ch >= q->channels || cmd->op >= LIGHT_CMD_OP_COUNT) return false;
+    // channel-less ops are parked under channel 0
+    if (cmd->op >= LIGHT_CMD_CHANNEL_OPS) cmd->ch = 0;
+    cmd->seq = ++q->seq;
+    q->stats.pushed++;
+    unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    unsigned depth = head - tail;
+    if (depth >= LIGHT_CMD_QUEUE_LEN) {
+        q->stats.overflows++;
+        mailbox_put(q, cmd);
+        return true;
+    }
+    q->ring[head & QUEUE_MASK] = *cmd;
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    if (depth + 1 > q->stats.depth_max) q->stats.depth_max = depth + 1;
+    return true;
+}
+
+static inline bool seq_before(uint32_t a, uint32_t b) { return (int32_t) (a - b) < 0; }
+
+// Oldest parked entry by sequence number; false if nothing is parked
+static bool mailbox_oldest(light_cmd_queue_t *q, light_cmd_t *out, uint16_t *out_ch, uint8_t *out_op)
+{
+    bool found = false;
+    light_cmd_t c;
+    for (uint16_t ch = 0; ch < q->channels; ++ch) {
+        uint32_t bits = atomic_load_explicit(&q->box_pending[ch], memory_order_acquire);
+        while (bits) {
+            uint8_t op = (uint8_t) __builtin_ctz(bits);
+            bits &= bits - 1;
+            mailbox_get(q, mailbox_slot(q, (uint8_t) ch, op), &c);
+            if (found && !seq_before(c.seq, out->seq)) continue;
+            *out = c;
+            *out_ch = ch;
+            *out_op = op;
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool light_cmd_queue_pop(light_cmd_queue_t *q, light_cmd_t *cmd)
+{
+    unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&q->head, memory_order_acquire);
+    bool ring = tail != head;
+    if (atomic_exchange_explicit(&q->spilled, false, memory_order_acq_rel)) {
+        // parked and ring entries are merged in producer order, so an op parked on overflow is not
+        // overtaken by a later command of another op that found room in the ring
+        light_cmd_t parked;
+        uint16_t ch;
+        uint8_t op;
+        if (mailbox_oldest(q, &parked, &ch, &op)) {
+            atomic_store_explicit(&q->spilled, true, memory_order_release);
+            if (!ring || seq_before(parked.seq, q->ring[tail & QUEUE_MASK].seq)) {
+                atomic_fetch_and_explicit(&q->box_pending[ch], ~(1u << op), memory_order_acq_rel);
+                // the producer may have replaced the slot since it was compared, take the newest copy
+                mailbox_get(q, mailbox_slot(q, (uint8_t) ch, op), cmd);
+                return true;
+            }
+        }
+    }
+    if (!ring) return false;
+    *cmd = q->ring[tail & QUEUE_MASK];
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+bool light_cmd_queue_empty(light_cmd_queue_t *q)
+{
+    return atomic_load_explicit(&q->head, memory_order_acquire) == atomic_load_explicit(&q->tail, memory_order_relaxed) &&
+           !atomic_load_explicit(&q->spilled, memory_order_acquire);
+}
@@ -0,0 +1,95 @@
+/*
+ * Single-producer / single-consumer command ring between a control task (the Zigbee task) and the
+ * light driver's render task.
+ *
+ * The producer never blocks: when the ring is full the command is parked in a per channel, per op
+ * mailbox instead, where a newer command of the same kind simply replaces an older one that was not
+ * consumed yet. Commands carry a sequence number so the consumer can drop a mailbox entry that was
+ * already superseded by a later ring entry. Light commands set absolute state, so coalescing only
+ * ever loses intermediate steps, never the final value.
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LIGHT_CMD_QUEUE_LEN 64  // ring slots, power of two
+
+typedef enum {
+    LIGHT_CMD_POWER = 0,        // a = on
+    LIGHT_CMD_LEVEL,            // a = level
+    LIGHT_CMD_COLOR,            // kind + a, b, c as in the driver's color state
+    LIGHT_CMD_TRANSITION,       // a = transition time in 1/10 s
+    LIGHT_CMD_EFFECT,           // a = light_effect_t, b = animation for LIGHT_EFFECT_ANIMATION
+    // ops from here on ignore the channel and have a single mailbox slot
+    LIGHT_CMD_GROUP_EFFECT,     // a = group effect id, b = start; channel is ignored
+    LIGHT_CMD_MARK,             // b, c = low, high half of an esp_timer timestamp (us); channel is ignored
+    LIGHT_CMD_OP_COUNT,
+    LIGHT_CMD_CHANNEL_OPS = LIGHT_CMD_GROUP_EFFECT,
+} light_cmd_op_t;
+
+typedef struct {
+    uint8_t ch;
+    uint8_t op;                 // light_cmd_op_t
+    uint8_t kind;
+    uint8_t reserved;
+    uint16_t a, b, c;
+    uint32_t seq;               // producer order, set by light_cmd_queue_push()
+    uint32_t t_ms;              // time the command was issued
+} light_cmd_t;
+
+typedef struct {
+    uint32_t pushed;
+    uint32_t depth_max;         // ring high-water mark
+    uint32_t overflows;         // commands that went to the mailbox because the ring was full
+    uint32_t coalesced;         // mailbox entries replaced before the consumer saw them
+} light_cmd_queue_stats_t;
+
+typedef struct {
+    light_cmd_t ring[LIGHT_CMD_QUEUE_LEN];
+    atomic_uint head;           // written by the producer
+    atomic_uint tail;           // written by the consumer
+    uint32_t seq;
+
+    // Overflow mailbox, one slot per channel and op guarded by a sequence lock
+    uint16_t channels;
+    light_cmd_t *box;
+    atomic_uint *box_lock;      // odd while the producer writes the slot
+    atomic_uint *box_pending;   // per channel bitmask of ops with an unread slot
+    atomic_bool spilled;
+
+    light_cmd_queue_stats_t stats;
+} light_cmd_queue_t;
+
+/**
+* @brief Allocate the overflow mailbox of a queue for the given channel count
+*/
+esp_err_t light_cmd_queue_init(light_cmd_queue_t *q, uint16_t channels);
+
+/**
+* @brief Producer side: enqueue a command, never blocks
+*
+* @return false only for an invalid channel or op
+*/
+bool light_cmd_queue_push(light_cmd_queue_t *q, light_cmd_t *cmd);
+
+/**
+* @brief Consumer side: take the oldest command, ring and parked mailbox entries merged in push order
+*
+* Mailbox entries may be stale; the consumer compares cmd->seq against the last sequence it applied
+* for that channel and op.
+*/
+bool light_cmd_queue_pop(light_cmd_queue_t *q, light_cmd_t *cmd);
+
+bool light_cmd_queue_empty(light_cmd_queue_t *q);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -14,12 +14,20 @@
 
 
 #include "esp_log.h"
-#include "led_strip.h"
+#include <stdlib.h>
+#include <string.h>
+#include "led_output.h"
 #include "light_driver.h"
+#include "color_convert.h"
+#include "light_cmd_queue.h"
+#include "light_anim.h"
+#include "light_power.h"
+#include "esp_partition.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "esp_random.h"
+#include "esp_timer.h"
 
 static const char *LD_TAG = "light_drv";
 
@@ -28,193 +36,1167 @@ static const char *LD_TAG = "light_drv";
 // #undef CONFIG_EXAMPLE_STRIP_LED_NUMBER
 // #undef CONFIG_EXAMPLE_STRIP_LED_GPIO
 
-#define MAX_LIGHT_CHANNELS 16
+#define MAX_LIGHT_CHANNELS LIGHT_CHANNELS_MAX
+#define MAX_LIGHT_STRIPS   8
+#define RENDER_TASK_STACK  3072
+#define RENDER_TASK_PRIO   4
+
+typedef enum {
+    COLOR_RGB = 0,  // a, b, c = r, g, b
+    COLOR_XY,       // a, b = x, y
+    COLOR_HS,       // a, b = hue (0..255), sat
+    COLOR_EHS,      // a, b = enhanced hue (0..65535), sat
+    COLOR_CT,       // a = mired
+} color_kind_t;
+
+typedef struct {
+    uint8_t kind;
+    uint16_t a, b, c;
+} light_color_t;
+
+typedef struct {
+    uint32_t start_ms;
+    uint32_t dur_ms;            // 0 = idle
+} light_fade_t;
 
 typedef struct {
-    led_strip_handle_t handle;
+    // 4-byte members first, then 2- and 1-byte ones: no padding holes, the array is sized to the channel count
+    led_output_t *out;          // strip this channel renders into
+    uint8_t *canvas;            // per-pixel RGB content (framebuffer API), NULL = solid color channel
+    light_fade_t color_fade, level_fade, on_fade;
+    uint32_t fade_deadline_ms;  // setters fade until this time (armed by light_driver_set_transition_ch), 0 = disarmed
+    uint32_t cmd_seq[LIGHT_CMD_CHANNEL_OPS]; // last applied command per op, drops superseded mailbox entries
+    uint32_t fx_slot;           // last time slot an effect acted on (e.g. random color pick)
+    uint32_t fx_start_ms;       // s_clock_ms when the effect started
+    uint32_t load_ma;           // estimated current of the channel's output before the limiter
+    light_color_t color;        // current color in its native space
+    light_color_t color_from, color_to, color_target;
+    uint16_t offset;            // first pixel of the channel's segment on the strip
     uint16_t led_count;
-    uint8_t r, g, b, level;
+    uint16_t anim;              // animation played by LIGHT_EFFECT_ANIMATION
+    uint16_t canvas_lo, canvas_hi; // canvas pixels written since the last render
+    uint16_t group_px;          // first wipe pixel of this channel on the group timeline
+    uint16_t limit_q8;          // power limiter scale applied on output, 256 = none
+    uint16_t canvas_limit;      // limit_q8 the canvas was last scaled with
+    uint8_t strip;              // index into s_strips
+    uint8_t r, g, b, level;     // current (possibly mid-transition) color and level
+    uint8_t on_frac;            // 0..255 power fade factor applied on top of level
+    uint8_t level_from, level_to, on_from, on_to;
+    uint8_t effect;             // light_effect_t
+    uint8_t fx_r, fx_g, fx_b;   // effect-owned color, base color stays untouched
+    uint8_t out_r, out_g, out_b; // scaled color currently in the strip buffer
+    uint8_t canvas_level;
+    uint8_t group_pos;          // step index in the running group effect, GROUP_POS_NONE if not a member
+    uint8_t priority;           // power budget priority, 0 = served first
     bool power;
-    light_effect_t effect;
-    TaskHandle_t effect_task;
-    bool effect_stop;
+    bool pending;               // setter state not yet rendered, applied by the render task on the next frame
+    bool out_valid;
+    bool canvas_active;
+    bool canvas_synced;         // strip buffer holds the canvas scaled by canvas_level
 } light_channel_state_t;
 
-static light_channel_state_t s_channels[MAX_LIGHT_CHANNELS];
+/* Physical strip: one or more channels (segments) render into it, it is transmitted once per frame */
+typedef struct {
+    led_output_t *out;
+    uint16_t dirty_lo, dirty_hi; // pixel range [lo, hi) changed since the last refresh
+    bool rendered;              // a channel on this strip was rendered in the current frame
+} light_strip_state_t;
+
+#define GROUP_POS_NONE 0xFF
+
+typedef struct {
+    light_group_effect_config_t cfg; // cfg.channels points at list
+    uint8_t list[MAX_LIGHT_CHANNELS];
+    bool defined;
+} light_group_def_t;
+
+static light_channel_state_t *s_channels;     // s_channel_count entries, allocated once by init
 static size_t s_channel_count = 0;
+static light_strip_state_t s_strips[MAX_LIGHT_STRIPS];
+static size_t s_strip_count = 0;
 static SemaphoreHandle_t s_driver_lock;
+static light_render_stats_t s_render_stats;
+
+// Shared frame clock: every channel derives its effect phase from s_clock_ms so effects stay in lockstep
+static TaskHandle_t s_render_task;
+static TickType_t s_frame_ticks = 1;
+static uint32_t s_frame_budget_us = LIGHT_RENDER_BUDGET_US_DEFAULT;
+static uint32_t s_clock_ms;
+static bool s_first_frame_logged;
+
+// Group effects, the running one is owned by the render task
+static light_group_def_t s_group_defs[LIGHT_GROUP_EFFECTS_MAX];
+static light_driver_group_land_cb_t s_group_land_cb;
+static int s_group_active = -1;
+static uint32_t s_group_start_ms;   // s_clock_ms when the running group effect started
+
+// Power limiter: current model and budget, per-priority scale computed once per frame
+static light_power_config_t s_power_cfg = LIGHT_POWER_CONFIG_DEFAULT();
+static light_power_stats_t s_power_stats;
+static uint32_t s_total_pixels;
+
+// Animation library, read in place from the memory-mapped anim partition
+static light_anim_lib_t s_anim;
+static esp_partition_mmap_handle_t s_anim_map;
+// Global output cap (thermal derating), ramped towards its target by LIGHT_OUTPUT_CAP_STEP_Q8 per frame
+static uint16_t s_cap_q8 = 256;
+static uint16_t s_cap_target_q8 = 256;
+
+// Latency mark applied in the current frame, completed once the frame is out
+static bool s_mark_pending;
+static uint32_t s_mark_event_us;
+
+// Setters only push commands here; the render task is the single writer of channel state
+static light_cmd_queue_t s_cmd_queue;
+static uint32_t s_global_seq[LIGHT_CMD_OP_COUNT - LIGHT_CMD_CHANNEL_OPS]; // cmd_seq of the ops that ignore the channel
+
+// Nested update batch (see light_driver_batch_begin), owned by the command producer. Pending channels are not
+// rendered while it is open.
+static atomic_uint s_batch_depth;
+static atomic_uint s_batch_start_ms;
 
 static inline bool ch_valid(size_t ch) { return ch < s_channel_count; }
 
-static inline void apply_output_ch(light_channel_state_t *ch)
+// Level -> Q16 output factor with the gamma curve folded in; the hot path is one multiply and a shift per component
+static uint16_t s_level_lut[256];
+
+static inline uint8_t scale_by_level(uint8_t c, uint8_t level)
 {
-    if (!ch || !ch->handle) return;
-    if (ch->power) {
-        float ratio = (float) ch->level / 255.0f;
-        uint8_t rr = (uint8_t) ((float) ch->r * ratio);
-        uint8_t gg = (uint8_t) ((float) ch->g * ratio);
-        uint8_t bb = (uint8_t) ((float) ch->b * ratio);
-        for (uint16_t i = 0; i < ch->led_count; ++i) {
-            led_strip_set_pixel(ch->handle, i, rr, gg, bb);
-        }
-    } else {
-        for (uint16_t i = 0; i < ch->led_count; ++i) {
-            led_strip_set_pixel(ch->handle, i, 0, 0, 0);
-        }
+    return (uint8_t) (((uint32_t) c * s_level_lut[level] + 32768) >> 16);
+}
+
+static inline uint8_t scale_by_limit(uint8_t c, uint16_t limit_q8)
+{
+    return (uint8_t) (((uint32_t) c * limit_q8 + 128) >> 8);
+}
+
+// Estimated current of one pixel showing (r, g, b), in units of 1/255 mA
+static inline uint32_t pixel_load(uint8_t r, uint8_t g, uint8_t b)
+{
+    return (uint32_t) r * s_power_cfg.ma_red + (uint32_t) g * s_power_cfg.ma_green + (uint32_t) b * s_power_cfg.ma_blue;
+}
+
+// Marks channel pixels [lo, hi) dirty on the channel's strip
+static inline void mark_dirty_ch(light_channel_state_t *ch, uint16_t lo, uint16_t hi)
+{
+    if (lo >= hi) return;
+    light_strip_state_t *strip = &s_strips[ch->strip];
+    lo += ch->offset; hi += ch->offset;
+    strip->rendered = true;
+    if (strip->dirty_hi <= strip->dirty_lo) { strip->dirty_lo = lo; strip->dirty_hi = hi; return; }
+    if (lo < strip->dirty_lo) strip->dirty_lo = lo;
+    if (hi > strip->dirty_hi) strip->dirty_hi = hi;
+}
+
+static inline uint8_t *segment_pixels(const light_channel_state_t *ch, uint16_t first)
+{
+    return led_output_back_buffer(ch->out) + (size_t) (ch->offset + first) * LED_OUTPUT_BYTES_PER_PIXEL;
+}
+
+// Writes a solid color; pixels are only touched (and marked dirty) when the scaled RGB differs from what is on the strip
+static inline void write_pixels_ch(light_channel_state_t *ch, uint8_t r, uint8_t g, uint8_t b, uint8_t level)
+{
+    uint8_t rr = scale_by_level(r, level);
+    uint8_t gg = scale_by_level(g, level);
+    uint8_t bb = scale_by_level(b, level);
+    // the estimate is taken before the limiter so the limiter never feeds back into its own input
+    ch->load_ma = ch->led_count * pixel_load(rr, gg, bb) / 255;
+    rr = scale_by_limit(rr, ch->limit_q8);
+    gg = scale_by_limit(gg, ch->limit_q8);
+    bb = scale_by_limit(bb, ch->limit_q8);
+    if (ch->out_valid && ch->out_r == rr && ch->out_g == gg && ch->out_b == bb) return;
+    uint8_t *px = segment_pixels(ch, 0);
+    for (uint16_t i = 0; i < ch->led_count; ++i, px += LED_OUTPUT_BYTES_PER_PIXEL) {
+        px[0] = gg; px[1] = rr; px[2] = bb;
     }
-    led_strip_refresh(ch->handle);
+    ch->out_r = rr; ch->out_g = gg; ch->out_b = bb; ch->out_valid = true;
+    ch->canvas_synced = false;
+    mark_dirty_ch(ch, 0, ch->led_count);
 }
 
-static void color_temp_to_rgb(uint16_t mired, uint8_t *r, uint8_t *g, uint8_t *b)
+// Scales the changed part of the canvas into the strip buffer; a level or limiter change rescales all of it
+static inline void write_canvas_ch(light_channel_state_t *ch, uint8_t level)
 {
-    // mired = 1,000,000 / K. Clamp typical range 153 (6500K) - 500 (2000K)
-    if (mired < 153) mired = 153;
-    if (mired > 500) mired = 500;
-    float kelvin = 1000000.0f / (float)mired; // ~2000 - 6500
-    float temp = kelvin / 100.0f;
-    float rr, gg, bb;
-    if (temp <= 66) {
-        rr = 255.0f;
-    } else {
-        rr = 329.698727446f * powf(temp - 60.0f, -0.1332047592f);
-        if (rr < 0) rr = 0;
-        if (rr > 255) rr = 255;
+    if (!ch->canvas_synced || ch->canvas_level != level || ch->canvas_limit != ch->limit_q8) {
+        ch->canvas_lo = 0; ch->canvas_hi = ch->led_count;
     }
-    if (temp <= 66) {
-        gg = 99.4708025861f * logf(temp) - 161.1195681661f;
-    } else {
-        gg = 288.1221695283f * powf(temp - 60.0f, -0.0755148492f);
-    }
-    if (gg < 0) gg = 0;
-    if (gg > 255) gg = 255;
-    if (temp >= 66) {
-        bb = 255.0f;
-    } else if (temp <= 19) {
-        bb = 0;
+    if (ch->canvas_lo >= ch->canvas_hi) return;
+    // level and limiter folded into one Q16 factor
+    uint32_t f = ((uint32_t) s_level_lut[level] * ch->limit_q8) >> 8;
+    const uint8_t *src = ch->canvas + (size_t) ch->canvas_lo * 3;
+    uint8_t *px = segment_pixels(ch, ch->canvas_lo);
+    for (uint16_t i = ch->canvas_lo; i < ch->canvas_hi; ++i, src += 3, px += LED_OUTPUT_BYTES_PER_PIXEL) {
+        px[0] = (uint8_t) ((src[1] * f + 32768) >> 16);
+        px[1] = (uint8_t) ((src[0] * f + 32768) >> 16);
+        px[2] = (uint8_t) ((src[2] * f + 32768) >> 16);
+    }
+    mark_dirty_ch(ch, ch->canvas_lo, ch->canvas_hi);
+    // the load covers the whole canvas, the unchanged part included
+    uint32_t sr = 0, sg = 0, sb = 0;
+    src = ch->canvas;
+    for (uint16_t i = 0; i < ch->led_count; ++i, src += 3) { sr += src[0]; sg += src[1]; sb += src[2]; }
+    uint64_t load = (uint64_t) sr * s_power_cfg.ma_red + (uint64_t) sg * s_power_cfg.ma_green + (uint64_t) sb * s_power_cfg.ma_blue;
+    ch->load_ma = (uint32_t) ((load * s_level_lut[level]) >> 16) / 255;
+    ch->canvas_lo = ch->canvas_hi = 0;
+    ch->canvas_level = level;
+    ch->canvas_limit = ch->limit_q8;
+    ch->canvas_synced = true;
+    ch->out_valid = false;
+}
+
+static inline bool strip_dirty(const light_strip_state_t *strip) { return strip->dirty_hi > strip->dirty_lo; }
+
+// Starts a transmission of a strip only when some segment of it changed since the last refresh. Never waits:
+// if the previous frame is still on the wire the dirty range is kept and the render task retries next frame.
+static inline void flush_strip(light_strip_state_t *strip)
+{
+    strip->rendered = false;
+    if (!strip_dirty(strip)) { s_render_stats.refreshes_skipped++; return; }
+    if (led_output_present(strip->out, strip->dirty_lo, strip->dirty_hi) != ESP_OK) {
+        s_render_stats.refreshes_deferred++;
+        if (s_render_task && xTaskGetCurrentTaskHandle() != s_render_task) xTaskNotifyGive(s_render_task);
+        return;
+    }
+    s_render_stats.pixels_sent += led_output_led_count(strip->out);
+    s_render_stats.refreshes++;
+    strip->dirty_lo = strip->dirty_hi = 0;
+}
+
+static inline uint8_t out_level(const light_channel_state_t *ch)
+{
+    return ch->power ? (uint8_t) (((uint32_t) ch->level * ch->on_frac + 127) / 255) : 0;
+}
+
+// Base (non-effect) content: the pixel canvas if a producer owns the channel, else the solid color
+static inline void render_base_ch(light_channel_state_t *ch)
+{
+    if (ch->canvas_active) write_canvas_ch(ch, out_level(ch));
+    else write_pixels_ch(ch, ch->r, ch->g, ch->b, out_level(ch));
+}
+
+/* Transition engine: setters record from/to values, the render task interpolates them every frame */
+
+static inline uint32_t now_ms(void) { return (uint32_t) (esp_timer_get_time() / 1000); }
+
+// Q16 progress of a fade; finishes (and idles) the fade once its duration has elapsed
+static inline uint32_t fade_progress(light_fade_t *f, uint32_t now)
+{
+    uint32_t elapsed = now - f->start_ms;
+    if (!f->dur_ms || elapsed >= f->dur_ms) { f->dur_ms = 0; return 0x10000; }
+    return (uint32_t) (((uint64_t) elapsed << 16) / f->dur_ms);
+}
+
+static inline uint16_t lerp_u16(uint16_t from, uint16_t to, uint32_t p)
+{
+    return (uint16_t) (from + (((int64_t) ((int32_t) to - (int32_t) from) * p) >> 16));
+}
+
+static void color_resolve(const light_color_t *c, color_rgb_t *out)
+{
+    switch (c->kind) {
+        case COLOR_XY: if (!color_xy_to_rgb(c->a, c->b, out)) out->r = out->g = out->b = 255; break;
+        case COLOR_HS: color_hs_to_rgb((uint8_t) c->a, (uint8_t) c->b, out); break;
+        case COLOR_EHS: color_ehs_to_rgb(c->a, (uint8_t) c->b, out); break;
+        case COLOR_CT: color_mired_to_rgb(c->a, out); break;
+        case COLOR_RGB:
+        default: out->r = (uint8_t) c->a; out->g = (uint8_t) c->b; out->b = (uint8_t) c->c; break;
+    }
+}
+
+static void color_to_rgb_kind(light_color_t *c)
+{
+    color_rgb_t rgb;
+    color_resolve(c, &rgb);
+    *c = (light_color_t) { .kind = COLOR_RGB, .a = rgb.r, .b = rgb.g, .c = rgb.b };
+}
+
+// Interpolates in the native space of the color: xy and mired linearly, hue along the shorter arc
+static void color_lerp(const light_color_t *from, const light_color_t *to, uint32_t p, light_color_t *out)
+{
+    out->kind = to->kind;
+    switch (to->kind) {
+        case COLOR_HS:
+            out->a = (uint8_t) (from->a + (((int32_t) (int8_t) (uint8_t) (to->a - from->a) * (int32_t) p) >> 16));
+            out->b = lerp_u16(from->b, to->b, p);
+            break;
+        case COLOR_EHS:
+            out->a = (uint16_t) (from->a + (((int64_t) (int16_t) (to->a - from->a) * p) >> 16));
+            out->b = lerp_u16(from->b, to->b, p);
+            break;
+        default:
+            out->a = lerp_u16(from->a, to->a, p);
+            out->b = lerp_u16(from->b, to->b, p);
+            out->c = lerp_u16(from->c, to->c, p);
+            break;
+    }
+}
+
+static inline bool fades_running(const light_channel_state_t *st)
+{
+    return st->level_fade.dur_ms || st->on_fade.dur_ms || st->color_fade.dur_ms;
+}
+
+// Time left until the armed transition deadline, 0 means apply instantly. A deadline that has passed is
+// disarmed (0), otherwise the wrapping comparison would see it as far in the future ~24.8 days later.
+static inline uint32_t transition_ms(light_channel_state_t *st, uint32_t now)
+{
+    if (!st->fade_deadline_ms) return 0;
+    int32_t left = (int32_t) (st->fade_deadline_ms - now);
+    if (left > 0) return (uint32_t) left;
+    st->fade_deadline_ms = 0;
+    return 0;
+}
+
+static void advance_fades_ch(light_channel_state_t *st, uint32_t now)
+{
+    if (st->level_fade.dur_ms) {
+        st->level = (uint8_t) lerp_u16(st->level_from, st->level_to, fade_progress(&st->level_fade, now));
+    }
+    if (st->on_fade.dur_ms) {
+        st->on_frac = (uint8_t) lerp_u16(st->on_from, st->on_to, fade_progress(&st->on_fade, now));
+        if (!st->on_fade.dur_ms && !st->on_to) st->power = false;
+    }
+    if (st->color_fade.dur_ms) {
+        uint32_t p = fade_progress(&st->color_fade, now);
+        if (st->color_fade.dur_ms) color_lerp(&st->color_from, &st->color_to, p, &st->color);
+        else st->color = st->color_target;
+        color_rgb_t rgb;
+        color_resolve(&st->color, &rgb);
+        st->r = rgb.r; st->g = rgb.g; st->b = rgb.b;
+    }
+}
+
+static void set_level_internal(light_channel_state_t *st, uint8_t level, uint32_t now)
+{
+    st->level_from = st->level;
+    st->level_to = level;
+    st->level_fade = (light_fade_t) { .start_ms = now, .dur_ms = transition_ms(st, now) };
+    if (!st->level_fade.dur_ms) st->level = level;
+}
+
+static void set_power_internal(light_channel_state_t *st, bool power, uint32_t now)
+{
+    st->on_from = st->power ? st->on_frac : 0;
+    st->on_to = power ? 255 : 0;
+    st->on_fade = (light_fade_t) { .start_ms = now, .dur_ms = transition_ms(st, now) };
+    if (power) {
+        if (!st->power) st->on_frac = 0;
+        st->power = true;
+    }
+    if (!st->on_fade.dur_ms) { st->on_frac = st->on_to; st->power = power; }
+}
+
+static void set_color_internal(light_channel_state_t *st, const light_color_t *target, uint32_t now)
+{
+    st->color_target = *target;
+    st->color_from = st->color;
+    st->color_to = *target;
+    st->color_fade = (light_fade_t) { .start_ms = now, .dur_ms = transition_ms(st, now) };
+    if (!st->color_fade.dur_ms) {
+        st->color = *target;
+    } else if (st->color_from.kind != st->color_to.kind) {
+        // no common space, blend in RGB
+        color_to_rgb_kind(&st->color_from);
+        color_to_rgb_kind(&st->color_to);
+        return;
     } else {
-        bb = 138.5177312231f * logf(temp - 10.0f) - 305.0447927307f;
-        if (bb < 0) bb = 0;
-        if (bb > 255) bb = 255;
-    }
-    *r = (uint8_t)rr; *g = (uint8_t)gg; *b = (uint8_t)bb;
-}
-
-// Effect task per channel
-static void effect_task_ch(void *arg)
-{
-    size_t ch_index = (size_t) arg;
-    if (!ch_valid(ch_index)) { vTaskDelete(NULL); return; }
-    light_channel_state_t *st = &s_channels[ch_index];
-    uint8_t breathe_level = st->level ? st->level : 1;
-    int breathe_dir = 1;
-    while (!st->effect_stop) {
-        switch (st->effect) {
-            case LIGHT_EFFECT_BLINK: {
-                st->power = !st->power; apply_output_ch(st); vTaskDelay(pdMS_TO_TICKS(500)); break; }
-            case LIGHT_EFFECT_BREATHE: {
-                breathe_level += breathe_dir * 5;
-                if (breathe_level >= (int) st->level) { breathe_level = st->level; breathe_dir = -1; }
-                if (breathe_level <= 5) { breathe_level = 5; breathe_dir = 1; }
-                if (st->power) {
-                    float ratio = (float) breathe_level / 255.0f;
-                    uint8_t rr = (uint8_t) ((float) st->r * ratio);
-                    uint8_t gg = (uint8_t) ((float) st->g * ratio);
-                    uint8_t bb = (uint8_t) ((float) st->b * ratio);
-                    for (uint16_t i=0;i<st->led_count;++i) led_strip_set_pixel(st->handle, i, rr, gg, bb);
-                    led_strip_refresh(st->handle);
-                }
-                vTaskDelay(pdMS_TO_TICKS(40));
-                break; }
-            case LIGHT_EFFECT_ICU: {
-                st->power = true; apply_output_ch(st); vTaskDelay(pdMS_TO_TICKS(120));
-                st->power = false; apply_output_ch(st); vTaskDelay(pdMS_TO_TICKS(120));
-                st->power = true; apply_output_ch(st); vTaskDelay(pdMS_TO_TICKS(120));
-                st->power = false; apply_output_ch(st); vTaskDelay(pdMS_TO_TICKS(500));
-                break; }
-            case LIGHT_EFFECT_RANDOM_COLOR: {
-                st->r = (uint8_t) (esp_random() & 0xFF);
-                st->g = (uint8_t) (esp_random() >> 8);
-                st->b = (uint8_t) (esp_random() >> 16);
-                apply_output_ch(st); vTaskDelay(pdMS_TO_TICKS(700));
-                break; }
-            case LIGHT_EFFECT_STATIC:
-            case LIGHT_EFFECT_NONE:
-            default:
-                vTaskDelay(pdMS_TO_TICKS(200));
-                break;
+        return;
+    }
+    color_rgb_t rgb;
+    color_resolve(&st->color, &rgb);
+    st->r = rgb.r; st->g = rgb.g; st->b = rgb.b;
+}
+
+/* Group effects */
+
+// Writes a solid color into channel pixels [lo, hi) without touching the rest of the segment
+static void write_span_ch(light_channel_state_t *ch, uint16_t lo, uint16_t hi, uint8_t r, uint8_t g, uint8_t b, uint8_t level)
+{
+    uint8_t rr = scale_by_level(r, level), gg = scale_by_level(g, level), bb = scale_by_level(b, level);
+    // the span replaces its share of the base content in the estimate
+    uint16_t n = hi - lo;
+    ch->load_ma = (uint32_t) ((uint64_t) ch->load_ma * (ch->led_count - n) / ch->led_count) + n * pixel_load(rr, gg, bb) / 255;
+    rr = scale_by_limit(rr, ch->limit_q8);
+    gg = scale_by_limit(gg, ch->limit_q8);
+    bb = scale_by_limit(bb, ch->limit_q8);
+    uint8_t *px = segment_pixels(ch, lo);
+    for (uint16_t i = lo; i < hi; ++i, px += LED_OUTPUT_BYTES_PER_PIXEL) {
+        px[0] = gg; px[1] = rr; px[2] = bb;
+    }
+    ch->out_valid = false;
+    ch->canvas_synced = false;
+    mark_dirty_ch(ch, lo, hi);
+}
+
+static void group_stop(void)
+{
+    if (s_group_active < 0) return;
+    for (size_t i = 0; i < s_channel_count; ++i) {
+        light_channel_state_t *st = &s_channels[i];
+        if (st->group_pos == GROUP_POS_NONE) continue;
+        st->group_pos = GROUP_POS_NONE;
+        st->out_valid = false;
+        st->canvas_synced = false;
+        st->pending = true;
+    }
+    s_group_active = -1;
+}
+
+static void group_start(uint8_t id)
+{
+    group_stop();
+    if (id >= LIGHT_GROUP_EFFECTS_MAX || !s_group_defs[id].defined) return;
+    const light_group_effect_config_t *cfg = &s_group_defs[id].cfg;
+    uint16_t px = 0;
+    for (uint8_t n = 0; n < cfg->count; ++n) {
+        uint8_t ch = cfg->channels[cfg->reverse ? cfg->count - 1 - n : n];
+        if (ch >= s_channel_count || !s_channels[ch].out) continue;
+        s_channels[ch].group_pos = n;
+        s_channels[ch].group_px = px;
+        px += s_channels[ch].led_count;
+    }
+    s_group_active = id;
+    s_group_start_ms = s_clock_ms;
+}
+
+static bool group_done(const light_group_effect_config_t *cfg, uint32_t t)
+{
+    uint32_t step = t / cfg->step_ms;
+    switch (cfg->kind) {
+        case LIGHT_GROUP_CHASE: return !cfg->loop && step >= (uint32_t) cfg->count + cfg->tail;
+        case LIGHT_GROUP_CASCADE: return t >= (uint32_t) (cfg->count - 1) * cfg->step_ms + cfg->fade_ms;
+        case LIGHT_GROUP_WIPE: {
+            uint32_t total = 0;
+            for (size_t i = 0; i < s_channel_count; ++i) {
+                if (s_channels[i].group_pos != GROUP_POS_NONE) total += s_channels[i].led_count;
+            }
+            return step >= total; }
+        default: return true;
+    }
+}
+
+// The final frame of a held cascade/wipe becomes the channels' own state; returns the channels that landed
+static uint64_t group_land(const light_group_effect_config_t *cfg)
+{
+    uint64_t landed = 0;
+    for (size_t i = 0; i < s_channel_count; ++i) {
+        light_channel_state_t *st = &s_channels[i];
+        if (st->group_pos == GROUP_POS_NONE) continue;
+        landed |= 1ull << i;
+        st->color = st->color_target = (light_color_t) { .kind = COLOR_RGB, .a = cfg->r, .b = cfg->g, .c = cfg->b };
+        st->r = cfg->r; st->g = cfg->g; st->b = cfg->b;
+        st->level = cfg->level;
+        st->power = true;
+        st->on_frac = 255;
+        st->color_fade.dur_ms = st->level_fade.dur_ms = st->on_fade.dur_ms = 0;
+    }
+    return landed;
+}
+
+// Group effect frame for one member channel at time t since the effect started
+static void render_group_ch(light_channel_state_t *st, const light_group_effect_config_t *cfg, uint32_t t)
+{
+    uint32_t step = t / cfg->step_ms;
+    switch (cfg->kind) {
+        case LIGHT_GROUP_CHASE: {
+            uint32_t span = (uint32_t) cfg->count + cfg->tail;
+            uint32_t s = cfg->loop ? step % span : step;
+            bool lit = s >= st->group_pos && s < (uint32_t) st->group_pos + cfg->tail;
+            write_pixels_ch(st, cfg->r, cfg->g, cfg->b, lit ? cfg->level : 0);
+            break; }
+        case LIGHT_GROUP_CASCADE: {
+            uint32_t begin = (uint32_t) st->group_pos * cfg->step_ms;
+            uint32_t lvl = 0;
+            if (t > begin) lvl = t - begin >= cfg->fade_ms ? cfg->level : (uint32_t) cfg->level * (t - begin) / cfg->fade_ms;
+            write_pixels_ch(st, cfg->r, cfg->g, cfg->b, (uint8_t) lvl);
+            break; }
+        case LIGHT_GROUP_WIPE: {
+            uint32_t k = step > st->group_px ? step - st->group_px : 0;
+            if (k > st->led_count) k = st->led_count;
+            render_base_ch(st);
+            if (!k) break;
+            if (cfg->reverse) write_span_ch(st, (uint16_t) (st->led_count - k), st->led_count, cfg->r, cfg->g, cfg->b, cfg->level);
+            else write_span_ch(st, 0, (uint16_t) k, cfg->r, cfg->g, cfg->b, cfg->level);
+            break; }
+        default:
+            render_base_ch(st);
+            break;
+    }
+}
+
+static bool batch_held(uint32_t now)
+{
+    static bool warned;
+    if (!atomic_load_explicit(&s_batch_depth, memory_order_acquire)) { warned = false; return false; }
+    if (now - atomic_load_explicit(&s_batch_start_ms, memory_order_relaxed) < LIGHT_BATCH_HOLD_MAX_MS) return true;
+    if (!warned) ESP_LOGW(LD_TAG, "Update batch not ended after %d ms, releasing", LIGHT_BATCH_HOLD_MAX_MS);
+    warned = true;
+    return false;
+}
+
+// Applies one queued setter command to its channel, at the time it was issued
+static void apply_cmd(const light_cmd_t *cmd)
+{
+    if (cmd->ch >= s_channel_count) return;
+    light_channel_state_t *st = &s_channels[cmd->ch];
+    // a mailbox entry older than what the ring already delivered
+    uint32_t *seq = cmd->op < LIGHT_CMD_CHANNEL_OPS ? &st->cmd_seq[cmd->op] : &s_global_seq[cmd->op - LIGHT_CMD_CHANNEL_OPS];
+    if ((int32_t) (cmd->seq - *seq) <= 0) return;
+    *seq = cmd->seq;
+    switch (cmd->op) {
+        case LIGHT_CMD_GROUP_EFFECT:
+            if (cmd->b) group_start((uint8_t) cmd->a);
+            else group_stop();
+            return;
+        case LIGHT_CMD_MARK:
+            s_mark_pending = true;
+            s_mark_event_us = (uint32_t) cmd->b | ((uint32_t) cmd->c << 16);
+            return;
+        case LIGHT_CMD_POWER: set_power_internal(st, cmd->a != 0, cmd->t_ms); break;
+        case LIGHT_CMD_LEVEL: set_level_internal(st, (uint8_t) cmd->a, cmd->t_ms); break;
+        case LIGHT_CMD_COLOR: {
+            light_color_t c = { .kind = cmd->kind, .a = cmd->a, .b = cmd->b, .c = cmd->c };
+            set_color_internal(st, &c, cmd->t_ms);
+            break; }
+        case LIGHT_CMD_TRANSITION: {
+            // 0 means disarmed, a deadline landing on it moves a millisecond on
+            uint32_t deadline = cmd->t_ms + (uint32_t) cmd->a * 100;
+            st->fade_deadline_ms = cmd->a ? (deadline ? deadline : 1) : 0;
+            return; }
+        case LIGHT_CMD_EFFECT:
+            st->effect = (uint8_t) cmd->a;
+            st->fx_slot = UINT32_MAX;
+            st->anim = cmd->b;
+            st->fx_start_ms = s_clock_ms;
+            break;
+        default: return;
+    }
+    st->pending = true;
+}
+
+static void push_cmd(light_cmd_t *cmd)
+{
+    cmd->t_ms = now_ms();
+    light_cmd_queue_push(&s_cmd_queue, cmd);
+    if (s_render_task) xTaskNotifyGive(s_render_task);
+}
+
+// Writes the color ramp of an animation span into its channel pixels, on top of what the frame already wrote
+static void write_ramp_ch(light_channel_state_t *ch, const light_anim_span_t *s, uint8_t level)
+{
+    if (s->px_lo >= s->px_hi) return;
+    uint16_t n = s->px_hi - s->px_lo;
+    // a linear ramp draws what its middle color draws
+    uint8_t mr = scale_by_level((uint8_t) ((s->c0[0] + s->c1[0]) / 2), level);
+    uint8_t mg = scale_by_level((uint8_t) ((s->c0[1] + s->c1[1]) / 2), level);
+    uint8_t mb = scale_by_level((uint8_t) ((s->c0[2] + s->c1[2]) / 2), level);
+    ch->load_ma = (uint32_t) ((uint64_t) ch->load_ma * (ch->led_count - n) / ch->led_count) + n * pixel_load(mr, mg, mb) / 255;
+    uint32_t f = ((uint32_t) s_level_lut[level] * ch->limit_q8) >> 8;
+    int32_t dr = s->c1[0] - s->c0[0], dg = s->c1[1] - s->c0[1], db = s->c1[2] - s->c0[2];
+    int32_t step = n > 1 ? 0x10000 / (n - 1) : 0, w = 0;
+    uint8_t *px = segment_pixels(ch, s->px_lo);
+    for (uint16_t i = 0; i < n; ++i, w += step, px += LED_OUTPUT_BYTES_PER_PIXEL) {
+        uint32_t r = (uint32_t) (s->c0[0] + ((dr * w) >> 16));
+        uint32_t g = (uint32_t) (s->c0[1] + ((dg * w) >> 16));
+        uint32_t b = (uint32_t) (s->c0[2] + ((db * w) >> 16));
+        px[0] = (uint8_t) ((g * f + 32768) >> 16);
+        px[1] = (uint8_t) ((r * f + 32768) >> 16);
+        px[2] = (uint8_t) ((b * f + 32768) >> 16);
+    }
+    ch->out_valid = false;
+    ch->canvas_synced = false;
+    mark_dirty_ch(ch, s->px_lo, s->px_hi);
+}
+
+// Animation frame: the segment is cleared and every track draws its ramp, key levels are relative to the channel level
+static void render_anim_ch(light_channel_state_t *st, uint32_t t_ms)
+{
+    light_anim_span_t spans[LIGHT_ANIM_TRACKS_MAX];
+    size_t count;
+    if (!light_anim_eval(&s_anim, st->anim, t_ms - st->fx_start_ms, st->led_count, spans, &count)) {
+        // a one-shot animation is over, the channel shows its base state again
+        st->effect = LIGHT_EFFECT_NONE;
+        st->out_valid = false;
+        render_base_ch(st);
+        return;
+    }
+    uint8_t level = out_level(st);
+    write_pixels_ch(st, 0, 0, 0, 0);
+    for (size_t i = 0; i < count; ++i) {
+        write_ramp_ch(st, &spans[i], (uint8_t) ((spans[i].level * level + 127) / 255));
+    }
+}
+
+// Effect frame for one channel at shared time t_ms; only writes pixels, the caller refreshes
+static void render_effect_ch(light_channel_state_t *st, uint32_t t_ms)
+{
+    switch (st->effect) {
+        case LIGHT_EFFECT_BLINK: {
+            bool on = ((t_ms / 500) & 1) == 0;
+            write_pixels_ch(st, st->r, st->g, st->b, on ? st->level : 0);
+            break; }
+        case LIGHT_EFFECT_BREATHE: {
+            // Triangle wave between 5 and the channel level, 5 steps per 40 ms
+            uint8_t lvl = st->level;
+            if (st->level > 5) {
+                uint32_t range = (uint32_t) st->level - 5;
+                uint32_t pos = (t_ms / 40 * 5) % (2 * range);
+                lvl = (uint8_t) (5 + (pos < range ? pos : 2 * range - pos));
+            }
+            write_pixels_ch(st, st->r, st->g, st->b, st->power ? lvl : 0);
+            break; }
+        case LIGHT_EFFECT_ICU: {
+            // on 120, off 120, on 120, off 500
+            uint32_t pos = t_ms % 860;
+            bool on = pos < 120 || (pos >= 240 && pos < 360);
+            write_pixels_ch(st, st->r, st->g, st->b, on ? st->level : 0);
+            break; }
+        case LIGHT_EFFECT_RANDOM_COLOR: {
+            uint32_t slot = t_ms / 700;
+            if (slot != st->fx_slot) {
+                uint32_t rnd = esp_random();
+                st->fx_r = (uint8_t) (rnd & 0xFF);
+                st->fx_g = (uint8_t) (rnd >> 8);
+                st->fx_b = (uint8_t) (rnd >> 16);
+                st->fx_slot = slot;
+            }
+            write_pixels_ch(st, st->fx_r, st->fx_g, st->fx_b, out_level(st));
+            break; }
+        case LIGHT_EFFECT_ANIMATION:
+            render_anim_ch(st, t_ms);
+            break;
+        case LIGHT_EFFECT_STATIC:
+        case LIGHT_EFFECT_NONE:
+        default:
+            render_base_ch(st);
+            break;
+    }
+}
+
+// Disarms transition deadlines that have passed; returns the ms until the next armed one, UINT32_MAX for none.
+// The idle render task sleeps no longer than that, so no deadline outlives the 2^31 ms comparison window.
+static uint32_t expire_transitions(uint32_t now)
+{
+    uint32_t next = UINT32_MAX;
+    for (size_t i = 0; i < s_channel_count; ++i) {
+        light_channel_state_t *st = &s_channels[i];
+        if (!st->fade_deadline_ms) continue;
+        uint32_t left = transition_ms(st, now);
+        if (left && left < next) next = left;
+    }
+    return next;
+}
+
+static bool render_active(void)
+{
+    for (size_t i = 0; i < s_channel_count; ++i) {
+        const light_channel_state_t *st = &s_channels[i];
+        if (st->out && (st->pending || st->effect != LIGHT_EFFECT_NONE || fades_running(st))) return true;
+    }
+    if (!light_cmd_queue_empty(&s_cmd_queue) || s_group_active >= 0 || s_cap_q8 != s_cap_target_q8) return true;
+    // a deferred flush still has to go out
+    for (size_t i = 0; i < s_strip_count; ++i) {
+        if (s_strips[i].out && strip_dirty(&s_strips[i])) return true;
+    }
+    return false;
+}
+
+// Single render task: applies pending setter state, advances all channel effects and transitions on one frame
+// clock and pushes each strip once per frame. Sleeps on a task notification while nothing is animating; a
+// wake-up from idle renders right away so single updates are not delayed by a frame.
+// One channel's frame: a per-channel effect owns the pixels, then a running group effect, then the base state
+static void render_ch(light_channel_state_t *st, const light_group_effect_config_t *group, uint32_t group_t)
+{
+    if (st->effect != LIGHT_EFFECT_NONE) render_effect_ch(st, s_clock_ms);
+    else if (group && st->group_pos != GROUP_POS_NONE) render_group_ch(st, group, group_t);
+    else render_base_ch(st);
+    s_strips[st->strip].rendered = true;
+}
+
+// Sums the estimated load of all channels and hands the budget out in priority order, on top of the global
+// output cap. Channels whose scale changed are rendered again, so an over-budget frame never reaches the strips.
+static void power_limit_frame(bool held, const light_group_effect_config_t *group, uint32_t group_t)
+{
+    if (s_cap_q8 + LIGHT_OUTPUT_CAP_STEP_Q8 <= s_cap_target_q8) s_cap_q8 += LIGHT_OUTPUT_CAP_STEP_Q8;
+    else if (s_cap_q8 >= s_cap_target_q8 + LIGHT_OUTPUT_CAP_STEP_Q8) s_cap_q8 -= LIGHT_OUTPUT_CAP_STEP_Q8;
+    else s_cap_q8 = s_cap_target_q8;
+    uint32_t demand[LIGHT_POWER_PRIORITIES] = { 0 };
+    uint32_t idle_ma = s_total_pixels * s_power_cfg.idle_ua_per_pixel / 1000;
+    // a held channel keeps showing its pixels at the scale they were written with, that load is taken first
+    uint32_t fixed_ma = 0;
+    for (size_t i = 0; i < s_channel_count; ++i) {
+        const light_channel_state_t *st = &s_channels[i];
+        if (!st->out) continue;
+        if (held && st->pending) fixed_ma += (st->load_ma * st->limit_q8) >> 8;
+        else demand[st->priority] += st->load_ma;
+    }
+    light_power_allot_t allot;
+    if (light_power_allot(demand, idle_ma + fixed_ma, s_power_cfg.budget_ma, s_cap_q8, &allot)) s_power_stats.limited_frames++;
+    const uint16_t *scale = allot.scale_q8;
+    memcpy(s_power_stats.scale_q8, scale, sizeof(s_power_stats.scale_q8));
+    s_power_stats.cap_q8 = s_cap_q8;
+    s_power_stats.demand_ma = allot.demand_ma;     // capped demand; the cap is not the budget's doing
+    s_power_stats.output_ma = allot.output_ma;
+
+    for (size_t i = 0; i < s_channel_count; ++i) {
+        light_channel_state_t *st = &s_channels[i];
+        // a held channel picks its new scale up with the frame that releases it
+        if (!st->out || st->limit_q8 == scale[st->priority] || (held && st->pending)) continue;
+        st->limit_q8 = scale[st->priority];
+        render_ch(st, group, group_t);
+    }
+}
+
+static void render_task(void *arg)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+    for (;;) {
+        xSemaphoreTake(s_driver_lock, portMAX_DELAY);
+        bool active = render_active();
+        uint32_t armed_ms = expire_transitions(now_ms());
+        xSemaphoreGive(s_driver_lock);
+        if (!active) {
+            ulTaskNotifyTake(pdTRUE, armed_ms == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(armed_ms) + 1);
+            last_wake = xTaskGetTickCount();
+        } else {
+            vTaskDelayUntil(&last_wake, s_frame_ticks);
+        }
+
+        int64_t t0 = esp_timer_get_time();
+        xSemaphoreTake(s_driver_lock, portMAX_DELAY);
+        s_clock_ms += s_frame_ticks * portTICK_PERIOD_MS;
+        uint32_t now = now_ms();
+        bool held = batch_held(now);
+        light_cmd_t cmd;
+        while (light_cmd_queue_pop(&s_cmd_queue, &cmd)) apply_cmd(&cmd);
+        // group effects step on the same clock, a step always lands on a frame boundary
+        const light_group_effect_config_t *group = s_group_active >= 0 ? &s_group_defs[s_group_active].cfg : NULL;
+        uint32_t group_t = s_clock_ms - s_group_start_ms;
+        uint64_t landed = 0;
+        light_group_effect_config_t landed_cfg = { 0 };
+        if (group && group_done(group, group_t)) {
+            if (group->hold && group->kind != LIGHT_GROUP_CHASE) {
+                landed = group_land(group);
+                landed_cfg = *group;
+            }
+            group_stop();
+            group = NULL;
+        }
+        for (size_t i = 0; i < s_channel_count; ++i) {
+            light_channel_state_t *st = &s_channels[i];
+            if (!st->out) continue;
+            // a command is still being written into this channel, keep showing the previous state
+            if (held && st->pending) continue;
+            bool fading = fades_running(st);
+            if (fading) advance_fades_ch(st, now);
+            if (st->effect != LIGHT_EFFECT_NONE || (group && st->group_pos != GROUP_POS_NONE) || fading || st->pending) {
+                render_ch(st, group, group_t);
+            }
+            st->pending = false;
+        }
+        power_limit_frame(held, group, group_t);
+        uint32_t refreshes_before = s_render_stats.refreshes;
+        // all segments of a strip are out together, one transmission per strip per frame; the transmissions
+        // of different strips run in parallel on their own peripherals
+        for (size_t i = 0; i < s_strip_count; ++i) {
+            if (s_strips[i].rendered || (s_strips[i].out && strip_dirty(&s_strips[i]))) flush_strip(&s_strips[i]);
         }
+
+        if (!s_first_frame_logged && s_render_stats.refreshes != refreshes_before) {
+            // boot instrumentation: first frame the render task put on the wire (esp_timer starts with the app)
+            s_first_frame_logged = true;
+            ESP_LOGI(LD_TAG, "First frame sent %lld us after boot", (long long) esp_timer_get_time());
+        }
+        // a held batch keeps the marked commands back, the mark completes with the frame that shows them
+        if (s_mark_pending && !held) {
+            uint32_t lat = (uint32_t) esp_timer_get_time() - s_mark_event_us;
+            s_mark_pending = false;
+            s_render_stats.marks++;
+            s_render_stats.mark_last_us = lat;
+            if (lat > s_render_stats.mark_max_us) s_render_stats.mark_max_us = lat;
+            ESP_LOGI(LD_TAG, "Marked event reached the strips after %u us", (unsigned) lat);
+        }
+        uint32_t dt = (uint32_t) (esp_timer_get_time() - t0);
+        s_render_stats.frames++;
+        s_render_stats.last_frame_us = dt;
+        if (dt > s_render_stats.max_frame_us) s_render_stats.max_frame_us = dt;
+        if (dt > s_frame_budget_us && (s_render_stats.overruns++ % 100) == 0) {
+            ESP_LOGW(LD_TAG, "Frame took %u us (budget %u us, %u overruns)", (unsigned) dt,
+                     (unsigned) s_frame_budget_us, (unsigned) s_render_stats.overruns);
+        }
+        xSemaphoreGive(s_driver_lock);
+        if (landed && s_group_land_cb) s_group_land_cb(landed, &landed_cfg);
+    }
+}
+
+void light_driver_set_frame_rate(uint16_t fps, uint32_t budget_us)
+{
+    if (fps == 0) fps = 1;
+    if (fps > configTICK_RATE_HZ) fps = configTICK_RATE_HZ;
+    s_frame_ticks = configTICK_RATE_HZ / fps;
+    s_frame_budget_us = budget_us ? budget_us : s_frame_ticks * portTICK_PERIOD_MS * 1000;
+}
+
+void light_driver_set_gamma(uint16_t gamma_x100)
+{
+    if (gamma_x100 == 0) gamma_x100 = 100;
+    if (s_driver_lock) xSemaphoreTake(s_driver_lock, portMAX_DELAY);
+    color_level_lut_build(gamma_x100, s_level_lut);
+    // every channel re-encodes through the new curve on the next frame
+    for (size_t i = 0; i < s_channel_count; ++i) {
+        s_channels[i].out_valid = false;
+        s_channels[i].canvas_synced = false;
+        s_channels[i].pending = true;
     }
-    st->effect_task = NULL;
-    vTaskDelete(NULL);
+    if (s_driver_lock) xSemaphoreGive(s_driver_lock);
+    if (s_render_task) xTaskNotifyGive(s_render_task);
 }
 
-void light_driver_init_channels(const light_channel_config_t *channels, size_t count, bool power_default)
+// Re-estimates every channel under a new model or budget on the next frame
+static void power_invalidate(void)
 {
-    if (!channels || count == 0) return;
-    if (count > MAX_LIGHT_CHANNELS) {
-        ESP_LOGW(LD_TAG, "Requested %u channels, limiting to %d", (unsigned)count, MAX_LIGHT_CHANNELS);
-        count = MAX_LIGHT_CHANNELS;
+    for (size_t i = 0; i < s_channel_count; ++i) {
+        s_channels[i].out_valid = false;
+        s_channels[i].canvas_synced = false;
+        s_channels[i].pending = true;
+    }
+    if (s_render_task) xTaskNotifyGive(s_render_task);
+}
+
+void light_driver_set_power_config(const light_power_config_t *cfg)
+{
+    if (!cfg) return;
+    if (s_driver_lock) xSemaphoreTake(s_driver_lock, portMAX_DELAY);
+    s_power_cfg = *cfg;
+    power_invalidate();
+    if (s_driver_lock) xSemaphoreGive(s_driver_lock);
+}
+
+void light_driver_set_power_budget(uint32_t budget_ma)
+{
+    if (s_driver_lock) xSemaphoreTake(s_driver_lock, portMAX_DELAY);
+    s_power_cfg.budget_ma = budget_ma;
+    power_invalidate();
+    if (s_driver_lock) xSemaphoreGive(s_driver_lock);
+}
+
+void light_driver_set_output_cap(uint16_t cap_q8)
+{
+    if (cap_q8 > 256) cap_q8 = 256;
+    if (s_driver_lock) xSemaphoreTake(s_driver_lock, portMAX_DELAY);
+    s_cap_target_q8 = cap_q8;
+    if (s_render_task) xTaskNotifyGive(s_render_task);
+    if (s_driver_lock) xSemaphoreGive(s_driver_lock);
+}
+
+void light_driver_set_power_priority_ch(size_t ch, uint8_t priority)
+{
+    if (!ch_valid(ch) || !s_driver_lock) return;
+    if (priority >= LIGHT_POWER_PRIORITIES) priority = LIGHT_POWER_PRIORITIES - 1;
+    xSemaphoreTake(s_driver_lock, portMAX_DELAY);
+    s_channels[ch].priority = priority;
+    if (s_render_task) xTaskNotifyGive(s_render_task);
+    xSemaphoreGive(s_driver_lock);
+}
+
+void light_driver_get_power_stats(light_power_stats_t *out)
+{
+    if (!out || !s_driver_lock) return;
+    xSemaphoreTake(s_driver_lock, portMAX_DELAY);
+    *out = s_power_stats;
+    out->budget_ma = s_power_cfg.budget_ma;
+    xSemaphoreGive(s_driver_lock);
+}
+
+void light_driver_get_render_stats(light_render_stats_t *out)
+{
+    if (!out || !s_driver_lock) return;
+    xSemaphoreTake(s_driver_lock, portMAX_DELAY);
+    *out = s_render_stats;
+    out->cmds_queued = s_cmd_queue.stats.pushed;
+    out->cmd_depth_max = s_cmd_queue.stats.depth_max;
+    out->cmd_overflows = s_cmd_queue.stats.overflows;
+    out->cmd_coalesced = s_cmd_queue.stats.coalesced;
+    xSemaphoreGive(s_driver_lock);
+}
+
+esp_err_t light_driver_init_segments(const light_strip_config_t *strips, size_t strip_count,
+                                     const light_segment_config_t *segments, size_t count, bool power_default)
+{
+    if (!strips || !segments || strip_count == 0 || count == 0) return ESP_ERR_INVALID_ARG;
+    if (count > MAX_LIGHT_CHANNELS || strip_count > MAX_LIGHT_STRIPS) {
+        ESP_LOGE(LD_TAG, "Requested %u channels on %u strips, at most %d on %d", (unsigned) count, (unsigned) strip_count,
+                 MAX_LIGHT_CHANNELS, MAX_LIGHT_STRIPS);
+        return ESP_ERR_INVALID_ARG;
     }
     if (!s_driver_lock) s_driver_lock = xSemaphoreCreateMutex();
     xSemaphoreTake(s_driver_lock, portMAX_DELAY);
     if (s_channel_count) { // already initialized
-        xSemaphoreGive(s_driver_lock); return; }
-    for (size_t i = 0; i < count; ++i) {
-        led_strip_config_t cfg = { .strip_gpio_num = channels[i].gpio, .max_leds = channels[i].led_count };
-        led_strip_rmt_config_t rmt = { .resolution_hz = 10 * 1000 * 1000 };
-        led_strip_handle_t handle;
-        esp_err_t err = led_strip_new_rmt_device(&cfg, &rmt, &handle);
-        if (err == ESP_OK && handle) {
-            s_channels[i].handle = handle;
-            s_channels[i].led_count = channels[i].led_count;
-            s_channels[i].r = 255; s_channels[i].g = 255; s_channels[i].b = 255;
-            s_channels[i].level = 255; s_channels[i].power = power_default;
-            s_channels[i].effect = LIGHT_EFFECT_NONE; s_channels[i].effect_task = NULL; s_channels[i].effect_stop = false;
-            apply_output_ch(&s_channels[i]);
-            ESP_LOGI(LD_TAG, "Channel %u init OK (GPIO %d, leds %u)", (unsigned)i, channels[i].gpio, channels[i].led_count);
+        xSemaphoreGive(s_driver_lock); return ESP_ERR_INVALID_STATE; }
+    if (!s_level_lut[255]) color_level_lut_build(LIGHT_GAMMA_X100_DEFAULT, s_level_lut);
+    s_channels = calloc(count, sizeof(*s_channels));
+    if (!s_channels) {
+        ESP_LOGE(LD_TAG, "No memory for %u channels", (unsigned) count);
+        xSemaphoreGive(s_driver_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < strip_count; ++i) {
+        const led_output_config_t out_cfg = {
+            .backend = strips[i].backend, .gpio = strips[i].gpio, .led_count = strips[i].led_count };
+        esp_err_t err = led_output_new(&out_cfg, &s_strips[i].out);
+        if (err == ESP_OK) {
+            ESP_LOGI(LD_TAG, "Strip %u init OK (GPIO %d, leds %u, %s)", (unsigned)i, strips[i].gpio, strips[i].led_count,
+                     strips[i].backend == LED_OUTPUT_SPI ? "SPI" : "RMT");
+            s_total_pixels += strips[i].led_count;
         } else {
-            ESP_LOGE(LD_TAG, "Channel %u init FAILED (GPIO %d, err %s)", (unsigned)i, channels[i].gpio, esp_err_to_name(err));
-            s_channels[i].handle = NULL;
+            ESP_LOGE(LD_TAG, "Strip %u init FAILED (GPIO %d, err %s)", (unsigned)i, strips[i].gpio, esp_err_to_name(err));
+            s_strips[i].out = NULL;
         }
     }
+    s_strip_count = strip_count;
+    for (size_t i = 0; i < count; ++i) {
+        const light_segment_config_t *seg = &segments[i];
+        light_channel_state_t *st = &s_channels[i];
+        bool fits = seg->strip < strip_count && s_strips[seg->strip].out && seg->led_count &&
+                    (uint32_t) seg->offset + seg->led_count <= strips[seg->strip].led_count;
+        if (!fits) {
+            ESP_LOGE(LD_TAG, "Channel %u has no usable segment (strip %u, offset %u, leds %u)", (unsigned)i,
+                     seg->strip, seg->offset, seg->led_count);
+            st->out = NULL;
+            continue;
+        }
+        st->out = s_strips[seg->strip].out;
+        st->strip = seg->strip;
+        st->offset = seg->offset;
+        st->led_count = seg->led_count;
+        st->r = 255; st->g = 255; st->b = 255;
+        st->color = (light_color_t) { .kind = COLOR_RGB, .a = 255, .b = 255, .c = 255 };
+        st->level = 255; st->power = power_default;
+        st->on_frac = power_default ? 255 : 0;
+        st->effect = LIGHT_EFFECT_NONE; st->fx_slot = UINT32_MAX;
+        st->group_pos = GROUP_POS_NONE;
+        st->limit_q8 = 256;
+        render_base_ch(st);
+    }
+    if (light_cmd_queue_init(&s_cmd_queue, (uint16_t) count) != ESP_OK) {
+        ESP_LOGE(LD_TAG, "No memory for the command queue");
+        free(s_channels);
+        s_channels = NULL;
+        xSemaphoreGive(s_driver_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(LD_TAG, "%u channels: %u bytes of channel state", (unsigned) count, (unsigned) (count * sizeof(*s_channels)));
     s_channel_count = count;
+    for (size_t i = 0; i < strip_count; ++i) {
+        if (s_strips[i].out) flush_strip(&s_strips[i]);
+    }
+    if (!s_render_task) {
+        light_driver_set_frame_rate(LIGHT_RENDER_FPS_DEFAULT, LIGHT_RENDER_BUDGET_US_DEFAULT);
+        xTaskCreate(render_task, "light_render", RENDER_TASK_STACK, NULL, RENDER_TASK_PRIO, &s_render_task);
+    }
     xSemaphoreGive(s_driver_lock);
+    return ESP_OK;
+}
+
+// One strip per channel
+esp_err_t light_driver_init_channels(const light_channel_config_t *channels, size_t count, bool power_default)
+{
+    if (!channels || count == 0) return ESP_ERR_INVALID_ARG;
+    if (count > MAX_LIGHT_STRIPS) {
+        ESP_LOGE(LD_TAG, "Requested %u single-strip channels, at most %d strips", (unsigned) count, MAX_LIGHT_STRIPS);
+        return ESP_ERR_INVALID_ARG;
+    }
+    light_strip_config_t strips[MAX_LIGHT_STRIPS];
+    light_segment_config_t segments[MAX_LIGHT_STRIPS];
+    for (size_t i = 0; i < count; ++i) {
+        strips[i] = (light_strip_config_t) { .gpio = channels[i].gpio, .led_count = channels[i].led_count };
+        segments[i] = (light_segment_config_t) { .strip = (uint8_t) i, .offset = 0, .led_count = channels[i].led_count };
+    }
+    return light_driver_init_segments(strips, count, segments, count, power_default);
 }
 
 size_t light_driver_channel_count(void) { return s_channel_count; }
 
-static void set_color_xy_internal(light_channel_state_t *st, uint16_t x, uint16_t y)
-{
-    float red_f = 0, green_f = 0, blue_f = 0, cx, cy;
-    cx = (float) x / 65535.0f;
-    cy = (float) y / 65535.0f;
-    if (cy < 0.00001f) return;
-    float X = cx / cy;
-    float Z = (1.0f - cx - cy) / cy;
-    XYZ_to_RGB(X, 1.0f, Z, red_f, green_f, blue_f);
-    if (red_f < 0) red_f = 0;
-    if (green_f < 0) green_f = 0;
-    if (blue_f < 0) blue_f = 0;
-    if (red_f > 1) red_f = 1;
-    if (green_f > 1) green_f = 1;
-    if (blue_f > 1) blue_f = 1;
-    st->r = (uint8_t) (red_f * 255.0f);
-    st->g = (uint8_t) (green_f * 255.0f);
-    st->b = (uint8_t) (blue_f * 255.0f);
-    if (st->power) apply_output_ch(st);
-}
-
-void light_driver_set_power_ch(size_t ch, bool power) { if (!ch_valid(ch)) return; s_channels[ch].power = power; apply_output_ch(&s_channels[ch]); }
-void light_driver_set_level_ch(size_t ch, uint8_t level) { if (!ch_valid(ch)) return; s_channels[ch].level = level; if (s_channels[ch].power) apply_output_ch(&s_channels[ch]); }
-void light_driver_set_color_RGB_ch(size_t ch, uint8_t red, uint8_t green, uint8_t blue) { if (!ch_valid(ch)) return; s_channels[ch].r=red; s_channels[ch].g=green; s_channels[ch].b=blue; if (s_channels[ch].power) apply_output_ch(&s_channels[ch]); }
-void light_driver_set_color_xy_ch(size_t ch, uint16_t x, uint16_t y) { if (!ch_valid(ch)) return; set_color_xy_internal(&s_channels[ch], x, y); }
-void light_driver_set_color_hue_sat_ch(size_t ch, uint8_t hue, uint8_t sat) { if (!ch_valid(ch)) return; float rf,gf,bf; HSV_to_RGB(hue,sat,UINT8_MAX,rf,gf,bf); s_channels[ch].r=(uint8_t)rf; s_channels[ch].g=(uint8_t)gf; s_channels[ch].b=(uint8_t)bf; if (s_channels[ch].power) apply_output_ch(&s_channels[ch]); }
-void light_driver_set_color_temperature_mired_ch(size_t ch, uint16_t mired) { if (!ch_valid(ch)) return; color_temp_to_rgb(mired,&s_channels[ch].r,&s_channels[ch].g,&s_channels[ch].b); if (s_channels[ch].power) apply_output_ch(&s_channels[ch]); }
+static void push_color(size_t ch, color_kind_t kind, uint16_t a, uint16_t b, uint16_t c)
+{
+    light_cmd_t cmd = { .ch = (uint8_t) ch, .op = LIGHT_CMD_COLOR, .kind = kind, .a = a, .b = b, .c = c };
+    push_cmd(&cmd);
+}
 
+void light_driver_set_transition_ch(size_t ch, uint16_t transition_ds)
+{
+    if (!ch_valid(ch)) return;
+    light_cmd_t cmd = { .ch = (uint8_t) ch, .op = LIGHT_CMD_TRANSITION, .a = transition_ds };
+    push_cmd(&cmd);
+}
+
+void light_driver_batch_begin(void)
+{
+    if (atomic_fetch_add_explicit(&s_batch_depth, 1, memory_order_relaxed) == 0) {
+        atomic_store_explicit(&s_batch_start_ms, now_ms(), memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_release);
+}
+
+void light_driver_batch_end(void)
+{
+    unsigned depth = atomic_load_explicit(&s_batch_depth, memory_order_relaxed);
+    if (depth) atomic_store_explicit(&s_batch_depth, depth - 1, memory_order_release);
+    if (depth <= 1 && s_render_task) xTaskNotifyGive(s_render_task);
+}
+
+void light_driver_set_power_ch(size_t ch, bool power) { if (!ch_valid(ch)) return; light_cmd_t cmd = { .ch = (uint8_t) ch, .op = LIGHT_CMD_POWER, .a = power }; push_cmd(&cmd); }
+void light_driver_set_level_ch(size_t ch, uint8_t level) { if (!ch_valid(ch)) return; light_cmd_t cmd = { .ch = (uint8_t) ch, .op = LIGHT_CMD_LEVEL, .a = level }; push_cmd(&cmd); }
+void light_driver_set_color_RGB_ch(size_t ch, uint8_t red, uint8_t green, uint8_t blue) { if (!ch_valid(ch)) return; push_color(ch, COLOR_RGB, red, green, blue); }
+void light_driver_set_color_xy_ch(size_t ch, uint16_t x, uint16_t y) { if (!ch_valid(ch) || y == 0) return; push_color(ch, COLOR_XY, x, y, 0); }
+void light_driver_set_color_hue_sat_ch(size_t ch, uint8_t hue, uint8_t sat) { if (!ch_valid(ch)) return; push_color(ch, COLOR_HS, hue, sat, 0); }
+void light_driver_set_color_enhanced_hue_sat_ch(size_t ch, uint16_t enhanced_hue, uint8_t sat) { if (!ch_valid(ch)) return; push_color(ch, COLOR_EHS, enhanced_hue, sat, 0); }
+void light_driver_set_color_temperature_mired_ch(size_t ch, uint16_t mired) { if (!ch_valid(ch)) return; push_color(ch, COLOR_CT, mired, 0, 0); }
+
+uint8_t *light_driver_fb_begin(size_t ch, uint16_t *led_count)
+{
+    if (!ch_valid(ch) || !s_channels[ch].out) return NULL;
+    light_channel_state_t *st = &s_channels[ch];
+    xSemaphoreTake(s_driver_lock, portMAX_DELAY);
+    if (!st->canvas) st->canvas = calloc(st->led_count, 3);
+    if (!st->canvas) { xSemaphoreGive(s_driver_lock); return NULL; }
+    if (!st->canvas_active) {
+        st->canvas_active = true;
+        st->canvas_synced = false;
+    }
+    if (led_count) *led_count = st->led_count;
+    return st->canvas;
+}
+
+void light_driver_fb_end(size_t ch, uint16_t start, uint16_t count)
+{
+    if (!ch_valid(ch)) return;
+    light_channel_state_t *st = &s_channels[ch];
+    if (start < st->led_count && count) {
+        uint16_t hi = (uint16_t) ((uint32_t) start + count > st->led_count ? st->led_count : start + count);
+        if (st->canvas_lo >= st->canvas_hi) { st->canvas_lo = start; st->canvas_hi = hi; }
+        else { if (start < st->canvas_lo) st->canvas_lo = start; if (hi > st->canvas_hi) st->canvas_hi = hi; }
+    }
+    // presented by the render task with the rest of the frame, after the power limiter has seen it
+    st->pending = true;
+    xSemaphoreGive(s_driver_lock);
+    if (s_render_task) xTaskNotifyGive(s_render_task);
+}
+
+esp_err_t light_driver_fb_write(size_t ch, uint16_t start, const uint8_t *rgb, uint16_t count)
+{
+    uint16_t led_count = 0;
+    if (!rgb) return ESP_ERR_INVALID_ARG;
+    uint8_t *canvas = light_driver_fb_begin(ch, &led_count);
+    if (!canvas) return ESP_ERR_INVALID_STATE;
+    if (start >= led_count) { light_driver_fb_end(ch, 0, 0); return ESP_ERR_INVALID_SIZE; }
+    if (count > led_count - start) count = led_count - start;
+    memcpy(canvas + (size_t) start * 3, rgb, (size_t) count * 3);
+    light_driver_fb_end(ch, start, count);
+    return ESP_OK;
+}
+
+void light_driver_fb_release(size_t ch)
+{
+    if (!ch_valid(ch)) return;
+    xSemaphoreTake(s_driver_lock, portMAX_DELAY);
+    s_channels[ch].canvas_active = false;
+    s_channels[ch].out_valid = false;
+    s_channels[ch].pending = true;
+    xSemaphoreGive(s_driver_lock);
+    if (s_render_task) xTaskNotifyGive(s_render_task);
+}
+
+// Effects only flip per-channel state; the shared render task does the work, so start/stop never creates or deletes tasks
 void light_driver_effect_start_ch(size_t ch, light_effect_t effect)
-{ if (!ch_valid(ch)) return; light_channel_state_t *st=&s_channels[ch]; if (effect==LIGHT_EFFECT_NONE){ light_driver_effect_stop_ch(ch); return;} st->effect=effect; st->effect_stop=false; if(!st->effect_task){ xTaskCreate(effect_task_ch,"fx_ch",2048,(void*)ch,4,&st->effect_task);} }
-void light_driver_effect_stop_ch(size_t ch)
-{ if (!ch_valid(ch)) return; light_channel_state_t *st=&s_channels[ch]; if(st->effect_task){ st->effect_stop=true; for(int i=0;i<10 && st->effect_task;++i) vTaskDelay(pdMS_TO_TICKS(20)); } st->effect=LIGHT_EFFECT_NONE; st->power=true; apply_output_ch(st); }
+{
+    if (!ch_valid(ch)) return;
+    light_cmd_t cmd = { .ch = (uint8_t) ch, .op = LIGHT_CMD_EFFECT, .a = (uint16_t) effect };
+    push_cmd(&cmd);
+}
+void light_driver_effect_stop_ch(size_t ch) { light_driver_effect_start_ch(ch, LIGHT_EFFECT_NONE); }
+
+esp_err_t light_driver_anim_load(void)
+{
+    if (s_anim.image) return ESP_ERR_INVALID_STATE;
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, LIGHT_ANIM_PARTITION_SUBTYPE,
+                                                           LIGHT_ANIM_PARTITION_LABEL);
+    if (!part) return ESP_ERR_NOT_FOUND;
+    // mapped through the flash cache: frames read keyframes in place, nothing is copied to RAM
+    const void *image;
+    esp_err_t err = esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, &image, &s_anim_map);
+    if (err != ESP_OK) return err;
+    light_anim_lib_t lib;
+    err = light_anim_open(image, part->size, &lib);
+    if (err != ESP_OK) {
+        esp_partition_munmap(s_anim_map);
+        if (err == ESP_ERR_NOT_FOUND) ESP_LOGI(LD_TAG, "No animation image in partition '%s'", part->label);
+        return err;
+    }
+    s_anim = lib;
+    ESP_LOGI(LD_TAG, "%u animations mapped from partition '%s' (%u bytes)", s_anim.count, part->label, (unsigned) s_anim.size);
+    return ESP_OK;
+}
+
+size_t light_driver_anim_count(void) { return s_anim.count; }
+
+int light_driver_anim_find(const char *name) { return light_anim_find(&s_anim, name); }
+
+esp_err_t light_driver_anim_start_ch(size_t ch, uint16_t anim)
+{
+    if (!ch_valid(ch)) return ESP_ERR_INVALID_ARG;
+    if (anim >= s_anim.count) return ESP_ERR_NOT_FOUND;
+    light_cmd_t cmd = { .ch = (uint8_t) ch, .op = LIGHT_CMD_EFFECT, .a = LIGHT_EFFECT_ANIMATION, .b = anim };
+    push_cmd(&cmd);
+    return ESP_OK;
+}
+
+void light_driver_set_group_land_cb(light_driver_group_land_cb_t cb) { s_group_land_cb = cb; }
+
+esp_err_t light_driver_group_effect_define(uint8_t id, const light_group_effect_config_t *cfg)
+{
+    if (id >= LIGHT_GROUP_EFFECTS_MAX || !cfg || !cfg->channels || !cfg->count || cfg->count > MAX_LIGHT_CHANNELS ||
+        cfg->count >= GROUP_POS_NONE || !s_driver_lock) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s_driver_lock, portMAX_DELAY);
+    // a running effect keeps its definition until it lands, redefining it would change the sequence mid-run
+    if (s_group_active == id) {
+        xSemaphoreGive(s_driver_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    light_group_def_t *def = &s_group_defs[id];
+    memcpy(def->list, cfg->channels, cfg->count);
+    def->cfg = *cfg;
+    def->cfg.channels = def->list;
+    if (!def->cfg.step_ms) def->cfg.step_ms = 1;
+    if (!def->cfg.tail) def->cfg.tail = 1;
+    if (!def->cfg.fade_ms) def->cfg.fade_ms = 1;
+    def->defined = true;
+    xSemaphoreGive(s_driver_lock);
+    return ESP_OK;
+}
+
+void light_driver_group_effect_start(uint8_t id)
+{
+    if (!s_channel_count) return;
+    light_cmd_t cmd = { .ch = 0, .op = LIGHT_CMD_GROUP_EFFECT, .a = id, .b = 1 };
+    push_cmd(&cmd);
+}
+
+void light_driver_group_effect_stop(void)
+{
+    if (!s_channel_count) return;
+    light_cmd_t cmd = { .ch = 0, .op = LIGHT_CMD_GROUP_EFFECT, .b = 0 };
+    push_cmd(&cmd);
+}
+
+void light_driver_mark_latency(int64_t event_us)
+{
+    if (!s_channel_count) return;
+    light_cmd_t cmd = { .ch = 0, .op = LIGHT_CMD_MARK, .b = (uint16_t) event_us, .c = (uint16_t) ((uint64_t) event_us >> 16) };
+    push_cmd(&cmd);
+}
 
 // Single-channel backward compatible wrappers operate on channel 0
 void light_driver_init(bool power) { light_channel_config_t def={ .gpio=CONFIG_EXAMPLE_STRIP_LED_GPIO, .led_count=CONFIG_EXAMPLE_STRIP_LED_NUMBER }; light_driver_init_channels(&def,1,power); }
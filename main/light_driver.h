@@ -16,8 +16,10 @@
 #pragma once
 
 #include <stdbool.h>
-#include <math.h>
+#include <stdint.h>
 #include <stddef.h>
+#include "led_output.h"
+#include "esp_err.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -27,54 +29,14 @@ extern "C" {
 #define LIGHT_DEFAULT_ON  1
 #define LIGHT_DEFAULT_OFF 0
 
+/* Channels per driver; state is allocated for the configured count only */
+#define LIGHT_CHANNELS_MAX 64
+
 /* LED strip configuration */
 #define CONFIG_EXAMPLE_STRIP_LED_GPIO   8
 #define CONFIG_EXAMPLE_STRIP_LED_NUMBER 1
 
 
-/** Convert Hue,Saturation,V to RGB
- * RGB - [0..0xffff]
- * hue - [0..0xff]
- * Sat - [0..0xff]
- * V always = (ZB_UINT16_MAX-1)
-*/
-#define HSV_to_RGB(h, s, v, r, g, b )           \
-{                                               \
-  uint8_t i;                                    \
-  uint8_t sector = UINT8_MAX/6;                 \
-  float f, p, q, t;                             \
-  if( s == 0 ) {  /* achromatic (grey)*/        \
-    r = g = b = (v);                            \
-  }                                             \
-  else                                          \
-  {                                             \
-    i = h / sector;  /* sector 0 to 5 */        \
-    f = h % sector; /* factorial part of h*/    \
-    p = (float)(v * ( 1.0 - (float)s/UINT8_MAX ));                            \
-    q = (float)(v * ( 1.0 - (float)s/UINT8_MAX * f/(float)sector ));          \
-    t = (float)(v * ( 1.0 - (float)s/UINT8_MAX * ( 1 - f/(float)sector ) ));  \
-    switch( i ) {                               \
-      case 0: r = (v); g = t; b = p; break;     \
-      case 1: r = q; g = (v); b = p; break;     \
-      case 2: r = p; g = (v); b = t; break;     \
-      case 3: r = p; g = q; b = (v); break;     \
-      case 4: r = t; g = p; b = (v); break;     \
-      case 5:                                   \
-      default: r = (v); g = p; b = q; break;    \
-    }                                           \
-  }                                             \
-}
-
-#define XYZ_to_RGB(X, Y, Z, r, g, b)                        \
-{                                                           \
-  r = (float)( 3.240479*(X) -1.537150*(Y) -0.498535*(Z));   \
-  g = (float)(-0.969256*(X) +1.875992*(Y) +0.041556*(Z));   \
-  b = (float)( 0.055648*(X) -0.204043*(Y) +1.057311*(Z));   \
-  if(r>1){r=1;}                                             \
-  if(g>1){g=1;}                                             \
-  if(b>1){b=1;}                                             \
-}
-
 /**
 * @brief Set light power (on/off).
 *
@@ -134,29 +96,299 @@ typedef enum {
     LIGHT_EFFECT_BLINK,
     LIGHT_EFFECT_BREATHE,
     LIGHT_EFFECT_ICU,
-    LIGHT_EFFECT_RANDOM_COLOR
+    LIGHT_EFFECT_RANDOM_COLOR,
+    LIGHT_EFFECT_ANIMATION,     // keyframe animation from the anim partition, see light_driver_anim_start_ch()
 } light_effect_t;
 
 void light_driver_effect_start(light_effect_t effect);
 void light_driver_effect_stop(void);
 
+/* Render scheduler: one task renders all channel effects on a shared frame clock */
+#define LIGHT_RENDER_FPS_DEFAULT        50      // frames per second, capped at the FreeRTOS tick rate
+#define LIGHT_RENDER_BUDGET_US_DEFAULT  5000    // per-frame render time budget, overruns are counted and logged
+
+typedef struct {
+    uint32_t frames;            // frames rendered since init
+    uint32_t overruns;          // frames that exceeded the time budget
+    uint32_t last_frame_us;     // render time of the most recent frame
+    uint32_t max_frame_us;      // worst render time seen
+    uint32_t refreshes;         // strip transmissions issued
+    uint32_t refreshes_skipped; // flushes elided because nothing in the channel changed
+    uint32_t pixels_sent;       // pixels transmitted in total
+    uint32_t refreshes_deferred; // flushes postponed to the next frame because the strip was still transmitting
+    uint32_t cmds_queued;       // setter commands pushed to the render task
+    uint32_t cmd_depth_max;     // command ring high-water mark
+    uint32_t cmd_overflows;     // commands parked in the overflow mailbox because the ring was full
+    uint32_t cmd_coalesced;     // parked commands replaced by a newer one before being applied
+    uint32_t marks;             // latency marks completed (light_driver_mark_latency)
+    uint32_t mark_last_us;      // event to frame-out time of the most recent mark
+    uint32_t mark_max_us;       // worst event to frame-out time seen
+} light_render_stats_t;
+
+/**
+* @brief Set render frame rate and per-frame time budget
+*
+* @param  fps        Frames per second (1..configTICK_RATE_HZ)
+* @param  budget_us  Frame time budget in microseconds, 0 = whole frame period
+*/
+void light_driver_set_frame_rate(uint16_t fps, uint32_t budget_us);
+void light_driver_get_render_stats(light_render_stats_t *out);
+
+/*
+ * Power limiter: every frame the render task sums the estimated current of all channels' output (before
+ * limiting) and, over budget, scales channels down. The budget is granted in priority order: priority 0
+ * channels are served first and only the lowest priority that does not fit is scaled (lower ones go dark).
+ */
+#define LIGHT_POWER_PRIORITIES          4
+
+typedef struct {
+    uint16_t ma_red, ma_green, ma_blue; // current of one pixel's component at full scale
+    uint16_t idle_ua_per_pixel;         // quiescent current of every pixel on the strips
+    uint32_t budget_ma;                 // 0 = unlimited
+} light_power_config_t;
+
+#define LIGHT_POWER_CONFIG_DEFAULT() { .ma_red = 20, .ma_green = 20, .ma_blue = 20, .idle_ua_per_pixel = 1000, .budget_ma = 0 }
+
+typedef struct {
+    uint32_t demand_ma;         // estimate of what the channels ask for, idle current included
+    uint32_t output_ma;         // estimate after limiting
+    uint32_t budget_ma;
+    uint32_t limited_frames;    // frames in which the limiter scaled something down
+    uint16_t scale_q8[LIGHT_POWER_PRIORITIES]; // current scale per priority (output cap included), 256 = full
+    uint16_t cap_q8;            // global output cap currently applied
+} light_power_stats_t;
+
+void light_driver_set_power_config(const light_power_config_t *cfg);
+void light_driver_set_power_budget(uint32_t budget_ma);
+/**
+* @brief Set a channel's power priority, 0 (served first) .. LIGHT_POWER_PRIORITIES - 1 (default 0)
+*/
+void light_driver_set_power_priority_ch(size_t ch, uint8_t priority);
+void light_driver_get_power_stats(light_power_stats_t *out);
+
+/**
+* @brief Cap the output of all channels (e.g. thermal derating) without touching their level
+*
+* Applied in the output scaling path together with the power limiter; the render task ramps towards a
+* new cap by LIGHT_OUTPUT_CAP_STEP_Q8 per frame so changes are never a visible step.
+*
+* @param  cap_q8  256 = no cap
+*/
+#define LIGHT_OUTPUT_CAP_STEP_Q8        1
+void light_driver_set_output_cap(uint16_t cap_q8);
+
+/* Perceptual level curve, folded into the integer level lookup table */
+#define LIGHT_GAMMA_X100_DEFAULT        220     // gamma * 100, 100 = linear (previous behaviour)
+
+/**
+* @brief Rebuild the level lookup table for a new gamma curve
+*
+* @param  gamma_x100  Gamma multiplied by 100 (e.g. 220 for 2.2)
+*/
+void light_driver_set_gamma(uint16_t gamma_x100);
+
 typedef struct {
     int gpio;
     uint16_t led_count; // number of pixels on this channel
 } light_channel_config_t;
 
-void light_driver_init_channels(const light_channel_config_t *channels, size_t count, bool power_default);
+/**
+* @brief Init one channel per strip
+*
+* @return ESP_ERR_INVALID_ARG for more than 8 channels (one strip each)
+*/
+esp_err_t light_driver_init_channels(const light_channel_config_t *channels, size_t count, bool power_default);
+
+/* Physical (daisy-chained) strip */
+typedef struct {
+    int gpio;
+    uint16_t led_count; // total pixels on the strip
+    led_output_backend_t backend; // RMT by default; at most one strip can use SPI
+} light_strip_config_t;
+
+/* Channel mapped onto a pixel range of a strip */
+typedef struct {
+    uint8_t strip;      // index into the strip config array
+    uint16_t offset;    // first pixel of the segment
+    uint16_t led_count; // pixels in the segment
+} light_segment_config_t;
+
+/**
+* @brief Init channels as segments of shared strips
+*
+* Each segment becomes one channel (in array order). All segments of a strip are rendered into
+* the same buffer and go out in a single transmission per frame, so many channels share one RMT channel.
+*
+* @param  strips         Physical strips
+* @param  strip_count    Number of strips
+* @param  segments       Channel segments
+* @param  count          Number of channels
+* @param  power_default  Initial power state
+*
+* @return ESP_ERR_INVALID_ARG for more than LIGHT_CHANNELS_MAX channels or 8 strips, ESP_ERR_INVALID_STATE
+*         if the driver is already initialized, ESP_ERR_NO_MEM
+*/
+esp_err_t light_driver_init_segments(const light_strip_config_t *strips, size_t strip_count,
+                                     const light_segment_config_t *segments, size_t count, bool power_default);
 size_t light_driver_channel_count(void);
 
+/*
+ * Channel setters, transitions, effects and batches below are lock-free: they push a command to a
+ * single-producer ring that the render task drains, so they must only be called from the Zigbee task
+ * or with the Zigbee lock held (one producer at a time), and never block on LED I/O.
+ */
 void light_driver_set_power_ch(size_t ch, bool power);
 void light_driver_set_level_ch(size_t ch, uint8_t level);
 void light_driver_set_color_RGB_ch(size_t ch, uint8_t red, uint8_t green, uint8_t blue);
 void light_driver_set_color_xy_ch(size_t ch, uint16_t color_current_x, uint16_t color_current_y);
 void light_driver_set_color_hue_sat_ch(size_t ch, uint8_t hue, uint8_t sat);
+void light_driver_set_color_enhanced_hue_sat_ch(size_t ch, uint16_t enhanced_hue, uint8_t sat);
 void light_driver_set_color_temperature_mired_ch(size_t ch, uint16_t mired);
+/**
+* @brief Arm a transition for a channel
+*
+* Setters called on the channel before the deadline fade from the current output to their target
+* instead of cutting, all finishing transition_ds after this call. Repeated updates (e.g. the stack
+* stepping an attribute) retarget smoothly towards the same deadline. The deadline stays armed until it
+* passes or the channel is armed again, so callers that set the targets themselves disarm (0) once their
+* setters are queued; commands apply in order, so the queued setters keep their fade.
+*
+* @param  ch             Channel index
+* @param  transition_ds  ZCL transition time in 1/10 s, 0 disarms
+*/
+void light_driver_set_transition_ch(size_t ch, uint16_t transition_ds);
+
+/**
+* @brief Hold output of channel updates until light_driver_batch_end()
+*
+* Setters only record pending state; the render task applies it once per frame. Inside a batch the
+* pending channels keep their last output, so attributes written one by one for a single command
+* (X then Y, hue then saturation, a scene's on/off + level + color) reach the strip together. Batches
+* nest and are released after LIGHT_BATCH_HOLD_MAX_MS if never ended.
+*/
+#define LIGHT_BATCH_HOLD_MAX_MS 100
+void light_driver_batch_begin(void);
+void light_driver_batch_end(void);
 void light_driver_effect_start_ch(size_t ch, light_effect_t effect);
 void light_driver_effect_stop_ch(size_t ch);
 
+/**
+* @brief Map the animation library from the "anim" data partition (see light_anim.h); call once at startup
+*
+* The image is validated and then read in place through the flash cache, so it costs no RAM and can be
+* reflashed without rebuilding the firmware.
+*
+* @return ESP_ERR_NOT_FOUND if there is no partition or it holds no image
+*/
+esp_err_t light_driver_anim_load(void);
+size_t light_driver_anim_count(void);
+
+/**
+* @brief Index of the animation called name, -1 if there is none
+*/
+int light_driver_anim_find(const char *name);
+
+/**
+* @brief Play animation anim on a channel as its effect; stopped like any effect, a one-shot animation
+*        returns the channel to its base state when it ends
+*/
+esp_err_t light_driver_anim_start_ch(size_t ch, uint16_t anim);
+
+/**
+* @brief Measure the path from an external event to the strips
+*
+* Queued behind the commands issued so far; the render task records the time from event_us
+* (esp_timer_get_time() base) until the frame that applied those commands starts transmitting.
+*/
+void light_driver_mark_latency(int64_t event_us);
+
+/*
+ * Per-pixel framebuffer for multi-pixel channels.
+ *
+ * The canvas holds full-brightness RGB (3 bytes per pixel). While a channel has an active canvas its
+ * solid color is ignored; the render task scales the changed part of the canvas by level/power and the
+ * power limit straight into the strip's back buffer on its next frame, like any other setter.
+ */
+
+/**
+* @brief Take the channel's canvas for direct writes
+*
+* Switches the channel to per-pixel mode and holds the driver lock until light_driver_fb_end()
+* is called from the same task.
+*
+* @param  ch         Channel index
+* @param  led_count  Optional, receives the canvas size in pixels
+*
+* @return Canvas (led_count * 3 bytes, RGB order) or NULL
+*/
+uint8_t *light_driver_fb_begin(size_t ch, uint16_t *led_count);
+
+/**
+* @brief Finish direct canvas writes, marking pixels [start, start + count) for the next frame
+*/
+void light_driver_fb_end(size_t ch, uint16_t start, uint16_t count);
+
+/**
+* @brief Copy a span of RGB pixels into the channel canvas
+*/
+esp_err_t light_driver_fb_write(size_t ch, uint16_t start, const uint8_t *rgb, uint16_t count);
+
+/**
+* @brief Leave per-pixel mode, the channel shows its solid color again
+*/
+void light_driver_fb_release(size_t ch);
+
+/* Group effects: one timeline across an ordered list of channels, stepped on the render frame clock */
+#define LIGHT_GROUP_EFFECTS_MAX 8
+
+typedef enum {
+    LIGHT_GROUP_CHASE = 0,      // a window of `tail` lit channels runs along the list
+    LIGHT_GROUP_CASCADE,        // channels fade in one after another, each over fade_ms
+    LIGHT_GROUP_WIPE,           // color sweeps pixel by pixel through the channels in list order
+} light_group_effect_kind_t;
+
+typedef struct {
+    light_group_effect_kind_t kind;
+    const uint8_t *channels;    // ordered channel list, copied by light_driver_group_effect_define()
+    uint8_t count;
+    uint16_t step_ms;           // delay between consecutive channels (chase/cascade) or pixels (wipe)
+    uint16_t fade_ms;           // cascade fade-in time per channel
+    uint8_t tail;               // chase window length in channels, 0 = 1
+    uint8_t r, g, b, level;
+    bool reverse;               // run the list back to front
+    bool loop;                  // chase only: restart at the end until stopped
+    bool hold;                  // cascade/wipe: the final frame becomes the channels' state (powered on)
+} light_group_effect_config_t;
+
+/**
+* @brief Define (or redefine) group effect id; not for the Zigbee hot path
+*
+* @return ESP_ERR_INVALID_STATE while effect id is running
+*/
+esp_err_t light_driver_group_effect_define(uint8_t id, const light_group_effect_config_t *cfg);
+
+/**
+* @brief Start a defined group effect, replacing any running one
+*
+* Channels with a per-channel effect keep it; the others show the group effect until it ends or is
+* stopped, then return to their own state (or the final frame with `hold`).
+*/
+void light_driver_group_effect_start(uint8_t id);
+void light_driver_group_effect_stop(void);
+
+/**
+* @brief Called when a held cascade/wipe has landed and its final frame became the channels' state
+*
+* Runs in the render task after the frame, without the driver lock; meant to bring the ZCL attributes
+* and the stored state in line with the strips.
+*
+* @param  channels  Bit n = channel n now shows cfg's color at cfg's level, powered on
+* @param  cfg       Configuration of the effect that landed
+*/
+typedef void (*light_driver_group_land_cb_t)(uint64_t channels, const light_group_effect_config_t *cfg);
+
+void light_driver_set_group_land_cb(light_driver_group_land_cb_t cb);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
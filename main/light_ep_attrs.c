@@ -0,0 +1,52 @@
+/*
+ * Per-endpoint attribute storage of the light channels.
+ */
+
+#include <stdlib.h>
+#include "esp_zigbee_core.h"
+#include "light_persist.h"
+#include "light_ep_attrs.h"
+
+static light_ep_attrs_t *s_attrs;
+static size_t s_channels;
+
+esp_err_t light_ep_attrs_init(size_t channels)
+{
+    if (!channels) return ESP_ERR_INVALID_ARG;
+    if (s_attrs) return channels == s_channels ? ESP_OK : ESP_ERR_INVALID_STATE;
+    s_attrs = calloc(channels, sizeof(*s_attrs));
+    if (!s_attrs) return ESP_ERR_NO_MEM;
+    s_channels = channels;
+    return ESP_OK;
+}
+
+light_ep_attrs_t *light_ep_attrs_get(size_t ch)
+{
+    return ch < s_channels ? &s_attrs[ch] : NULL;
+}
+
+void light_ep_attrs_seed(size_t ch, uint16_t led_count)
+{
+    light_ep_attrs_t *a = light_ep_attrs_get(ch);
+    if (!a) return;
+    *a = (light_ep_attrs_t) {
+        .x = ESP_ZB_ZCL_COLOR_CONTROL_CURRENT_X_DEF_VALUE, .y = ESP_ZB_ZCL_COLOR_CONTROL_CURRENT_Y_DEF_VALUE,
+        .color_temp = ESP_ZB_ZCL_COLOR_CONTROL_COLOR_TEMPERATURE_DEF_VALUE,
+        .color_temp_min = ESP_ZB_ZCL_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MIN_MIREDS_DEFAULT_VALUE,
+        .color_temp_max = ESP_ZB_ZCL_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MAX_MIREDS_DEFAULT_VALUE,
+        .startup_mired = LIGHT_STARTUP_MIRED_PREVIOUS,
+        .startup_on_off = LIGHT_STARTUP_ON_OFF_PREVIOUS, .startup_level = LIGHT_STARTUP_LEVEL_PREVIOUS,
+        .led_count = led_count,
+    };
+    const light_persist_channel_t *c = light_persist_get(ch);
+    if (!c) return;
+    a->x = c->x;
+    a->y = c->y;
+    a->enhanced_hue = c->hue;
+    a->hue = (uint8_t) (c->hue >> 8);
+    a->sat = c->sat;
+    a->color_temp = c->mired;
+    a->startup_on_off = c->startup_on_off;
+    a->startup_level = c->startup_level;
+    a->startup_mired = c->startup_mired;
+}
@@ -0,0 +1,49 @@
+/*
+ * Attribute values of the light endpoints, one record per channel in a single contiguous arena.
+ *
+ * Cluster creation hands the stack each endpoint's own record (nothing is shared between endpoints) and
+ * every attribute write or sync updates it, so the app reads an endpoint's current state here instead of
+ * looking it up in the stack's attribute lists.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint16_t x, y;
+    uint16_t enhanced_hue;
+    uint16_t color_temp, color_temp_min, color_temp_max;
+    uint16_t startup_mired;
+    uint16_t on_off_transition_ds;  // Level OnOffTransitionTime, used for On/Off commands and 0xFFFF transition times
+    uint16_t led_count;             // pixel cluster LedCount
+    uint8_t hue, sat;
+    uint8_t startup_on_off, startup_level;
+} light_ep_attrs_t;
+
+/**
+* @brief Allocate the records of all light channels once; later calls only check the channel count
+*/
+esp_err_t light_ep_attrs_init(size_t channels);
+
+/**
+* @brief Record of a channel, NULL for an invalid channel
+*/
+light_ep_attrs_t *light_ep_attrs_get(size_t ch);
+
+/**
+* @brief Fill a channel's record from the ZCL defaults and its restored light_persist state
+*
+* Called before the endpoint's clusters are created, so each endpoint registers with its own state.
+*/
+void light_ep_attrs_seed(size_t ch, uint16_t led_count);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,277 @@
+/*
+ * Debounced NVS persistence of per-channel light state.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_zigbee_core.h"
+#include "nvs.h"
+#include "light_persist.h"
+
+static const char *TAG = "light_persist";
+
+#define PERSIST_NAMESPACE   "light"
+#define PERSIST_KEY         "state"
+#define PERSIST_VERSION     2
+#define PERSIST_V1_RECORD   12                  // v1 had no StartUp* fields
+
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t channels;
+    uint16_t reserved;
+} persist_header_t;
+
+static light_persist_channel_t *s_shadow;
+static light_persist_channel_t *s_written;     // content of the last blob in flash
+static size_t s_channels;
+static uint32_t s_quiet_ms = LIGHT_PERSIST_QUIET_MS_DEFAULT;
+static bool s_armed;
+static uint32_t s_first_change_ms;             // oldest unsaved change, bounds the debounce
+static light_persist_stats_t s_stats;
+
+static inline uint32_t now_ms(void) { return (uint32_t) (esp_timer_get_time() / 1000); }
+
+static void persist_defaults(light_persist_channel_t *c)
+{
+    *c = (light_persist_channel_t) { .power = 0, .level = 255, .color_mode = LIGHT_PERSIST_COLOR_XY,
+                                     .x = 0x5000, .y = 0x5000, .mired = 250,
+                                     .startup_on_off = LIGHT_STARTUP_ON_OFF_PREVIOUS,
+                                     .startup_level = LIGHT_STARTUP_LEVEL_PREVIOUS,
+                                     .startup_mired = LIGHT_STARTUP_MIRED_PREVIOUS };
+}
+
+esp_err_t light_persist_init(size_t channels, uint32_t quiet_ms)
+{
+    if (!channels || channels > UINT8_MAX) return ESP_ERR_INVALID_ARG;
+    if (quiet_ms) s_quiet_ms = quiet_ms;
+    if (!s_shadow) {
+        s_shadow = calloc(channels, sizeof(*s_shadow));
+        s_written = calloc(channels, sizeof(*s_written));
+        if (!s_shadow || !s_written) {
+            free(s_shadow); free(s_written);
+            s_shadow = s_written = NULL;
+            return ESP_ERR_NO_MEM;
+        }
+        s_channels = channels;
+    }
+    for (size_t i = 0; i < s_channels; ++i) persist_defaults(&s_shadow[i]);
+    memcpy(s_written, s_shadow, s_channels * sizeof(*s_shadow));
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(PERSIST_NAMESPACE, NVS_READONLY, &nvs);
+    if (err != ESP_OK) return ESP_ERR_NOT_FOUND;
+    // size the read from the stored blob, not from this build: nvs_get_blob refuses a short buffer
+    size_t len = 0;
+    err = nvs_get_blob(nvs, PERSIST_KEY, NULL, &len);
+    if (err != ESP_OK || len < sizeof(persist_header_t)) {
+        nvs_close(nvs);
+        if (err == ESP_OK) ESP_LOGW(TAG, "Ignoring stored state (%u bytes)", (unsigned) len);
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint8_t *blob = malloc(len);
+    if (!blob) { nvs_close(nvs); return ESP_ERR_NO_MEM; }
+    err = nvs_get_blob(nvs, PERSIST_KEY, blob, &len);
+    nvs_close(nvs);
+    const persist_header_t *hdr = (const persist_header_t *) blob;
+    size_t record = 0;
+    if (err == ESP_OK && len >= sizeof(*hdr)) {
+        if (hdr->version == PERSIST_VERSION) record = sizeof(light_persist_channel_t);
+        else if (hdr->version == 1) record = PERSIST_V1_RECORD;
+    }
+    if (record && len == sizeof(*hdr) + hdr->channels * record) {
+        // a blob from a build with fewer/more channels restores the common part; fields an older version
+        // lacks keep their defaults
+        size_t n = hdr->channels < s_channels ? hdr->channels : s_channels;
+        for (size_t i = 0; i < n; ++i) memcpy(&s_shadow[i], blob + sizeof(*hdr) + i * record, record);
+        if (record == sizeof(light_persist_channel_t) && hdr->channels == s_channels) memcpy(s_written, s_shadow, s_channels * sizeof(*s_shadow));
+        ESP_LOGI(TAG, "Restored %u channels (blob v%u)", (unsigned) n, hdr->version);
+    } else {
+        if (err == ESP_OK) ESP_LOGW(TAG, "Ignoring stored state (version %u, %u bytes)", blob[0], (unsigned) len);
+        err = ESP_ERR_NOT_FOUND;
+    }
+    free(blob);
+    return err;
+}
+
+const light_persist_channel_t *light_persist_get(size_t ch)
+{
+    return s_shadow && ch < s_channels ? &s_shadow[ch] : NULL;
+}
+
+static esp_err_t persist_write(void)
+{
+    s_stats.flushes++;
+    if (!memcmp(s_shadow, s_written, s_channels * sizeof(*s_shadow))) {
+        // changed and changed back, e.g. a toggle burst
+        s_stats.skipped++;
+        return ESP_OK;
+    }
+    size_t len = sizeof(persist_header_t) + s_channels * sizeof(light_persist_channel_t);
+    uint8_t *blob = malloc(len);
+    if (!blob) return ESP_ERR_NO_MEM;
+    *(persist_header_t *) blob = (persist_header_t) { .version = PERSIST_VERSION, .channels = (uint8_t) s_channels };
+    memcpy(blob + sizeof(persist_header_t), s_shadow, s_channels * sizeof(*s_shadow));
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(PERSIST_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, PERSIST_KEY, blob, len);
+        if (err == ESP_OK) err = nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+    free(blob);
+    if (err == ESP_OK) {
+        memcpy(s_written, s_shadow, s_channels * sizeof(*s_shadow));
+        s_stats.writes++;
+    } else {
+        ESP_LOGE(TAG, "Saving light state failed: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+static void persist_flush_cb(uint8_t param)
+{
+    s_armed = false;
+    persist_write();
+}
+
+// Re-arms the flush alarm on every change, but never past the max latency from the first unsaved change
+static void persist_touch(void)
+{
+    s_stats.changes++;
+    uint32_t now = now_ms();
+    if (!s_armed) {
+        s_armed = true;
+        s_first_change_ms = now;
+    } else {
+        esp_zb_scheduler_alarm_cancel(persist_flush_cb, 0);
+    }
+    uint32_t waited = now - s_first_change_ms;
+    uint32_t delay = s_quiet_ms;
+    if (waited + delay > LIGHT_PERSIST_MAX_LATENCY_MS) {
+        delay = waited < LIGHT_PERSIST_MAX_LATENCY_MS ? LIGHT_PERSIST_MAX_LATENCY_MS - waited : 0;
+    }
+    esp_zb_scheduler_alarm(persist_flush_cb, 0, delay);
+}
+
+#define PERSIST_SET(ch, field, value)                                   \
+    do {                                                                \
+        if (!s_shadow || (ch) >= s_channels) return;                    \
+        if (s_shadow[ch].field == (value)) break;                       \
+        s_shadow[ch].field = (value);                                   \
+        changed = true;                                                 \
+    } while (0)
+
+void light_persist_set_power(size_t ch, bool power)
+{
+    bool changed = false;
+    PERSIST_SET(ch, power, (uint8_t) power);
+    if (changed) persist_touch();
+}
+
+void light_persist_set_level(size_t ch, uint8_t level)
+{
+    bool changed = false;
+    PERSIST_SET(ch, level, level);
+    if (changed) persist_touch();
+}
+
+void light_persist_set_xy(size_t ch, uint16_t x, uint16_t y)
+{
+    bool changed = false;
+    PERSIST_SET(ch, x, x);
+    PERSIST_SET(ch, y, y);
+    PERSIST_SET(ch, color_mode, LIGHT_PERSIST_COLOR_XY);
+    if (changed) persist_touch();
+}
+
+void light_persist_set_hue_sat(size_t ch, uint16_t enhanced_hue, uint8_t sat, bool enhanced)
+{
+    bool changed = false;
+    PERSIST_SET(ch, hue, enhanced_hue);
+    PERSIST_SET(ch, sat, sat);
+    PERSIST_SET(ch, color_mode, enhanced ? LIGHT_PERSIST_COLOR_EHS : LIGHT_PERSIST_COLOR_HS);
+    if (changed) persist_touch();
+}
+
+void light_persist_set_mired(size_t ch, uint16_t mired)
+{
+    bool changed = false;
+    PERSIST_SET(ch, mired, mired);
+    PERSIST_SET(ch, color_mode, LIGHT_PERSIST_COLOR_CT);
+    if (changed) persist_touch();
+}
+
+void light_persist_set_channel(size_t ch, const light_persist_channel_t *state)
+{
+    if (!s_shadow || ch >= s_channels || !state) return;
+    light_persist_channel_t next = *state;
+    next.startup_on_off = s_shadow[ch].startup_on_off;
+    next.startup_level = s_shadow[ch].startup_level;
+    next.startup_mired = s_shadow[ch].startup_mired;
+    if (!memcmp(&next, &s_shadow[ch], sizeof(next))) return;
+    s_shadow[ch] = next;
+    persist_touch();
+}
+
+void light_persist_set_startup_on_off(size_t ch, uint8_t startup_on_off)
+{
+    bool changed = false;
+    PERSIST_SET(ch, startup_on_off, startup_on_off);
+    if (changed) persist_touch();
+}
+
+void light_persist_set_startup_level(size_t ch, uint8_t startup_level)
+{
+    bool changed = false;
+    PERSIST_SET(ch, startup_level, startup_level);
+    if (changed) persist_touch();
+}
+
+void light_persist_set_startup_mired(size_t ch, uint16_t startup_mired)
+{
+    bool changed = false;
+    PERSIST_SET(ch, startup_mired, startup_mired);
+    if (changed) persist_touch();
+}
+
+void light_persist_apply_startup(void)
+{
+    for (size_t i = 0; i < s_channels; ++i) {
+        light_persist_channel_t *c = &s_shadow[i];
+        switch (c->startup_on_off) {
+            case LIGHT_STARTUP_ON_OFF_OFF: c->power = 0; break;
+            case LIGHT_STARTUP_ON_OFF_ON: c->power = 1; break;
+            case LIGHT_STARTUP_ON_OFF_TOGGLE: c->power = !c->power; break;
+            default: break;
+        }
+        if (c->startup_level == LIGHT_STARTUP_LEVEL_MINIMUM) c->level = 1;
+        else if (c->startup_level != LIGHT_STARTUP_LEVEL_PREVIOUS) c->level = c->startup_level;
+        if (c->startup_mired != LIGHT_STARTUP_MIRED_PREVIOUS) {
+            c->mired = c->startup_mired;
+            c->color_mode = LIGHT_PERSIST_COLOR_CT;
+        }
+    }
+}
+
+void light_persist_start(void)
+{
+    if (s_shadow && !s_armed && memcmp(s_shadow, s_written, s_channels * sizeof(*s_shadow))) persist_touch();
+}
+
+esp_err_t light_persist_flush(void)
+{
+    if (!s_shadow) return ESP_ERR_INVALID_STATE;
+    if (s_armed) {
+        esp_zb_scheduler_alarm_cancel(persist_flush_cb, 0);
+        s_armed = false;
+    }
+    return persist_write();
+}
+
+void light_persist_get_stats(light_persist_stats_t *out)
+{
+    if (out) *out = s_stats;
+}
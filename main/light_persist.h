@@ -0,0 +1,115 @@
+/*
+ * Persistence of per-channel light state across power loss.
+ *
+ * Attribute handlers update a RAM shadow only. Changes are written to NVS as a single packed,
+ * versioned blob once the shadow has been quiet for a while (or at the latest after
+ * LIGHT_PERSIST_MAX_LATENCY_MS during a continuous sweep), from a Zigbee scheduler alarm. A blob
+ * identical to the last written one is not written again. This keeps flash wear and NVS latency
+ * off the ZCL path: a dimming sweep of any length costs one write.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LIGHT_PERSIST_QUIET_MS_DEFAULT  3000    // write once the state has not changed for this long
+#define LIGHT_PERSIST_MAX_LATENCY_MS    30000   // upper bound from the first unsaved change to the write
+
+typedef enum {
+    LIGHT_PERSIST_COLOR_XY = 0,
+    LIGHT_PERSIST_COLOR_HS,
+    LIGHT_PERSIST_COLOR_EHS,
+    LIGHT_PERSIST_COLOR_CT,
+} light_persist_color_mode_t;
+
+/* ZCL StartUp* attribute values with special meaning */
+#define LIGHT_STARTUP_ON_OFF_OFF        0x00
+#define LIGHT_STARTUP_ON_OFF_ON         0x01
+#define LIGHT_STARTUP_ON_OFF_TOGGLE     0x02
+#define LIGHT_STARTUP_ON_OFF_PREVIOUS   0xFF
+#define LIGHT_STARTUP_LEVEL_MINIMUM     0x00
+#define LIGHT_STARTUP_LEVEL_PREVIOUS    0xFF
+#define LIGHT_STARTUP_MIRED_PREVIOUS    0xFFFF
+
+/* Blob layout per channel, 16 bytes */
+typedef struct __attribute__((packed)) {
+    uint8_t power;
+    uint8_t level;
+    uint8_t color_mode;         // light_persist_color_mode_t
+    uint8_t sat;
+    uint16_t x, y;
+    uint16_t hue;               // enhanced hue, the 8-bit hue is hue >> 8
+    uint16_t mired;
+    uint8_t startup_on_off;     // StartUpOnOff
+    uint8_t startup_level;      // StartUpCurrentLevel
+    uint16_t startup_mired;     // StartUpColorTemperatureMireds
+} light_persist_channel_t;
+
+typedef struct {
+    uint32_t changes;           // shadow updates that changed a value
+    uint32_t flushes;           // alarm-driven flush attempts
+    uint32_t writes;            // blobs actually written to flash
+    uint32_t skipped;           // flushes dropped because the blob matched the last write
+} light_persist_stats_t;
+
+/**
+* @brief Load the stored blob into the shadow; NVS must be initialized
+*
+* @param  channels  Number of light channels
+* @param  quiet_ms  Debounce period, 0 for LIGHT_PERSIST_QUIET_MS_DEFAULT
+*
+* @return ESP_OK if a valid blob was restored, ESP_ERR_NOT_FOUND if the shadow holds defaults
+*/
+esp_err_t light_persist_init(size_t channels, uint32_t quiet_ms);
+
+/**
+* @brief Restored (or default) state of a channel, NULL for an invalid channel
+*/
+const light_persist_channel_t *light_persist_get(size_t ch);
+
+/*
+ * Shadow setters, called from the Zigbee task; they never touch flash. A change arms the debounced
+ * flush, an unchanged value does nothing.
+ */
+void light_persist_set_power(size_t ch, bool power);
+void light_persist_set_level(size_t ch, uint8_t level);
+void light_persist_set_xy(size_t ch, uint16_t x, uint16_t y);
+void light_persist_set_hue_sat(size_t ch, uint16_t enhanced_hue, uint8_t sat, bool enhanced);
+void light_persist_set_mired(size_t ch, uint16_t mired);
+/* Whole channel state (scene recall); the StartUp* fields of the channel are kept */
+void light_persist_set_channel(size_t ch, const light_persist_channel_t *state);
+void light_persist_set_startup_on_off(size_t ch, uint8_t startup_on_off);
+void light_persist_set_startup_level(size_t ch, uint8_t startup_level);
+void light_persist_set_startup_mired(size_t ch, uint16_t startup_mired);
+
+/**
+* @brief Resolve the power-on state of every channel from the stored state and StartUp* attributes
+*
+* Called once at boot after light_persist_init(), before the Zigbee stack runs. The shadow is updated
+* to the resolved state, so a toggle or a fixed startup level becomes the new "previous" state once
+* light_persist_start() saves it.
+*/
+void light_persist_apply_startup(void);
+
+/**
+* @brief Arm the flush for changes made before the Zigbee scheduler was running; call from the Zigbee task
+*/
+void light_persist_start(void);
+
+/**
+* @brief Write pending changes now (e.g. before a planned restart)
+*/
+esp_err_t light_persist_flush(void);
+
+void light_persist_get_stats(light_persist_stats_t *out);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,202 @@
+/*
+ * Pixel cluster: payload decoding, per-channel staging and atomic commit into the driver canvas.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "light_driver.h"
+#include "light_pixels.h"
+
+static const char *TAG = "light_pixels";
+
+typedef struct {
+    bool used;
+    uint8_t ch;
+    uint16_t led_count;
+    uint8_t *staging;           // RGB, whole channel
+    uint16_t span_lo[LIGHT_PIXELS_PACKETS_MAX], span_hi[LIGHT_PIXELS_PACKETS_MAX]; // pixels of each received packet
+    uint8_t frame;              // frame id of the packets in received
+    uint32_t received;          // bit n = packet n of the frame decoded
+    bool committed;             // frame is on the strip, a repeated Commit only acknowledges it
+    light_pixels_stats_t stats;
+} pixels_channel_t;
+
+static pixels_channel_t s_pixels[LIGHT_PIXELS_CHANNELS_MAX];
+
+static pixels_channel_t *find_channel(size_t ch)
+{
+    for (size_t i = 0; i < LIGHT_PIXELS_CHANNELS_MAX; ++i) {
+        if (s_pixels[i].used && s_pixels[i].ch == ch) return &s_pixels[i];
+    }
+    return NULL;
+}
+
+esp_err_t light_pixels_add_channel(size_t ch, uint16_t led_count)
+{
+    if (!led_count || ch > UINT8_MAX) return ESP_ERR_INVALID_ARG;
+    if (find_channel(ch)) return ESP_ERR_INVALID_STATE;
+    for (size_t i = 0; i < LIGHT_PIXELS_CHANNELS_MAX; ++i) {
+        if (s_pixels[i].used) continue;
+        s_pixels[i] = (pixels_channel_t) { .used = true, .ch = (uint8_t) ch, .led_count = led_count };
+        return ESP_OK;
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+// Rounded a * i / n for a signed a, the host encoder predicts ramps with the same expression
+static inline int ramp_step(int a, int i, int n)
+{
+    int v = a * i;
+    return v >= 0 ? (v + n / 2) / n : -((-v + n / 2) / n);
+}
+
+static esp_err_t decode_rle(const uint8_t *data, size_t len, uint8_t *rgb, uint16_t led_count, uint16_t start, uint16_t *end)
+{
+    uint16_t pos = start;
+    // a packet never depends on what another packet wrote, so packets can arrive in any order or again
+    uint8_t prev[3] = { 0, 0, 0 };
+    for (size_t i = 0; i + 4 <= len; i += 4) {
+        uint8_t n = data[i] & ~LIGHT_PIXELS_RUN_RAMP;
+        const uint8_t *c = &data[i + 1];
+        if (!n || n > led_count - pos) return ESP_ERR_INVALID_SIZE;
+        uint8_t *px = rgb + (size_t) pos * 3;
+        if (data[i] & LIGHT_PIXELS_RUN_RAMP) {
+            for (int k = 1; k <= n; ++k, px += 3) {
+                for (int j = 0; j < 3; ++j) px[j] = (uint8_t) (prev[j] + ramp_step(c[j] - prev[j], k, n));
+            }
+        } else {
+            for (int k = 0; k < n; ++k, px += 3) memcpy(px, c, 3);
+        }
+        memcpy(prev, c, 3);
+        pos += n;
+    }
+    if (len % 4) return ESP_ERR_INVALID_SIZE;
+    *end = pos;
+    return ESP_OK;
+}
+
+static esp_err_t decode_palette(const uint8_t *data, size_t len, uint8_t *rgb, uint16_t led_count, uint16_t start, uint16_t *end)
+{
+    if (len < 1) return ESP_ERR_INVALID_SIZE;
+    uint8_t colors = data[0];
+    size_t head = 1 + (size_t) colors * 3 + 2;
+    if (!colors || len < head) return ESP_ERR_INVALID_SIZE;
+    const uint8_t *palette = data + 1;
+    uint16_t count = (uint16_t) (data[head - 2] | (data[head - 1] << 8));
+    uint8_t bits = colors <= 2 ? 1 : colors <= 4 ? 2 : colors <= 16 ? 4 : 8;
+    if (count > led_count - start || len - head < ((size_t) count * bits + 7) / 8) return ESP_ERR_INVALID_SIZE;
+    const uint8_t *idx = data + head;
+    uint8_t mask = (uint8_t) ((1u << bits) - 1);
+    uint8_t *px = rgb + (size_t) start * 3;
+    for (uint16_t i = 0; i < count; ++i, px += 3) {
+        uint32_t bit = (uint32_t) i * bits;
+        uint8_t k = (idx[bit / 8] >> (bit % 8)) & mask;
+        if (k >= colors) return ESP_ERR_INVALID_SIZE;
+        memcpy(px, palette + k * 3, 3);
+    }
+    *end = (uint16_t) (start + count);
+    return ESP_OK;
+}
+
+esp_err_t light_pixels_decode(uint8_t encoding, const uint8_t *data, size_t len, uint8_t *rgb, uint16_t led_count,
+                              uint16_t start, uint16_t *end)
+{
+    if (!data || !rgb || !end || start >= led_count) return ESP_ERR_INVALID_ARG;
+    switch (encoding) {
+        case LIGHT_PIXELS_ENC_RAW:
+            if (len % 3 || len / 3 > (size_t) (led_count - start)) return ESP_ERR_INVALID_SIZE;
+            memcpy(rgb + (size_t) start * 3, data, len);
+            *end = (uint16_t) (start + len / 3);
+            return ESP_OK;
+        case LIGHT_PIXELS_ENC_RLE:
+            return decode_rle(data, len, rgb, led_count, start, end);
+        case LIGHT_PIXELS_ENC_PALETTE:
+            return decode_palette(data, len, rgb, led_count, start, end);
+        default:
+            return ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+static esp_err_t pixels_write(pixels_channel_t *p, const uint8_t *payload, size_t len)
+{
+    if (len < LIGHT_PIXELS_WRITE_HEADER) return ESP_ERR_INVALID_SIZE;
+    uint8_t frame = payload[0], packet = payload[1], encoding = payload[2];
+    uint16_t start = (uint16_t) (payload[3] | (payload[4] << 8));
+    if (packet >= LIGHT_PIXELS_PACKETS_MAX || start >= p->led_count) return ESP_ERR_INVALID_SIZE;
+    if (!p->staging) {
+        p->staging = calloc(p->led_count, 3);
+        if (!p->staging) return ESP_ERR_NO_MEM;
+    }
+    // a new frame id starts over; pixels of an abandoned frame stay staged but are never committed
+    if (frame != p->frame || p->committed) {
+        p->frame = frame;
+        p->received = 0;
+        p->committed = false;
+    }
+    uint16_t end;
+    esp_err_t err = light_pixels_decode(encoding, payload + LIGHT_PIXELS_WRITE_HEADER, len - LIGHT_PIXELS_WRITE_HEADER,
+                                        p->staging, p->led_count, start, &end);
+    if (err != ESP_OK) return err;
+    p->span_lo[packet] = start;
+    p->span_hi[packet] = end;
+    p->received |= 1u << packet;
+    p->stats.packets++;
+    return ESP_OK;
+}
+
+static esp_err_t pixels_commit(pixels_channel_t *p, const uint8_t *payload, size_t len)
+{
+    if (len < 2 || !payload[1] || payload[1] > LIGHT_PIXELS_PACKETS_MAX) return ESP_ERR_INVALID_SIZE;
+    uint32_t all = payload[1] == LIGHT_PIXELS_PACKETS_MAX ? UINT32_MAX : (1u << payload[1]) - 1;
+    if (payload[0] == p->frame && p->committed) return ESP_OK;
+    if (payload[0] != p->frame || (p->received & all) != all) {
+        ESP_LOGW(TAG, "Channel %u frame %u incomplete (packets 0x%08lx of %u)", p->ch, payload[0],
+                 (unsigned long) (payload[0] == p->frame ? p->received : 0), payload[1]);
+        return ESP_ERR_INVALID_STATE;
+    }
+    // only the pixels the frame's own packets wrote are copied, never leftovers of an abandoned frame;
+    // all in one canvas hold, so the render task sees the whole frame or none of it
+    uint16_t led_count;
+    uint8_t *canvas = light_driver_fb_begin(p->ch, &led_count);
+    if (!canvas) return ESP_ERR_INVALID_STATE;
+    uint16_t lo = UINT16_MAX, hi = 0;
+    for (uint8_t i = 0; i < payload[1]; ++i) {
+        uint16_t a = p->span_lo[i], b = p->span_hi[i] < led_count ? p->span_hi[i] : led_count;
+        if (a >= b) continue;
+        memcpy(canvas + (size_t) a * 3, p->staging + (size_t) a * 3, (size_t) (b - a) * 3);
+        if (a < lo) lo = a;
+        if (b > hi) hi = b;
+    }
+    light_driver_fb_end(p->ch, lo, hi > lo ? (uint16_t) (hi - lo) : 0);
+    p->committed = true;
+    p->stats.frames++;
+    return ESP_OK;
+}
+
+esp_err_t light_pixels_command(size_t ch, uint8_t cmd, const uint8_t *payload, size_t len)
+{
+    pixels_channel_t *p = find_channel(ch);
+    if (!p) return ESP_ERR_NOT_FOUND;
+    if (!payload && len) return ESP_ERR_INVALID_ARG;
+    esp_err_t err;
+    switch (cmd) {
+        case LIGHT_PIXELS_CMD_WRITE: err = pixels_write(p, payload, len); break;
+        case LIGHT_PIXELS_CMD_COMMIT: err = pixels_commit(p, payload, len); break;
+        case LIGHT_PIXELS_CMD_RELEASE:
+            light_driver_fb_release(ch);
+            return ESP_OK;
+        default: return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (err != ESP_OK) p->stats.rejected++;
+    return err;
+}
+
+void light_pixels_get_stats(size_t ch, light_pixels_stats_t *out)
+{
+    const pixels_channel_t *p = find_channel(ch);
+    if (!out) return;
+    if (p) *out = p->stats;
+    else memset(out, 0, sizeof(*out));
+}
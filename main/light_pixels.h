@@ -0,0 +1,91 @@
+/*
+ * Bulk pixel upload over a manufacturer-specific cluster on the strip endpoints.
+ *
+ * A frame is sent as one or more Write commands, each small enough for a single unfragmented APS
+ * frame, followed by a Commit. Writes decode into a per-channel staging buffer; the Commit copies
+ * the pixels written by the frame's packets into the channel canvas under the driver lock, so a
+ * multi-packet frame appears on the strip in one render frame or not at all. Every Write decodes on
+ * its own (an RLE ramp never starts from another packet's pixels). Packets carry their
+ * index in the frame and the Commit the packet count, so a lost packet fails the Commit instead of
+ * showing a torn frame; writes and commits are idempotent and can simply be sent again. The next
+ * frame must use a different frame id.
+ *
+ * Command payloads (little endian):
+ *   Write   (0x00)  frame u8, packet u8, encoding u8, start pixel u16, encoded pixels
+ *   Commit  (0x01)  frame u8, packets u8
+ *   Release (0x02)  -             channel leaves pixel mode and shows its solid color again
+ *
+ * Encodings of the pixels of a Write:
+ *   RAW      r g b per pixel
+ *   RLE      runs of: count u8 (1..127, bit 7 = ramp), r g b. A plain run repeats the color, a ramp
+ *            runs linearly from the pixel before the run (black for the first run of a Write) to the
+ *            color on its last pixel, so a gradient costs 4 bytes per straight piece
+ *   PALETTE  n u8 (1..255), n * r g b, pixel count u16, indices packed LSB first with 1, 2, 4 or 8
+ *            bits each for up to 2, 4, 16 or 256 colors
+ *
+ * tools/pixel_codec.py is the matching host-side encoder / decoder.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LIGHT_PIXELS_CLUSTER_ID         0xFC01
+#define LIGHT_PIXELS_CHANNELS_MAX       4       // channels that accept uploads
+#define LIGHT_PIXELS_PAYLOAD_MAX        64      // command payload that fits an unfragmented, secured APS frame
+#define LIGHT_PIXELS_WRITE_HEADER       5
+#define LIGHT_PIXELS_PACKETS_MAX        32      // Write packets per frame
+#define LIGHT_PIXELS_RUN_MAX            127
+#define LIGHT_PIXELS_RUN_RAMP           0x80
+#define LIGHT_PIXELS_ATTR_LED_COUNT     0x0000  // uint16 read-only, pixels of the channel
+
+typedef enum {
+    LIGHT_PIXELS_CMD_WRITE = 0x00,
+    LIGHT_PIXELS_CMD_COMMIT = 0x01,
+    LIGHT_PIXELS_CMD_RELEASE = 0x02,
+} light_pixels_cmd_t;
+
+typedef enum {
+    LIGHT_PIXELS_ENC_RAW = 0,
+    LIGHT_PIXELS_ENC_RLE,
+    LIGHT_PIXELS_ENC_PALETTE,
+} light_pixels_encoding_t;
+
+typedef struct {
+    uint32_t packets;           // Write commands decoded
+    uint32_t frames;            // commits applied
+    uint32_t rejected;          // malformed writes and commits of incomplete frames
+} light_pixels_stats_t;
+
+/**
+* @brief Accept uploads for a channel of led_count pixels; the staging buffer is allocated on the first Write
+*/
+esp_err_t light_pixels_add_channel(size_t ch, uint16_t led_count);
+
+/**
+* @brief Handle a command of the pixel cluster addressed to channel ch; Zigbee task only
+*
+* @return ESP_ERR_NOT_FOUND for a channel without uploads, ESP_ERR_INVALID_SIZE for a malformed payload,
+*         ESP_ERR_INVALID_STATE for a Commit of a frame with missing packets
+*/
+esp_err_t light_pixels_command(size_t ch, uint8_t cmd, const uint8_t *payload, size_t len);
+
+/**
+* @brief Decode encoded pixels into rgb (led_count * 3 bytes) from pixel start on
+*
+* @param  end  Receives the pixel after the last one written
+*/
+esp_err_t light_pixels_decode(uint8_t encoding, const uint8_t *data, size_t len, uint8_t *rgb, uint16_t led_count,
+                              uint16_t start, uint16_t *end);
+
+void light_pixels_get_stats(size_t ch, light_pixels_stats_t *out);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,27 @@
+/*
+ * Budget allotment of the light driver's power limiter.
+ */
+
+#include "light_power.h"
+
+bool light_power_allot(const uint32_t demand_ma[LIGHT_POWER_PRIORITIES], uint32_t fixed_ma, uint32_t budget_ma,
+                       uint16_t cap_q8, light_power_allot_t *out)
+{
+    uint32_t left = budget_ma > fixed_ma ? budget_ma - fixed_ma : 0;
+    out->demand_ma = out->output_ma = fixed_ma;
+    for (int p = 0; p < LIGHT_POWER_PRIORITIES; ++p) {
+        uint32_t demand = (demand_ma[p] * cap_q8) >> 8;
+        uint16_t scale;
+        if (!budget_ma || demand <= left) {
+            scale = 256;
+            left -= budget_ma ? demand : 0;
+        } else {
+            scale = (uint16_t) (((uint64_t) left << 8) / demand);
+            left = 0;
+        }
+        out->demand_ma += demand;
+        out->output_ma += (demand * scale) >> 8;
+        out->scale_q8[p] = (uint16_t) ((scale * cap_q8) >> 8);
+    }
+    return out->output_ma < out->demand_ma;
+}
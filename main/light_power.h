@@ -0,0 +1,42 @@
+/*
+ * Budget allotment of the light driver's power limiter.
+ *
+ * The render task sums each frame's estimated current per priority and hands it here. The budget left
+ * after the idle current and loads that cannot change this frame is granted in priority order:
+ * priority 0 first, the first priority that does not fit is scaled down proportionally and every lower
+ * one goes dark. The global output cap scales demand before the budget is applied and is folded into
+ * the resulting scales. Integer math only.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "light_driver.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t demand_ma;         // fixed load plus the capped demand of all priorities
+    uint32_t output_ma;         // estimate after limiting
+    uint16_t scale_q8[LIGHT_POWER_PRIORITIES]; // per priority, output cap included, 256 = full
+} light_power_allot_t;
+
+/**
+* @brief Split the budget over the priorities for one frame
+*
+* @param  demand_ma  Estimated current per priority before limiting and cap
+* @param  fixed_ma   Current drawn regardless of the scales (idle pixels, held channels)
+* @param  budget_ma  0 = unlimited
+* @param  cap_q8     Global output cap, 256 = none
+* @param  out        Scales and estimates
+*
+* @return true if the budget scaled something down
+*/
+bool light_power_allot(const uint32_t demand_ma[LIGHT_POWER_PRIORITIES], uint32_t fixed_ma, uint32_t budget_ma,
+                       uint16_t cap_q8, light_power_allot_t *out);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
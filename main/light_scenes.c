@@ -0,0 +1,142 @@
+/*
+ * Scene table with constant-time recall, persisted as one NVS blob.
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "nvs.h"
+#include "light_scenes.h"
+
+static const char *TAG = "light_scenes";
+
+#define SCENES_NAMESPACE    "scenes"
+#define SCENES_KEY          "table"
+#define SCENES_VERSION      1
+#define SCENES_MASK         (LIGHT_SCENES_MAX - 1)
+
+_Static_assert((LIGHT_SCENES_MAX & SCENES_MASK) == 0, "LIGHT_SCENES_MAX must be a power of two");
+
+typedef enum {
+    SLOT_EMPTY = 0,
+    SLOT_USED,
+    SLOT_DELETED,               // tombstone, keeps probe chains intact
+} slot_state_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t state;              // slot_state_t
+    uint8_t ch;
+    uint16_t group;
+    uint8_t scene;
+    uint8_t reserved;
+    light_persist_channel_t light;
+} scene_record_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t record_size;
+    uint16_t slots;
+    scene_record_t records[LIGHT_SCENES_MAX];
+} scene_table_t;
+
+static scene_table_t s_table;
+
+static inline uint32_t scene_hash(uint16_t group, uint8_t scene, uint8_t ch)
+{
+    uint32_t k = ((uint32_t) group << 16) | ((uint32_t) scene << 8) | ch;
+    k *= 0x9E3779B1u;           // Fibonacci hashing, top bits are the best mixed
+    return k >> 25;
+}
+
+_Static_assert(LIGHT_SCENES_MAX == 128, "scene_hash returns 7 bits");
+
+static inline bool record_is(const scene_record_t *r, uint16_t group, uint8_t scene, uint8_t ch)
+{
+    return r->state == SLOT_USED && r->group == group && r->scene == scene && r->ch == ch;
+}
+
+static scene_record_t *scene_lookup(uint16_t group, uint8_t scene, uint8_t ch)
+{
+    uint32_t i = scene_hash(group, scene, ch);
+    for (uint32_t n = 0; n < LIGHT_SCENES_MAX; ++n, i = (i + 1) & SCENES_MASK) {
+        scene_record_t *r = &s_table.records[i];
+        if (r->state == SLOT_EMPTY) return NULL;
+        if (record_is(r, group, scene, ch)) return r;
+    }
+    return NULL;
+}
+
+static esp_err_t scenes_save(void)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(SCENES_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) return err;
+    err = nvs_set_blob(nvs, SCENES_KEY, &s_table, sizeof(s_table));
+    if (err == ESP_OK) err = nvs_commit(nvs);
+    nvs_close(nvs);
+    if (err != ESP_OK) ESP_LOGE(TAG, "Saving scenes failed: %s", esp_err_to_name(err));
+    return err;
+}
+
+esp_err_t light_scenes_init(void)
+{
+    memset(&s_table, 0, sizeof(s_table));
+    nvs_handle_t nvs;
+    size_t len = sizeof(s_table);
+    esp_err_t err = nvs_open(SCENES_NAMESPACE, NVS_READONLY, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(nvs, SCENES_KEY, &s_table, &len);
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK || len != sizeof(s_table) || s_table.version != SCENES_VERSION ||
+        s_table.record_size != sizeof(scene_record_t) || s_table.slots != LIGHT_SCENES_MAX) {
+        memset(&s_table, 0, sizeof(s_table));
+    }
+    s_table.version = SCENES_VERSION;
+    s_table.record_size = sizeof(scene_record_t);
+    s_table.slots = LIGHT_SCENES_MAX;
+    return ESP_OK;
+}
+
+esp_err_t light_scenes_store(uint16_t group, uint8_t scene, uint8_t ch, const light_persist_channel_t *state)
+{
+    scene_record_t *r = scene_lookup(group, scene, ch);
+    if (!r) {
+        uint32_t i = scene_hash(group, scene, ch);
+        for (uint32_t n = 0; n < LIGHT_SCENES_MAX; ++n, i = (i + 1) & SCENES_MASK) {
+            if (s_table.records[i].state != SLOT_USED) { r = &s_table.records[i]; break; }
+        }
+        if (!r) {
+            ESP_LOGW(TAG, "Scene table full, group 0x%04x scene %u not stored", group, scene);
+            return ESP_ERR_NO_MEM;
+        }
+        *r = (scene_record_t) { .state = SLOT_USED, .ch = ch, .group = group, .scene = scene };
+    } else if (!memcmp(&r->light, state, sizeof(*state))) {
+        return ESP_OK;
+    }
+    r->light = *state;
+    return scenes_save();
+}
+
+const light_persist_channel_t *light_scenes_find(uint16_t group, uint8_t scene, uint8_t ch)
+{
+    const scene_record_t *r = scene_lookup(group, scene, ch);
+    return r ? &r->light : NULL;
+}
+
+void light_scenes_remove(uint16_t group, uint8_t scene, uint8_t ch)
+{
+    scene_record_t *r = scene_lookup(group, scene, ch);
+    if (!r) return;
+    r->state = SLOT_DELETED;
+    scenes_save();
+}
+
+void light_scenes_remove_all(uint16_t group, uint8_t ch)
+{
+    bool changed = false;
+    for (size_t i = 0; i < LIGHT_SCENES_MAX; ++i) {
+        scene_record_t *r = &s_table.records[i];
+        if (r->state == SLOT_USED && r->group == group && r->ch == ch) { r->state = SLOT_DELETED; changed = true; }
+    }
+    if (changed) scenes_save();
+}
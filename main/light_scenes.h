@@ -0,0 +1,53 @@
+/*
+ * Application scene table for the light endpoints.
+ *
+ * Each record is the full state of one channel for one (group, scene id) pair, the same
+ * light_persist_channel_t the boot restore uses. Records live in a fixed open-addressed hash table,
+ * so a recall is a constant-time lookup per endpoint and needs no attribute-by-attribute replay.
+ * The table is stored as one NVS blob and rewritten on every Store/Remove, which are rare user
+ * actions.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "light_persist.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LIGHT_SCENES_MAX    128     // channel records (e.g. 8 scenes across 14 endpoints), power of two
+
+/**
+* @brief Load the scene table from NVS; NVS must be initialized
+*/
+esp_err_t light_scenes_init(void);
+
+/**
+* @brief Store (or overwrite) a channel's state under (group, scene)
+*
+* @return ESP_ERR_NO_MEM when the table is full
+*/
+esp_err_t light_scenes_store(uint16_t group, uint8_t scene, uint8_t ch, const light_persist_channel_t *state);
+
+/**
+* @brief Look up a channel's state for (group, scene), NULL if the scene does not cover the channel
+*/
+const light_persist_channel_t *light_scenes_find(uint16_t group, uint8_t scene, uint8_t ch);
+
+/**
+* @brief Remove one scene of a channel
+*/
+void light_scenes_remove(uint16_t group, uint8_t scene, uint8_t ch);
+
+/**
+* @brief Remove all scenes of a group on a channel
+*/
+void light_scenes_remove_all(uint16_t group, uint8_t ch);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,87 @@
+/*
+ * Median / EMA filter with outlier rejection, report gating and adaptive sampling interval.
+ */
+
+#include <string.h>
+#include "sensor_filter.h"
+
+static inline int32_t abs32(int32_t v) { return v < 0 ? -v : v; }
+
+void sensor_filter_init(sensor_filter_t *f, const sensor_filter_config_t *cfg)
+{
+    memset(f, 0, sizeof(*f));
+    f->cfg = *cfg;
+    if (f->cfg.median_len > SENSOR_FILTER_MEDIAN_MAX) f->cfg.median_len = SENSOR_FILTER_MEDIAN_MAX;
+    if (f->cfg.median_len && !(f->cfg.median_len & 1)) f->cfg.median_len--;
+    if (f->cfg.ema_shift > 8) f->cfg.ema_shift = 8;
+    if (f->cfg.interval_max_ms < f->cfg.interval_min_ms) f->cfg.interval_max_ms = f->cfg.interval_min_ms;
+    f->interval_ms = f->cfg.interval_min_ms;
+}
+
+// Median of the filled part of the window; insertion sort of at most SENSOR_FILTER_MEDIAN_MAX values
+static int32_t window_median(const sensor_filter_t *f)
+{
+    int32_t v[SENSOR_FILTER_MEDIAN_MAX];
+    uint8_t n = f->window_fill;
+    for (uint8_t i = 0; i < n; ++i) {
+        int32_t x = f->window[i];
+        uint8_t j = i;
+        for (; j > 0 && v[j - 1] > x; --j) v[j] = v[j - 1];
+        v[j] = x;
+    }
+    return v[n / 2];
+}
+
+bool sensor_filter_update(sensor_filter_t *f, int32_t raw, int32_t *filtered)
+{
+    f->stats.samples++;
+    int32_t current = f->ema_q8 / 256;
+
+    if (f->primed && f->cfg.outlier_delta && abs32(raw - current) >= f->cfg.outlier_delta &&
+        f->outliers < f->cfg.outlier_max) {
+        // keep sampling fast until the jump is either confirmed or gone
+        f->outliers++;
+        f->stats.rejected++;
+        f->interval_ms = f->cfg.interval_min_ms;
+        if (filtered) *filtered = current;
+        return false;
+    }
+    bool step = f->outliers >= f->cfg.outlier_max && f->outliers;
+    f->outliers = 0;
+
+    int32_t sample = raw;
+    if (f->cfg.median_len > 1) {
+        if (step) {
+            // a confirmed step restarts the window instead of being voted down
+            f->window_fill = 0;
+            f->window_pos = 0;
+        }
+        f->window[f->window_pos] = raw;
+        f->window_pos = (uint8_t) ((f->window_pos + 1) % f->cfg.median_len);
+        if (f->window_fill < f->cfg.median_len) f->window_fill++;
+        sample = window_median(f);
+    }
+
+    if (!f->primed || step || !f->cfg.ema_shift) {
+        f->ema_q8 = sample * 256;
+        f->primed = true;
+    } else {
+        f->ema_q8 += (sample * 256 - f->ema_q8) >> f->cfg.ema_shift;
+    }
+    int32_t value = f->ema_q8 / 256;
+    if (filtered) *filtered = value;
+
+    // adaptive rate: back off while the input agrees with the filter, snap back on a change
+    if (abs32(raw - value) <= f->cfg.stable_delta) {
+        uint32_t next = f->interval_ms * 2;
+        f->interval_ms = next > f->cfg.interval_max_ms ? f->cfg.interval_max_ms : next;
+    } else {
+        f->interval_ms = f->cfg.interval_min_ms;
+    }
+
+    if (f->reported_valid && abs32(value - f->reported) < f->cfg.report_delta) return false;
+    f->reported = value;
+    f->reported_valid = true;
+    f->stats.reports++;
+    return true;
+}
@@ -0,0 +1,71 @@
+/*
+ * Sampling pipeline shared by the board sensors (temperature, ultrasonic distance).
+ *
+ * Raw samples (integer units, e.g. centi-degrees or centimeters) go through outlier rejection, a
+ * short median and an exponential moving average. The filter tells the caller when the filtered
+ * value moved by at least report_delta since the last report, so the caller only takes the Zigbee
+ * lock and writes the attribute for real changes, and suggests the next sampling interval: it doubles
+ * while samples stay within stable_delta of the filtered value and snaps back to the minimum on a
+ * change. All integer math, the C6 has no FPU; samples must stay within +-2^23.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SENSOR_FILTER_MEDIAN_MAX 7
+
+typedef struct {
+    uint8_t median_len;         // odd median window, 0/1 = off, up to SENSOR_FILTER_MEDIAN_MAX
+    uint8_t ema_shift;          // EMA weight 1/2^shift for new samples, 0 = off
+    int32_t outlier_delta;      // a sample this far from the filtered value is rejected, 0 = off
+    uint8_t outlier_max;        // after this many consecutive rejects the samples are a real step and accepted
+    int32_t stable_delta;       // a sample within this of the filtered value counts as stable
+    int32_t report_delta;       // report once the filtered value moved this much since the last report
+    uint32_t interval_min_ms;   // sampling interval while readings change
+    uint32_t interval_max_ms;   // sampling interval backed off to while readings are stable
+} sensor_filter_config_t;
+
+typedef struct {
+    uint32_t samples;
+    uint32_t rejected;          // outliers dropped
+    uint32_t reports;           // updates handed to the caller for the attribute
+} sensor_filter_stats_t;
+
+typedef struct {
+    sensor_filter_config_t cfg;
+    int32_t window[SENSOR_FILTER_MEDIAN_MAX];
+    uint8_t window_pos;
+    uint8_t window_fill;
+    uint8_t outliers;           // consecutive rejected samples
+    bool primed;                // first sample seen
+    bool reported_valid;
+    int32_t ema_q8;             // filtered value * 256
+    int32_t reported;
+    uint32_t interval_ms;
+    sensor_filter_stats_t stats;
+} sensor_filter_t;
+
+void sensor_filter_init(sensor_filter_t *f, const sensor_filter_config_t *cfg);
+
+/**
+* @brief Feed a raw sample
+*
+* @param  f         Filter
+* @param  raw       Raw sample
+* @param  filtered  Optional, receives the filtered value
+*
+* @return true when the filtered value crossed the reporting delta and should be written to the attribute
+*/
+bool sensor_filter_update(sensor_filter_t *f, int32_t raw, int32_t *filtered);
+
+static inline uint32_t sensor_filter_interval_ms(const sensor_filter_t *f) { return f->interval_ms; }
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -24,7 +24,8 @@
  * This example code shows how to configure temperature sensor.
  *
  * @note:
- * The callback will be called with updated temperature sensor value every $interval seconds.
+ * Samples go through a sensor_filter; the callback is only called with the filtered value when it
+ * crossed the reporting delta, and the sampling interval backs off while the temperature is stable.
  *
  */
 
@@ -32,8 +33,8 @@
 static temperature_sensor_handle_t temp_sensor;
 /* call back function pointer */
 static esp_temp_sensor_callback_t func_ptr;
-/* update interval in seconds */
-static uint16_t interval = 1;
+/* filter pipeline, owns the sampling interval */
+static sensor_filter_t filter;
 
 static const char *TAG = "ESP_TEMP_SENSOR_DRIVER";
 
@@ -46,11 +47,12 @@ static void temp_sensor_driver_value_update(void *arg)
 {
     for (;;) {
         float tsens_value;
-        temperature_sensor_get_celsius(temp_sensor, &tsens_value);
-        if (func_ptr) {
-            func_ptr(tsens_value);
+        int32_t centi;
+        if (temperature_sensor_get_celsius(temp_sensor, &tsens_value) == ESP_OK &&
+            sensor_filter_update(&filter, (int32_t) (tsens_value * 100), &centi) && func_ptr) {
+            func_ptr(centi / 100.0f);
         }
-        vTaskDelay(pdMS_TO_TICKS(interval * 1000));
+        vTaskDelay(pdMS_TO_TICKS(sensor_filter_interval_ms(&filter)));
     }
 }
 
@@ -68,13 +70,17 @@ static esp_err_t temp_sensor_driver_sensor_init(temperature_sensor_config_t *con
     return (xTaskCreate(temp_sensor_driver_value_update, "sensor_update", 2048, NULL, 10, NULL) == pdTRUE) ? ESP_OK : ESP_FAIL;
 }
 
-esp_err_t temp_sensor_driver_init(temperature_sensor_config_t *config, uint16_t update_interval,
+esp_err_t temp_sensor_driver_init(temperature_sensor_config_t *config, const sensor_filter_config_t *filter_cfg,
                              esp_temp_sensor_callback_t cb)
 {
+    if (!filter_cfg) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // the task starts sampling right away, so filter and callback come first
+    sensor_filter_init(&filter, filter_cfg);
+    func_ptr = cb;
     if (ESP_OK != temp_sensor_driver_sensor_init(config)) {
         return ESP_FAIL;
     }
-    func_ptr = cb;
-    interval = update_interval;
     return ESP_OK;
 }
@@ -15,14 +15,15 @@
 #pragma once
 
 #include "driver/temperature_sensor.h"
+#include "sensor_filter.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-/** Temperature sensor callback
+/** Temperature sensor callback, called when the filtered value crossed the reporting delta
  *
- * @param[in] temperature temperature value in degrees Celsius from sensor
+ * @param[in] temperature filtered temperature value in degrees Celsius
  *
  */
 typedef void (*esp_temp_sensor_callback_t)(float temperature);
@@ -31,12 +32,13 @@ typedef void (*esp_temp_sensor_callback_t)(float temperature);
  * @brief init function for temp sensor and callback setup
  *
  * @param config                pointer of temperature sensor config.
- * @param update_interval       sensor value update interval in seconds.
+ * @param filter_cfg            sample filter in centi-degrees, its interval bounds set the sampling rate.
  * @param cb                    callback pointer.
  *
  * @return ESP_OK if the driver initialization succeed, otherwise ESP_FAIL.
  */
-esp_err_t temp_sensor_driver_init(temperature_sensor_config_t *config, uint16_t update_interval, esp_temp_sensor_callback_t cb);
+esp_err_t temp_sensor_driver_init(temperature_sensor_config_t *config, const sensor_filter_config_t *filter_cfg,
+                                  esp_temp_sensor_callback_t cb);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -0,0 +1,45 @@
+/*
+ * Thermal derating controller with hysteresis.
+ */
+
+#include "thermal_derate.h"
+
+void thermal_derate_init(thermal_derate_t *d, const thermal_derate_config_t *cfg)
+{
+    d->cfg = *cfg;
+    if (d->cfg.full_c100 <= d->cfg.start_c100) d->cfg.full_c100 = d->cfg.start_c100 + 1;
+    if (d->cfg.min_cap_q8 > 256) d->cfg.min_cap_q8 = 256;
+    if (d->cfg.hysteresis_c100 < 0) d->cfg.hysteresis_c100 = 0;
+    d->cap_q8 = 256;
+}
+
+// Cap the curve asks for at temp
+static uint16_t curve_cap(const thermal_derate_config_t *cfg, int32_t temp)
+{
+    if (temp <= cfg->start_c100) return 256;
+    if (temp >= cfg->full_c100) return cfg->min_cap_q8;
+    int32_t span = cfg->full_c100 - cfg->start_c100;
+    return (uint16_t) (256 - (int32_t) (256 - cfg->min_cap_q8) * (temp - cfg->start_c100) / span);
+}
+
+bool thermal_derate_update(thermal_derate_t *d, int32_t temp_c100)
+{
+    uint16_t target = curve_cap(&d->cfg, temp_c100);
+    uint16_t cap = d->cap_q8;
+    if (target < cap) {
+        cap = target;
+    } else if (target > cap) {
+        // recover along the curve shifted up by the hysteresis, never above what the temperature allows
+        uint16_t relaxed = curve_cap(&d->cfg, temp_c100 + d->cfg.hysteresis_c100);
+        if (relaxed > cap) cap = relaxed;
+    }
+    if (cap == d->cap_q8) return false;
+    d->cap_q8 = cap;
+    return true;
+}
+
+thermal_derate_state_t thermal_derate_state(const thermal_derate_t *d)
+{
+    if (d->cap_q8 >= 256) return THERMAL_DERATE_NORMAL;
+    return d->cap_q8 <= d->cfg.min_cap_q8 ? THERMAL_DERATE_MAX : THERMAL_DERATE_ACTIVE;
+}
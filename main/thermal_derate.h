@@ -0,0 +1,52 @@
+/*
+ * Thermal derating: maps the board temperature to a global output cap.
+ *
+ * Below start the cap is 256 (none). Between start and full it falls linearly to min_cap, and above full
+ * it stays at min_cap. The cap drops as soon as the temperature calls for it, but only rises again once
+ * the temperature is hysteresis below the point where the current cap would apply. The cap therefore
+ * moves monotonically along a temperature trace with small ripples and never toggles around a threshold.
+ * Temperatures are centi-degrees Celsius; integer math only.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    THERMAL_DERATE_NORMAL = 0,
+    THERMAL_DERATE_ACTIVE,      // output capped
+    THERMAL_DERATE_MAX,         // output at min_cap
+} thermal_derate_state_t;
+
+typedef struct {
+    int32_t start_c100;         // derating starts above this temperature
+    int32_t full_c100;          // min_cap is reached at this temperature
+    int32_t hysteresis_c100;    // recovery starts this far below the point of the current cap
+    uint16_t min_cap_q8;        // lowest cap, 256 = full output
+} thermal_derate_config_t;
+
+typedef struct {
+    thermal_derate_config_t cfg;
+    uint16_t cap_q8;
+} thermal_derate_t;
+
+void thermal_derate_init(thermal_derate_t *d, const thermal_derate_config_t *cfg);
+
+/**
+* @brief Feed a temperature sample
+*
+* @return true when the cap changed (pass thermal_derate_cap() to light_driver_set_output_cap())
+*/
+bool thermal_derate_update(thermal_derate_t *d, int32_t temp_c100);
+
+static inline uint16_t thermal_derate_cap(const thermal_derate_t *d) { return d->cap_q8; }
+thermal_derate_state_t thermal_derate_state(const thermal_derate_t *d);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
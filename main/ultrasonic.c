@@ -12,6 +12,9 @@
 #include <freertos/task.h>
 #include <esp_timer.h>
 #include <esp_log.h>
+#include <esp_attr.h>
+#include <esp_rom_sys.h>
+#include <string.h>
 
 #define TRIGGER_LOW_DELAY_US   4      // us
 #define TRIGGER_HIGH_DELAY_US  10     // us (10us pulse is standard)
@@ -103,4 +106,150 @@ esp_err_t ultrasonic_measure_cm(const ultrasonic_sensor_t *dev, uint32_t max_dis
 
     *distance = (int32_t)cm;
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+/* Asynchronous ranging */
+
+#define RANGING_TASK_STACK     3072
+#define RANGING_TASK_PRIORITY  6      // above the Zigbee task, a ping costs microseconds and results feed local automation
+
+typedef enum {
+    ECHO_IDLE = 0,
+    ECHO_WAIT_RISE,
+    ECHO_WAIT_FALL,
+    ECHO_DONE,
+} echo_state_t;
+
+// Written by the echo ISR, read by the ranging task once the ping is over
+typedef struct {
+    gpio_num_t echo_pin;
+    volatile echo_state_t state;
+    volatile int64_t rise_us;
+    volatile int64_t fall_us;
+} echo_capture_t;
+
+static const char *TAG = "ultrasonic";
+
+static ultrasonic_async_config_t s_cfg;
+static ultrasonic_sensor_t s_sensors[ULTRASONIC_ASYNC_MAX_SENSORS];
+static echo_capture_t s_capture[ULTRASONIC_ASYNC_MAX_SENSORS];
+static TaskHandle_t s_ranging_task;
+static volatile bool s_ranging_run;
+
+static void IRAM_ATTR echo_isr(void *arg)
+{
+    echo_capture_t *c = (echo_capture_t *) arg;
+    int64_t t = esp_timer_get_time();
+    if (gpio_get_level(c->echo_pin)) {
+        if (c->state == ECHO_WAIT_RISE) {
+            c->rise_us = t;
+            c->state = ECHO_WAIT_FALL;
+        }
+    } else if (c->state == ECHO_WAIT_FALL) {
+        c->fall_us = t;
+        c->state = ECHO_DONE;
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(s_ranging_task, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+// Fires one ping and sleeps until the falling echo edge or the timeout
+static void ping_sensor(uint8_t i, ultrasonic_result_t *res)
+{
+    const ultrasonic_sensor_t *dev = &s_sensors[i];
+    echo_capture_t *c = &s_capture[i];
+    *res = (ultrasonic_result_t) { .sensor = i };
+
+    if (gpio_get_level(dev->echo_pin)) {
+        // previous ping not finished or line stuck
+        res->err = ESP_ERR_ULTRASONIC_PING;
+        res->timestamp_us = esp_timer_get_time();
+        return;
+    }
+    ulTaskNotifyTake(pdTRUE, 0); // drop a late notification from the previous ping
+    c->state = ECHO_WAIT_RISE;
+    gpio_set_level(dev->trigger_pin, 1);
+    esp_rom_delay_us(TRIGGER_HIGH_DELAY_US);
+    gpio_set_level(dev->trigger_pin, 0);
+
+    const uint32_t window_us = WAIT_FOR_ECHO_HIGH_US + s_cfg.max_distance * ROUNDTRIP_US_PER_CM + 2000;
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(window_us / 1000) + 1);
+    echo_state_t state = c->state;
+    c->state = ECHO_IDLE;
+    res->timestamp_us = esp_timer_get_time();
+
+    if (state != ECHO_DONE) {
+        res->err = state == ECHO_WAIT_RISE ? ESP_ERR_ULTRASONIC_PING_TIMEOUT : ESP_ERR_ULTRASONIC_ECHO_TIMEOUT;
+        return;
+    }
+    const uint32_t cm = (uint32_t) ((c->fall_us - c->rise_us) / ROUNDTRIP_US_PER_CM);
+    if (cm > s_cfg.max_distance) {
+        res->err = ESP_ERR_ULTRASONIC_ECHO_TIMEOUT;
+        return;
+    }
+    res->err = ESP_OK;
+    res->distance_cm = cm;
+    res->timestamp_us = c->fall_us;
+}
+
+static void ranging_task(void *arg)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+    uint8_t next = 0;
+    while (s_ranging_run) {
+        ultrasonic_result_t res;
+        ping_sensor(next, &res);
+        if (s_cfg.cb) s_cfg.cb(&res, s_cfg.cb_arg);
+        if (s_cfg.queue) xQueueSend(s_cfg.queue, &res, 0);
+        next = (uint8_t) ((next + 1) % s_cfg.count);
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(s_cfg.slot_ms));
+    }
+    for (size_t i = 0; i < s_cfg.count; ++i) {
+        gpio_isr_handler_remove(s_sensors[i].echo_pin);
+        gpio_set_intr_type(s_sensors[i].echo_pin, GPIO_INTR_DISABLE);
+    }
+    s_ranging_task = NULL;
+    vTaskDelete(NULL);
+}
+
+esp_err_t ultrasonic_async_start(const ultrasonic_async_config_t *config)
+{
+    if (!config || !config->sensors || !config->count || config->count > ULTRASONIC_ASYNC_MAX_SENSORS || !config->max_distance)
+        return ESP_ERR_INVALID_ARG;
+    if (s_ranging_task)
+        return ESP_ERR_INVALID_STATE;
+
+    s_cfg = *config;
+    memcpy(s_sensors, config->sensors, config->count * sizeof(s_sensors[0]));
+    s_cfg.sensors = s_sensors;
+    // the slot must cover the longest echo window, or a late echo lands in the next sensor's slot
+    uint32_t min_slot_ms = (WAIT_FOR_ECHO_HIGH_US + s_cfg.max_distance * ROUNDTRIP_US_PER_CM) / 1000 + 10;
+    if (s_cfg.slot_ms < ULTRASONIC_SLOT_MS_MIN) s_cfg.slot_ms = ULTRASONIC_SLOT_MS_MIN;
+    if (s_cfg.slot_ms < min_slot_ms) s_cfg.slot_ms = min_slot_ms;
+
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) // already installed is fine
+        return err;
+    for (size_t i = 0; i < s_cfg.count; ++i) {
+        ultrasonic_init(&s_sensors[i]);
+        s_capture[i] = (echo_capture_t) { .echo_pin = s_sensors[i].echo_pin, .state = ECHO_IDLE };
+        gpio_set_intr_type(s_sensors[i].echo_pin, GPIO_INTR_ANYEDGE);
+        err = gpio_isr_handler_add(s_sensors[i].echo_pin, echo_isr, &s_capture[i]);
+        if (err != ESP_OK)
+            return err;
+    }
+
+    s_ranging_run = true;
+    if (xTaskCreate(ranging_task, "ultrasonic", RANGING_TASK_STACK, NULL, RANGING_TASK_PRIORITY, &s_ranging_task) != pdPASS) {
+        s_ranging_run = false;
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Ranging %u sensor(s), %lu ms per ping", (unsigned) s_cfg.count, (unsigned long) s_cfg.slot_ms);
+    return ESP_OK;
+}
+
+void ultrasonic_async_stop(void)
+{
+    s_ranging_run = false;
+}
@@ -11,7 +11,10 @@
 #ifndef __ULTRASONIC_H__
 #define __ULTRASONIC_H__
 
+#include <stddef.h>
 #include <driver/gpio.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
 //#include <driver/dac.h>
 
 #ifdef __cplusplus
@@ -38,13 +41,60 @@ typedef struct
 void ultrasonic_init(const ultrasonic_sensor_t *dev);
 
 /**
- * Measure distance
+ * Measure distance, busy-waiting for the echo (up to ~35 ms at 600 cm); prefer the asynchronous API
  * \param dev Pointer to the device descriptor
  * \param max_distance Maximal distance to measure, centimeters
  * \return Distance in centimeters or ULTRASONIC_ERROR_xxx if error occured
  */
 esp_err_t ultrasonic_measure_cm(const ultrasonic_sensor_t *dev, uint32_t max_distance, int32_t *distance);
 
+/*
+ * Asynchronous ranging: a low priority task fires the trigger pulses and GPIO interrupts timestamp
+ * the echo edges, so a ping costs the CPU a few microseconds instead of busy-waiting for the echo.
+ * Sensors are pinged one at a time, round-robin, so none of them hears another one's echo.
+ */
+#define ULTRASONIC_ASYNC_MAX_SENSORS 4
+#define ULTRASONIC_SLOT_MS_MIN       60     // ms between pings, lets the previous ping's echoes die out
+
+/**
+ * Result of one asynchronous ping
+ */
+typedef struct
+{
+	uint8_t sensor;         // index into ultrasonic_async_config_t::sensors
+	esp_err_t err;          // ESP_OK or ESP_ERR_ULTRASONIC_xxx
+	uint32_t distance_cm;
+	int64_t timestamp_us;   // esp_timer time of the echo's falling edge, or of the timeout
+} ultrasonic_result_t;
+
+typedef void (*ultrasonic_result_cb_t)(const ultrasonic_result_t *result, void *arg);
+
+/**
+ * Asynchronous ranging configuration
+ */
+typedef struct
+{
+	const ultrasonic_sensor_t *sensors; // copied by ultrasonic_async_start()
+	size_t count;                       // up to ULTRASONIC_ASYNC_MAX_SENSORS
+	uint32_t max_distance;              // centimeters
+	uint32_t slot_ms;                   // ping period, each sensor is pinged every count * slot_ms; 0 = ULTRASONIC_SLOT_MS_MIN
+	ultrasonic_result_cb_t cb;          // optional, called from the ranging task
+	void *cb_arg;
+	QueueHandle_t queue;                // optional, receives ultrasonic_result_t, results are dropped while full
+} ultrasonic_async_config_t;
+
+/**
+ * Init the sensors and start pinging them round-robin
+ * \param config Ranging configuration
+ * \return ESP_OK, ESP_ERR_INVALID_ARG or ESP_ERR_INVALID_STATE if already running
+ */
+esp_err_t ultrasonic_async_start(const ultrasonic_async_config_t *config);
+
+/**
+ * Stop asynchronous ranging after the ping in flight
+ */
+void ultrasonic_async_stop(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,90 @@
+/*
+ * Table-driven dispatch of ZCL attribute writes.
+ */
+
+#include <stdlib.h>
+#include "zcl_attr_dispatch.h"
+
+static inline uint32_t make_key(uint16_t cluster, uint16_t attr_id) { return ((uint32_t) cluster << 16) | attr_id; }
+static inline uint32_t entry_key(const zcl_attr_entry_t *e) { return make_key(e->cluster, e->attr_id); }
+static inline uint32_t key_hash(uint32_t key) { return (key * 0x9E3779B1u) >> 15; }
+
+esp_err_t zcl_attr_dispatch_init(zcl_attr_dispatch_t *d, const zcl_attr_entry_t *table, size_t count)
+{
+    if (!d || !table) return ESP_ERR_INVALID_ARG;
+    if (!count || count > UINT16_MAX / 2) return ESP_ERR_INVALID_SIZE;
+    uint16_t *order = malloc(count * sizeof(*order));
+    if (!order) return ESP_ERR_NO_MEM;
+    // insertion sort, stable, so entries of one key keep their table order; runs once at startup
+    size_t keys = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t key = entry_key(&table[i]);
+        size_t j = i;
+        for (; j > 0 && entry_key(&table[order[j - 1]]) > key; --j) order[j] = order[j - 1];
+        order[j] = (uint16_t) i;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (!i || entry_key(&table[order[i]]) != entry_key(&table[order[i - 1]])) keys++;
+    }
+    uint32_t size = 2;
+    while (size < 2 * keys) size *= 2;
+    uint16_t *slots = calloc(size, sizeof(*slots));
+    if (!slots) {
+        free(order);
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t key = entry_key(&table[order[i]]);
+        if (i && key == entry_key(&table[order[i - 1]])) continue;
+        uint32_t h = key_hash(key) & (size - 1);
+        while (slots[h]) h = (h + 1) & (size - 1);
+        slots[h] = (uint16_t) (i + 1);
+    }
+    *d = (zcl_attr_dispatch_t) { .table = table, .count = (uint16_t) count, .order = order, .slots = slots, .mask = size - 1 };
+    return ESP_OK;
+}
+
+void zcl_attr_dispatch_deinit(zcl_attr_dispatch_t *d)
+{
+    if (!d) return;
+    free(d->order);
+    free(d->slots);
+    *d = (zcl_attr_dispatch_t) { 0 };
+}
+
+// Table index of the first entry of key whose type matches, count if there is none
+static size_t first_of_key(const zcl_attr_dispatch_t *d, uint32_t key, uint8_t type)
+{
+    uint32_t h = key_hash(key) & d->mask;
+    for (; d->slots[h]; h = (h + 1) & d->mask) {
+        size_t i = d->slots[h] - 1;
+        if (entry_key(&d->table[d->order[i]]) != key) continue;
+        for (; i < d->count; ++i) {
+            const zcl_attr_entry_t *e = &d->table[d->order[i]];
+            if (entry_key(e) != key) break;
+            if (e->type == ZCL_ATTR_TYPE_ANY || e->type == type) return d->order[i];
+        }
+        break;
+    }
+    return d->count;
+}
+
+const zcl_attr_entry_t *zcl_attr_find(const zcl_attr_dispatch_t *d, uint16_t cluster, uint16_t attr_id, uint8_t type)
+{
+    if (!d || !d->slots) return NULL;
+    // the exact attribute and the cluster's wildcard entries compete on table order
+    size_t exact = first_of_key(d, make_key(cluster, attr_id), type);
+    size_t any = attr_id == ZCL_ATTR_ANY ? d->count : first_of_key(d, make_key(cluster, ZCL_ATTR_ANY), type);
+    size_t first = exact < any ? exact : any;
+    return first < d->count ? &d->table[first] : NULL;
+}
+
+esp_err_t zcl_attr_dispatch(const zcl_attr_dispatch_t *d, size_t ch, uint16_t cluster, uint16_t attr_id, uint8_t type,
+                            const void *value)
+{
+    const zcl_attr_entry_t *e = zcl_attr_find(d, cluster, attr_id, type);
+    if (!e) return ESP_ERR_NOT_FOUND;
+    if (!value && !(e->flags & ZCL_ATTR_VALUE_OPTIONAL)) return ESP_ERR_INVALID_ARG;
+    e->handler(ch, attr_id, value);
+    return ESP_OK;
+}
@@ -0,0 +1,69 @@
+/*
+ * Table-driven dispatch of ZCL attribute writes.
+ *
+ * A constant table maps (cluster, attribute, type) to a handler; a write goes to the first entry that
+ * matches, so the most frequent writes belong at the top and wildcard entries below the specific ones.
+ * zcl_attr_dispatch_init() indexes the table by (cluster, attribute) once: the entries sorted by key plus
+ * an open-addressed hash from each key to its first sorted entry. A lookup is then two hash probes (the
+ * attribute and the cluster's wildcard) and a walk over the few entries of each key, independent of
+ * the table size.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ZCL_ATTR_ANY            0xFFFF  // entry matches every attribute of its cluster
+#define ZCL_ATTR_TYPE_ANY       0xFF    // entry matches every data type
+#define ZCL_ATTR_VALUE_OPTIONAL 0x01    // handler copes with a message without data
+
+typedef void (*zcl_attr_handler_t)(size_t ch, uint16_t attr_id, const void *value);
+
+typedef struct {
+    uint16_t cluster;
+    uint16_t attr_id;
+    uint8_t type;
+    uint8_t flags;
+    zcl_attr_handler_t handler;
+} zcl_attr_entry_t;
+
+typedef struct {
+    const zcl_attr_entry_t *table;
+    uint16_t count;
+    uint16_t *order;            // table indices sorted by (cluster, attribute, table index)
+    uint16_t *slots;            // hash of keys, position in order + 1 of the key's first entry, 0 = empty
+    uint32_t mask;              // slots - 1, a power of two at least twice the number of keys
+} zcl_attr_dispatch_t;
+
+/**
+* @brief Index a table; the table must stay valid as long as the dispatcher is used
+*
+* @return ESP_ERR_INVALID_SIZE for an empty table or one of more than UINT16_MAX / 2 entries
+*/
+esp_err_t zcl_attr_dispatch_init(zcl_attr_dispatch_t *d, const zcl_attr_entry_t *table, size_t count);
+
+void zcl_attr_dispatch_deinit(zcl_attr_dispatch_t *d);
+
+/**
+* @brief First entry of the table matching the write, NULL if none does
+*/
+const zcl_attr_entry_t *zcl_attr_find(const zcl_attr_dispatch_t *d, uint16_t cluster, uint16_t attr_id, uint8_t type);
+
+/**
+* @brief Call the handler of the first matching entry with channel ch
+*
+* @return ESP_ERR_NOT_FOUND if no entry matches, ESP_ERR_INVALID_ARG for a write without data to an entry
+*         that needs a value
+*/
+esp_err_t zcl_attr_dispatch(const zcl_attr_dispatch_t *d, size_t ch, uint16_t cluster, uint16_t attr_id, uint8_t type,
+                            const void *value);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,75 @@
+/*
+ * Host microbenchmarks. A test file built through host_bench() (CMakeLists.txt) gets HOST_BENCH defined
+ * and -O2, and runs its benchmarks instead of the Unity tests. The numbers are host timings: only the
+ * ratio between two kernels says something about the C6, which has no FPU and loses far more on the
+ * float paths than a desktop core does.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+
+#define BENCH_MIN_NS    20000000ull     // a timed run lasts at least this long
+#define BENCH_RUNS      5               // best of
+
+typedef struct {
+    double ns_per_op;
+    double ticks_per_op;                // time stamp counter, 0 where there is none
+} bench_result_t;
+
+// Kernels fold their results into this so the optimizer cannot drop them
+static volatile uint32_t bench_sink __attribute__((unused));
+
+static inline uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static inline uint64_t bench_ticks(void)
+{
+#ifdef BENCH_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+* @brief Time fn(iters), each iteration doing ops_per_iter operations, and print one line for it
+*
+* iters doubles until a run lasts BENCH_MIN_NS, the best of BENCH_RUNS such runs is reported.
+*/
+static inline bench_result_t bench_run(const char *name, void (*fn)(uint32_t iters), uint32_t ops_per_iter)
+{
+    uint32_t iters = 1;
+    for (;;) {
+        uint64_t t0 = bench_now_ns();
+        fn(iters);
+        if (bench_now_ns() - t0 >= BENCH_MIN_NS || iters >= (1u << 30)) break;
+        iters *= 2;
+    }
+    uint64_t best_ns = UINT64_MAX, best_ticks = UINT64_MAX;
+    for (int r = 0; r < BENCH_RUNS; ++r) {
+        uint64_t c0 = bench_ticks(), t0 = bench_now_ns();
+        fn(iters);
+        uint64_t ns = bench_now_ns() - t0, ticks = bench_ticks() - c0;
+        if (ns < best_ns) best_ns = ns;
+        if (ticks < best_ticks) best_ticks = ticks;
+    }
+    double ops = (double) iters * ops_per_iter;
+    bench_result_t res = { best_ns / ops, best_ticks / ops };
+#ifdef BENCH_HAVE_TSC
+    printf("%-40s %9.2f ns/op %9.1f ticks/op\n", name, res.ns_per_op, res.ticks_per_op);
+#else
+    printf("%-40s %9.2f ns/op\n", name, res.ns_per_op);
+#endif
+    return res;
+}
@@ -0,0 +1,81 @@
+/*
+ * Host backend for led_output: captures every transmitted frame instead of driving a strip.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "led_output_priv.h"
+#include "led_output_mock.h"
+
+typedef struct {
+    led_output_t base;
+    led_output_mock_t mock;
+} mock_output_t;
+
+static esp_err_t mock_transmit(led_output_t *out, const uint8_t *grb, size_t len)
+{
+    led_output_mock_t *m = led_output_mock(out);
+    if (m->transmit_err != ESP_OK) return m->transmit_err;
+    uint8_t *frame;
+    if (m->frames < LED_OUTPUT_MOCK_FRAMES_MAX) {
+        frame = malloc(len);
+        if (!frame) return ESP_ERR_NO_MEM;
+        m->frame[m->frames] = frame;
+    } else {
+        frame = m->frame[0];
+        memmove(&m->frame[0], &m->frame[1], (LED_OUTPUT_MOCK_FRAMES_MAX - 1) * sizeof(m->frame[0]));
+        m->frame[LED_OUTPUT_MOCK_FRAMES_MAX - 1] = frame;
+    }
+    memcpy(frame, grb, len);
+    m->len = len;
+    m->frames++;
+    return ESP_OK;
+}
+
+static esp_err_t mock_wait_done(led_output_t *out, int timeout_ms)
+{
+    // nothing completes on its own here; a wait that would block forever is a test bug
+    return timeout_ms < 0 ? ESP_ERR_INVALID_STATE : ESP_ERR_TIMEOUT;
+}
+
+static void mock_del(led_output_t *out)
+{
+    led_output_mock_t *m = led_output_mock(out);
+    size_t kept = m->frames < LED_OUTPUT_MOCK_FRAMES_MAX ? m->frames : LED_OUTPUT_MOCK_FRAMES_MAX;
+    for (size_t i = 0; i < kept; ++i) free(m->frame[i]);
+    led_output_free_buffers(out);
+    free(out);
+}
+
+static const led_output_ops_t s_mock_ops = {
+    .transmit = mock_transmit,
+    .wait_done = mock_wait_done,
+    .del = mock_del,
+};
+
+static esp_err_t mock_new(const led_output_config_t *cfg, led_output_t **ret)
+{
+    mock_output_t *o = calloc(1, sizeof(*o));
+    if (!o) return ESP_ERR_NO_MEM;
+    o->base.ops = &s_mock_ops;
+    esp_err_t err = led_output_init_buffers(&o->base, cfg->led_count);
+    if (err != ESP_OK) { free(o); return err; }
+    *ret = &o->base;
+    return ESP_OK;
+}
+
+esp_err_t led_output_rmt_new(const led_output_config_t *cfg, led_output_t **ret) { return mock_new(cfg, ret); }
+esp_err_t led_output_spi_new(const led_output_config_t *cfg, led_output_t **ret) { return mock_new(cfg, ret); }
+
+led_output_mock_t *led_output_mock(led_output_t *out) { return &((mock_output_t *) out)->mock; }
+
+void led_output_mock_complete(led_output_t *out) { out->busy = false; }
+
+const uint8_t *led_output_mock_last(led_output_t *out)
+{
+    led_output_mock_t *m = led_output_mock(out);
+    if (!m->frames) return NULL;
+    return m->frame[(m->frames < LED_OUTPUT_MOCK_FRAMES_MAX ? m->frames : LED_OUTPUT_MOCK_FRAMES_MAX) - 1];
+}
+
+void led_output_mock_del(led_output_t *out) { out->ops->del(out); }
@@ -0,0 +1,33 @@
+/*
+ * Host backend for led_output: captures every transmitted frame instead of driving a strip.
+ *
+ * It stands in for both hardware backends (led_output_rmt_new / led_output_spi_new), so
+ * led_output_new() returns a mock whatever backend the config names. A transmission stays in flight
+ * until led_output_mock_complete(), which plays the part of the completion interrupt.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "led_output.h"
+
+#define LED_OUTPUT_MOCK_FRAMES_MAX  8
+
+typedef struct {
+    size_t frames;                  // transmissions so far
+    size_t len;                     // bytes of each captured frame
+    uint8_t *frame[LED_OUTPUT_MOCK_FRAMES_MAX];     // the last LED_OUTPUT_MOCK_FRAMES_MAX frames, oldest first
+    esp_err_t transmit_err;         // returned by the next transmissions when not ESP_OK
+} led_output_mock_t;
+
+/* Capture state of an output created by led_output_new() on the host */
+led_output_mock_t *led_output_mock(led_output_t *out);
+
+/* The frame in flight is out: clears busy like the backend's completion interrupt */
+void led_output_mock_complete(led_output_t *out);
+
+/* Last captured frame, NULL before the first transmission */
+const uint8_t *led_output_mock_last(led_output_t *out);
+
+void led_output_mock_del(led_output_t *out);
@@ -0,0 +1,6 @@
+/* Host stand-in for esp_timer.h: the clock only moves when a test advances it (host_stubs.h) */
+#pragma once
+
+#include "esp_err.h"
+
+int64_t esp_timer_get_time(void);
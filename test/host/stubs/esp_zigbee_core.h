@@ -0,0 +1,16 @@
+/* Host stand-in for the parts of esp_zigbee_core.h the tested modules use; alarms run from host_stubs.h */
+#pragma once
+
+#include "esp_err.h"
+
+typedef void (*esp_zb_callback_t)(uint8_t param);
+
+void esp_zb_scheduler_alarm(esp_zb_callback_t cb, uint8_t param, uint32_t time);
+void esp_zb_scheduler_alarm_cancel(esp_zb_callback_t cb, uint8_t param);
+
+/* Color Control defaults of the ZCL headers */
+#define ESP_ZB_ZCL_COLOR_CONTROL_CURRENT_X_DEF_VALUE                            0x616b
+#define ESP_ZB_ZCL_COLOR_CONTROL_CURRENT_Y_DEF_VALUE                            0x607d
+#define ESP_ZB_ZCL_COLOR_CONTROL_COLOR_TEMPERATURE_DEF_VALUE                    0x00fa
+#define ESP_ZB_ZCL_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MIN_MIREDS_DEFAULT_VALUE   0x0000
+#define ESP_ZB_ZCL_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MAX_MIREDS_DEFAULT_VALUE   0xfeff
@@ -0,0 +1,37 @@
+/*
+ * ESP-IDF stand-ins for the host tests: error names, logging and the clock.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "host_stubs.h"
+
+static uint32_t s_clock_ms;
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    static char buf[16];
+    snprintf(buf, sizeof(buf), "0x%x", code);
+    return buf;
+}
+
+void host_log(char level, const char *tag, const char *fmt, ...)
+{
+    if (!getenv("HOST_TEST_LOG")) return;
+    va_list ap;
+    va_start(ap, fmt);
+    printf("%c (%s) ", level, tag);
+    vprintf(fmt, ap);
+    printf("\n");
+    va_end(ap);
+}
+
+int64_t esp_timer_get_time(void) { return (int64_t) s_clock_ms * 1000; }
+
+void host_clock_set_ms(uint32_t ms) { s_clock_ms = ms; }
+
+uint32_t host_clock_ms(void) { return s_clock_ms; }
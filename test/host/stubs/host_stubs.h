@@ -0,0 +1,26 @@
+/*
+ * Controls of the ESP-IDF stand-ins, for the tests.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/* Fake clock behind esp_timer_get_time(); starts at 0 */
+void host_clock_set_ms(uint32_t ms);
+uint32_t host_clock_ms(void);
+
+/* Scheduler alarms: advance the clock by ms, running alarms as they come due */
+void host_zb_advance_ms(uint32_t ms);
+size_t host_zb_alarms_pending(void);
+void host_zb_reset(void);
+
+/* In-memory NVS */
+void host_nvs_reset(void);
+esp_err_t host_nvs_put(const char *ns, const char *key, const void *data, size_t len);
+/* Stored length of a blob, 0 if there is none; copies up to size bytes into buf when given */
+size_t host_nvs_get(const char *ns, const char *key, void *buf, size_t size);
+uint32_t host_nvs_writes(void);                 // nvs_set_blob() calls that stored something
+void host_nvs_fail_writes(esp_err_t err);       // nvs_set_blob() returns err until reset to ESP_OK
@@ -0,0 +1,141 @@
+/*
+ * In-memory NVS with the blob semantics the firmware relies on.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "nvs.h"
+#include "host_stubs.h"
+
+#define ENTRIES_MAX     16
+#define NAME_MAX_LEN    16
+
+typedef struct {
+    char ns[NAME_MAX_LEN];
+    char key[NAME_MAX_LEN];
+    uint8_t *data;
+    size_t len;
+} entry_t;
+
+static entry_t s_entries[ENTRIES_MAX];
+static char s_open_ns[ENTRIES_MAX][NAME_MAX_LEN];     // namespace of handle i + 1
+static uint32_t s_writes;
+static esp_err_t s_write_err;
+
+static entry_t *find(const char *ns, const char *key)
+{
+    for (size_t i = 0; i < ENTRIES_MAX; ++i) {
+        if (s_entries[i].data && !strcmp(s_entries[i].ns, ns) && !strcmp(s_entries[i].key, key)) return &s_entries[i];
+    }
+    return NULL;
+}
+
+static bool ns_exists(const char *ns)
+{
+    for (size_t i = 0; i < ENTRIES_MAX; ++i) {
+        if (s_entries[i].data && !strcmp(s_entries[i].ns, ns)) return true;
+    }
+    return false;
+}
+
+static const char *handle_ns(nvs_handle_t handle)
+{
+    if (!handle || handle > ENTRIES_MAX || !s_open_ns[handle - 1][0]) return NULL;
+    return s_open_ns[handle - 1];
+}
+
+esp_err_t host_nvs_put(const char *ns, const char *key, const void *data, size_t len)
+{
+    entry_t *e = find(ns, key);
+    for (size_t i = 0; !e && i < ENTRIES_MAX; ++i) {
+        if (!s_entries[i].data) e = &s_entries[i];
+    }
+    if (!e) return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    uint8_t *copy = malloc(len ? len : 1);
+    if (!copy) return ESP_ERR_NO_MEM;
+    memcpy(copy, data, len);
+    free(e->data);
+    strncpy(e->ns, ns, NAME_MAX_LEN - 1);
+    strncpy(e->key, key, NAME_MAX_LEN - 1);
+    e->data = copy;
+    e->len = len;
+    return ESP_OK;
+}
+
+size_t host_nvs_get(const char *ns, const char *key, void *buf, size_t size)
+{
+    const entry_t *e = find(ns, key);
+    if (!e) return 0;
+    if (buf) memcpy(buf, e->data, e->len < size ? e->len : size);
+    return e->len;
+}
+
+void host_nvs_reset(void)
+{
+    for (size_t i = 0; i < ENTRIES_MAX; ++i) free(s_entries[i].data);
+    memset(s_entries, 0, sizeof(s_entries));
+    memset(s_open_ns, 0, sizeof(s_open_ns));
+    s_writes = 0;
+    s_write_err = ESP_OK;
+}
+
+uint32_t host_nvs_writes(void) { return s_writes; }
+
+void host_nvs_fail_writes(esp_err_t err) { s_write_err = err; }
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    // as on the target, a namespace that was never written cannot be opened read-only
+    if (open_mode == NVS_READONLY && !ns_exists(namespace_name)) return ESP_ERR_NVS_NOT_FOUND;
+    for (size_t i = 0; i < ENTRIES_MAX; ++i) {
+        if (s_open_ns[i][0]) continue;
+        strncpy(s_open_ns[i], namespace_name, NAME_MAX_LEN - 1);
+        *out_handle = (nvs_handle_t) (i + 1);
+        return ESP_OK;
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    if (handle_ns(handle)) s_open_ns[handle - 1][0] = '\0';
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    const char *ns = handle_ns(handle);
+    if (!ns) return ESP_ERR_NVS_INVALID_HANDLE;
+    const entry_t *e = find(ns, key);
+    if (!e) return ESP_ERR_NVS_NOT_FOUND;
+    if (!out_value) {
+        *length = e->len;
+        return ESP_OK;
+    }
+    if (*length < e->len) return ESP_ERR_NVS_INVALID_LENGTH;
+    memcpy(out_value, e->data, e->len);
+    *length = e->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    const char *ns = handle_ns(handle);
+    if (!ns) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (s_write_err != ESP_OK) return s_write_err;
+    esp_err_t err = host_nvs_put(ns, key, value, length);
+    if (err == ESP_OK) s_writes++;
+    return err;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    const char *ns = handle_ns(handle);
+    if (!ns) return ESP_ERR_NVS_INVALID_HANDLE;
+    entry_t *e = find(ns, key);
+    if (!e) return ESP_ERR_NVS_NOT_FOUND;
+    free(e->data);
+    memset(e, 0, sizeof(*e));
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) { return handle_ns(handle) ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE; }
@@ -0,0 +1,60 @@
+/*
+ * Zigbee scheduler alarms on the host fake clock.
+ */
+
+#include <string.h>
+#include "esp_zigbee_core.h"
+#include "host_stubs.h"
+
+#define ALARMS_MAX 16
+
+typedef struct {
+    esp_zb_callback_t cb;
+    uint8_t param;
+    uint32_t due_ms;
+} alarm_t;
+
+static alarm_t s_alarms[ALARMS_MAX];
+static size_t s_count;
+
+void esp_zb_scheduler_alarm(esp_zb_callback_t cb, uint8_t param, uint32_t time)
+{
+    if (s_count == ALARMS_MAX) return;
+    s_alarms[s_count++] = (alarm_t) { .cb = cb, .param = param, .due_ms = host_clock_ms() + time };
+}
+
+void esp_zb_scheduler_alarm_cancel(esp_zb_callback_t cb, uint8_t param)
+{
+    for (size_t i = 0; i < s_count;) {
+        if (s_alarms[i].cb == cb && s_alarms[i].param == param) {
+            memmove(&s_alarms[i], &s_alarms[i + 1], (s_count - i - 1) * sizeof(s_alarms[0]));
+            s_count--;
+        } else {
+            ++i;
+        }
+    }
+}
+
+void host_zb_advance_ms(uint32_t ms)
+{
+    uint32_t end = host_clock_ms() + ms;
+    for (;;) {
+        // earliest due alarm within the step, in registration order for equal times
+        size_t next = s_count;
+        for (size_t i = 0; i < s_count; ++i) {
+            if ((int32_t) (s_alarms[i].due_ms - end) > 0) continue;
+            if (next == s_count || (int32_t) (s_alarms[i].due_ms - s_alarms[next].due_ms) < 0) next = i;
+        }
+        if (next == s_count) break;
+        alarm_t a = s_alarms[next];
+        memmove(&s_alarms[next], &s_alarms[next + 1], (s_count - next - 1) * sizeof(s_alarms[0]));
+        s_count--;
+        if ((int32_t) (a.due_ms - host_clock_ms()) > 0) host_clock_set_ms(a.due_ms);
+        a.cb(a.param);
+    }
+    host_clock_set_ms(end);
+}
+
+size_t host_zb_alarms_pending(void) { return s_count; }
+
+void host_zb_reset(void) { s_count = 0; }
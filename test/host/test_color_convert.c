@@ -0,0 +1,217 @@
+/*
+ * Fixed-point color conversion against the float code it replaced.
+ */
+
+#include <math.h>
+#include "unity.h"
+#include "color_convert.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static uint8_t clamp_u8(float v) { return v <= 0 ? 0 : v >= 1 ? 255 : (uint8_t) (v * 255.0f); }
+
+// former set_color_xy_internal() with the XYZ_to_RGB macro
+static void ref_xy_to_rgb(uint16_t x, uint16_t y, color_rgb_t *out)
+{
+    float cx = x / 65535.0f, cy = y / 65535.0f;
+    float X = cx / cy, Z = (1.0f - cx - cy) / cy;
+    out->r = clamp_u8(3.240479f * X - 1.537150f - 0.498535f * Z);
+    out->g = clamp_u8(-0.969256f * X + 1.875992f + 0.041556f * Z);
+    out->b = clamp_u8(0.055648f * X - 0.204043f + 1.057311f * Z);
+}
+
+// former HSV_to_RGB macro at full value
+static void ref_hs_to_rgb(uint8_t h, uint8_t s, color_rgb_t *out)
+{
+    const uint8_t sector = UINT8_MAX / 6;
+    if (s == 0) { out->r = out->g = out->b = 255; return; }
+    float f = h % sector;
+    uint8_t p = (uint8_t) (255 * (1.0 - (float) s / UINT8_MAX));
+    uint8_t q = (uint8_t) (255 * (1.0 - (float) s / UINT8_MAX * f / (float) sector));
+    uint8_t t = (uint8_t) (255 * (1.0 - (float) s / UINT8_MAX * (1 - f / (float) sector)));
+    switch (h / sector) {
+        case 0: *out = (color_rgb_t) { 255, t, p }; break;
+        case 1: *out = (color_rgb_t) { q, 255, p }; break;
+        case 2: *out = (color_rgb_t) { p, 255, t }; break;
+        case 3: *out = (color_rgb_t) { p, q, 255 }; break;
+        case 4: *out = (color_rgb_t) { t, p, 255 }; break;
+        default: *out = (color_rgb_t) { 255, p, q }; break;
+    }
+}
+
+// former color_temp_to_rgb()
+static void ref_mired_to_rgb(uint16_t mired, color_rgb_t *out)
+{
+    if (mired < 153) mired = 153;
+    if (mired > 500) mired = 500;
+    float temp = 1000000.0f / (float) mired / 100.0f;
+    float r, g, b;
+    if (temp <= 66) r = 255.0f;
+    else r = fminf(fmaxf(329.698727446f * powf(temp - 60.0f, -0.1332047592f), 0), 255);
+    if (temp <= 66) g = 99.4708025861f * logf(temp) - 161.1195681661f;
+    else g = 288.1221695283f * powf(temp - 60.0f, -0.0755148492f);
+    g = fminf(fmaxf(g, 0), 255);
+    if (temp >= 66) b = 255.0f;
+    else if (temp <= 19) b = 0;
+    else b = fminf(fmaxf(138.5177312231f * logf(temp - 10.0f) - 305.0447927307f, 0), 255);
+    *out = (color_rgb_t) { (uint8_t) r, (uint8_t) g, (uint8_t) b };
+}
+
+static void assert_rgb_within(uint8_t delta, const color_rgb_t *want, const color_rgb_t *got)
+{
+    TEST_ASSERT_UINT_WITHIN(delta, want->r, got->r);
+    TEST_ASSERT_UINT_WITHIN(delta, want->g, got->g);
+    TEST_ASSERT_UINT_WITHIN(delta, want->b, got->b);
+}
+
+static void test_xy_matches_float(void)
+{
+    // y below ~0.01 is where the Q12 matrix rounding grows, see color_convert.h
+    for (uint32_t y = 656; y < 65536; y += 397) {
+        for (uint32_t x = 0; x + y < 65536; x += 401) {
+            color_rgb_t want, got;
+            ref_xy_to_rgb((uint16_t) x, (uint16_t) y, &want);
+            TEST_ASSERT_TRUE(color_xy_to_rgb((uint16_t) x, (uint16_t) y, &got));
+            assert_rgb_within(1, &want, &got);
+        }
+    }
+}
+
+static void test_xy_zero_y_is_undefined(void)
+{
+    color_rgb_t out = { 1, 2, 3 };
+    TEST_ASSERT_FALSE(color_xy_to_rgb(0x5000, 0, &out));
+    TEST_ASSERT_EQUAL_UINT8(1, out.r);
+    TEST_ASSERT_EQUAL_UINT8(2, out.g);
+    TEST_ASSERT_EQUAL_UINT8(3, out.b);
+}
+
+static void test_hs_matches_float(void)
+{
+    for (int h = 0; h < 256; ++h) {
+        for (int s = 0; s < 256; ++s) {
+            color_rgb_t want, got;
+            ref_hs_to_rgb((uint8_t) h, (uint8_t) s, &want);
+            color_hs_to_rgb((uint8_t) h, (uint8_t) s, &got);
+            assert_rgb_within(1, &want, &got);
+        }
+    }
+}
+
+static void test_ehs_agrees_with_hs(void)
+{
+    // hue h of 0..255 and enhanced hue h * 65536 / 252 start the same 42-step sector position
+    for (int h = 0; h < 252; ++h) {
+        color_rgb_t hs, ehs;
+        color_hs_to_rgb((uint8_t) h, 200, &hs);
+        color_ehs_to_rgb((uint16_t) ((h * 65536 + 126) / 252), 200, &ehs);
+        assert_rgb_within(1, &hs, &ehs);
+    }
+}
+
+static void test_rgb_to_ehs_round_trip(void)
+{
+    for (uint32_t hue = 0; hue < 65536; hue += 97) {
+        for (int sat = 1; sat < 256; sat += 9) {
+            color_rgb_t rgb, back;
+            uint16_t h;
+            uint8_t s;
+            color_ehs_to_rgb((uint16_t) hue, (uint8_t) sat, &rgb);
+            TEST_ASSERT_TRUE(color_rgb_to_ehs(&rgb, &h, &s));
+            color_ehs_to_rgb(h, s, &back);
+            assert_rgb_within(1, &rgb, &back);
+        }
+    }
+    color_rgb_t black = { 0, 0, 0 };
+    uint16_t h = 7;
+    uint8_t s = 9;
+    TEST_ASSERT_FALSE(color_rgb_to_ehs(&black, &h, &s));
+    TEST_ASSERT_EQUAL_UINT16(7, h);
+    TEST_ASSERT_EQUAL_UINT8(9, s);
+}
+
+static void test_mired_matches_float(void)
+{
+    for (uint16_t mired = 100; mired <= 600; ++mired) {
+        color_rgb_t want, got;
+        ref_mired_to_rgb(mired, &want);
+        color_mired_to_rgb(mired, &got);
+        assert_rgb_within(0, &want, &got);
+    }
+}
+
+#ifdef HOST_BENCH
+#include "bench.h"
+
+#define BENCH_INPUTS 256
+
+static uint16_t s_x[BENCH_INPUTS], s_y[BENCH_INPUTS], s_ehue[BENCH_INPUTS], s_mired[BENCH_INPUTS];
+static uint8_t s_hue[BENCH_INPUTS], s_sat[BENCH_INPUTS];
+
+// One kernel over all inputs per iteration, the RGB folded into the sink
+#define BENCH_KERNEL(fn_name, call)                                             \
+    static void fn_name(uint32_t iters)                                         \
+    {                                                                           \
+        uint32_t acc = 0;                                                       \
+        for (uint32_t n = 0; n < iters; ++n) {                                  \
+            for (int i = 0; i < BENCH_INPUTS; ++i) {                            \
+                color_rgb_t c;                                                  \
+                call;                                                           \
+                acc += c.r + c.g + c.b;                                         \
+            }                                                                   \
+            bench_sink = acc;                                                   \
+        }                                                                       \
+    }
+
+BENCH_KERNEL(bench_xy_float, ref_xy_to_rgb(s_x[i], s_y[i], &c))
+BENCH_KERNEL(bench_xy_fixed, color_xy_to_rgb(s_x[i], s_y[i], &c))
+BENCH_KERNEL(bench_hs_float, ref_hs_to_rgb(s_hue[i], s_sat[i], &c))
+BENCH_KERNEL(bench_hs_fixed, color_hs_to_rgb(s_hue[i], s_sat[i], &c))
+BENCH_KERNEL(bench_ehs_fixed, color_ehs_to_rgb(s_ehue[i], s_sat[i], &c))
+BENCH_KERNEL(bench_mired_float, ref_mired_to_rgb(s_mired[i], &c))
+BENCH_KERNEL(bench_mired_fixed, color_mired_to_rgb(s_mired[i], &c))
+
+static void compare(const char *what, void (*ref)(uint32_t), void (*fixed)(uint32_t))
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%s float", what);
+    bench_result_t f = bench_run(name, ref, BENCH_INPUTS);
+    snprintf(name, sizeof(name), "%s fixed point", what);
+    bench_result_t q = bench_run(name, fixed, BENCH_INPUTS);
+    printf("%-40s %9.1fx\n", "  speedup", f.ns_per_op / q.ns_per_op);
+}
+
+int main(void)
+{
+    // inside the gamut triangle's bounding box, y away from 0 like the accuracy test
+    uint32_t seed = 12345;
+    for (int i = 0; i < BENCH_INPUTS; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        s_x[i] = (uint16_t) (4000 + (seed >> 8) % 40000);
+        s_y[i] = (uint16_t) (2000 + (seed >> 4) % (63000 - s_x[i]));
+        s_hue[i] = (uint8_t) (seed >> 16);
+        s_sat[i] = (uint8_t) (seed >> 24);
+        s_ehue[i] = (uint16_t) (seed >> 12);
+        s_mired[i] = (uint16_t) (153 + (seed >> 10) % 348);
+    }
+    printf("color conversion, %d inputs per kernel\n", BENCH_INPUTS);
+    compare("xy -> RGB (XYZ_to_RGB)", bench_xy_float, bench_xy_fixed);
+    compare("hue/sat -> RGB (HSV_to_RGB)", bench_hs_float, bench_hs_fixed);
+    compare("enhanced hue/sat -> RGB", bench_hs_float, bench_ehs_fixed);
+    compare("mired -> RGB (powf/logf)", bench_mired_float, bench_mired_fixed);
+    return 0;
+}
+#else
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_xy_matches_float);
+    RUN_TEST(test_xy_zero_y_is_undefined);
+    RUN_TEST(test_hs_matches_float);
+    RUN_TEST(test_ehs_agrees_with_hs);
+    RUN_TEST(test_rgb_to_ehs_round_trip);
+    RUN_TEST(test_mired_matches_float);
+    return UNITY_END();
+}
+#endif
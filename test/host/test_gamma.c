@@ -0,0 +1,124 @@
+/*
+ * Level lookup table: color_level_lut_build() against the float curve it replaces.
+ */
+
+#include <math.h>
+#include "unity.h"
+#include "color_convert.h"
+
+static uint16_t s_lut[256];
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void test_endpoints(void)
+{
+    color_level_lut_build(220, s_lut);
+    TEST_ASSERT_EQUAL_UINT16(0, s_lut[0]);
+    TEST_ASSERT_EQUAL_UINT16(65535, s_lut[255]);
+}
+
+static void test_monotonic_and_visible(void)
+{
+    static const uint16_t gammas[] = { 100, 180, 220, 280 };
+    for (size_t g = 0; g < sizeof(gammas) / sizeof(gammas[0]); ++g) {
+        color_level_lut_build(gammas[g], s_lut);
+        for (int i = 1; i < 256; ++i) {
+            TEST_ASSERT_GREATER_OR_EQUAL_UINT16(257, s_lut[i]);
+            TEST_ASSERT_GREATER_OR_EQUAL_UINT16(s_lut[i - 1], s_lut[i]);
+        }
+    }
+}
+
+static void test_linear_is_previous_behaviour(void)
+{
+    // gamma 1.0 must reproduce the old level / 255 scaling exactly on a full-scale component
+    color_level_lut_build(100, s_lut);
+    for (int i = 0; i < 256; ++i) {
+        TEST_ASSERT_UINT_WITHIN(1, i * 257, s_lut[i]);
+        TEST_ASSERT_EQUAL_UINT8(i, (uint8_t) ((255u * s_lut[i] + 32768) >> 16));
+    }
+}
+
+static void test_matches_float_curve(void)
+{
+    color_level_lut_build(220, s_lut);
+    for (int level = 1; level < 256; ++level) {
+        for (int c = 0; c < 256; c += 17) {
+            float want = powf(level / 255.0f, 2.2f) * c;
+            uint8_t got = (uint8_t) (((uint32_t) c * s_lut[level] + 32768) >> 16);
+            // the 257 floor lifts the darkest levels to one LSB on a full component
+            if (want < 1.0f) TEST_ASSERT_LESS_OR_EQUAL_UINT32(1, got);
+            else TEST_ASSERT_UINT_WITHIN(1, (uint32_t) (want + 0.5f), got);
+        }
+    }
+}
+
+#ifdef HOST_BENCH
+#include "bench.h"
+
+/* Scaling every component of a frame by its level: all 256 levels x RGB per iteration */
+
+static uint8_t s_rgb[256][3];
+
+static void bench_float_ratio(uint32_t iters)
+{
+    uint32_t acc = 0;
+    for (uint32_t n = 0; n < iters; ++n) {
+        for (int level = 0; level < 256; ++level) {
+            // former write_pixels_ch()
+            float ratio = (float) level / 255.0f;
+            for (int j = 0; j < 3; ++j) acc += (uint8_t) ((float) s_rgb[level][j] * ratio);
+        }
+        bench_sink = acc;
+    }
+}
+
+static void bench_float_gamma(uint32_t iters)
+{
+    uint32_t acc = 0;
+    for (uint32_t n = 0; n < iters; ++n) {
+        for (int level = 0; level < 256; ++level) {
+            float ratio = powf((float) level / 255.0f, 2.2f);
+            for (int j = 0; j < 3; ++j) acc += (uint8_t) ((float) s_rgb[level][j] * ratio);
+        }
+        bench_sink = acc;
+    }
+}
+
+static void bench_lut(uint32_t iters)
+{
+    uint32_t acc = 0;
+    for (uint32_t n = 0; n < iters; ++n) {
+        for (int level = 0; level < 256; ++level) {
+            // scale_by_level() in light_driver.c
+            for (int j = 0; j < 3; ++j) acc += (uint8_t) (((uint32_t) s_rgb[level][j] * s_lut[level] + 32768) >> 16);
+        }
+        bench_sink = acc;
+    }
+}
+
+int main(void)
+{
+    for (int i = 0; i < 256; ++i) {
+        for (int j = 0; j < 3; ++j) s_rgb[i][j] = (uint8_t) (i * 37 + j * 101 + 13);
+    }
+    color_level_lut_build(220, s_lut);
+    printf("level scaling, 256 levels x RGB\n");
+    bench_result_t ratio = bench_run("float level / 255 (old)", bench_float_ratio, 256 * 3);
+    bench_run("float powf gamma 2.2", bench_float_gamma, 256 * 3);
+    bench_result_t lut = bench_run("Q16 LUT gamma 2.2", bench_lut, 256 * 3);
+    printf("LUT speedup over the old float path: %.1fx\n", ratio.ns_per_op / lut.ns_per_op);
+    return 0;
+}
+#else
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_endpoints);
+    RUN_TEST(test_monotonic_and_visible);
+    RUN_TEST(test_linear_is_previous_behaviour);
+    RUN_TEST(test_matches_float_curve);
+    return UNITY_END();
+}
+#endif
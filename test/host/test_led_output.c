@@ -0,0 +1,119 @@
+/*
+ * led_output double buffering and frame hand-off, on the capturing mock backend.
+ */
+
+#include <string.h>
+#include "unity.h"
+#include "led_output.h"
+#include "led_output_mock.h"
+
+#define LEDS 8
+#define BYTES (LEDS * LED_OUTPUT_BYTES_PER_PIXEL)
+
+static led_output_t *s_out;
+
+void setUp(void)
+{
+    led_output_config_t cfg = { .backend = LED_OUTPUT_SPI, .gpio = 4, .led_count = LEDS };
+    TEST_ASSERT_EQUAL_INT(ESP_OK, led_output_new(&cfg, &s_out));
+}
+
+void tearDown(void)
+{
+    led_output_mock_del(s_out);
+    s_out = NULL;
+}
+
+static void fill(uint8_t *buf, uint8_t v) { memset(buf, v, BYTES); }
+
+static void test_rejects_empty_config(void)
+{
+    led_output_t *out = NULL;
+    led_output_config_t cfg = { .backend = LED_OUTPUT_RMT, .gpio = 4, .led_count = 0 };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, led_output_new(&cfg, &out));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, led_output_new(NULL, &out));
+    cfg = (led_output_config_t) { .backend = (led_output_backend_t) 7, .led_count = 1 };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_NOT_SUPPORTED, led_output_new(&cfg, &out));
+}
+
+static void test_present_sends_back_buffer_in_place(void)
+{
+    uint8_t *back = led_output_back_buffer(s_out);
+    fill(back, 0x11);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, led_output_present(s_out, 0, LEDS));
+    led_output_mock_t *m = led_output_mock(s_out);
+    TEST_ASSERT_EQUAL_UINT(1, m->frames);
+    TEST_ASSERT_EQUAL_UINT(BYTES, m->len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(back, led_output_mock_last(s_out), BYTES);
+    TEST_ASSERT_TRUE(led_output_busy(s_out));
+    // the renderer now writes the other buffer while the sent one is on the wire
+    TEST_ASSERT_TRUE(led_output_back_buffer(s_out) != back);
+}
+
+static void test_present_while_busy_is_refused(void)
+{
+    fill(led_output_back_buffer(s_out), 0x22);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, led_output_present(s_out, 0, LEDS));
+    uint8_t *back = led_output_back_buffer(s_out);
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_STATE, led_output_present(s_out, 0, LEDS));
+    TEST_ASSERT_EQUAL_PTR(back, led_output_back_buffer(s_out));
+    TEST_ASSERT_EQUAL_UINT(1, led_output_mock(s_out)->frames);
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_TIMEOUT, led_output_wait_done(s_out, 10));
+
+    led_output_mock_complete(s_out);
+    TEST_ASSERT_FALSE(led_output_busy(s_out));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, led_output_wait_done(s_out, -1));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, led_output_present(s_out, 0, 0));
+    TEST_ASSERT_EQUAL_UINT(2, led_output_mock(s_out)->frames);
+}
+
+static void test_changed_range_is_carried_into_back_buffer(void)
+{
+    uint8_t *back = led_output_back_buffer(s_out);
+    fill(back, 0x33);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, led_output_present(s_out, 0, LEDS));
+    led_output_mock_complete(s_out);
+
+    // change pixels 2..4 only; the back buffer must again mirror the strip afterwards
+    back = led_output_back_buffer(s_out);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(led_output_mock_last(s_out), back, BYTES);
+    memset(back + 2 * LED_OUTPUT_BYTES_PER_PIXEL, 0x44, 3 * LED_OUTPUT_BYTES_PER_PIXEL);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, led_output_present(s_out, 2, 5));
+    led_output_mock_complete(s_out);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(led_output_mock_last(s_out), led_output_back_buffer(s_out), BYTES);
+    TEST_ASSERT_EQUAL_HEX8(0x33, led_output_mock_last(s_out)[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x44, led_output_mock_last(s_out)[2 * LED_OUTPUT_BYTES_PER_PIXEL]);
+}
+
+static void test_range_past_the_strip_is_clamped(void)
+{
+    fill(led_output_back_buffer(s_out), 0x55);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, led_output_present(s_out, 0, 1000));
+    led_output_mock_complete(s_out);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(led_output_mock_last(s_out), led_output_back_buffer(s_out), BYTES);
+}
+
+static void test_failed_transmit_keeps_buffers(void)
+{
+    uint8_t *back = led_output_back_buffer(s_out);
+    fill(back, 0x66);
+    led_output_mock(s_out)->transmit_err = ESP_FAIL;
+    TEST_ASSERT_EQUAL_INT(ESP_FAIL, led_output_present(s_out, 0, LEDS));
+    TEST_ASSERT_FALSE(led_output_busy(s_out));
+    TEST_ASSERT_EQUAL_PTR(back, led_output_back_buffer(s_out));
+    led_output_mock(s_out)->transmit_err = ESP_OK;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, led_output_present(s_out, 0, LEDS));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(back, led_output_mock_last(s_out), BYTES);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_rejects_empty_config);
+    RUN_TEST(test_present_sends_back_buffer_in_place);
+    RUN_TEST(test_present_while_busy_is_refused);
+    RUN_TEST(test_changed_range_is_carried_into_back_buffer);
+    RUN_TEST(test_range_past_the_strip_is_clamped);
+    RUN_TEST(test_failed_transmit_keeps_buffers);
+    return UNITY_END();
+}
@@ -0,0 +1,230 @@
+/*
+ * Animation image validation and evaluation, checked against the host player (tools/anim_play.py).
+ *
+ * The build compiles anim/library.anim and has anim_play.py render frame captures of it; the evaluated
+ * spans here, drawn with the player's ramp math, must give the same pixels.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "light_anim.h"
+
+#define LEDS 60
+
+void setUp(void) {}
+void tearDown(void) {}
+
+/* Hand-built images */
+
+typedef struct __attribute__((packed)) {
+    light_anim_file_t file;
+    light_anim_index_t index[1];
+    light_anim_header_t header;
+    light_anim_track_t track;
+    light_anim_key_t keys[2];
+} one_track_image_t;
+
+static one_track_image_t make_image(uint8_t flags, uint8_t easing)
+{
+    one_track_image_t img = {
+        .file = { .magic = { 'L', 'A', 'N', 'M' }, .version = LIGHT_ANIM_VERSION, .count = 1, .size = sizeof(img) },
+        .index = { { .name = "fade", .offset = offsetof(one_track_image_t, header) } },
+        .header = { .duration_10ms = 100, .flags = flags, .track_count = 1 },
+        .track = { .seg_lo = 0, .seg_hi = 127, .key_count = 2 },
+        .keys = {
+            { .t_10ms = 0, .easing = easing, .level = 0, .c0 = { 0, 0, 0 }, .c1 = { 200, 0, 0 } },
+            { .t_10ms = 100, .easing = LIGHT_ANIM_EASE_LINEAR, .level = 200, .c0 = { 0, 200, 0 }, .c1 = { 0, 0, 200 } },
+        },
+    };
+    return img;
+}
+
+static void test_open_rejects_bad_images(void)
+{
+    light_anim_lib_t lib;
+    one_track_image_t img = make_image(0, LIGHT_ANIM_EASE_LINEAR);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_anim_open(&img, sizeof(img), &lib));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, light_anim_open(NULL, sizeof(img), &lib));
+
+    one_track_image_t bad = img;
+    bad.file.magic[0] = 'X';
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_NOT_FOUND, light_anim_open(&bad, sizeof(bad), &lib));
+    TEST_ASSERT_NULL(lib.image);
+    bad = img;
+    bad.file.version = LIGHT_ANIM_VERSION + 1;
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_VERSION, light_anim_open(&bad, sizeof(bad), &lib));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_VERSION, light_anim_open(&img, sizeof(img) - 1, &lib));
+    bad = img;
+    bad.keys[0].t_10ms = 50;
+    bad.keys[1].t_10ms = 5;
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_anim_open(&bad, sizeof(bad), &lib));
+    bad = img;
+    bad.track.key_count = 3;
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_anim_open(&bad, sizeof(bad), &lib));
+    bad = img;
+    bad.keys[0].easing = LIGHT_ANIM_EASE_STEP + 1;
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_anim_open(&bad, sizeof(bad), &lib));
+    bad = img;
+    bad.index[0].offset = sizeof(bad);
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_anim_open(&bad, sizeof(bad), &lib));
+}
+
+static void test_find(void)
+{
+    light_anim_lib_t lib;
+    one_track_image_t img = make_image(0, LIGHT_ANIM_EASE_LINEAR);
+    light_anim_open(&img, sizeof(img), &lib);
+    TEST_ASSERT_EQUAL_INT(0, light_anim_find(&lib, "fade"));
+    TEST_ASSERT_EQUAL_INT(-1, light_anim_find(&lib, "fad"));
+    TEST_ASSERT_EQUAL_INT(-1, light_anim_find(&lib, NULL));
+}
+
+static void test_linear_interpolation_and_end(void)
+{
+    light_anim_lib_t lib;
+    one_track_image_t img = make_image(0, LIGHT_ANIM_EASE_LINEAR);
+    light_anim_open(&img, sizeof(img), &lib);
+    light_anim_span_t spans[LIGHT_ANIM_TRACKS_MAX];
+    size_t count;
+    TEST_ASSERT_TRUE(light_anim_eval(&lib, 0, 500, LEDS, spans, &count));
+    TEST_ASSERT_EQUAL_UINT(1, count);
+    TEST_ASSERT_EQUAL_UINT16(0, spans[0].px_lo);
+    TEST_ASSERT_EQUAL_UINT16(30, spans[0].px_hi);
+    TEST_ASSERT_EQUAL_UINT8(100, spans[0].level);
+    TEST_ASSERT_EQUAL_UINT8(100, spans[0].c0[1]);
+    TEST_ASSERT_EQUAL_UINT8(100, spans[0].c1[0]);
+    TEST_ASSERT_EQUAL_UINT8(100, spans[0].c1[2]);
+
+    TEST_ASSERT_TRUE(light_anim_eval(&lib, 0, 999, LEDS, spans, &count));
+    TEST_ASSERT_FALSE(light_anim_eval(&lib, 0, 1000, LEDS, spans, &count));
+    TEST_ASSERT_EQUAL_UINT(0, count);
+    TEST_ASSERT_FALSE(light_anim_eval(&lib, 1, 0, LEDS, spans, &count));
+}
+
+static void test_loop_and_step(void)
+{
+    light_anim_lib_t lib;
+    one_track_image_t img = make_image(LIGHT_ANIM_FLAG_LOOP, LIGHT_ANIM_EASE_STEP);
+    light_anim_open(&img, sizeof(img), &lib);
+    light_anim_span_t spans[LIGHT_ANIM_TRACKS_MAX];
+    size_t count;
+    // a step key holds until the next one, a loop wraps instead of ending
+    TEST_ASSERT_TRUE(light_anim_eval(&lib, 0, 10990, LEDS, spans, &count));
+    TEST_ASSERT_EQUAL_UINT8(0, spans[0].level);
+    TEST_ASSERT_TRUE(light_anim_eval(&lib, 0, 10000, LEDS, spans, &count));
+    TEST_ASSERT_EQUAL_UINT8(0, spans[0].level);
+}
+
+static void test_easing_curves_are_monotonic(void)
+{
+    static const uint8_t easings[] = { LIGHT_ANIM_EASE_IN, LIGHT_ANIM_EASE_OUT, LIGHT_ANIM_EASE_IN_OUT };
+    for (size_t e = 0; e < sizeof(easings); ++e) {
+        light_anim_lib_t lib;
+        one_track_image_t img = make_image(0, easings[e]);
+        light_anim_open(&img, sizeof(img), &lib);
+        light_anim_span_t spans[LIGHT_ANIM_TRACKS_MAX];
+        size_t count;
+        uint8_t last = 0;
+        for (uint32_t t = 0; t < 1000; t += 10) {
+            light_anim_eval(&lib, 0, t, LEDS, spans, &count);
+            TEST_ASSERT_GREATER_OR_EQUAL_UINT32(last, spans[0].level);
+            last = spans[0].level;
+        }
+        TEST_ASSERT_UINT_WITHIN(6, 200, last);
+    }
+}
+
+/* Compiled library against the player's frame captures */
+
+typedef struct { uint8_t r, g, b; } px_t;
+
+// anim_play.py render(): per-span ramp at the span's level, pixels without a span stay dark
+static void render(const light_anim_span_t *spans, size_t count, px_t *frame)
+{
+    memset(frame, 0, LEDS * sizeof(*frame));
+    for (size_t s = 0; s < count; ++s) {
+        const light_anim_span_t *sp = &spans[s];
+        int32_t n = sp->px_hi - sp->px_lo;
+        int32_t step = n > 1 ? 0x10000 / (n - 1) : 0;
+        for (int32_t i = 0; i < n; ++i) {
+            int32_t w = i * step;
+            uint8_t c[3];
+            for (int k = 0; k < 3; ++k) {
+                int32_t v = sp->c0[k] + (((sp->c1[k] - sp->c0[k]) * w) >> 16);
+                c[k] = (uint8_t) (v * sp->level / 255);
+            }
+            frame[sp->px_lo + i] = (px_t) { c[0], c[1], c[2] };
+        }
+    }
+}
+
+static uint8_t *read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    *size = (size_t) ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(*size);
+    if (buf && fread(buf, 1, *size, f) != *size) { free(buf); buf = NULL; }
+    fclose(f);
+    return buf;
+}
+
+static void check_capture(const light_anim_lib_t *lib, const char *name)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/anim_%s.csv", ANIM_CAPTURE_DIR, name);
+    FILE *f = fopen(path, "r");
+    TEST_ASSERT_NOT_NULL(f);
+    int idx = light_anim_find(lib, name);
+    TEST_ASSERT_TRUE(idx >= 0);
+
+    char line[128];
+    TEST_ASSERT_NOT_NULL(fgets(line, sizeof(line), f));       // header
+    px_t frame[LEDS];
+    int frames = 0, cur = -1;
+    unsigned n, t_ms, pixel, r, g, b;
+    while (fscanf(f, "%u,%u,%u,%u,%u,%u", &n, &t_ms, &pixel, &r, &g, &b) == 6) {
+        if ((int) n != cur) {
+            light_anim_span_t spans[LIGHT_ANIM_TRACKS_MAX];
+            size_t count;
+            TEST_ASSERT_TRUE(light_anim_eval(lib, (uint16_t) idx, t_ms, LEDS, spans, &count));
+            render(spans, count, frame);
+            cur = (int) n;
+            frames++;
+        }
+        TEST_ASSERT_TRUE(pixel < LEDS);
+        TEST_ASSERT_EQUAL_UINT8(r, frame[pixel].r);
+        TEST_ASSERT_EQUAL_UINT8(g, frame[pixel].g);
+        TEST_ASSERT_EQUAL_UINT8(b, frame[pixel].b);
+    }
+    fclose(f);
+    TEST_ASSERT_GREATER_THAN_UINT32(1, frames);
+}
+
+static void test_library_matches_player(void)
+{
+    size_t size = 0;
+    uint8_t *image = read_file(ANIM_IMAGE_PATH, &size);
+    TEST_ASSERT_NOT_NULL(image);
+    light_anim_lib_t lib;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_anim_open(image, size, &lib));
+    static const char *names[] = { ANIM_CAPTURE_NAMES };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) check_capture(&lib, names[i]);
+    free(image);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_open_rejects_bad_images);
+    RUN_TEST(test_find);
+    RUN_TEST(test_linear_interpolation_and_end);
+    RUN_TEST(test_loop_and_step);
+    RUN_TEST(test_easing_curves_are_monotonic);
+    RUN_TEST(test_library_matches_player);
+    return UNITY_END();
+}
@@ -0,0 +1,151 @@
+/*
+ * Command ring with overflow mailbox: order, coalescing and stats, single-threaded.
+ */
+
+#include <stdlib.h>
+#include "unity.h"
+#include "light_cmd_queue.h"
+
+#define CHANNELS 4
+
+static light_cmd_queue_t s_q;
+
+void setUp(void)
+{
+    s_q = (light_cmd_queue_t) { 0 };
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_cmd_queue_init(&s_q, CHANNELS));
+}
+
+void tearDown(void)
+{
+    free(s_q.box);
+    free(s_q.box_lock);
+    free(s_q.box_pending);
+}
+
+static light_cmd_t cmd(uint8_t ch, light_cmd_op_t op, uint16_t a)
+{
+    return (light_cmd_t) { .ch = ch, .op = (uint8_t) op, .a = a };
+}
+
+static void push(uint8_t ch, light_cmd_op_t op, uint16_t a)
+{
+    light_cmd_t c = cmd(ch, op, a);
+    TEST_ASSERT_TRUE(light_cmd_queue_push(&s_q, &c));
+}
+
+static void fill_ring(void)
+{
+    for (int i = 0; i < LIGHT_CMD_QUEUE_LEN; ++i) push(0, LIGHT_CMD_LEVEL, (uint16_t) i);
+    TEST_ASSERT_EQUAL_UINT32(0, s_q.stats.overflows);
+}
+
+static void test_init_rejects_no_channels(void)
+{
+    light_cmd_queue_t q = { 0 };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, light_cmd_queue_init(&q, 0));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, light_cmd_queue_init(NULL, 1));
+}
+
+static void test_fifo_with_sequence_numbers(void)
+{
+    TEST_ASSERT_TRUE(light_cmd_queue_empty(&s_q));
+    push(1, LIGHT_CMD_POWER, 1);
+    push(2, LIGHT_CMD_LEVEL, 80);
+    push(1, LIGHT_CMD_LEVEL, 90);
+    TEST_ASSERT_FALSE(light_cmd_queue_empty(&s_q));
+    light_cmd_t c;
+    uint32_t last = 0;
+    static const uint16_t want[] = { 1, 80, 90 };
+    for (int i = 0; i < 3; ++i) {
+        TEST_ASSERT_TRUE(light_cmd_queue_pop(&s_q, &c));
+        TEST_ASSERT_EQUAL_UINT16(want[i], c.a);
+        TEST_ASSERT_GREATER_THAN_UINT32(last, c.seq);
+        last = c.seq;
+    }
+    TEST_ASSERT_FALSE(light_cmd_queue_pop(&s_q, &c));
+    TEST_ASSERT_TRUE(light_cmd_queue_empty(&s_q));
+    TEST_ASSERT_EQUAL_UINT32(3, s_q.stats.pushed);
+    TEST_ASSERT_EQUAL_UINT32(3, s_q.stats.depth_max);
+}
+
+static void test_rejects_bad_channel_and_op(void)
+{
+    light_cmd_t c = cmd(CHANNELS, LIGHT_CMD_POWER, 1);
+    TEST_ASSERT_FALSE(light_cmd_queue_push(&s_q, &c));
+    c = cmd(0, LIGHT_CMD_OP_COUNT, 1);
+    TEST_ASSERT_FALSE(light_cmd_queue_push(&s_q, &c));
+    TEST_ASSERT_TRUE(light_cmd_queue_empty(&s_q));
+}
+
+static void test_overflow_coalesces_to_last_value(void)
+{
+    fill_ring();
+    push(2, LIGHT_CMD_LEVEL, 10);
+    push(2, LIGHT_CMD_LEVEL, 20);
+    push(2, LIGHT_CMD_LEVEL, 30);
+    TEST_ASSERT_EQUAL_UINT32(3, s_q.stats.overflows);
+    TEST_ASSERT_EQUAL_UINT32(2, s_q.stats.coalesced);
+
+    light_cmd_t c;
+    for (int i = 0; i < LIGHT_CMD_QUEUE_LEN; ++i) {
+        TEST_ASSERT_TRUE(light_cmd_queue_pop(&s_q, &c));
+        TEST_ASSERT_EQUAL_UINT8(0, c.ch);
+    }
+    TEST_ASSERT_TRUE(light_cmd_queue_pop(&s_q, &c));
+    TEST_ASSERT_EQUAL_UINT8(2, c.ch);
+    TEST_ASSERT_EQUAL_UINT16(30, c.a);
+    TEST_ASSERT_FALSE(light_cmd_queue_pop(&s_q, &c));
+    TEST_ASSERT_TRUE(light_cmd_queue_empty(&s_q));
+}
+
+static void test_parked_entries_keep_push_order(void)
+{
+    // a transition parked on overflow must not be overtaken by the level it was meant to fade
+    fill_ring();
+    push(1, LIGHT_CMD_TRANSITION, 5);
+    push(1, LIGHT_CMD_POWER, 0);
+    light_cmd_t c;
+    TEST_ASSERT_TRUE(light_cmd_queue_pop(&s_q, &c));
+    TEST_ASSERT_EQUAL_UINT16(0, c.a);
+    push(1, LIGHT_CMD_LEVEL, 200);     // finds room in the ring
+
+    uint32_t last = c.seq;
+    int transition = -1, power = -1, level = -1;
+    for (int i = 0; light_cmd_queue_pop(&s_q, &c); ++i) {
+        TEST_ASSERT_GREATER_THAN_UINT32(last, c.seq);
+        last = c.seq;
+        if (c.ch != 1) continue;
+        if (c.op == LIGHT_CMD_TRANSITION) transition = i;
+        if (c.op == LIGHT_CMD_POWER) power = i;
+        if (c.op == LIGHT_CMD_LEVEL) level = i;
+    }
+    TEST_ASSERT_TRUE(transition >= 0 && transition < power && power < level);
+}
+
+static void test_channel_less_ops_share_one_slot(void)
+{
+    fill_ring();
+    push(3, LIGHT_CMD_GROUP_EFFECT, 1);
+    push(1, LIGHT_CMD_GROUP_EFFECT, 2);
+    TEST_ASSERT_EQUAL_UINT32(1, s_q.stats.coalesced);
+    light_cmd_t c;
+    for (int i = 0; i < LIGHT_CMD_QUEUE_LEN; ++i) TEST_ASSERT_TRUE(light_cmd_queue_pop(&s_q, &c));
+    TEST_ASSERT_TRUE(light_cmd_queue_pop(&s_q, &c));
+    TEST_ASSERT_EQUAL_UINT8(LIGHT_CMD_GROUP_EFFECT, c.op);
+    TEST_ASSERT_EQUAL_UINT8(0, c.ch);
+    TEST_ASSERT_EQUAL_UINT16(2, c.a);
+    TEST_ASSERT_FALSE(light_cmd_queue_pop(&s_q, &c));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_init_rejects_no_channels);
+    RUN_TEST(test_fifo_with_sequence_numbers);
+    RUN_TEST(test_rejects_bad_channel_and_op);
+    RUN_TEST(test_overflow_coalesces_to_last_value);
+    RUN_TEST(test_parked_entries_keep_push_order);
+    RUN_TEST(test_channel_less_ops_share_one_slot);
+    return UNITY_END();
+}
@@ -0,0 +1,191 @@
+/*
+ * Endpoint independence: each light channel has its own attribute record, persisted shadow and scene
+ * records, and a change to one channel never shows on another.
+ */
+
+#include <string.h>
+#include "unity.h"
+#include "host_stubs.h"
+#include "light_ep_attrs.h"
+#include "light_persist.h"
+#include "light_scenes.h"
+
+#define CHANNELS    14
+#define QUIET_MS    3000
+#define GROUP       0x0010
+#define SCENE       3
+
+static light_ep_attrs_t s_before[CHANNELS];
+
+void setUp(void)
+{
+    host_nvs_reset();
+    host_zb_reset();
+    host_clock_set_ms(1000);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_ep_attrs_init(CHANNELS));
+}
+
+void tearDown(void)
+{
+    light_persist_flush();
+}
+
+// A state that differs in every field from channel to channel
+static light_persist_channel_t channel_state(size_t ch)
+{
+    return (light_persist_channel_t) {
+        .power = ch & 1, .level = (uint8_t) (10 + ch), .color_mode = LIGHT_PERSIST_COLOR_XY, .sat = (uint8_t) (20 + ch),
+        .x = (uint16_t) (1000 + ch), .y = (uint16_t) (2000 + ch), .hue = (uint16_t) ((30 + ch) << 8),
+        .mired = (uint16_t) (200 + ch), .startup_on_off = LIGHT_STARTUP_ON_OFF_ON,
+        .startup_level = (uint8_t) (40 + ch), .startup_mired = (uint16_t) (300 + ch),
+    };
+}
+
+static void set_persisted(size_t ch, const light_persist_channel_t *c)
+{
+    light_persist_set_channel(ch, c);
+    light_persist_set_startup_on_off(ch, c->startup_on_off);
+    light_persist_set_startup_level(ch, c->startup_level);
+    light_persist_set_startup_mired(ch, c->startup_mired);
+}
+
+static void snapshot(void)
+{
+    for (size_t ch = 0; ch < CHANNELS; ++ch) s_before[ch] = *light_ep_attrs_get(ch);
+}
+
+static void assert_unchanged_except(size_t changed)
+{
+    for (size_t ch = 0; ch < CHANNELS; ++ch) {
+        if (ch == changed) continue;
+        TEST_ASSERT_EQUAL_MEMORY(&s_before[ch], light_ep_attrs_get(ch), sizeof(light_ep_attrs_t));
+    }
+}
+
+static void test_arena_is_contiguous(void)
+{
+    light_ep_attrs_t *base = light_ep_attrs_get(0);
+    TEST_ASSERT_NOT_NULL(base);
+    for (size_t ch = 0; ch < CHANNELS; ++ch) TEST_ASSERT_EQUAL_PTR(base + ch, light_ep_attrs_get(ch));
+    TEST_ASSERT_NULL(light_ep_attrs_get(CHANNELS));
+    // allocated once
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_ep_attrs_init(CHANNELS));
+    TEST_ASSERT_EQUAL_PTR(base, light_ep_attrs_get(0));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_STATE, light_ep_attrs_init(CHANNELS + 1));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, light_ep_attrs_init(0));
+}
+
+static void test_seed_from_own_channel(void)
+{
+    light_persist_init(CHANNELS, QUIET_MS);
+    for (size_t ch = 0; ch < CHANNELS; ++ch) {
+        light_persist_channel_t c = channel_state(ch);
+        set_persisted(ch, &c);
+    }
+    for (size_t ch = 0; ch < CHANNELS; ++ch) light_ep_attrs_seed(ch, ch < 12 ? 1 : 60);
+
+    for (size_t ch = 0; ch < CHANNELS; ++ch) {
+        const light_ep_attrs_t *a = light_ep_attrs_get(ch);
+        light_persist_channel_t c = channel_state(ch);
+        TEST_ASSERT_EQUAL_UINT16(c.x, a->x);
+        TEST_ASSERT_EQUAL_UINT16(c.y, a->y);
+        TEST_ASSERT_EQUAL_UINT16(c.hue, a->enhanced_hue);
+        TEST_ASSERT_EQUAL_UINT8(c.hue >> 8, a->hue);
+        TEST_ASSERT_EQUAL_UINT8(c.sat, a->sat);
+        TEST_ASSERT_EQUAL_UINT16(c.mired, a->color_temp);
+        TEST_ASSERT_EQUAL_UINT8(c.startup_level, a->startup_level);
+        TEST_ASSERT_EQUAL_UINT16(c.startup_mired, a->startup_mired);
+        TEST_ASSERT_EQUAL_UINT16(ch < 12 ? 1 : 60, a->led_count);
+        TEST_ASSERT_EQUAL_UINT16(0, a->on_off_transition_ds);
+    }
+}
+
+static void test_write_stays_on_its_endpoint(void)
+{
+    light_persist_init(CHANNELS, QUIET_MS);
+    for (size_t ch = 0; ch < CHANNELS; ++ch) light_ep_attrs_seed(ch, 1);
+    snapshot();
+
+    light_ep_attrs_t *a = light_ep_attrs_get(5);
+    a->x = 0x1234;
+    a->hue = 77;
+    a->color_temp = 400;
+    a->on_off_transition_ds = 25;
+    assert_unchanged_except(5);
+    TEST_ASSERT_EQUAL_UINT16(0x1234, light_ep_attrs_get(5)->x);
+
+    // seeding one endpoint again leaves the others alone
+    snapshot();
+    light_ep_attrs_seed(CHANNELS - 1, 30);
+    assert_unchanged_except(CHANNELS - 1);
+    snapshot();
+    light_ep_attrs_seed(CHANNELS, 30);
+    assert_unchanged_except(CHANNELS);
+}
+
+static void test_persisted_shadows_are_independent(void)
+{
+    light_persist_init(CHANNELS, QUIET_MS);
+    light_persist_channel_t before[CHANNELS];
+    for (size_t ch = 0; ch < CHANNELS; ++ch) before[ch] = *light_persist_get(ch);
+
+    light_persist_set_level(3, 99);
+    light_persist_set_xy(3, 111, 222);
+    light_persist_set_startup_mired(3, 350);
+    for (size_t ch = 0; ch < CHANNELS; ++ch) {
+        if (ch == 3) continue;
+        TEST_ASSERT_EQUAL_MEMORY(&before[ch], light_persist_get(ch), sizeof(light_persist_channel_t));
+    }
+
+    // and stay apart through flash
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_persist_flush());
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_persist_init(CHANNELS, QUIET_MS));
+    TEST_ASSERT_EQUAL_UINT8(99, light_persist_get(3)->level);
+    TEST_ASSERT_EQUAL_UINT16(111, light_persist_get(3)->x);
+    TEST_ASSERT_EQUAL_UINT16(350, light_persist_get(3)->startup_mired);
+    TEST_ASSERT_EQUAL_UINT8(before[2].level, light_persist_get(2)->level);
+    TEST_ASSERT_EQUAL_UINT16(before[4].x, light_persist_get(4)->x);
+}
+
+static void test_scene_records_are_per_channel(void)
+{
+    light_scenes_init();
+    for (uint8_t ch = 0; ch < CHANNELS; ++ch) {
+        light_persist_channel_t c = channel_state(ch);
+        TEST_ASSERT_EQUAL_INT(ESP_OK, light_scenes_store(GROUP, SCENE, ch, &c));
+    }
+    light_persist_channel_t c = channel_state(100);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_scenes_store(GROUP, SCENE, 1, &c));   // overwrite one channel only
+
+    light_scenes_remove(GROUP, SCENE, 2);
+    light_scenes_remove_all(GROUP, 3);
+    TEST_ASSERT_NULL(light_scenes_find(GROUP, SCENE, 2));
+    TEST_ASSERT_NULL(light_scenes_find(GROUP, SCENE, 3));
+    TEST_ASSERT_NULL(light_scenes_find(GROUP, SCENE, CHANNELS));
+
+    // the same checks after a reload from NVS
+    for (int pass = 0; pass < 2; ++pass) {
+        for (uint8_t ch = 0; ch < CHANNELS; ++ch) {
+            const light_persist_channel_t *r = light_scenes_find(GROUP, SCENE, ch);
+            if (ch == 2 || ch == 3) {
+                TEST_ASSERT_NULL(r);
+                continue;
+            }
+            TEST_ASSERT_NOT_NULL(r);
+            light_persist_channel_t expect = channel_state(ch == 1 ? 100 : ch);
+            TEST_ASSERT_EQUAL_MEMORY(&expect, r, sizeof(expect));
+        }
+        light_scenes_init();
+    }
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_arena_is_contiguous);
+    RUN_TEST(test_seed_from_own_channel);
+    RUN_TEST(test_write_stays_on_its_endpoint);
+    RUN_TEST(test_persisted_shadows_are_independent);
+    RUN_TEST(test_scene_records_are_per_channel);
+    return UNITY_END();
+}
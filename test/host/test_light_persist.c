@@ -0,0 +1,262 @@
+/*
+ * Debounced light state persistence against the in-memory NVS and scheduler stand-ins.
+ */
+
+#include <string.h>
+#include "unity.h"
+#include "host_stubs.h"
+#include "light_persist.h"
+#include "nvs.h"
+
+#define CHANNELS    4
+#define QUIET_MS    3000
+
+// blob header as written by light_persist.c
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t channels;
+    uint16_t reserved;
+} blob_header_t;
+
+void setUp(void)
+{
+    host_nvs_reset();
+    host_zb_reset();
+    host_clock_set_ms(1000);
+}
+
+void tearDown(void)
+{
+    // leave nothing armed for the next test, the module keeps its state across init calls
+    light_persist_flush();
+}
+
+static void put_blob(uint8_t version, uint8_t channels, size_t record, const light_persist_channel_t *recs)
+{
+    uint8_t blob[sizeof(blob_header_t) + 8 * sizeof(light_persist_channel_t)];
+    *(blob_header_t *) blob = (blob_header_t) { .version = version, .channels = channels };
+    for (size_t i = 0; i < channels; ++i) memcpy(blob + sizeof(blob_header_t) + i * record, &recs[i], record);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, host_nvs_put("light", "state", blob, sizeof(blob_header_t) + channels * record));
+}
+
+static light_persist_channel_t stored(uint8_t level)
+{
+    return (light_persist_channel_t) { .power = 1, .level = level, .color_mode = LIGHT_PERSIST_COLOR_CT, .mired = 300,
+                                       .startup_on_off = LIGHT_STARTUP_ON_OFF_PREVIOUS,
+                                       .startup_level = LIGHT_STARTUP_LEVEL_PREVIOUS,
+                                       .startup_mired = LIGHT_STARTUP_MIRED_PREVIOUS };
+}
+
+static void test_defaults_without_blob(void)
+{
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_NOT_FOUND, light_persist_init(CHANNELS, QUIET_MS));
+    const light_persist_channel_t *c = light_persist_get(0);
+    TEST_ASSERT_NOT_NULL(c);
+    TEST_ASSERT_EQUAL_UINT8(0, c->power);
+    TEST_ASSERT_EQUAL_UINT8(255, c->level);
+    TEST_ASSERT_EQUAL_UINT8(LIGHT_STARTUP_ON_OFF_PREVIOUS, c->startup_on_off);
+    TEST_ASSERT_NULL(light_persist_get(CHANNELS));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, light_persist_init(0, QUIET_MS));
+}
+
+#define BURST       1000
+#define BURST_GAP_MS 10     // a dimmer held down, the stack stepping the level
+
+static void test_burst_is_one_write_after_quiet(void)
+{
+    light_persist_init(CHANNELS, QUIET_MS);
+    light_persist_stats_t before, after;
+    light_persist_get_stats(&before);
+    for (int i = 0; i < BURST; ++i) {
+        light_persist_set_level(1, (uint8_t) i);
+        host_zb_advance_ms(BURST_GAP_MS);
+    }
+    // the burst spans less than the max latency, nothing is forced out while it lasts
+    const uint32_t forced = (BURST - 1) * BURST_GAP_MS / LIGHT_PERSIST_MAX_LATENCY_MS;
+    TEST_ASSERT_EQUAL_UINT32(0, forced);
+    TEST_ASSERT_EQUAL_UINT32(forced, host_nvs_writes());
+    host_zb_advance_ms(QUIET_MS - BURST_GAP_MS - 1);
+    TEST_ASSERT_EQUAL_UINT32(forced, host_nvs_writes());
+    host_zb_advance_ms(1);
+    TEST_ASSERT_EQUAL_UINT32(forced + 1, host_nvs_writes());
+    TEST_ASSERT_EQUAL_UINT(0, host_zb_alarms_pending());
+    light_persist_get_stats(&after);
+    TEST_ASSERT_EQUAL_UINT32(BURST, after.changes - before.changes);
+    TEST_ASSERT_EQUAL_UINT32(forced + 1, after.writes - before.writes);
+
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_persist_init(CHANNELS, QUIET_MS));
+    TEST_ASSERT_EQUAL_UINT8((uint8_t) (BURST - 1), light_persist_get(1)->level);
+}
+
+static void test_long_burst_is_cut_by_max_latency(void)
+{
+    // the same rate kept up past the max latency: one forced write per LIGHT_PERSIST_MAX_LATENCY_MS
+    light_persist_init(CHANNELS, QUIET_MS);
+    const uint32_t len_ms = 3 * LIGHT_PERSIST_MAX_LATENCY_MS + 5000;
+    for (uint32_t t = 0; t < len_ms; t += BURST_GAP_MS) {
+        light_persist_set_level(2, (uint8_t) (t / BURST_GAP_MS));
+        host_zb_advance_ms(BURST_GAP_MS);
+    }
+    TEST_ASSERT_EQUAL_UINT32(3, host_nvs_writes());
+    host_zb_advance_ms(QUIET_MS);
+    TEST_ASSERT_EQUAL_UINT32(4, host_nvs_writes());
+    TEST_ASSERT_EQUAL_UINT(0, host_zb_alarms_pending());
+}
+
+static void test_endless_changes_are_saved_within_max_latency(void)
+{
+    light_persist_init(CHANNELS, QUIET_MS);
+    for (uint32_t t = 0; t < 2 * LIGHT_PERSIST_MAX_LATENCY_MS + 500; t += 1000) {
+        light_persist_set_level(0, (uint8_t) (t / 1000));
+        host_zb_advance_ms(1000);
+    }
+    TEST_ASSERT_EQUAL_UINT32(2, host_nvs_writes());
+}
+
+static void test_unchanged_values_do_not_arm(void)
+{
+    light_persist_init(CHANNELS, QUIET_MS);
+    light_persist_set_level(2, 255);
+    light_persist_set_power(2, false);
+    TEST_ASSERT_EQUAL_UINT(0, host_zb_alarms_pending());
+}
+
+static void test_change_and_back_skips_the_write(void)
+{
+    light_persist_init(CHANNELS, QUIET_MS);
+    light_persist_stats_t before, after;
+    light_persist_get_stats(&before);
+    light_persist_set_power(3, true);
+    light_persist_set_power(3, false);
+    host_zb_advance_ms(QUIET_MS);
+    light_persist_get_stats(&after);
+    TEST_ASSERT_EQUAL_UINT32(0, host_nvs_writes());
+    TEST_ASSERT_EQUAL_UINT32(before.skipped + 1, after.skipped);
+    TEST_ASSERT_EQUAL_UINT32(before.changes + 2, after.changes);
+}
+
+static void test_failed_write_is_retried_on_flush(void)
+{
+    light_persist_init(CHANNELS, QUIET_MS);
+    light_persist_set_xy(0, 0x1234, 0x2345);
+    host_nvs_fail_writes(ESP_ERR_NVS_NOT_ENOUGH_SPACE);
+    host_zb_advance_ms(QUIET_MS);
+    TEST_ASSERT_EQUAL_UINT32(0, host_nvs_writes());
+    host_nvs_fail_writes(ESP_OK);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_persist_flush());
+    TEST_ASSERT_EQUAL_UINT32(1, host_nvs_writes());
+}
+
+static void test_v1_blob_keeps_startup_defaults(void)
+{
+    light_persist_channel_t recs[CHANNELS];
+    for (int i = 0; i < CHANNELS; ++i) {
+        recs[i] = stored((uint8_t) (10 + i));
+        recs[i].startup_on_off = LIGHT_STARTUP_ON_OFF_ON;       // not part of a v1 record
+    }
+    put_blob(1, CHANNELS, 12, recs);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_persist_init(CHANNELS, QUIET_MS));
+    TEST_ASSERT_EQUAL_UINT8(13, light_persist_get(3)->level);
+    TEST_ASSERT_EQUAL_UINT16(300, light_persist_get(3)->mired);
+    TEST_ASSERT_EQUAL_UINT8(LIGHT_STARTUP_ON_OFF_PREVIOUS, light_persist_get(3)->startup_on_off);
+
+    // the upgraded blob is written once the scheduler runs
+    light_persist_start();
+    host_zb_advance_ms(QUIET_MS);
+    TEST_ASSERT_EQUAL_UINT32(1, host_nvs_writes());
+    blob_header_t hdr;
+    TEST_ASSERT_EQUAL_UINT(sizeof(hdr) + CHANNELS * sizeof(light_persist_channel_t),
+                           host_nvs_get("light", "state", &hdr, sizeof(hdr)));
+    TEST_ASSERT_EQUAL_UINT8(2, hdr.version);
+}
+
+static void test_blob_with_more_channels_restores_common_part(void)
+{
+    light_persist_channel_t recs[CHANNELS + 2];
+    for (int i = 0; i < CHANNELS + 2; ++i) recs[i] = stored((uint8_t) (20 + i));
+    put_blob(2, CHANNELS + 2, sizeof(light_persist_channel_t), recs);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_persist_init(CHANNELS, QUIET_MS));
+    for (int i = 0; i < CHANNELS; ++i) TEST_ASSERT_EQUAL_UINT8(20 + i, light_persist_get(i)->level);
+
+    // rewritten at this build's size
+    light_persist_start();
+    host_zb_advance_ms(QUIET_MS);
+    TEST_ASSERT_EQUAL_UINT(sizeof(blob_header_t) + CHANNELS * sizeof(light_persist_channel_t),
+                           host_nvs_get("light", "state", NULL, 0));
+}
+
+static void test_blob_with_fewer_channels_leaves_the_rest_default(void)
+{
+    light_persist_channel_t recs[2] = { stored(31), stored(32) };
+    put_blob(2, 2, sizeof(light_persist_channel_t), recs);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_persist_init(CHANNELS, QUIET_MS));
+    TEST_ASSERT_EQUAL_UINT8(32, light_persist_get(1)->level);
+    TEST_ASSERT_EQUAL_UINT8(255, light_persist_get(2)->level);
+    TEST_ASSERT_EQUAL_UINT8(0, light_persist_get(2)->power);
+}
+
+static void test_corrupt_blob_is_ignored(void)
+{
+    light_persist_channel_t recs[CHANNELS];
+    for (int i = 0; i < CHANNELS; ++i) recs[i] = stored(40);
+    put_blob(9, CHANNELS, sizeof(light_persist_channel_t), recs);
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_NOT_FOUND, light_persist_init(CHANNELS, QUIET_MS));
+    TEST_ASSERT_EQUAL_UINT8(255, light_persist_get(0)->level);
+
+    uint8_t tiny = 2;
+    host_nvs_put("light", "state", &tiny, 1);
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_NOT_FOUND, light_persist_init(CHANNELS, QUIET_MS));
+}
+
+static void test_startup_attributes(void)
+{
+    light_persist_channel_t recs[CHANNELS];
+    for (int i = 0; i < CHANNELS; ++i) recs[i] = stored(120);
+    recs[0].startup_on_off = LIGHT_STARTUP_ON_OFF_TOGGLE;
+    recs[1].startup_on_off = LIGHT_STARTUP_ON_OFF_OFF;
+    recs[1].startup_level = LIGHT_STARTUP_LEVEL_MINIMUM;
+    recs[2].startup_level = 77;
+    recs[2].startup_mired = 400;
+    recs[2].color_mode = LIGHT_PERSIST_COLOR_XY;
+    put_blob(2, CHANNELS, sizeof(light_persist_channel_t), recs);
+    light_persist_init(CHANNELS, QUIET_MS);
+    light_persist_apply_startup();
+    TEST_ASSERT_EQUAL_UINT8(0, light_persist_get(0)->power);
+    TEST_ASSERT_EQUAL_UINT8(0, light_persist_get(1)->power);
+    TEST_ASSERT_EQUAL_UINT8(1, light_persist_get(1)->level);
+    TEST_ASSERT_EQUAL_UINT8(77, light_persist_get(2)->level);
+    TEST_ASSERT_EQUAL_UINT16(400, light_persist_get(2)->mired);
+    TEST_ASSERT_EQUAL_UINT8(LIGHT_PERSIST_COLOR_CT, light_persist_get(2)->color_mode);
+    TEST_ASSERT_EQUAL_UINT8(1, light_persist_get(3)->power);
+    TEST_ASSERT_EQUAL_UINT8(120, light_persist_get(3)->level);
+}
+
+static void test_set_channel_keeps_startup_fields(void)
+{
+    light_persist_init(CHANNELS, QUIET_MS);
+    light_persist_set_startup_level(1, 50);
+    light_persist_channel_t scene = stored(90);
+    scene.startup_level = 10;
+    light_persist_set_channel(1, &scene);
+    TEST_ASSERT_EQUAL_UINT8(90, light_persist_get(1)->level);
+    TEST_ASSERT_EQUAL_UINT8(50, light_persist_get(1)->startup_level);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_defaults_without_blob);
+    RUN_TEST(test_burst_is_one_write_after_quiet);
+    RUN_TEST(test_long_burst_is_cut_by_max_latency);
+    RUN_TEST(test_endless_changes_are_saved_within_max_latency);
+    RUN_TEST(test_unchanged_values_do_not_arm);
+    RUN_TEST(test_change_and_back_skips_the_write);
+    RUN_TEST(test_failed_write_is_retried_on_flush);
+    RUN_TEST(test_v1_blob_keeps_startup_defaults);
+    RUN_TEST(test_blob_with_more_channels_restores_common_part);
+    RUN_TEST(test_blob_with_fewer_channels_leaves_the_rest_default);
+    RUN_TEST(test_corrupt_blob_is_ignored);
+    RUN_TEST(test_startup_attributes);
+    RUN_TEST(test_set_channel_keeps_startup_fields);
+    return UNITY_END();
+}
@@ -0,0 +1,421 @@
+/*
+ * Pixel cluster decoding and frame commits, against a fake driver canvas.
+ *
+ * The fixture frames in pixel_frames/ are encoded by tools/pixel_codec.py at build time; sending those
+ * payloads through light_pixels_command() must reproduce the frame exactly.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "light_driver.h"
+#include "light_pixels.h"
+
+#define LEDS        60
+#define CH          0
+#define CH_CODEC    1
+#define CH_NONE     3
+
+/* Fake driver canvas */
+
+static uint8_t s_canvas[LEDS * 3];
+static bool s_fb_available;
+static int s_fb_begins, s_fb_ends, s_fb_releases;
+static uint16_t s_fb_start, s_fb_count;
+
+uint8_t *light_driver_fb_begin(size_t ch, uint16_t *led_count)
+{
+    if (!s_fb_available) return NULL;
+    s_fb_begins++;
+    *led_count = LEDS;
+    return s_canvas;
+}
+
+void light_driver_fb_end(size_t ch, uint16_t start, uint16_t count)
+{
+    s_fb_ends++;
+    s_fb_start = start;
+    s_fb_count = count;
+}
+
+void light_driver_fb_release(size_t ch)
+{
+    s_fb_releases++;
+}
+
+void setUp(void)
+{
+    memset(s_canvas, 0xAA, sizeof(s_canvas));
+    s_fb_available = true;
+    s_fb_begins = s_fb_ends = s_fb_releases = 0;
+    s_fb_start = s_fb_count = 0;
+}
+
+void tearDown(void) {}
+
+// every test uses its own frame ids, the channel state carries over between tests
+static uint8_t next_frame(void)
+{
+    static uint8_t frame;
+    return ++frame;
+}
+
+static esp_err_t write_raw(uint8_t frame, uint8_t packet, uint16_t start, const uint8_t *rgb, uint16_t count)
+{
+    uint8_t p[LIGHT_PIXELS_PAYLOAD_MAX];
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(sizeof(p), LIGHT_PIXELS_WRITE_HEADER + count * 3u);
+    p[0] = frame;
+    p[1] = packet;
+    p[2] = LIGHT_PIXELS_ENC_RAW;
+    p[3] = (uint8_t) start;
+    p[4] = (uint8_t) (start >> 8);
+    memcpy(p + LIGHT_PIXELS_WRITE_HEADER, rgb, count * 3u);
+    return light_pixels_command(CH, LIGHT_PIXELS_CMD_WRITE, p, LIGHT_PIXELS_WRITE_HEADER + count * 3u);
+}
+
+static esp_err_t commit(size_t ch, uint8_t frame, uint8_t packets)
+{
+    uint8_t p[] = { frame, packets };
+    return light_pixels_command(ch, LIGHT_PIXELS_CMD_COMMIT, p, sizeof(p));
+}
+
+static void fill(uint8_t *rgb, uint16_t count, uint8_t seed)
+{
+    for (uint16_t i = 0; i < count * 3u; ++i) rgb[i] = (uint8_t) (seed + i * 7);
+}
+
+/* Decoding */
+
+static void test_decode_raw(void)
+{
+    uint8_t rgb[LEDS * 3] = { 0 }, data[6] = { 1, 2, 3, 4, 5, 6 };
+    uint16_t end = 0;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_pixels_decode(LIGHT_PIXELS_ENC_RAW, data, 6, rgb, LEDS, 10, &end));
+    TEST_ASSERT_EQUAL_UINT16(12, end);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data, rgb + 30, 6);
+    TEST_ASSERT_EQUAL_UINT8(0, rgb[29]);
+    TEST_ASSERT_EQUAL_UINT8(0, rgb[36]);
+
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_pixels_decode(LIGHT_PIXELS_ENC_RAW, data, 5, rgb, LEDS, 0, &end));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_pixels_decode(LIGHT_PIXELS_ENC_RAW, data, 6, rgb, LEDS, LEDS - 1, &end));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, light_pixels_decode(LIGHT_PIXELS_ENC_RAW, data, 6, rgb, LEDS, LEDS, &end));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_NOT_SUPPORTED, light_pixels_decode(7, data, 6, rgb, LEDS, 0, &end));
+}
+
+static void test_decode_rle_runs(void)
+{
+    uint8_t rgb[LEDS * 3] = { 0 };
+    const uint8_t data[] = { 3, 10, 20, 30, 2, 1, 2, 3 };
+    uint16_t end = 0;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_pixels_decode(LIGHT_PIXELS_ENC_RLE, data, sizeof(data), rgb, LEDS, 5, &end));
+    TEST_ASSERT_EQUAL_UINT16(10, end);
+    const uint8_t expect[] = { 10, 20, 30, 10, 20, 30, 10, 20, 30, 1, 2, 3, 1, 2, 3 };
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expect, rgb + 15, sizeof(expect));
+}
+
+static void test_decode_rle_ramp_starts_from_black(void)
+{
+    uint8_t rgb[LEDS * 3];
+    memset(rgb, 0xFF, sizeof(rgb));
+    // the pixel before the Write is white, the ramp still starts from black
+    const uint8_t data[] = { LIGHT_PIXELS_RUN_RAMP | 4, 100, 0, 40, LIGHT_PIXELS_RUN_RAMP | 2, 0, 0, 0 };
+    uint16_t end = 0;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_pixels_decode(LIGHT_PIXELS_ENC_RLE, data, sizeof(data), rgb, LEDS, 1, &end));
+    TEST_ASSERT_EQUAL_UINT16(7, end);
+    const uint8_t expect[] = { 25, 0, 10, 50, 0, 20, 75, 0, 30, 100, 0, 40, 50, 0, 20, 0, 0, 0 };
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expect, rgb + 3, sizeof(expect));
+    TEST_ASSERT_EQUAL_UINT8(0xFF, rgb[21]);
+}
+
+static void test_decode_rle_rejects_malformed(void)
+{
+    uint8_t rgb[LEDS * 3];
+    uint16_t end = 0;
+    const uint8_t zero_run[] = { 0, 1, 2, 3 };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_pixels_decode(LIGHT_PIXELS_ENC_RLE, zero_run, 4, rgb, LEDS, 0, &end));
+    const uint8_t too_long[] = { 11, 1, 2, 3 };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_pixels_decode(LIGHT_PIXELS_ENC_RLE, too_long, 4, rgb, LEDS, LEDS - 10, &end));
+    const uint8_t partial[] = { 1, 1, 2, 3, 1, 1 };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_pixels_decode(LIGHT_PIXELS_ENC_RLE, partial, sizeof(partial), rgb, LEDS, 0, &end));
+}
+
+static void test_decode_palette_widths(void)
+{
+    static const uint8_t widths[][2] = { { 2, 1 }, { 4, 2 }, { 16, 4 }, { 200, 8 } }; // colors, bits per index
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); ++w) {
+        uint8_t colors = widths[w][0], bits = widths[w][1];
+        uint8_t data[1 + 255 * 3 + 2 + LEDS] = { 0 };
+        data[0] = colors;
+        for (int k = 0; k < colors * 3; ++k) data[1 + k] = (uint8_t) (k + 1);
+        size_t head = 1 + colors * 3u + 2;
+        data[head - 2] = LEDS;
+        for (uint32_t i = 0; i < LEDS; ++i) {
+            uint32_t bit = i * bits;
+            data[head + bit / 8] |= (uint8_t) ((i % colors) << (bit % 8));
+        }
+        size_t len = head + (LEDS * bits + 7) / 8;
+        uint8_t rgb[LEDS * 3] = { 0 };
+        uint16_t end = 0;
+        TEST_ASSERT_EQUAL_INT(ESP_OK, light_pixels_decode(LIGHT_PIXELS_ENC_PALETTE, data, len, rgb, LEDS, 0, &end));
+        TEST_ASSERT_EQUAL_UINT16(LEDS, end);
+        for (uint32_t i = 0; i < LEDS; ++i) {
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(&data[1 + (i % colors) * 3], &rgb[i * 3], 3);
+        }
+        // one index byte short
+        TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_pixels_decode(LIGHT_PIXELS_ENC_PALETTE, data, len - 1, rgb, LEDS, 0, &end));
+    }
+}
+
+static void test_decode_palette_rejects_malformed(void)
+{
+    uint8_t rgb[LEDS * 3];
+    uint16_t end = 0;
+    const uint8_t no_colors[] = { 0, 1, 0, 0 };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_pixels_decode(LIGHT_PIXELS_ENC_PALETTE, no_colors, sizeof(no_colors), rgb, LEDS, 0, &end));
+    const uint8_t short_palette[] = { 2, 1, 2, 3 };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_pixels_decode(LIGHT_PIXELS_ENC_PALETTE, short_palette, sizeof(short_palette), rgb, LEDS, 0, &end));
+    // three colors use 2-bit indices, index 3 is outside the palette
+    const uint8_t bad_index[] = { 3, 1, 1, 1, 2, 2, 2, 3, 3, 3, 2, 0, 0x0C };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_pixels_decode(LIGHT_PIXELS_ENC_PALETTE, bad_index, sizeof(bad_index), rgb, LEDS, 0, &end));
+    const uint8_t past_end[] = { 1, 1, 2, 3, 2, 0, 0 };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_pixels_decode(LIGHT_PIXELS_ENC_PALETTE, past_end, sizeof(past_end), rgb, LEDS, LEDS - 1, &end));
+}
+
+/* Commands */
+
+static void test_add_channels(void)
+{
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_pixels_add_channel(CH, LEDS));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_pixels_add_channel(CH_CODEC, LEDS));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, light_pixels_add_channel(CH_NONE, 0));
+    uint8_t p[] = { 1, 1 };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_NOT_FOUND, light_pixels_command(CH_NONE, LIGHT_PIXELS_CMD_COMMIT, p, sizeof(p)));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_STATE, light_pixels_add_channel(CH, LEDS));
+}
+
+static void test_multi_packet_commit(void)
+{
+    uint8_t frame = next_frame();
+    uint8_t a[16 * 3], b[16 * 3];
+    fill(a, 16, 1);
+    fill(b, 16, 100);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, write_raw(frame, 1, 30, b, 16));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, write_raw(frame, 0, 4, a, 16));
+    TEST_ASSERT_EQUAL_INT(0, s_fb_begins);      // nothing reaches the canvas before the Commit
+
+    TEST_ASSERT_EQUAL_INT(ESP_OK, commit(CH, frame, 2));
+    TEST_ASSERT_EQUAL_INT(1, s_fb_begins);
+    TEST_ASSERT_EQUAL_INT(1, s_fb_ends);
+    TEST_ASSERT_EQUAL_UINT16(4, s_fb_start);
+    TEST_ASSERT_EQUAL_UINT16(46 - 4, s_fb_count);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(a, s_canvas + 4 * 3, sizeof(a));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(b, s_canvas + 30 * 3, sizeof(b));
+    TEST_ASSERT_EQUAL_UINT8(0xAA, s_canvas[4 * 3 - 1]);
+    TEST_ASSERT_EQUAL_UINT8(0xAA, s_canvas[20 * 3]);   // between the packets
+    TEST_ASSERT_EQUAL_UINT8(0xAA, s_canvas[46 * 3]);
+}
+
+static void test_missing_packet_leaves_canvas(void)
+{
+    uint8_t frame = next_frame();
+    uint8_t a[8 * 3];
+    fill(a, 8, 3);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, write_raw(frame, 0, 0, a, 8));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, write_raw(frame, 2, 16, a, 8));
+    light_pixels_stats_t before, after;
+    light_pixels_get_stats(CH, &before);
+
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_STATE, commit(CH, frame, 3));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_STATE, commit(CH, (uint8_t) (frame + 100), 1));
+    TEST_ASSERT_EQUAL_INT(0, s_fb_begins);
+    for (size_t i = 0; i < sizeof(s_canvas); ++i) TEST_ASSERT_EQUAL_UINT8(0xAA, s_canvas[i]);
+    light_pixels_get_stats(CH, &after);
+    TEST_ASSERT_EQUAL_UINT32(before.rejected + 2, after.rejected);
+    TEST_ASSERT_EQUAL_UINT32(before.frames, after.frames);
+
+    // the lost packet sent again completes the frame
+    TEST_ASSERT_EQUAL_INT(ESP_OK, write_raw(frame, 1, 8, a, 8));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, commit(CH, frame, 3));
+    TEST_ASSERT_EQUAL_UINT16(0, s_fb_start);
+    TEST_ASSERT_EQUAL_UINT16(24, s_fb_count);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(a, s_canvas + 8 * 3, sizeof(a));
+}
+
+static void test_abandoned_frame_is_not_committed(void)
+{
+    uint8_t old = next_frame(), frame = next_frame();
+    uint8_t a[10 * 3], b[4 * 3];
+    fill(a, 10, 9);
+    fill(b, 4, 50);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, write_raw(old, 0, 40, a, 10));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, write_raw(old, 1, 0, a, 10));
+    // the next frame reuses packet 0, its pixels elsewhere; the old pixels stay staged
+    TEST_ASSERT_EQUAL_INT(ESP_OK, write_raw(frame, 0, 20, b, 4));
+
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_STATE, commit(CH, old, 2));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_STATE, commit(CH, frame, 2));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, commit(CH, frame, 1));
+    TEST_ASSERT_EQUAL_UINT16(20, s_fb_start);
+    TEST_ASSERT_EQUAL_UINT16(4, s_fb_count);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(b, s_canvas + 20 * 3, sizeof(b));
+    for (size_t i = 0; i < 20 * 3; ++i) TEST_ASSERT_EQUAL_UINT8(0xAA, s_canvas[i]);
+    for (size_t i = 24 * 3; i < sizeof(s_canvas); ++i) TEST_ASSERT_EQUAL_UINT8(0xAA, s_canvas[i]);
+}
+
+static void test_repeated_commit_is_idempotent(void)
+{
+    uint8_t frame = next_frame();
+    uint8_t a[5 * 3];
+    fill(a, 5, 77);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, write_raw(frame, 0, 50, a, 5));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, commit(CH, frame, 1));
+    light_pixels_stats_t before, after;
+    light_pixels_get_stats(CH, &before);
+
+    memset(s_canvas, 0, sizeof(s_canvas));  // e.g. the strip drew over it since
+    TEST_ASSERT_EQUAL_INT(ESP_OK, commit(CH, frame, 1));
+    TEST_ASSERT_EQUAL_INT(1, s_fb_begins);
+    TEST_ASSERT_EQUAL_UINT8(0, s_canvas[50 * 3]);
+    light_pixels_get_stats(CH, &after);
+    TEST_ASSERT_EQUAL_UINT32(before.frames, after.frames);
+    TEST_ASSERT_EQUAL_UINT32(before.rejected, after.rejected);
+
+    // a Write after the Commit starts the frame over, even with the same id
+    TEST_ASSERT_EQUAL_INT(ESP_OK, write_raw(frame, 0, 50, a, 5));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, commit(CH, frame, 1));
+    TEST_ASSERT_EQUAL_INT(2, s_fb_begins);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(a, s_canvas + 50 * 3, sizeof(a));
+}
+
+static void test_commit_without_canvas(void)
+{
+    uint8_t frame = next_frame();
+    uint8_t a[3] = { 1, 2, 3 };
+    TEST_ASSERT_EQUAL_INT(ESP_OK, write_raw(frame, 0, 0, a, 1));
+    s_fb_available = false;
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_STATE, commit(CH, frame, 1));
+    TEST_ASSERT_EQUAL_INT(0, s_fb_ends);
+    s_fb_available = true;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, commit(CH, frame, 1));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(a, s_canvas, 3);
+}
+
+static void test_malformed_commands(void)
+{
+    light_pixels_stats_t before, after;
+    light_pixels_get_stats(CH, &before);
+    uint8_t short_write[] = { 1, 0, LIGHT_PIXELS_ENC_RAW, 0 };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_pixels_command(CH, LIGHT_PIXELS_CMD_WRITE, short_write, sizeof(short_write)));
+    uint8_t bad_packet[] = { 1, LIGHT_PIXELS_PACKETS_MAX, LIGHT_PIXELS_ENC_RAW, 0, 0, 1, 2, 3 };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_pixels_command(CH, LIGHT_PIXELS_CMD_WRITE, bad_packet, sizeof(bad_packet)));
+    uint8_t bad_start[] = { 1, 0, LIGHT_PIXELS_ENC_RAW, LEDS, 0, 1, 2, 3 };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_pixels_command(CH, LIGHT_PIXELS_CMD_WRITE, bad_start, sizeof(bad_start)));
+    uint8_t no_packets[] = { 1, 0 };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_pixels_command(CH, LIGHT_PIXELS_CMD_COMMIT, no_packets, sizeof(no_packets)));
+    uint8_t too_many[] = { 1, LIGHT_PIXELS_PACKETS_MAX + 1 };
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, light_pixels_command(CH, LIGHT_PIXELS_CMD_COMMIT, too_many, sizeof(too_many)));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, light_pixels_command(CH, LIGHT_PIXELS_CMD_WRITE, NULL, 5));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_NOT_SUPPORTED, light_pixels_command(CH, 0x7F, NULL, 0));
+    light_pixels_get_stats(CH, &after);
+    TEST_ASSERT_EQUAL_UINT32(before.rejected + 5, after.rejected);
+    TEST_ASSERT_EQUAL_UINT32(before.packets, after.packets);
+    TEST_ASSERT_EQUAL_INT(0, s_fb_begins);
+}
+
+static void test_release(void)
+{
+    TEST_ASSERT_EQUAL_INT(ESP_OK, light_pixels_command(CH, LIGHT_PIXELS_CMD_RELEASE, NULL, 0));
+    TEST_ASSERT_EQUAL_INT(1, s_fb_releases);
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_NOT_FOUND, light_pixels_command(CH_NONE, LIGHT_PIXELS_CMD_RELEASE, NULL, 0));
+    TEST_ASSERT_EQUAL_INT(1, s_fb_releases);
+}
+
+/* Frames encoded by tools/pixel_codec.py */
+
+static void load_frame(const char *name, uint8_t *expect)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s.hex", PIXEL_FRAME_DIR, name);
+    FILE *f = fopen(path, "r");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, path);
+    unsigned v;
+    size_t n = 0;
+    while (n < LEDS && fscanf(f, "%6x", &v) == 1) {
+        expect[n * 3] = (uint8_t) (v >> 16);
+        expect[n * 3 + 1] = (uint8_t) (v >> 8);
+        expect[n * 3 + 2] = (uint8_t) v;
+        ++n;
+    }
+    fclose(f);
+    TEST_ASSERT_EQUAL_size_t(LEDS, n);
+}
+
+// Replays one capture (suffix "" encoded, "_raw" raw RGB only) onto a cleared canvas; returns its packet count
+static int replay_capture(const char *name, const char *suffix, const uint8_t *expect)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/pixels_%s%s.txt", PIXEL_CAPTURE_DIR, name, suffix);
+    FILE *f = fopen(path, "r");
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, path);
+    memset(s_canvas, 0, sizeof(s_canvas));
+    unsigned cmd;
+    char hex[2 * LIGHT_PIXELS_PAYLOAD_MAX + 2];
+    int writes = 0, commits = 0;
+    while (fscanf(f, "%x %130s", &cmd, hex) == 2) {
+        uint8_t payload[LIGHT_PIXELS_PAYLOAD_MAX];
+        size_t len = strlen(hex) / 2;
+        TEST_ASSERT_LESS_OR_EQUAL_size_t(sizeof(payload), len);
+        for (size_t i = 0; i < len; ++i) sscanf(hex + 2 * i, "%2hhx", &payload[i]);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(ESP_OK, light_pixels_command(CH_CODEC, (uint8_t) cmd, payload, len), path);
+        if (cmd == LIGHT_PIXELS_CMD_WRITE) writes++;
+        else commits++;
+    }
+    fclose(f);
+    TEST_ASSERT_GREATER_THAN_INT(0, writes);
+    TEST_ASSERT_EQUAL_INT(1, commits);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(expect, s_canvas, LEDS * 3, path);
+    TEST_ASSERT_EQUAL_UINT16(0, s_fb_start);
+    TEST_ASSERT_EQUAL_UINT16(LEDS, s_fb_count);
+    return writes + commits;
+}
+
+static void check_codec_frame(const char *name)
+{
+    uint8_t expect[LEDS * 3];
+    load_frame(name, expect);
+    int encoded = replay_capture(name, "", expect);
+    int raw = replay_capture(name, "_raw", expect);
+    printf("%-10s %2d packets encoded, %2d raw\n", name, encoded, raw);
+    // the ramps have to pay off on gradients
+    if (!strcmp(name, "gradient") || !strcmp(name, "gradient3")) TEST_ASSERT_LESS_THAN_INT_MESSAGE(raw, encoded, name);
+    else TEST_ASSERT_LESS_OR_EQUAL_INT_MESSAGE(raw, encoded, name);
+}
+
+static void test_codec_frames(void)
+{
+    static const char *names[] = { PIXEL_FRAME_NAMES };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) check_codec_frame(names[i]);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_add_channels);
+    RUN_TEST(test_decode_raw);
+    RUN_TEST(test_decode_rle_runs);
+    RUN_TEST(test_decode_rle_ramp_starts_from_black);
+    RUN_TEST(test_decode_rle_rejects_malformed);
+    RUN_TEST(test_decode_palette_widths);
+    RUN_TEST(test_decode_palette_rejects_malformed);
+    RUN_TEST(test_multi_packet_commit);
+    RUN_TEST(test_missing_packet_leaves_canvas);
+    RUN_TEST(test_abandoned_frame_is_not_committed);
+    RUN_TEST(test_repeated_commit_is_idempotent);
+    RUN_TEST(test_commit_without_canvas);
+    RUN_TEST(test_malformed_commands);
+    RUN_TEST(test_release);
+    RUN_TEST(test_codec_frames);
+    return UNITY_END();
+}
@@ -0,0 +1,89 @@
+/*
+ * Power limiter budget allotment: priorities, fixed load and the output cap.
+ */
+
+#include "unity.h"
+#include "light_power.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static light_power_allot_t s_out;
+
+static void test_unlimited_budget_passes_everything(void)
+{
+    const uint32_t demand[LIGHT_POWER_PRIORITIES] = { 5000, 4000, 3000, 2000 };
+    TEST_ASSERT_FALSE(light_power_allot(demand, 100, 0, 256, &s_out));
+    for (int p = 0; p < LIGHT_POWER_PRIORITIES; ++p) TEST_ASSERT_EQUAL_UINT16(256, s_out.scale_q8[p]);
+    TEST_ASSERT_EQUAL_UINT32(14100, s_out.demand_ma);
+    TEST_ASSERT_EQUAL_UINT32(14100, s_out.output_ma);
+}
+
+static void test_within_budget_is_untouched(void)
+{
+    const uint32_t demand[LIGHT_POWER_PRIORITIES] = { 1000, 1000, 0, 500 };
+    TEST_ASSERT_FALSE(light_power_allot(demand, 500, 3000, 256, &s_out));
+    for (int p = 0; p < LIGHT_POWER_PRIORITIES; ++p) TEST_ASSERT_EQUAL_UINT16(256, s_out.scale_q8[p]);
+    TEST_ASSERT_EQUAL_UINT32(3000, s_out.output_ma);
+}
+
+static void test_priorities_are_served_in_order(void)
+{
+    // 4000 mA budget, 400 idle: priority 0 fits, priority 1 gets the 600 left of its 1200, the rest go dark
+    const uint32_t demand[LIGHT_POWER_PRIORITIES] = { 3000, 1200, 800, 100 };
+    TEST_ASSERT_TRUE(light_power_allot(demand, 400, 4000, 256, &s_out));
+    TEST_ASSERT_EQUAL_UINT16(256, s_out.scale_q8[0]);
+    TEST_ASSERT_EQUAL_UINT16(128, s_out.scale_q8[1]);
+    TEST_ASSERT_EQUAL_UINT16(0, s_out.scale_q8[2]);
+    TEST_ASSERT_EQUAL_UINT16(0, s_out.scale_q8[3]);
+    TEST_ASSERT_EQUAL_UINT32(5500, s_out.demand_ma);
+    TEST_ASSERT_EQUAL_UINT32(4000, s_out.output_ma);
+}
+
+static void test_output_never_exceeds_budget(void)
+{
+    for (uint32_t budget = 500; budget < 20000; budget += 731) {
+        for (uint32_t d = 0; d < 12000; d += 997) {
+            const uint32_t demand[LIGHT_POWER_PRIORITIES] = { d, d / 2, d / 3, 7 };
+            light_power_allot(demand, 300, budget, 256, &s_out);
+            TEST_ASSERT_LESS_OR_EQUAL_UINT32(budget > 300 ? budget : 300, s_out.output_ma);
+            // and uses it up to the Q8 resolution of the scale
+            if (s_out.demand_ma > budget) TEST_ASSERT_UINT_WITHIN(s_out.demand_ma / 256 + 2, budget, s_out.output_ma);
+        }
+    }
+}
+
+static void test_fixed_load_over_budget_darkens_all(void)
+{
+    const uint32_t demand[LIGHT_POWER_PRIORITIES] = { 100, 100, 100, 100 };
+    TEST_ASSERT_TRUE(light_power_allot(demand, 2500, 2000, 256, &s_out));
+    for (int p = 0; p < LIGHT_POWER_PRIORITIES; ++p) TEST_ASSERT_EQUAL_UINT16(0, s_out.scale_q8[p]);
+    TEST_ASSERT_EQUAL_UINT32(2500, s_out.output_ma);
+}
+
+static void test_cap_applies_before_budget(void)
+{
+    // half cap halves the demand, which then fits: the scale is the cap alone and nothing counts as limited
+    const uint32_t demand[LIGHT_POWER_PRIORITIES] = { 4000, 0, 0, 0 };
+    TEST_ASSERT_FALSE(light_power_allot(demand, 0, 2000, 128, &s_out));
+    TEST_ASSERT_EQUAL_UINT16(128, s_out.scale_q8[0]);
+    TEST_ASSERT_EQUAL_UINT32(2000, s_out.demand_ma);
+    TEST_ASSERT_EQUAL_UINT32(2000, s_out.output_ma);
+
+    // still over budget after the cap: both scales combine
+    TEST_ASSERT_TRUE(light_power_allot(demand, 0, 1000, 128, &s_out));
+    TEST_ASSERT_EQUAL_UINT16(64, s_out.scale_q8[0]);
+    TEST_ASSERT_EQUAL_UINT32(1000, s_out.output_ma);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_unlimited_budget_passes_everything);
+    RUN_TEST(test_within_budget_is_untouched);
+    RUN_TEST(test_priorities_are_served_in_order);
+    RUN_TEST(test_output_never_exceeds_budget);
+    RUN_TEST(test_fixed_load_over_budget_darkens_all);
+    RUN_TEST(test_cap_applies_before_budget);
+    return UNITY_END();
+}
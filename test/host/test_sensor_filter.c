@@ -0,0 +1,122 @@
+/*
+ * Sensor sampling filter: outliers, confirmed steps, median, report gating and interval backoff.
+ */
+
+#include "unity.h"
+#include "sensor_filter.h"
+
+static sensor_filter_t s_f;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static int32_t feed(int32_t raw)
+{
+    int32_t out = 0;
+    sensor_filter_update(&s_f, raw, &out);
+    return out;
+}
+
+static void test_outlier_is_rejected(void)
+{
+    const sensor_filter_config_t cfg = { .median_len = 3, .outlier_delta = 100, .outlier_max = 2 };
+    sensor_filter_init(&s_f, &cfg);
+    for (int i = 0; i < 4; ++i) TEST_ASSERT_EQUAL_INT32(50, feed(50));
+
+    int32_t out = 0;
+    TEST_ASSERT_FALSE(sensor_filter_update(&s_f, 1000, &out));
+    TEST_ASSERT_EQUAL_INT32(50, out);
+    TEST_ASSERT_EQUAL_UINT32(1, s_f.stats.rejected);
+    // the spike never reaches the window
+    TEST_ASSERT_EQUAL_INT32(50, feed(52));
+    TEST_ASSERT_EQUAL_INT32(50, feed(50));
+    TEST_ASSERT_EQUAL_UINT32(1, s_f.stats.rejected);
+}
+
+static void test_sustained_step_is_accepted(void)
+{
+    const sensor_filter_config_t cfg = { .median_len = 3, .ema_shift = 2, .outlier_delta = 100, .outlier_max = 2 };
+    for (int prime = 1; prime <= 6; ++prime) {
+        // every window position the step can arrive at
+        sensor_filter_init(&s_f, &cfg);
+        for (int i = 0; i < prime; ++i) feed(50);
+        TEST_ASSERT_EQUAL_INT32(50, feed(300));
+        TEST_ASSERT_EQUAL_INT32(50, feed(300));
+        TEST_ASSERT_EQUAL_INT32_MESSAGE(300, feed(300), "step after outlier_max rejects");
+        TEST_ASSERT_EQUAL_INT32(300, feed(300));
+        TEST_ASSERT_EQUAL_UINT32(2, s_f.stats.rejected);
+    }
+}
+
+static void test_median_and_ema(void)
+{
+    const sensor_filter_config_t cfg = { .median_len = 3, .ema_shift = 1 };
+    sensor_filter_init(&s_f, &cfg);
+    TEST_ASSERT_EQUAL_INT32(100, feed(100));
+    TEST_ASSERT_EQUAL_INT32(100, feed(100));
+    // a single spike is voted down by the median
+    TEST_ASSERT_EQUAL_INT32(100, feed(900));
+    // two in a row move the median, the EMA takes half of the step
+    TEST_ASSERT_EQUAL_INT32(500, feed(900));
+}
+
+static void test_report_gating(void)
+{
+    const sensor_filter_config_t cfg = { .report_delta = 10 };
+    sensor_filter_init(&s_f, &cfg);
+    TEST_ASSERT_TRUE(sensor_filter_update(&s_f, 2000, NULL));
+    TEST_ASSERT_FALSE(sensor_filter_update(&s_f, 2009, NULL));
+    TEST_ASSERT_FALSE(sensor_filter_update(&s_f, 1991, NULL));
+    TEST_ASSERT_TRUE(sensor_filter_update(&s_f, 2010, NULL));
+    // measured from the last report, not the last sample
+    TEST_ASSERT_FALSE(sensor_filter_update(&s_f, 2019, NULL));
+    TEST_ASSERT_TRUE(sensor_filter_update(&s_f, 2000, NULL));
+    TEST_ASSERT_EQUAL_UINT32(3, s_f.stats.reports);
+    TEST_ASSERT_EQUAL_UINT32(6, s_f.stats.samples);
+}
+
+static void test_interval_backoff_and_reset(void)
+{
+    const sensor_filter_config_t cfg = { .outlier_delta = 100, .outlier_max = 2, .stable_delta = 5,
+                                         .interval_min_ms = 1000, .interval_max_ms = 8000 };
+    sensor_filter_init(&s_f, &cfg);
+    TEST_ASSERT_EQUAL_UINT32(1000, sensor_filter_interval_ms(&s_f));
+    static const uint32_t backoff[] = { 2000, 4000, 8000, 8000 };
+    for (int i = 0; i < 4; ++i) {
+        feed(500);
+        TEST_ASSERT_EQUAL_UINT32(backoff[i], sensor_filter_interval_ms(&s_f));
+    }
+    // an outlier samples fast until it is confirmed or gone
+    feed(900);
+    TEST_ASSERT_EQUAL_UINT32(1000, sensor_filter_interval_ms(&s_f));
+    feed(502);
+    TEST_ASSERT_EQUAL_UINT32(2000, sensor_filter_interval_ms(&s_f));
+    // without EMA or median every sample matches the filter; with them a change shows as unstable
+    const sensor_filter_config_t ema = { .ema_shift = 2, .stable_delta = 5, .interval_min_ms = 1000, .interval_max_ms = 8000 };
+    sensor_filter_init(&s_f, &ema);
+    for (int i = 0; i < 3; ++i) feed(500);
+    TEST_ASSERT_EQUAL_UINT32(8000, sensor_filter_interval_ms(&s_f));
+    feed(600);
+    TEST_ASSERT_EQUAL_UINT32(1000, sensor_filter_interval_ms(&s_f));
+}
+
+static void test_config_is_clamped(void)
+{
+    const sensor_filter_config_t cfg = { .median_len = 4, .ema_shift = 12, .interval_min_ms = 5000, .interval_max_ms = 1000 };
+    sensor_filter_init(&s_f, &cfg);
+    TEST_ASSERT_EQUAL_UINT8(3, s_f.cfg.median_len);
+    TEST_ASSERT_EQUAL_UINT8(8, s_f.cfg.ema_shift);
+    TEST_ASSERT_EQUAL_UINT32(5000, s_f.cfg.interval_max_ms);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_outlier_is_rejected);
+    RUN_TEST(test_sustained_step_is_accepted);
+    RUN_TEST(test_median_and_ema);
+    RUN_TEST(test_report_gating);
+    RUN_TEST(test_interval_backoff_and_reset);
+    RUN_TEST(test_config_is_clamped);
+    return UNITY_END();
+}
@@ -0,0 +1,104 @@
+/*
+ * Thermal derating curve and hysteresis.
+ */
+
+#include "unity.h"
+#include "thermal_derate.h"
+
+static const thermal_derate_config_t s_cfg = {
+    .start_c100 = 6000, .full_c100 = 8000, .hysteresis_c100 = 200, .min_cap_q8 = 64,
+};
+
+static thermal_derate_t s_d;
+
+void setUp(void) { thermal_derate_init(&s_d, &s_cfg); }
+void tearDown(void) {}
+
+static void test_curve(void)
+{
+    TEST_ASSERT_FALSE(thermal_derate_update(&s_d, 2500));
+    TEST_ASSERT_EQUAL_UINT16(256, thermal_derate_cap(&s_d));
+    TEST_ASSERT_EQUAL_INT(THERMAL_DERATE_NORMAL, thermal_derate_state(&s_d));
+    TEST_ASSERT_FALSE(thermal_derate_update(&s_d, 6000));
+
+    TEST_ASSERT_TRUE(thermal_derate_update(&s_d, 7000));
+    TEST_ASSERT_EQUAL_UINT16(160, thermal_derate_cap(&s_d));
+    TEST_ASSERT_EQUAL_INT(THERMAL_DERATE_ACTIVE, thermal_derate_state(&s_d));
+
+    TEST_ASSERT_TRUE(thermal_derate_update(&s_d, 9000));
+    TEST_ASSERT_EQUAL_UINT16(64, thermal_derate_cap(&s_d));
+    TEST_ASSERT_EQUAL_INT(THERMAL_DERATE_MAX, thermal_derate_state(&s_d));
+}
+
+static void test_recovery_waits_for_hysteresis(void)
+{
+    thermal_derate_update(&s_d, 7000);
+    uint16_t cap = thermal_derate_cap(&s_d);
+    // cooling by less than the hysteresis keeps the cap
+    TEST_ASSERT_FALSE(thermal_derate_update(&s_d, 6900));
+    TEST_ASSERT_FALSE(thermal_derate_update(&s_d, 6800));
+    TEST_ASSERT_EQUAL_UINT16(cap, thermal_derate_cap(&s_d));
+    // further down it follows the curve shifted by the hysteresis
+    TEST_ASSERT_TRUE(thermal_derate_update(&s_d, 6500));
+    TEST_ASSERT_EQUAL_UINT16(256 - 192 * 700 / 2000, thermal_derate_cap(&s_d));
+    TEST_ASSERT_TRUE(thermal_derate_update(&s_d, 5800));
+    TEST_ASSERT_EQUAL_UINT16(256, thermal_derate_cap(&s_d));
+    TEST_ASSERT_EQUAL_INT(THERMAL_DERATE_NORMAL, thermal_derate_state(&s_d));
+}
+
+// Sign of each cap change along a trace; a controller without toggling changes direction once at most
+static int direction_reversals(const int32_t *trace, int n)
+{
+    int reversals = 0, last = 0;
+    for (int i = 0; i < n; ++i) {
+        uint16_t before = thermal_derate_cap(&s_d);
+        thermal_derate_update(&s_d, trace[i]);
+        int dir = thermal_derate_cap(&s_d) > before ? 1 : thermal_derate_cap(&s_d) < before ? -1 : 0;
+        if (dir && last && dir != last) reversals++;
+        if (dir) last = dir;
+    }
+    return reversals;
+}
+
+static void test_ripple_does_not_toggle(void)
+{
+    // heat 50 -> 85 C and cool back, 0.05 C per sample with +-1 C ripple on top
+    static int32_t trace[2 * 700];
+    int n = 0;
+    for (int i = 0; i < 700; ++i) trace[n++] = 5000 + i * 5 + ((i & 1) ? 100 : -100);
+    for (int i = 0; i < 700; ++i) trace[n++] = 8500 - i * 5 + ((i & 1) ? 100 : -100);
+    TEST_ASSERT_EQUAL_INT(1, direction_reversals(trace, n));
+    TEST_ASSERT_EQUAL_UINT16(256, thermal_derate_cap(&s_d));
+}
+
+static void test_holding_near_a_threshold_is_stable(void)
+{
+    thermal_derate_update(&s_d, 7000);
+    uint16_t cap = thermal_derate_cap(&s_d);
+    int changes = 0;
+    for (int i = 0; i < 1000; ++i) changes += thermal_derate_update(&s_d, 7000 + ((i % 3) - 1) * 90);
+    // the first +0.9 C step lowers the cap once, the ripple never raises it again
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(1, changes);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT16(cap, thermal_derate_cap(&s_d));
+}
+
+static void test_init_sanitises_config(void)
+{
+    thermal_derate_config_t bad = { .start_c100 = 7000, .full_c100 = 6000, .hysteresis_c100 = -50, .min_cap_q8 = 400 };
+    thermal_derate_init(&s_d, &bad);
+    TEST_ASSERT_EQUAL_INT32(7001, s_d.cfg.full_c100);
+    TEST_ASSERT_EQUAL_INT32(0, s_d.cfg.hysteresis_c100);
+    TEST_ASSERT_EQUAL_UINT16(256, s_d.cfg.min_cap_q8);
+    TEST_ASSERT_FALSE(thermal_derate_update(&s_d, 9000));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_curve);
+    RUN_TEST(test_recovery_waits_for_hysteresis);
+    RUN_TEST(test_ripple_does_not_toggle);
+    RUN_TEST(test_holding_near_a_threshold_is_stable);
+    RUN_TEST(test_init_sanitises_config);
+    return UNITY_END();
+}
@@ -0,0 +1,276 @@
+/*
+ * Attribute write table: exact and wildcard matches, type checks, first-match order and missing values.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "unity.h"
+#include "zcl_attr_dispatch.h"
+
+#define CLUSTER_A   0x0006
+#define CLUSTER_B   0x0300
+#define CLUSTER_C   0x0003
+#define TYPE_U8     0x20
+#define TYPE_U16    0x21
+
+static int s_calls[4];
+static size_t s_ch;
+static uint16_t s_attr;
+static const void *s_value;
+
+static void record(int handler, size_t ch, uint16_t attr_id, const void *value)
+{
+    s_calls[handler]++;
+    s_ch = ch;
+    s_attr = attr_id;
+    s_value = value;
+}
+
+static void handler_0(size_t ch, uint16_t attr_id, const void *value) { record(0, ch, attr_id, value); }
+static void handler_1(size_t ch, uint16_t attr_id, const void *value) { record(1, ch, attr_id, value); }
+static void handler_2(size_t ch, uint16_t attr_id, const void *value) { record(2, ch, attr_id, value); }
+static void handler_3(size_t ch, uint16_t attr_id, const void *value) { record(3, ch, attr_id, value); }
+
+static const zcl_attr_entry_t s_table[] = {
+    { CLUSTER_A, 0x0000, TYPE_U8, 0, handler_0 },
+    { CLUSTER_B, 0x0003, TYPE_U16, 0, handler_1 },
+    { CLUSTER_B, 0x0003, ZCL_ATTR_TYPE_ANY, 0, handler_2 },                          // shadowed for U16
+    { CLUSTER_C, ZCL_ATTR_ANY, ZCL_ATTR_TYPE_ANY, ZCL_ATTR_VALUE_OPTIONAL, handler_3 },
+    { CLUSTER_C, 0x0001, TYPE_U8, 0, handler_0 },                                    // behind the wildcard, never reached
+};
+#define TABLE_LEN (sizeof(s_table) / sizeof(s_table[0]))
+
+static zcl_attr_dispatch_t s_d;
+
+void setUp(void)
+{
+    memset(s_calls, 0, sizeof(s_calls));
+    s_ch = 0;
+    s_attr = 0;
+    s_value = NULL;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, zcl_attr_dispatch_init(&s_d, s_table, TABLE_LEN));
+}
+
+void tearDown(void)
+{
+    zcl_attr_dispatch_deinit(&s_d);
+}
+
+static void test_exact_match(void)
+{
+    uint8_t v = 7;
+    TEST_ASSERT_EQUAL_PTR(&s_table[0], zcl_attr_find(&s_d, CLUSTER_A, 0x0000, TYPE_U8));
+    TEST_ASSERT_EQUAL_INT(ESP_OK, zcl_attr_dispatch(&s_d, 2, CLUSTER_A, 0x0000, TYPE_U8, &v));
+    TEST_ASSERT_EQUAL_INT(1, s_calls[0]);
+    TEST_ASSERT_EQUAL_size_t(2, s_ch);
+    TEST_ASSERT_EQUAL_UINT16(0x0000, s_attr);
+    TEST_ASSERT_EQUAL_PTR(&v, s_value);
+}
+
+static void test_no_match(void)
+{
+    uint8_t v = 0;
+    TEST_ASSERT_NULL(zcl_attr_find(&s_d, CLUSTER_A, 0x0001, TYPE_U8));
+    TEST_ASSERT_NULL(zcl_attr_find(&s_d, 0x0008, 0x0000, TYPE_U8));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_NOT_FOUND, zcl_attr_dispatch(&s_d, 0, CLUSTER_A, 0x0001, TYPE_U8, &v));
+    TEST_ASSERT_EQUAL_INT(0, s_calls[0] + s_calls[1] + s_calls[2] + s_calls[3]);
+}
+
+static void test_type_mismatch(void)
+{
+    uint16_t v = 0;
+    // an exact attribute with the wrong type is not handled
+    TEST_ASSERT_NULL(zcl_attr_find(&s_d, CLUSTER_A, 0x0000, TYPE_U16));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_NOT_FOUND, zcl_attr_dispatch(&s_d, 0, CLUSTER_A, 0x0000, TYPE_U16, &v));
+    TEST_ASSERT_EQUAL_INT(0, s_calls[0]);
+    // the type wildcard further down takes what the typed entry refuses
+    TEST_ASSERT_EQUAL_PTR(&s_table[2], zcl_attr_find(&s_d, CLUSTER_B, 0x0003, TYPE_U8));
+}
+
+static void test_first_match_wins(void)
+{
+    uint16_t v = 0;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, zcl_attr_dispatch(&s_d, 0, CLUSTER_B, 0x0003, TYPE_U16, &v));
+    TEST_ASSERT_EQUAL_INT(1, s_calls[1]);
+    TEST_ASSERT_EQUAL_INT(0, s_calls[2]);
+    TEST_ASSERT_EQUAL_PTR(&s_table[3], zcl_attr_find(&s_d, CLUSTER_C, 0x0001, TYPE_U8));
+}
+
+static void test_attribute_wildcard(void)
+{
+    uint8_t v = 0;
+    TEST_ASSERT_EQUAL_INT(ESP_OK, zcl_attr_dispatch(&s_d, 1, CLUSTER_C, 0x0042, 0x30, &v));
+    TEST_ASSERT_EQUAL_INT(1, s_calls[3]);
+    TEST_ASSERT_EQUAL_UINT16(0x0042, s_attr);
+    TEST_ASSERT_NULL(zcl_attr_find(&s_d, CLUSTER_A, ZCL_ATTR_ANY, TYPE_U8));
+}
+
+static void test_missing_value(void)
+{
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, zcl_attr_dispatch(&s_d, 0, CLUSTER_A, 0x0000, TYPE_U8, NULL));
+    TEST_ASSERT_EQUAL_INT(0, s_calls[0]);
+    TEST_ASSERT_EQUAL_INT(ESP_OK, zcl_attr_dispatch(&s_d, 0, CLUSTER_C, 0x0002, TYPE_U8, NULL));
+    TEST_ASSERT_EQUAL_INT(1, s_calls[3]);
+    TEST_ASSERT_NULL(s_value);
+}
+
+// The former linear first-match scan, the reference for the index
+static const zcl_attr_entry_t *ref_find(const zcl_attr_entry_t *table, size_t count, uint16_t cluster, uint16_t attr_id,
+                                        uint8_t type)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const zcl_attr_entry_t *e = &table[i];
+        if (e->cluster != cluster || (e->attr_id != ZCL_ATTR_ANY && e->attr_id != attr_id) ||
+            (e->type != ZCL_ATTR_TYPE_ANY && e->type != type)) {
+            continue;
+        }
+        return e;
+    }
+    return NULL;
+}
+
+static void test_index_matches_linear_scan(void)
+{
+    // few clusters, attributes and types, so keys repeat and wildcards interleave with exact entries
+    static const uint16_t attrs[] = { 0, 1, 2, ZCL_ATTR_ANY };
+    static const uint8_t types[] = { TYPE_U8, TYPE_U16, ZCL_ATTR_TYPE_ANY };
+    zcl_attr_entry_t table[200];
+    uint32_t seed = 7;
+    for (size_t i = 0; i < 200; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        table[i] = (zcl_attr_entry_t) { .cluster = (uint16_t) ((seed >> 8) % 5), .attr_id = attrs[(seed >> 12) % 4],
+                                        .type = types[(seed >> 16) % 3], .handler = handler_0 };
+    }
+    for (size_t n = 1; n <= 200; n += 13) {
+        zcl_attr_dispatch_t d;
+        TEST_ASSERT_EQUAL_INT(ESP_OK, zcl_attr_dispatch_init(&d, table, n));
+        for (uint16_t cluster = 0; cluster < 6; ++cluster) {
+            for (size_t a = 0; a < 4; ++a) {
+                for (uint8_t type = TYPE_U8; type <= TYPE_U16 + 1; ++type) {
+                    TEST_ASSERT_EQUAL_PTR(ref_find(table, n, cluster, attrs[a], type), zcl_attr_find(&d, cluster, attrs[a], type));
+                }
+            }
+        }
+        zcl_attr_dispatch_deinit(&d);
+    }
+}
+
+static void test_init_rejects_bad_tables(void)
+{
+    zcl_attr_dispatch_t d;
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_SIZE, zcl_attr_dispatch_init(&d, s_table, 0));
+    TEST_ASSERT_EQUAL_INT(ESP_ERR_INVALID_ARG, zcl_attr_dispatch_init(&d, NULL, 1));
+    zcl_attr_dispatch_t none = { 0 };
+    TEST_ASSERT_NULL(zcl_attr_find(&none, CLUSTER_A, 0x0000, TYPE_U8));
+}
+
+#ifdef HOST_BENCH
+#include <stdlib.h>
+#include "bench.h"
+
+/* Per-message cost through a stand-in of zb_attribute_handler(), as endpoints and table entries grow */
+
+#define BASE_EP     1
+#define BENCH_MSGS  1024
+
+typedef struct {
+    uint8_t dst_endpoint;
+    uint16_t cluster, attr_id;
+    uint8_t type;
+    const void *value;
+} bench_msg_t;                  // the fields of esp_zb_zcl_set_attr_value_message_t the handler reads
+
+static zcl_attr_dispatch_t s_bench_d;
+static const zcl_attr_entry_t *s_bench_table;
+static size_t s_bench_count, s_bench_endpoints;
+static bench_msg_t s_msgs[BENCH_MSGS];
+static uint32_t s_handled;
+
+static void bench_handler(size_t ch, uint16_t attr_id, const void *value) { s_handled += (uint32_t) ch + attr_id; }
+
+static esp_err_t attribute_handler(const bench_msg_t *m, bool indexed)
+{
+    if (m->dst_endpoint < BASE_EP || m->dst_endpoint >= BASE_EP + s_bench_endpoints) return ESP_OK;
+    size_t ch = m->dst_endpoint - BASE_EP;
+    if (indexed) return zcl_attr_dispatch(&s_bench_d, ch, m->cluster, m->attr_id, m->type, m->value);
+    const zcl_attr_entry_t *e = ref_find(s_bench_table, s_bench_count, m->cluster, m->attr_id, m->type);
+    if (!e) return ESP_ERR_NOT_FOUND;
+    e->handler(ch, m->attr_id, m->value);
+    return ESP_OK;
+}
+
+static void bench_indexed(uint32_t iters)
+{
+    for (uint32_t n = 0; n < iters; ++n) {
+        for (int i = 0; i < BENCH_MSGS; ++i) attribute_handler(&s_msgs[i], true);
+    }
+    bench_sink = s_handled;
+}
+
+static void bench_linear(uint32_t iters)
+{
+    for (uint32_t n = 0; n < iters; ++n) {
+        for (int i = 0; i < BENCH_MSGS; ++i) attribute_handler(&s_msgs[i], false);
+    }
+    bench_sink = s_handled;
+}
+
+// entries attributes over clusters of 16, then one wildcard cluster like Identify; messages hit random entries
+static void bench_setup(size_t entries, size_t endpoints)
+{
+    static zcl_attr_entry_t table[4096 + 1];
+    for (size_t i = 0; i < entries; ++i) {
+        table[i] = (zcl_attr_entry_t) { .cluster = (uint16_t) (0x0100 + i / 16), .attr_id = (uint16_t) (i % 16),
+                                        .type = TYPE_U16, .handler = bench_handler };
+    }
+    table[entries] = (zcl_attr_entry_t) { .cluster = CLUSTER_C, .attr_id = ZCL_ATTR_ANY, .type = ZCL_ATTR_TYPE_ANY,
+                                          .flags = ZCL_ATTR_VALUE_OPTIONAL, .handler = bench_handler };
+    s_bench_table = table;
+    s_bench_count = entries + 1;
+    s_bench_endpoints = endpoints;
+    zcl_attr_dispatch_deinit(&s_bench_d);
+    zcl_attr_dispatch_init(&s_bench_d, table, s_bench_count);
+    static const uint16_t value = 1;
+    uint32_t seed = 99;
+    for (int i = 0; i < BENCH_MSGS; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        const zcl_attr_entry_t *e = &table[(seed >> 8) % s_bench_count];
+        s_msgs[i] = (bench_msg_t) { .dst_endpoint = (uint8_t) (BASE_EP + (seed >> 20) % endpoints), .cluster = e->cluster,
+                                    .attr_id = e->attr_id == ZCL_ATTR_ANY ? 0x0002 : e->attr_id, .type = TYPE_U16,
+                                    .value = &value };
+    }
+}
+
+int main(void)
+{
+    static const size_t entries[] = { 16, 64, 256, 1024, 4096 };
+    static const size_t endpoints[] = { 14, 64, 240 };
+    printf("attribute write dispatch, per message\n");
+    for (size_t e = 0; e < sizeof(endpoints) / sizeof(endpoints[0]); ++e) {
+        for (size_t a = 0; a < sizeof(entries) / sizeof(entries[0]); ++a) {
+            char name[64];
+            bench_setup(entries[a], endpoints[e]);
+            snprintf(name, sizeof(name), "%3zu endpoints %4zu entries indexed", endpoints[e], entries[a] + 1);
+            bench_run(name, bench_indexed, BENCH_MSGS);
+            snprintf(name, sizeof(name), "%3zu endpoints %4zu entries linear", endpoints[e], entries[a] + 1);
+            bench_run(name, bench_linear, BENCH_MSGS);
+        }
+    }
+    zcl_attr_dispatch_deinit(&s_bench_d);
+    return 0;
+}
+#else
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_exact_match);
+    RUN_TEST(test_no_match);
+    RUN_TEST(test_type_mismatch);
+    RUN_TEST(test_first_match_wins);
+    RUN_TEST(test_attribute_wildcard);
+    RUN_TEST(test_missing_value);
+    RUN_TEST(test_index_matches_linear_scan);
+    RUN_TEST(test_init_rejects_bad_tables);
+    return UNITY_END();
+}
+#endif
@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""Compile a text animation library into the image flashed to the "anim" partition.
+
+The binary layout is described in main/light_anim.h. Source format, one statement
+per line, lines starting with '#' are comments:
+
+    anim <name> <duration> [loop]
+    track <lo>-<hi>%
+    key <time> <easing> <level> <color>[..<color>]
+
+A track covers a part of whatever channel plays the animation, in percent of its
+length. Each key gives the level (0-255, relative to the channel level) and a
+color ramp from the first to the last pixel of the track; a single color fills
+the track. Easing (linear, in, out, in_out, step) shapes the way from a key to
+the next one. Times are "<n>ms" or "<n>s" with a 10 ms resolution, up to 655 s.
+
+Usage: anim_compile.py <source> -o <image> [--partition-size <bytes>]
+"""
+import argparse
+import struct
+import sys
+
+MAGIC = b"LANM"
+VERSION = 1
+NAME_LEN = 12
+TRACKS_MAX = 8
+FLAG_LOOP = 0x01
+EASINGS = {"linear": 0, "in": 1, "out": 2, "in_out": 3, "step": 4}
+
+FILE_FMT = "<4sHHII"        # light_anim_file_t
+INDEX_FMT = "<12sI"         # light_anim_index_t
+HEADER_FMT = "<HBB"         # light_anim_header_t
+TRACK_FMT = "<BBBB"         # light_anim_track_t
+KEY_FMT = "<HBB3B3BH"       # light_anim_key_t
+
+
+class CompileError(Exception):
+    pass
+
+
+def parse_time(text):
+    if text.endswith("ms"):
+        ms = float(text[:-2])
+    elif text.endswith("s"):
+        ms = float(text[:-1]) * 1000
+    else:
+        raise CompileError(f"time '{text}' needs a ms or s unit")
+    ticks = int(round(ms / 10))
+    if not 0 <= ticks <= 0xFFFF:
+        raise CompileError(f"time '{text}' out of range")
+    return ticks
+
+
+def parse_color(text):
+    if len(text) != 7 or text[0] != "#":
+        raise CompileError(f"color '{text}' is not #rrggbb")
+    v = int(text[1:], 16)
+    return (v >> 16) & 0xFF, (v >> 8) & 0xFF, v & 0xFF
+
+
+def parse(lines):
+    anims = []
+    for lineno, raw in enumerate(lines, 1):
+        words = raw.split()
+        if not words or words[0].startswith("#"):
+            continue
+        try:
+            kind, args = words[0], words[1:]
+            if kind == "anim":
+                if len(args) not in (2, 3) or (len(args) == 3 and args[2] != "loop"):
+                    raise CompileError("expected: anim <name> <duration> [loop]")
+                name = args[0].encode()
+                if len(name) > NAME_LEN or any(a["name"] == name for a in anims):
+                    raise CompileError(f"name '{args[0]}' too long or duplicate")
+                duration = parse_time(args[1])
+                if not duration:
+                    raise CompileError("duration must not be zero")
+                anims.append({"name": name, "duration": duration, "loop": len(args) == 3, "tracks": []})
+            elif kind == "track":
+                if not anims:
+                    raise CompileError("track outside an anim")
+                if len(args) != 1 or not args[0].endswith("%") or "-" not in args[0]:
+                    raise CompileError("expected: track <lo>-<hi>%")
+                lo, hi = (float(v) for v in args[0][:-1].split("-", 1))
+                if not 0 <= lo <= hi <= 100:
+                    raise CompileError("track range must be within 0-100%")
+                tracks = anims[-1]["tracks"]
+                if len(tracks) == TRACKS_MAX:
+                    raise CompileError(f"more than {TRACKS_MAX} tracks")
+                tracks.append({"lo": round(lo * 255 / 100), "hi": round(hi * 255 / 100), "keys": []})
+            elif kind == "key":
+                if not anims or not anims[-1]["tracks"]:
+                    raise CompileError("key outside a track")
+                if len(args) != 4:
+                    raise CompileError("expected: key <time> <easing> <level> <color>[..<color>]")
+                t = parse_time(args[0])
+                if args[1] not in EASINGS:
+                    raise CompileError(f"easing must be one of {', '.join(EASINGS)}")
+                level = int(args[2])
+                if not 0 <= level <= 255:
+                    raise CompileError("level must be 0-255")
+                ends = args[3].split("..")
+                if len(ends) > 2:
+                    raise CompileError("a ramp has two colors")
+                c0 = parse_color(ends[0])
+                c1 = parse_color(ends[-1])
+                keys = anims[-1]["tracks"][-1]["keys"]
+                if keys and t < keys[-1]["t"]:
+                    raise CompileError("keys must be in time order")
+                if len(keys) == 255:
+                    raise CompileError("more than 255 keys")
+                keys.append({"t": t, "easing": EASINGS[args[1]], "level": level, "c0": c0, "c1": c1})
+            else:
+                raise CompileError(f"unknown statement '{kind}'")
+        except (CompileError, ValueError) as e:
+            raise CompileError(f"line {lineno}: {e}") from None
+    for a in anims:
+        if not a["tracks"] or any(not t["keys"] for t in a["tracks"]):
+            raise CompileError(f"anim '{a['name'].decode()}' has an empty track or no tracks")
+    return anims
+
+
+def encode(anims):
+    body = b""
+    offsets = []
+    base = struct.calcsize(FILE_FMT) + len(anims) * struct.calcsize(INDEX_FMT)
+    for a in anims:
+        offsets.append(base + len(body))
+        body += struct.pack(HEADER_FMT, a["duration"], FLAG_LOOP if a["loop"] else 0, len(a["tracks"]))
+        for t in a["tracks"]:
+            body += struct.pack(TRACK_FMT, t["lo"], t["hi"], len(t["keys"]), 0)
+            for k in t["keys"]:
+                body += struct.pack(KEY_FMT, k["t"], k["easing"], k["level"], *k["c0"], *k["c1"], 0)
+    index = b"".join(struct.pack(INDEX_FMT, a["name"], off) for a, off in zip(anims, offsets))
+    size = base + len(body)
+    return struct.pack(FILE_FMT, MAGIC, VERSION, len(anims), size, 0) + index + body
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("source")
+    ap.add_argument("-o", "--output", required=True)
+    ap.add_argument("--partition-size", type=lambda v: int(v, 0), default=0)
+    args = ap.parse_args()
+    try:
+        with open(args.source) as f:
+            image = encode(parse(f))
+    except CompileError as e:
+        sys.exit(f"{args.source}: {e}")
+    if args.partition_size and len(image) > args.partition_size:
+        sys.exit(f"{args.source}: image is {len(image)} bytes, the partition holds {args.partition_size}")
+    with open(args.output, "wb") as f:
+        f.write(image)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""Render an animation image on the host, frame by frame, for checking a library.
+
+Evaluates animations with the same integer math as main/light_anim.c and the
+driver's ramp writer, at full channel level and before the driver's gamma
+curve, and writes the frames as a PPM image (one row per frame, one column per
+pixel) or as CSV (frame, time_ms, pixel, r, g, b).
+
+Usage: anim_play.py <image> <name> [--leds 60] [--fps 50] [--seconds N] [-o out.ppm|out.csv]
+"""
+import argparse
+import struct
+import sys
+
+from anim_compile import FILE_FMT, FLAG_LOOP, HEADER_FMT, INDEX_FMT, KEY_FMT, MAGIC, TRACK_FMT, VERSION
+
+
+def load(image):
+    magic, version, count, size, _ = struct.unpack_from(FILE_FMT, image)
+    if magic != MAGIC or version != VERSION or size > len(image):
+        raise ValueError("not an animation image")
+    anims = {}
+    pos = struct.calcsize(FILE_FMT)
+    for _ in range(count):
+        name, off = struct.unpack_from(INDEX_FMT, image, pos)
+        pos += struct.calcsize(INDEX_FMT)
+        duration, flags, track_count = struct.unpack_from(HEADER_FMT, image, off)
+        p = off + struct.calcsize(HEADER_FMT)
+        tracks = []
+        for _ in range(track_count):
+            lo, hi, key_count, _ = struct.unpack_from(TRACK_FMT, image, p)
+            p += struct.calcsize(TRACK_FMT)
+            keys = []
+            for _ in range(key_count):
+                v = struct.unpack_from(KEY_FMT, image, p)
+                p += struct.calcsize(KEY_FMT)
+                keys.append({"t": v[0], "easing": v[1], "level": v[2], "c0": v[3:6], "c1": v[6:9]})
+            tracks.append((lo, hi, keys))
+        anims[name.rstrip(b"\0").decode()] = (duration, flags, tracks)
+    return anims
+
+
+def ease(easing, p):
+    if easing == 1:
+        return (p * p) >> 16
+    if easing == 2:
+        q = 0x10000 - p
+        return 0x10000 - ((q * q) >> 16)
+    if easing == 3:
+        return (((p * p) >> 16) * (0x30000 - 2 * p)) >> 16
+    if easing == 4:
+        return 0
+    return p
+
+
+def lerp8(a, b, p):
+    return a + (((b - a) * (p >> 1)) >> 15)
+
+
+def evaluate(anim, t_ms, leds):
+    duration, flags, tracks = anim
+    if flags & FLAG_LOOP:
+        t_ms %= duration * 10
+    elif t_ms >= duration * 10:
+        return None
+    t = t_ms // 10
+    spans = []
+    for lo, hi, keys in tracks:
+        i = 0
+        while i + 1 < len(keys) and keys[i + 1]["t"] <= t:
+            i += 1
+        k0 = keys[i]
+        k1 = keys[i + 1] if i + 1 < len(keys) else k0
+        p = 0
+        if k1 is not k0 and t > k0["t"]:
+            p = ease(k0["easing"], ((t - k0["t"]) << 16) // (k1["t"] - k0["t"]))
+        px_lo = lo * leds // 255
+        px_hi = min((hi * leds + 254) // 255, leds)
+        c0 = [lerp8(a, b, p) for a, b in zip(k0["c0"], k1["c0"])]
+        c1 = [lerp8(a, b, p) for a, b in zip(k0["c1"], k1["c1"])]
+        spans.append((px_lo, px_hi, c0, c1, lerp8(k0["level"], k1["level"], p)))
+    return spans
+
+
+def render(spans, leds):
+    frame = [(0, 0, 0)] * leds
+    for px_lo, px_hi, c0, c1, level in spans:
+        n = px_hi - px_lo
+        step = 0x10000 // (n - 1) if n > 1 else 0
+        for i in range(n):
+            w = i * step
+            rgb = [c + (((e - c) * w) >> 16) for c, e in zip(c0, c1)]
+            frame[px_lo + i] = tuple(v * level // 255 for v in rgb)
+    return frame
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("image")
+    ap.add_argument("name")
+    ap.add_argument("--leds", type=int, default=60)
+    ap.add_argument("--fps", type=int, default=50)
+    ap.add_argument("--seconds", type=float, help="default: one period of the animation")
+    ap.add_argument("-o", "--output", default="-")
+    args = ap.parse_args()
+    with open(args.image, "rb") as f:
+        anims = load(f.read())
+    if args.name not in anims:
+        sys.exit(f"no animation '{args.name}', the image has: {', '.join(anims)}")
+    anim = anims[args.name]
+    seconds = args.seconds if args.seconds is not None else anim[0] / 100
+    frames = []
+    for n in range(max(1, int(seconds * args.fps))):
+        t_ms = n * 1000 // args.fps
+        spans = evaluate(anim, t_ms, args.leds)
+        if spans is None:
+            break
+        frames.append((t_ms, render(spans, args.leds)))
+
+    if args.output.endswith(".ppm"):
+        with open(args.output, "wb") as f:
+            f.write(b"P6 %d %d 255\n" % (args.leds, len(frames)))
+            for _, frame in frames:
+                f.write(bytes(v for px in frame for v in px))
+        return
+    out = sys.stdout if args.output == "-" else open(args.output, "w")
+    out.write("frame,time_ms,pixel,r,g,b\n")
+    for n, (t_ms, frame) in enumerate(frames):
+        for i, (r, g, b) in enumerate(frame):
+            out.write(f"{n},{t_ms},{i},{r},{g},{b}\n")
+    if out is not sys.stdout:
+        out.close()
+
+
+if __name__ == "__main__":
+    main()
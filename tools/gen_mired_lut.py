@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+"""Generate the mired -> RGB lookup table used by color_convert.c.
+
+Evaluates the same Tanner Helland blackbody approximation the driver used to
+run with powf/logf at runtime, once per mired value in the supported range.
+
+Usage: gen_mired_lut.py <output header>
+"""
+import math
+import sys
+
+MIRED_MIN = 153  # 6500 K
+MIRED_MAX = 500  # 2000 K
+
+
+def clamp(v):
+    return 0.0 if v < 0.0 else 255.0 if v > 255.0 else v
+
+
+def mired_to_rgb(mired):
+    temp = 1000000.0 / mired / 100.0
+    if temp <= 66:
+        r = 255.0
+        g = 99.4708025861 * math.log(temp) - 161.1195681661
+    else:
+        r = 329.698727446 * math.pow(temp - 60.0, -0.1332047592)
+        g = 288.1221695283 * math.pow(temp - 60.0, -0.0755148492)
+    if temp >= 66:
+        b = 255.0
+    elif temp <= 19:
+        b = 0.0
+    else:
+        b = 138.5177312231 * math.log(temp - 10.0) - 305.0447927307
+    return tuple(int(clamp(c)) for c in (r, g, b))
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    lines = [
+        "/* Generated by tools/gen_mired_lut.py - do not edit */",
+        "#pragma once",
+        "",
+        "#define MIRED_LUT_MIN %d" % MIRED_MIN,
+        "#define MIRED_LUT_MAX %d" % MIRED_MAX,
+        "",
+        "static const uint8_t s_mired_lut[MIRED_LUT_MAX - MIRED_LUT_MIN + 1][3] = {",
+    ]
+    for m in range(MIRED_MIN, MIRED_MAX + 1):
+        r, g, b = mired_to_rgb(m)
+        lines.append("    {%3d, %3d, %3d}, /* %d mired */" % (r, g, b, m))
+    lines.append("};")
+    with open(sys.argv[1], "w") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+"""Host-side encoder / decoder for the pixel upload cluster (0xFC01).
+
+Splits a frame of RGB pixels into Write payloads of at most PAYLOAD_MAX bytes,
+picking per packet whichever encoding (raw, RLE with ramps, palette) covers the
+most pixels, followed by a Commit. The wire format is described in
+main/light_pixels.h; decode() mirrors main/light_pixels.c, including the
+integer ramp interpolation, so encoded frames round-trip exactly.
+
+Usage:
+    pixel_codec.py bench [--leds 60]          packets per frame for typical patterns, raw RGB vs encoded
+    pixel_codec.py encode <frame.hex> [--frame N] [--raw] [-o out.txt]
+                                              one payload per line as hex, Writes then the Commit;
+                                              frame.hex holds rrggbb words separated by whitespace;
+                                              --raw uses raw RGB packets only, as a baseline
+"""
+import argparse
+import colorsys
+import sys
+
+CLUSTER_ID = 0xFC01
+CMD_WRITE, CMD_COMMIT, CMD_RELEASE = 0x00, 0x01, 0x02
+ENC_RAW, ENC_RLE, ENC_PALETTE = 0, 1, 2
+PAYLOAD_MAX = 64
+WRITE_HEADER = 5
+PACKETS_MAX = 32
+RUN_MAX = 127
+RUN_RAMP = 0x80
+
+
+def ramp_step(a, i, n):
+    v = a * i
+    return (v + n // 2) // n if v >= 0 else -((-v + n // 2) // n)
+
+
+def ramp(prev, color, n):
+    return [tuple(p + ramp_step(c - p, k, n) for p, c in zip(prev, color)) for k in range(1, n + 1)]
+
+
+def encode_raw(pixels, pos, budget):
+    n = min(len(pixels) - pos, budget // 3)
+    return n, b"".join(bytes(px) for px in pixels[pos:pos + n])
+
+
+def encode_rle(pixels, pos, budget):
+    """Greedy runs: the longer of a repeat of the next pixel or an exact ramp from the previous one.
+
+    Every packet ramps from black, the device never looks at pixels another packet wrote."""
+    out = b""
+    start = pos
+    prev = (0, 0, 0)
+    while pos < len(pixels) and len(out) + 4 <= budget:
+        limit = min(RUN_MAX, len(pixels) - pos)
+        solid = 1
+        while solid < limit and pixels[pos + solid] == pixels[pos]:
+            solid += 1
+        best = 1
+        for n in range(limit, 1, -1):
+            if ramp(prev, pixels[pos + n - 1], n) == pixels[pos:pos + n]:
+                best = n
+                break
+        if best > solid:
+            out += bytes([RUN_RAMP | best]) + bytes(pixels[pos + best - 1])
+            pos += best
+        else:
+            out += bytes([solid]) + bytes(pixels[pos])
+            pos += solid
+        prev = pixels[pos - 1]
+    return pos - start, out
+
+
+def encode_palette(pixels, pos, budget):
+    colors = []
+    best = (0, b"")
+    n = 0
+    while pos + n < len(pixels):
+        px = pixels[pos + n]
+        if px not in colors:
+            if len(colors) == 255:
+                break
+            colors.append(px)
+        n += 1
+        bits = 1 if len(colors) <= 2 else 2 if len(colors) <= 4 else 4 if len(colors) <= 16 else 8
+        size = 1 + 3 * len(colors) + 2 + (n * bits + 7) // 8
+        if size > budget:
+            break
+        packed = bytearray((n * bits + 7) // 8)
+        for i in range(n):
+            k = colors.index(pixels[pos + i])
+            packed[i * bits // 8] |= k << (i * bits % 8)
+        body = bytes([len(colors)]) + b"".join(bytes(c) for c in colors) + n.to_bytes(2, "little") + bytes(packed)
+        best = (n, body)
+    return best
+
+
+ENCODERS = {ENC_RAW: encode_raw, ENC_RLE: encode_rle, ENC_PALETTE: encode_palette}
+
+
+def encode_frame(pixels, frame=0, encodings=(ENC_RAW, ENC_RLE, ENC_PALETTE), payload_max=PAYLOAD_MAX):
+    """Write payloads for a whole frame followed by its Commit payload, as (command, payload) pairs."""
+    pixels = [tuple(px) for px in pixels]
+    writes = []
+    pos = 0
+    budget = payload_max - WRITE_HEADER
+    while pos < len(pixels):
+        n, enc, body = best_packet(pixels, pos, budget, encodings)
+        if len(writes) == PACKETS_MAX:
+            raise ValueError(f"frame needs more than {PACKETS_MAX} packets")
+        writes.append((CMD_WRITE, bytes([frame & 0xFF, len(writes), enc]) + pos.to_bytes(2, "little") + body))
+        pos += n
+    return writes + [(CMD_COMMIT, bytes([frame & 0xFF, len(writes)]))]
+
+
+def best_packet(pixels, pos, budget, encodings):
+    best = None
+    for e in encodings:
+        n, body = ENCODERS[e](pixels, pos, budget)
+        if best is None or n > best[0] or (n == best[0] and len(body) < len(best[2])):
+            best = (n, e, body)
+    return best
+
+
+def decode(commands, led_count, staging=None):
+    """Apply (command, payload) pairs like the device does; returns the committed frame or None."""
+    staging = list(staging or [(0, 0, 0)] * led_count)
+    received = 0
+    frame = None
+    for cmd, payload in commands:
+        if cmd == CMD_WRITE:
+            if payload[0] != frame:
+                frame, received = payload[0], 0
+            enc, start = payload[2], int.from_bytes(payload[3:5], "little")
+            data = payload[WRITE_HEADER:]
+            pos = start
+            if enc == ENC_RAW:
+                for i in range(0, len(data), 3):
+                    staging[pos] = tuple(data[i:i + 3])
+                    pos += 1
+            elif enc == ENC_RLE:
+                prev = (0, 0, 0)
+                for i in range(0, len(data), 4):
+                    n, color = data[i] & ~RUN_RAMP & 0xFF, tuple(data[i + 1:i + 4])
+                    run = ramp(prev, color, n) if data[i] & RUN_RAMP else [color] * n
+                    staging[pos:pos + n] = run
+                    pos += n
+                    prev = color
+            elif enc == ENC_PALETTE:
+                colors = [tuple(data[1 + 3 * k:4 + 3 * k]) for k in range(data[0])]
+                head = 1 + 3 * data[0] + 2
+                count = int.from_bytes(data[head - 2:head], "little")
+                bits = 1 if len(colors) <= 2 else 2 if len(colors) <= 4 else 4 if len(colors) <= 16 else 8
+                for i in range(count):
+                    k = (data[head + i * bits // 8] >> (i * bits % 8)) & ((1 << bits) - 1)
+                    staging[pos] = colors[k]
+                    pos += 1
+            else:
+                raise ValueError(f"unknown encoding {enc}")
+            received |= 1 << payload[1]
+        elif cmd == CMD_COMMIT:
+            want = (1 << payload[1]) - 1
+            if payload[0] != frame or received & want != want:
+                return None
+            return staging
+    return None
+
+
+def patterns(leds):
+    def lerp(a, b, t):
+        return tuple(round(x + (y - x) * t) for x, y in zip(a, b))
+    span = max(leds - 1, 1)
+    yield "solid", [(255, 140, 40)] * leds
+    yield "gradient", [lerp((255, 40, 0), (40, 0, 255), i / span) for i in range(leds)]
+    yield "3-stop gradient", [lerp((255, 0, 0), (255, 200, 0), 2 * i / span) if i <= span / 2
+                              else lerp((255, 200, 0), (0, 80, 255), 2 * i / span - 1) for i in range(leds)]
+    yield "rainbow", [tuple(round(c * 255) for c in colorsys.hsv_to_rgb(i / leds, 1, 1)) for i in range(leds)]
+    yield "stripes", [(255, 0, 0) if (i // 5) % 2 else (255, 255, 255) for i in range(leds)]
+    yield "two-tone", [(255, 120, 0)] * (leds // 2) + [(0, 0, 80)] * (leds - leds // 2)
+
+
+def bench(leds):
+    print(f"{leds} pixels, {PAYLOAD_MAX} byte payloads; packets include the Commit")
+    print(f"{'pattern':<18}{'raw':>5}{'encoded':>9}{'bytes raw':>11}{'bytes enc':>11}")
+    for name, pixels in patterns(leds):
+        raw = encode_frame(pixels, encodings=(ENC_RAW,))
+        enc = encode_frame(pixels)
+        for commands in (raw, enc):
+            if decode(commands, leds) != [tuple(p) for p in pixels]:
+                sys.exit(f"{name}: round trip failed")
+        print(f"{name:<18}{len(raw):>5}{len(enc):>9}{sum(len(p) for _, p in raw):>11}{sum(len(p) for _, p in enc):>11}")
+        # gradients are what the ramps are for
+        if "gradient" in name and len(enc) >= len(raw):
+            sys.exit(f"{name}: {len(enc)} encoded packets, not fewer than {len(raw)} raw")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = ap.add_subparsers(dest="cmd", required=True)
+    b = sub.add_parser("bench")
+    b.add_argument("--leds", type=int, default=60)
+    e = sub.add_parser("encode")
+    e.add_argument("frame")
+    e.add_argument("--frame", dest="frame_id", type=int, default=0)
+    e.add_argument("--raw", action="store_true")
+    e.add_argument("-o", "--output", default="-")
+    args = ap.parse_args()
+    if args.cmd == "bench":
+        bench(args.leds)
+        return
+    with open(args.frame) as f:
+        pixels = [tuple(bytes.fromhex(w)) for w in f.read().split()]
+    out = sys.stdout if args.output == "-" else open(args.output, "w")
+    encodings = (ENC_RAW,) if args.raw else (ENC_RAW, ENC_RLE, ENC_PALETTE)
+    for cmd, payload in encode_frame(pixels, args.frame_id, encodings):
+        print(f"{cmd:02x} {payload.hex()}", file=out)
+
+
+if __name__ == "__main__":
+    main()